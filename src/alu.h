@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include "cpu.h"
+
+// ===============================================================
+// == PURE ALU HELPERS SHARED BY EVERY EXECUTION ENGINE
+// ===============================================================
+// NO CPU STATE IS TOUCHED HERE: EACH HELPER RETURNS THE STATUS BITS (AT THEIR Flags::BIT_*
+// POSITIONS) AN OPERATION PRODUCES, SO THE SCALAR HANDLERS IN cpu.cpp AND THE LANE LOOPS IN
+// lockstep.cpp CAN NEVER DISAGREE ABOUT A FLAG.
+template <typename T>
+struct Width
+{
+    static_assert(std::is_same<T, uint8_t>::value || std::is_same<T, uint16_t>::value, "8 OR 16 BIT OPERANDS ONLY");
+    static constexpr int BITS = sizeof(T) * 8;
+    static constexpr uint32_t MAX = (1u << BITS) - 1;
+    static constexpr uint32_t SIGN = 1u << (BITS - 1);
+};
+
+static constexpr uint16_t ARITH_FLAGS = Flags::BIT_CF | Flags::BIT_ZF | Flags::BIT_SF | Flags::BIT_OF;
+static constexpr uint16_t INC_DEC_FLAGS = Flags::BIT_ZF | Flags::BIT_SF | Flags::BIT_OF; // CF IS LEFT ALONE
+
+template <typename T>
+inline uint16_t zero_sign_bits(T result)
+{
+    return (result == 0 ? Flags::BIT_ZF : 0) | ((result & Width<T>::SIGN) ? Flags::BIT_SF : 0);
+}
+
+// result IS THE UNTRUNCATED SUM, CARRY INCLUDED
+template <typename T>
+inline uint16_t add_status(T dest_val, T src_val, uint32_t result)
+{
+    bool cf = (result > Width<T>::MAX);
+    bool of = (~(dest_val ^ src_val) & (dest_val ^ result) & Width<T>::SIGN) != 0; // SAME OPERAND SIGNS, RESULT FLIPPED
+    return zero_sign_bits<T>(static_cast<T>(result)) | (cf ? Flags::BIT_CF : 0) | (of ? Flags::BIT_OF : 0);
+}
+
+template <typename T>
+inline uint16_t sub_status(T dest_val, T src_val, T result)
+{
+    bool cf = (dest_val < src_val);
+    bool of = ((dest_val ^ src_val) & (dest_val ^ result) & Width<T>::SIGN) != 0; // OPERAND SIGNS DIFFER, RESULT TOOK src'S
+    return zero_sign_bits<T>(result) | (cf ? Flags::BIT_CF : 0) | (of ? Flags::BIT_OF : 0);
+}
+
+// CF = OF = 0
+template <typename T>
+inline uint16_t logic_status(T result)
+{
+    return zero_sign_bits<T>(result);
+}
+
+// ONLY THE INC_DEC_FLAGS BITS ARE MEANINGFUL
+template <typename T>
+inline uint16_t inc_status(T val_before, T val_after)
+{
+    return zero_sign_bits<T>(val_after) | (val_before == Width<T>::SIGN - 1 ? Flags::BIT_OF : 0);
+}
+
+template <typename T>
+inline uint16_t dec_status(T val_before, T val_after)
+{
+    return zero_sign_bits<T>(val_after) | (val_before == Width<T>::SIGN ? Flags::BIT_OF : 0); // 0X8000 -> 0X7FFF
+}
+
+// --- BRANCH CONDITIONS (Jcc, LOOPZ/LOOPNZ) ---
+// THEY TEST THE FLAG WORD (Flags::bits) RATHER THAN THE BITFIELDS: PLAIN MASKS, WHICH THE
+// LANE LOOPS CAN VECTORIZE
+static constexpr bool flag_set(uint16_t bits, uint16_t flag) { return (bits & flag) != 0; }
+static constexpr bool sign_differs_overflow(uint16_t bits) { return flag_set(bits, Flags::BIT_SF) != flag_set(bits, Flags::BIT_OF); }
+
+struct Always { static bool test(uint16_t) { return true; } };
+struct IfZ { static bool test(uint16_t f) { return flag_set(f, Flags::BIT_ZF); } };
+struct IfNZ { static bool test(uint16_t f) { return !flag_set(f, Flags::BIT_ZF); } };
+struct IfC { static bool test(uint16_t f) { return flag_set(f, Flags::BIT_CF); } };
+struct IfNC { static bool test(uint16_t f) { return !flag_set(f, Flags::BIT_CF); } };
+struct IfS { static bool test(uint16_t f) { return flag_set(f, Flags::BIT_SF); } };
+struct IfNS { static bool test(uint16_t f) { return !flag_set(f, Flags::BIT_SF); } };
+struct IfO { static bool test(uint16_t f) { return flag_set(f, Flags::BIT_OF); } };
+struct IfNO { static bool test(uint16_t f) { return !flag_set(f, Flags::BIT_OF); } };
+struct IfA { static bool test(uint16_t f) { return !flag_set(f, Flags::BIT_CF | Flags::BIT_ZF); } };
+struct IfBE { static bool test(uint16_t f) { return flag_set(f, Flags::BIT_CF | Flags::BIT_ZF); } };
+struct IfG { static bool test(uint16_t f) { return !flag_set(f, Flags::BIT_ZF) && !sign_differs_overflow(f); } };
+struct IfGE { static bool test(uint16_t f) { return !sign_differs_overflow(f); } };
+struct IfL { static bool test(uint16_t f) { return sign_differs_overflow(f); } };
+struct IfLE { static bool test(uint16_t f) { return flag_set(f, Flags::BIT_ZF) || sign_differs_overflow(f); } };
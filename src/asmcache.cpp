@@ -0,0 +1,375 @@
+#include "asmcache.h"
+#include "objfile.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+// ===============================================================
+// == SOURCE NORMALIZATION AND HASHING
+// ===============================================================
+static inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// TWO INDEPENDENT 64-BIT LANES OVER 8-BYTE WORDS
+static SourceKey hash_bytes(const char *data, size_t size)
+{
+    uint64_t h1 = 0x243F6A8885A308D3ULL ^ size;
+    uint64_t h2 = 0x13198A2E03707344ULL ^ (size * 0x9E3779B97F4A7C15ULL);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h1 = rotl64(h1 ^ mix64(word), 27) * 0x9E3779B97F4A7C15ULL;
+        h2 = rotl64(h2 + word * 0xC2B2AE3D27D4EB4FULL, 31) ^ h1;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    h1 = rotl64(h1 ^ mix64(tail), 27) * 0x9E3779B97F4A7C15ULL;
+    h2 = rotl64(h2 + tail * 0xC2B2AE3D27D4EB4FULL, 31) ^ h1;
+
+    SourceKey key;
+    key.lo = mix64(h1 ^ rotl64(h2, 17));
+    key.hi = mix64(h2 + key.lo);
+    return key;
+}
+
+std::string AssemblyCache::normalize(const std::string &code_string, const std::string &include_dir, std::vector<uint32_t> *raw_lines)
+{
+    std::string normalized;
+    normalized.reserve(code_string.size());
+    bool uses_include = false;
+
+    std::stringstream code_stream(code_string);
+    std::string line;
+    uint32_t line_number = 0;
+    while (std::getline(code_stream, line))
+    {
+        line_number++;
+        std::string cleaned = clean_line(line);
+        if (cleaned.empty())
+            continue;
+        if (raw_lines)
+            raw_lines->push_back(line_number);
+
+        // SPACING AROUND OPERAND PUNCTUATION NEVER CHANGES THE ENCODING. THE SPACE ENDING THE
+        // COMMAND DOES (THE PARSER READS "MOV[BX]," AS ONE WORD), SO IT IS ALWAYS KEPT: AFTER THE
+        // FIRST WORD, AND AFTER THE SECOND BEHIND A LOCK PREFIX. QUOTED TEXT (INCLUDE "a  b.asm")
+        // IS A FILE NAME AND IS KEPT AS WRITTEN
+        bool pending_space = false;
+        bool quoted = false;
+        bool in_command = true;
+        size_t word_start = normalized.size();
+        for (char c : cleaned)
+        {
+            if (quoted)
+            {
+                normalized += c;
+                quoted = c != '"';
+                continue;
+            }
+            if (std::isspace((unsigned char)c))
+            {
+                pending_space = true;
+                continue;
+            }
+            if (pending_space && in_command)
+            {
+                std::string word = normalized.substr(word_start);
+                std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+                in_command = word == "LOCK";
+                normalized += ' ';
+                word_start = normalized.size();
+            }
+            else if (pending_space && !std::strchr(",+[]", c) && !std::strchr(",+[]", normalized.back()))
+                normalized += ' ';
+            pending_space = false;
+            normalized += c;
+            quoted = c == '"';
+        }
+        normalized += '\n';
+
+        if (cleaned.size() >= 7)
+        {
+            std::string head = cleaned.substr(0, 7);
+            std::transform(head.begin(), head.end(), head.begin(), ::toupper);
+            if (head == "INCLUDE" && (cleaned.size() == 7 || std::isspace((unsigned char)cleaned[7])))
+                uses_include = true;
+        }
+    }
+
+    // THE SAME INCLUDE LINE MEANS DIFFERENT CODE UNDER A DIFFERENT DIRECTORY
+    if (uses_include)
+    {
+        normalized += '\0';
+        normalized += include_dir;
+    }
+    return normalized;
+}
+
+SourceKey AssemblyCache::key_of(const std::string &normalized)
+{
+    return hash_bytes(normalized.data(), normalized.size());
+}
+
+SourceKey AssemblyCache::key_for(const std::string &code_string, const std::string &include_dir, std::vector<uint32_t> *raw_lines)
+{
+    return key_of(normalize(code_string, include_dir, raw_lines));
+}
+
+// ===============================================================
+// == CACHE TIERS
+// ===============================================================
+AssemblyCache::AssemblyCache(size_t capacity, const std::string &disk_dir)
+    : capacity(std::max<size_t>(capacity, 1)), disk_dir(disk_dir)
+{
+    if (!disk_dir.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(disk_dir, ec);
+    }
+}
+
+// REWRITE THE LINE COLUMN OF A SOURCE MAP THROUGH convert
+template <typename Convert>
+static SourceMap remap_lines(const SourceMap &map, Convert convert)
+{
+    SourceMap out;
+    for (const auto &entry : map.entries())
+        out.add(entry.address, convert(entry.line));
+    out.finish(map.end());
+    return out;
+}
+
+static bool includes_unchanged(const std::vector<IncludeDependency> &includes)
+{
+    for (const auto &dependency : includes)
+    {
+        std::error_code ec;
+        if (std::filesystem::last_write_time(dependency.path, ec) != dependency.mtime || ec)
+            return false;
+    }
+    return true;
+}
+
+// THE ENTRY FOR key, MOVED TO THE FRONT, WITH THE INCLUDES AND THE SOURCE TEXT ITS CALLER MUST CHECK
+std::shared_ptr<const AssemblyResult> AssemblyCache::lookup_memory(const SourceKey &key, IncludeList &includes, SourceText &normalized)
+{
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return nullptr;
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+    includes = it->second.includes;
+    normalized = it->second.normalized;
+    return it->second.result;
+}
+
+// DROPS key IF IT STILL HOLDS result (ANOTHER THREAD MAY HAVE REPLACED IT MEANWHILE)
+void AssemblyCache::drop_memory(const SourceKey &key, const std::shared_ptr<const AssemblyResult> &result)
+{
+    auto it = entries.find(key);
+    if (it == entries.end() || it->second.result != result)
+        return;
+    lru.erase(it->second.lru_pos);
+    entries.erase(it);
+}
+
+void AssemblyCache::insert_memory(const SourceKey &key, std::shared_ptr<const AssemblyResult> result, const std::vector<IncludeDependency> &dependencies, SourceText normalized)
+{
+    IncludeList includes;
+    if (!dependencies.empty())
+        includes = std::make_shared<const std::vector<IncludeDependency>>(dependencies);
+
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        it->second.result = std::move(result);
+        it->second.includes = std::move(includes);
+        it->second.normalized = std::move(normalized);
+        lru.splice(lru.begin(), lru, it->second.lru_pos);
+        return;
+    }
+
+    while (entries.size() >= capacity)
+    {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(key);
+    entries[key] = {std::move(result), std::move(includes), std::move(normalized), lru.begin()};
+}
+
+std::string AssemblyCache::disk_path(const SourceKey &key) const
+{
+    static const char HEX[] = "0123456789abcdef";
+    std::string name(32, '0');
+    for (int i = 0; i < 16; i++)
+    {
+        name[15 - i] = HEX[(key.hi >> (4 * i)) & 0xF];
+        name[31 - i] = HEX[(key.lo >> (4 * i)) & 0xF];
+    }
+    return (std::filesystem::path(disk_dir) / (name + ".x86o")).string();
+}
+
+// A CACHE OBJECT HOLDS THE CODE AS SEGMENT 0 AND THE NORMALIZED SOURCE IT CAME FROM AS SEGMENT 1,
+// WHICH A HIT MUST MATCH BYTE FOR BYTE
+static const uint32_t SOURCE_TEXT_ADDRESS = 0xFFFFFFFF;
+
+std::shared_ptr<const AssemblyResult> AssemblyCache::lookup_disk(const SourceKey &key, const std::string &normalized)
+{
+    if (disk_dir.empty())
+        return nullptr;
+
+    ObjectFile object_file;
+    ObjectImage image;
+    if (!object_file.read(disk_path(key), image) || image.segments.size() != 2)
+        return nullptr;
+    const ObjectSegment &text = image.segments[1];
+    if (text.address != SOURCE_TEXT_ADDRESS || text.bytes.size() != normalized.size() ||
+        !std::equal(text.bytes.begin(), text.bytes.end(), normalized.begin()))
+        return nullptr;
+
+    auto result = std::make_shared<AssemblyResult>();
+    result->machine_code = std::move(image.segments[0].bytes);
+    for (const auto &symbol : image.symbols)
+        result->labels[symbol.name] = symbol.address;
+    for (uint32_t reloc : image.relocations)
+        result->relocations.push_back(reloc);
+    for (const auto &line : image.lines)
+        result->normalized_map.add(line.address, line.line);
+    result->normalized_map.finish(result->machine_code.size());
+    return result;
+}
+
+void AssemblyCache::store_disk(const SourceKey &key, const AssemblyResult &result, const std::string &normalized)
+{
+    ObjectImage image;
+    image.segments.push_back({0, result.machine_code});
+    image.segments.push_back({SOURCE_TEXT_ADDRESS, std::vector<uint8_t>(normalized.begin(), normalized.end())});
+    for (const auto &label : result.labels)
+        image.symbols.push_back({label.first, label.second});
+    for (uint16_t reloc : result.relocations)
+        image.relocations.push_back(reloc);
+    for (const auto &entry : result.normalized_map.entries())
+        image.lines.push_back({entry.address, entry.line});
+
+    // WRITE-THEN-RENAME SO CONCURRENT GRADERS NEVER SEE A HALF WRITTEN OBJECT
+    const std::string path = disk_path(key);
+    const std::string tmp_path = path + ".tmp" + std::to_string(reinterpret_cast<uintptr_t>(&result));
+    ObjectFile object_file;
+    if (!object_file.write(tmp_path, image))
+        return;
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+        std::filesystem::remove(tmp_path, ec);
+}
+
+std::shared_ptr<const AssemblyResult> AssemblyCache::assemble(Parser &parser, const std::string &code_string, const std::string &include_dir, SourceMap *source_map)
+{
+    std::vector<uint32_t> raw_lines;
+    auto normalized = std::make_shared<const std::string>(normalize(code_string, include_dir, &raw_lines));
+    const SourceKey key = key_of(*normalized);
+
+    // CACHED MAPS COUNT NORMALIZED LINES, TRANSLATE BACK TO THIS SUBMISSION'S LAYOUT
+    auto export_map = [&](const AssemblyResult &result)
+    {
+        if (source_map)
+            *source_map = remap_lines(result.normalized_map, [&](uint32_t line)
+                                      { return line >= 1 && line <= raw_lines.size() ? raw_lines[line - 1] : line; });
+    };
+
+    std::shared_ptr<const AssemblyResult> cached;
+    IncludeList includes;
+    SourceText cached_text;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        cached = lookup_memory(key, includes, cached_text);
+    }
+    // THE TEXT IS COMPARED AND THE INCLUDE FILES ARE STAT'ED WITHOUT THE LOCK, OTHER THREADS KEEP
+    // HITTING MEANWHILE. A DIFFERENT TEXT UNDER THE SAME KEY IS A MISS THAT REPLACES THE ENTRY
+    const bool same_text = cached && *cached_text == *normalized;
+    bool fresh = same_text && (!includes || includes_unchanged(*includes));
+    if (cached)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (fresh)
+            hit_count++;
+        else if (same_text)
+            drop_memory(key, cached);
+    }
+    if (fresh)
+    {
+        export_map(*cached);
+        return cached;
+    }
+
+    if (auto result = lookup_disk(key, *normalized))
+    {
+        export_map(*result);
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        hit_count++;
+        insert_memory(key, result, {}, normalized);
+        return result;
+    }
+
+    // MISS: THE ONLY PATH THAT RUNS THE PARSER
+    auto result = std::make_shared<AssemblyResult>();
+    parser.set_include_dir(include_dir);
+    result->machine_code = parser.parse_from_string(code_string);
+    result->error = parser.get_last_error();
+    if (result->error.empty())
+    {
+        result->labels = parser.get_labels();
+        result->relocations = parser.get_relocations();
+        result->normalized_map = remap_lines(parser.get_source_map(), [&](uint32_t line)
+                                             { return (uint32_t)(std::lower_bound(raw_lines.begin(), raw_lines.end(), line) - raw_lines.begin()) + 1; });
+        if (source_map)
+            *source_map = parser.get_source_map();
+    }
+
+    // ERRORS CARRY LINE NUMBERS OF THIS PARTICULAR LAYOUT, SO ONLY SUCCESSES ARE SHARED.
+    // ENTRIES THAT DEPEND ON INCLUDE FILES STAY IN MEMORY WHERE THEIR MTIMES ARE CHECKED.
+    if (result->error.empty() && parser.get_includes().empty() && !disk_dir.empty())
+        store_disk(key, *result, *normalized);
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    miss_count++;
+    if (result->error.empty())
+        insert_memory(key, result, parser.get_includes(), normalized);
+    return result;
+}
+
+void AssemblyCache::clear()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    lru.clear();
+    entries.clear();
+}
+
+size_t AssemblyCache::hits()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return hit_count;
+}
+
+size_t AssemblyCache::misses()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return miss_count;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "parser.h"
+
+// OUTPUT OF ONE ASSEMBLY, SHARED BETWEEN EVERY SUBMISSION WITH THE SAME NORMALIZED SOURCE
+struct AssemblyResult
+{
+    std::vector<uint8_t> machine_code;
+    std::unordered_map<std::string, uint16_t> labels;
+    std::vector<uint16_t> relocations;
+    SourceMap normalized_map; // LINES COUNT ONLY NON-BLANK SOURCE LINES, SEE AssemblyCache::assemble()
+    std::string error;
+};
+
+// 128-BIT CONTENT KEY OF A NORMALIZED SOURCE TEXT
+struct SourceKey
+{
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool operator==(const SourceKey &other) const { return lo == other.lo && hi == other.hi; }
+};
+
+struct SourceKeyHash
+{
+    size_t operator()(const SourceKey &key) const { return static_cast<size_t>(key.lo ^ (key.hi * 0x9E3779B97F4A7C15ULL)); }
+};
+
+class AssemblyCache
+{
+private:
+    // NULL WHEN THE SOURCE INCLUDES NOTHING, SHARED SO A HIT CAN CHECK IT OUTSIDE THE LOCK
+    using IncludeList = std::shared_ptr<const std::vector<IncludeDependency>>;
+    // THE normalize() TEXT THE ENTRY WAS ASSEMBLED FROM: A HIT MUST MATCH IT, NOT ONLY ITS KEY
+    using SourceText = std::shared_ptr<const std::string>;
+
+    struct Entry
+    {
+        std::shared_ptr<const AssemblyResult> result;
+        IncludeList includes;
+        SourceText normalized;
+        std::list<SourceKey>::iterator lru_pos;
+    };
+
+    size_t capacity;
+    std::string disk_dir;
+
+    std::mutex cache_mutex;
+    std::list<SourceKey> lru; // FRONT = MOST RECENTLY USED
+    std::unordered_map<SourceKey, Entry, SourceKeyHash> entries;
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+
+    std::shared_ptr<const AssemblyResult> lookup_memory(const SourceKey &key, IncludeList &includes, SourceText &normalized);
+    void drop_memory(const SourceKey &key, const std::shared_ptr<const AssemblyResult> &result);
+    std::shared_ptr<const AssemblyResult> lookup_disk(const SourceKey &key, const std::string &normalized);
+    void insert_memory(const SourceKey &key, std::shared_ptr<const AssemblyResult> result, const std::vector<IncludeDependency> &includes, SourceText normalized);
+    void store_disk(const SourceKey &key, const AssemblyResult &result, const std::string &normalized);
+    std::string disk_path(const SourceKey &key) const;
+
+public:
+    // disk_dir EMPTY -> MEMORY TIER ONLY
+    explicit AssemblyCache(size_t capacity = 256, const std::string &disk_dir = "");
+
+    // code_string AFTER clean_line() AND WHITESPACE COLLAPSING OUTSIDE QUOTES: TWO SOURCES WITH
+    // THE SAME TEXT ASSEMBLE THE SAME. include_dir IS APPENDED ONLY WHEN THE SOURCE USES INCLUDE.
+    // raw_lines (OPTIONAL) RECEIVES THE 1-BASED SOURCE LINE OF EVERY NORMALIZED LINE.
+    static std::string normalize(const std::string &code_string, const std::string &include_dir, std::vector<uint32_t> *raw_lines = nullptr);
+    static SourceKey key_of(const std::string &normalized);
+    // key_of(normalize(...))
+    static SourceKey key_for(const std::string &code_string, const std::string &include_dir, std::vector<uint32_t> *raw_lines = nullptr);
+
+    // RETURNS THE CACHED RESULT FOR code_string OR ASSEMBLES IT WITH parser ON A MISS.
+    // source_map (OPTIONAL) RECEIVES THE ADDRESS -> LINE MAP IN code_string'S OWN LINE NUMBERS,
+    // EVEN WHEN THE HIT CAME FROM A SUBMISSION WITH DIFFERENT BLANK LINES OR COMMENTS.
+    std::shared_ptr<const AssemblyResult> assemble(Parser &parser, const std::string &code_string, const std::string &include_dir = "", SourceMap *source_map = nullptr);
+
+    void clear();
+    size_t hits();
+    size_t misses();
+};
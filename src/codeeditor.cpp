@@ -13,7 +13,8 @@ int CodeEditor::lineNumberAreaWidth() {
     int digits = 1;
     int maxv = qMax(1, blockCount());
     while (maxv >= 10) { maxv /= 10; ++digits; }
-    return 3 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
+    // breakpoint dot + line numbers
+    return 3 + fontMetrics().height() + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
 }
 
 void CodeEditor::updateLineNumberAreaWidth(int) {
@@ -48,6 +49,12 @@ void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
 
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
+            if (breakpoints.contains(blockNumber + 1)) {
+                int d = fontMetrics().height() - 4;
+                painter.setBrush(Qt::red);
+                painter.setPen(Qt::NoPen);
+                painter.drawEllipse(2, top + 2, d, d);
+            }
             QString number = QString::number(blockNumber + 1);
             painter.setPen(Qt::black);
             painter.drawText(0, top, lineNumberArea->width() - 4,
@@ -60,23 +67,56 @@ void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event) {
     }
 }
 
+void CodeEditor::lineNumberAreaMousePressEvent(QMouseEvent *event) {
+    // satır numarasına tıklamak breakpoint ekler / kaldırır
+    int line = cursorForPosition(QPoint(0, event->pos().y())).blockNumber() + 1;
+    if (!breakpoints.remove(line))
+        breakpoints.insert(line);
+    lineNumberArea->update();
+    emit breakpointToggled(line);
+}
+
+void CodeEditor::setBreakpointLines(const QSet<int> &lines) {
+    breakpoints = lines;
+    lineNumberArea->update();
+}
+
 void CodeEditor::highlightErrorLine(int lineNumber) {
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    errorLine = lineNumber;
+    refreshHighlights();
+}
 
+void CodeEditor::highlightExecutionLine(int lineNumber) {
+    executionLine = lineNumber;
+    refreshHighlights();
     if (lineNumber >= 1) {
-        QTextEdit::ExtraSelection sel;
-        sel.format.setBackground(QColor(Qt::red).lighter(160));
-        sel.format.setProperty(QTextFormat::FullWidthSelection, true);
-
         QTextCursor cursor(document()->findBlockByNumber(lineNumber - 1));
-        sel.cursor = cursor;
+        setTextCursor(cursor);
+        ensureCursorVisible();
+    }
+}
+
+void CodeEditor::refreshHighlights() {
+    QList<QTextEdit::ExtraSelection> extraSelections;
 
+    auto addLine = [&](int lineNumber, const QColor &color) {
+        if (lineNumber < 1)
+            return;
+        QTextEdit::ExtraSelection sel;
+        sel.format.setBackground(color);
+        sel.format.setProperty(QTextFormat::FullWidthSelection, true);
+        sel.cursor = QTextCursor(document()->findBlockByNumber(lineNumber - 1));
         extraSelections.append(sel);
-    }
+    };
+
+    addLine(executionLine, QColor(Qt::green).lighter(160));
+    addLine(errorLine, QColor(Qt::red).lighter(160));
 
     setExtraSelections(extraSelections);
 }
 
 void CodeEditor::clearHighlight() {
+    errorLine = -1;
+    executionLine = -1;
     setExtraSelections({});
 }
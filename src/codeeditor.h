@@ -6,6 +6,8 @@
 #include <QTextBlock>
 #include <QTextFormat>
 #include <QColor>
+#include <QMouseEvent>
+#include <QSet>
 
 // === Main CodeEditor class ===
 class CodeEditor : public QPlainTextEdit {
@@ -14,12 +16,20 @@ public:
     explicit CodeEditor(QWidget *parent = nullptr);
 
     void lineNumberAreaPaintEvent(QPaintEvent *event);
+    void lineNumberAreaMousePressEvent(QMouseEvent *event);
     int  lineNumberAreaWidth();
 
+    const QSet<int> &breakpointLines() const { return breakpoints; }
+    void setBreakpointLines(const QSet<int> &lines);
+
 public slots:
     void highlightErrorLine(int lineNumber);  // hata satırını boya
+    void highlightExecutionLine(int lineNumber); // IP'nin bulunduğu satır, -1 = yok
     void clearHighlight();                    // highlight temizle
 
+signals:
+    void breakpointToggled(int lineNumber);
+
 protected:
     void resizeEvent(QResizeEvent *event) override;
 
@@ -29,6 +39,11 @@ private slots:
 
 private:
     QWidget *lineNumberArea;
+    QSet<int> breakpoints;   // 1-based line numbers
+    int errorLine = -1;
+    int executionLine = -1;
+
+    void refreshHighlights();
 };
 
 // === Line number area helper ===
@@ -40,6 +55,9 @@ protected:
     void paintEvent(QPaintEvent *event) override {
         codeEditor->lineNumberAreaPaintEvent(event);
     }
+    void mousePressEvent(QMouseEvent *event) override {
+        codeEditor->lineNumberAreaMousePressEvent(event);
+    }
 private:
     CodeEditor *codeEditor;
 };
@@ -1,11 +1,13 @@
 #include "cpu.h"
-#include <iostream>
-#include <iomanip>
+#include "alu.h"
+#include "opcodes.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <type_traits>
 
 CPU::CPU()
 {
-    memory.resize(65536, 0);
-
     // INITIALLY ALL REGISTERS SET BY ZERO
     regs.AX = 0;
     regs.BX = 0;
@@ -16,14 +18,26 @@ CPU::CPU()
     regs.SI = 0;
     regs.DI = 0;
     regs.IP = 0;
+    regs.CS = 0;
+    regs.DS = 0;
+    regs.SS = 0;
+    regs.ES = 0;
     flags.CF = 0;
     flags.ZF = 0;
     flags.SF = 0;
     flags.OF = 0;
+    flags.DF = 0;
+    flags.IF = 0;
+    flags.TF = 0;
 
     regs.SP = 0xFFFE;
 
-    std::cout << "CPU initialized with 64KB of memory." << std::endl;
+    console = bus.attach(std::make_unique<ConsoleDevice>(), PORT_CONSOLE, 2, MMIO_CONSOLE);
+    keyboard = bus.attach(std::make_unique<KeyboardDevice>(), PORT_KEYBOARD, 2, MMIO_KEYBOARD);
+    timer = bus.attach(std::make_unique<TimerDevice>(), PORT_TIMER, 6, MMIO_TIMER);
+    pic = bus.attach(std::make_unique<InterruptController>(), PORT_PIC, 2, MMIO_PIC);
+    pic->connect(IRQ_TIMER, timer);
+    pic->connect(IRQ_KEYBOARD, keyboard);
 };
 
 CPU::~CPU() {
@@ -42,6 +56,8 @@ uint16_t *CPU::get_register_ptr(uint8_t reg_code)
         return &regs.CX;
     case REG_DX:
         return &regs.DX;
+    case REG_MNK:
+        return &regs.MNK;
     case REG_SP:
         return &regs.SP;
     case REG_BP:
@@ -84,1186 +100,1562 @@ uint8_t *CPU::get_register8_ptr(uint8_t reg_code)
     }
 }
 
+uint16_t *CPU::get_segment_ptr(uint8_t seg_code)
+{
+    switch (seg_code)
+    {
+    case SEG_ES:
+        return &regs.ES;
+    case SEG_CS:
+        return &regs.CS;
+    case SEG_SS:
+        return &regs.SS;
+    case SEG_DS:
+        return &regs.DS;
+    default:
+        return nullptr;
+    }
+}
+
 // AUTOMATING THE WRITING PROCESS
-void CPU::write_mem16(uint16_t address, uint16_t value)
+// EVERY DATA ACCESS TESTS ONE "HAS DEVICE" BIT OF ITS PAGE; ONLY DEVICE PAGES GO TO THE BUS
+bool CPU::word_hits_device(uint16_t segment, uint16_t offset) const
 {
-    memory[address] = value & 0xFF;
-    memory[address + 1] = (value >> 8) & 0xFF;
+    uint32_t address = Memory::physical(segment, offset);
+    if (bus.mapped(address))
+        return true;
+    // THE HIGH BYTE ONLY LANDS ON ANOTHER PAGE AT THE LAST BYTE OF THIS ONE, OR AT segment:0000
+    // WHEN THE OFFSET WRAPS
+    return ((address & (DeviceBus::PAGE_SIZE - 1)) == DeviceBus::PAGE_SIZE - 1 || offset == 0xFFFF) &&
+           bus.mapped(Memory::physical(segment, offset + 1));
 }
 
-void CPU::write_mem8(uint16_t address, uint8_t value)
+void CPU::write_mem16(uint16_t segment, uint16_t offset, uint16_t value)
 {
-    if (address < memory.size())
+    if (word_hits_device(segment, offset))
     {
-        memory[address] = value;
+        write_mem8(segment, offset, value & 0xFF);
+        write_mem8(segment, offset + 1, (value >> 8) & 0xFF);
+        return;
     }
+    memory.write16(segment, offset, value);
 }
 
-uint8_t CPU::read_mem8(uint16_t address)
+void CPU::write_mem8(uint16_t segment, uint16_t offset, uint8_t value)
 {
-    if (address < memory.size())
+    uint32_t address = Memory::physical(segment, offset);
+    if (bus.mapped(address))
     {
-        return memory[address];
+        bus.write(address, value, instructions);
+        interrupt_check_at = 0; // A DEVICE MAY HAVE RAISED OR DROPPED ITS LINE
+        emit(EVENT_MMIO_WRITE, 0, value, address);
     }
-    return 0;
+    else
+        memory.write8(address, value);
 }
 
-uint16_t CPU::read_mem16(uint16_t address)
+uint8_t CPU::read_mem8(uint16_t segment, uint16_t offset)
 {
-    return (memory[address + 1] << 8) | memory[address];
+    uint32_t address = Memory::physical(segment, offset);
+    if (!bus.mapped(address))
+        return memory.read8(address);
+    interrupt_check_at = 0;
+    uint8_t value = device_read(address, false);
+    emit(EVENT_MMIO_READ, 0, value, address);
+    return value;
 }
 
-void CPU::update_flags_sub(uint16_t dest_val, uint16_t src_val, uint16_t result)
+// EVERY BYTE A DEVICE HANDS THE PROGRAM COMES FROM HERE. where = PORT OR PHYSICAL ADDRESS.
+// WITH AN InputLog, READS OF EXTERNAL DEVICES COME FROM THE LOG WHILE IT REPLAYS AND ARE LOGGED
+// WHILE IT RECORDS; THE OTHER DEVICES ANSWER THE SAME IN A REPLAY ANYWAY
+uint8_t CPU::device_read(uint32_t where, bool is_port)
 {
-    flags.ZF = (result == 0);
-    flags.SF = (result & 0x8000) != 0;
-    flags.CF = (dest_val < src_val);
-    bool dest_sign = (dest_val & 0x8000) != 0;
-    bool src_sign = (src_val & 0x8000) != 0;
-    flags.OF = (dest_sign != src_sign) && (src_sign == flags.SF);
+    const bool logged = input_log && bus.external(where, is_port);
+    uint8_t value;
+    if (logged && input_log->replay(InputLog::DEVICE_READ, instructions, value))
+        return value;
+    value = is_port ? bus.in(static_cast<uint16_t>(where), instructions) : bus.read(where, instructions);
+    if (logged)
+        input_log->record(InputLog::DEVICE_READ, instructions, value);
+    return value;
 }
 
-void CPU::update_flags_add(uint16_t dest_val, uint16_t src_val, uint32_t result)
+uint16_t CPU::read_mem16(uint16_t segment, uint16_t offset)
 {
-    flags.ZF = ((result & 0xFFFF) == 0);
-    flags.SF = (result & 0x8000) != 0;
-    flags.CF = (result > 0xFFFF);
-    bool dest_sign = (dest_val & 0x8000) != 0;
-    bool src_sign = (src_val & 0x8000) != 0;
-    flags.OF = (dest_sign == src_sign) && (dest_sign != flags.SF);
+    if (word_hits_device(segment, offset))
+        return read_mem8(segment, offset) | (read_mem8(segment, offset + 1) << 8);
+    return memory.read16(segment, offset);
 }
 
-void CPU::update_flags_logical(uint16_t result)
+// ===============================================================
+// == FLAG CALCULATORS, ONE BODY FOR BOTH OPERAND WIDTHS
+// ===============================================================
+// THE STATUS BITS COME FROM alu.h, EACH CALCULATOR STORES THEM WITH ONE READ-MODIFY-WRITE
+template <typename T>
+void CPU::update_flags_sub(T dest_val, T src_val, T result)
 {
-    flags.CF = false;
-    flags.OF = false;
-    flags.ZF = (result == 0);
-    flags.SF = (result & 0x8000) != 0;
+    flags.parity_source = result;
+    flags.aux_source = dest_val ^ src_val ^ result;
+    flags.assign(ARITH_FLAGS, sub_status<T>(dest_val, src_val, result));
 }
 
-void CPU::update_flags_inc(uint16_t val_before, uint16_t val_after)
+template <typename T>
+void CPU::update_flags_add(T dest_val, T src_val, uint32_t result)
 {
-    flags.ZF = (val_after == 0);
-    flags.SF = (val_after & 0x8000) != 0;
-    flags.OF = (val_before == 0x7FFF);
+    flags.parity_source = result;
+    flags.aux_source = dest_val ^ src_val ^ result;
+    flags.assign(ARITH_FLAGS, add_status<T>(dest_val, src_val, result));
 }
 
-void CPU::update_flags_dec(uint16_t val_before, uint16_t val_after)
-{
-    flags.ZF = (val_after == 0);
-    flags.SF = (val_after & 0x8000) != 0;
-    flags.OF = (val_before == 0x8000); // OVERFLOW OCCURS IF AND ONLY IF 0X8000 TO 0X7FFFF
-}
-void CPU::update_flags_add8(uint8_t dest_val, uint8_t src_val, uint16_t result)
-{
-    flags.ZF = ((result & 0xFF) == 0);
-    flags.SF = (result & 0x80) != 0;
-    flags.CF = (result > 0xFF);
-    bool dest_sign = (dest_val & 0x80) != 0;
-    bool src_sign = (src_val & 0x80) != 0;
-    flags.OF = (dest_sign == src_sign) && (dest_sign != flags.SF);
-}
-void CPU::update_flags_sub8(uint8_t dest_val, uint8_t src_val, uint8_t result)
-{
-    flags.ZF = (result == 0);
-    flags.SF = (result & 0x80) != 0;
-    flags.CF = (dest_val < src_val);
-    bool dest_sign = (dest_val & 0x80) != 0;
-    bool src_sign = (src_val & 0x80) != 0;
-    flags.OF = (dest_sign != src_sign) && (src_sign == flags.SF);
-}
-void CPU::update_flags_logical8(uint8_t result)
+template <typename T>
+void CPU::update_flags_logical(T result)
 {
-    flags.CF = false;
-    flags.OF = false;
-    flags.ZF = (result == 0);
-    flags.SF = (result & 0x80) != 0;
+    flags.parity_source = result;
+    flags.aux_source = 0;
+    flags.assign(ARITH_FLAGS, logic_status<T>(result));
 }
-void CPU::update_flags_inc8(uint8_t val_before, uint8_t val_after)
+
+// INC/DEC LEAVE CF ALONE
+template <typename T>
+void CPU::update_flags_inc(T val_before, T val_after)
 {
-    flags.ZF = (val_after == 0);
-    flags.SF = (val_after & 0x80) != 0;
-    flags.OF = (val_before == 0x7F);
+    flags.parity_source = val_after;
+    flags.aux_source = val_before ^ 1 ^ val_after;
+    flags.assign(INC_DEC_FLAGS, inc_status<T>(val_before, val_after));
 }
-void CPU::update_flags_dec8(uint8_t val_before, uint8_t val_after)
+
+template <typename T>
+void CPU::update_flags_dec(T val_before, T val_after)
 {
-    flags.ZF = (val_after == 0);
-    flags.SF = (val_after & 0x80) != 0;
-    flags.OF = (val_before == 0x80);
+    flags.parity_source = val_after;
+    flags.aux_source = val_before ^ 1 ^ val_after;
+    flags.assign(INC_DEC_FLAGS, dec_status<T>(val_before, val_after));
 }
 
-bool CPU::step()
+// ===============================================================
+// == INSTRUCTION HANDLERS
+// ===============================================================
+// EVERY OPCODE IS ONE INSTANTIATION OF
+//     exec<OPCODE, WIDTH, OPERATION, DESTINATION KIND, SOURCE KIND>
+// OPERAND KINDS DECODE THEIR BYTES AT A FIXED OFFSET AFTER THE OPCODE AND
+// HAND THE OPERATION A TINY LOCATION OBJECT (get/set), SO THE SAME OPERATION
+// BODY SERVES REGISTERS, IMMEDIATES AND MEMORY OF EITHER WIDTH.
+struct Exec
 {
-    uint8_t opcode = memory[regs.IP];
+    using Handler = bool (*)(CPU &);
 
-    switch (opcode)
+    // --- OPERAND LOCATIONS ---
+    template <typename T>
+    struct RegRef
     {
-#define FETCH_REG16_PTR(offset) get_register_ptr(memory[regs.IP + offset])
-#define FETCH_REG8_PTR(offset) get_register8_ptr(memory[regs.IP + offset])
-#define FETCH_IMM16(offset) read_mem16(regs.IP + offset)
-#define FETCH_IMM8(offset) memory[regs.IP + offset]
+        T *p;
+        T get() const { return *p; }
+        void set(T v) const { *p = v; }
+    };
 
-    // ===============================================================
-    // == PART 1: PROGRAM CONTROLL BRANCH
-    // ===============================================================
-    case OP_HALT:
+    template <typename T>
+    struct MemRef
     {
-        return false;
-    }
-    case OP_NOP:
-    {
-        regs.IP += 1;
-        break;
-    }
-    case OP_JMP:
-    {
-        regs.IP = FETCH_IMM16(1);
-        break;
-    }
-    case OP_CALL:
-    {
-        uint16_t target = FETCH_IMM16(1);
-        uint16_t ret_addr = regs.IP + 3;
-        regs.SP -= 2;
-        write_mem16(regs.SP, ret_addr);
-        regs.IP = target;
-        break;
-    }
-    case OP_RET:
+        CPU &c;
+        uint16_t segment;
+        uint16_t offset;
+        T get() const
+        {
+            if constexpr (sizeof(T) == 2)
+                return c.read_mem16(segment, offset);
+            else
+                return c.read_mem8(segment, offset);
+        }
+        void set(T v) const
+        {
+            if constexpr (sizeof(T) == 2)
+                c.write_mem16(segment, offset, v);
+            else
+                c.write_mem8(segment, offset, v);
+        }
+    };
+
+    template <typename T>
+    struct Value
     {
-        regs.IP = read_mem16(regs.SP);
-        regs.SP += 2;
-        break;
-    }
-    case OP_JZ:
+        T v;
+        T get() const { return v; }
+    };
+
+    // --- OPERAND KINDS (OFF = BYTE OFFSET AFTER THE OPCODE) ---
+    // OPERAND BYTES COME FROM THE FETCH WINDOW step() PREPARED, NEVER FROM MEMORY AGAIN
+    static uint8_t fetch8(CPU &c, int off) { return c.instruction[off]; }
+    static uint16_t fetch16(CPU &c, int off) { return c.instruction[off] | (c.instruction[off + 1] << 8); }
+
+    // AL OR AX, BY WIDTH
+    template <typename T>
+    static T &accumulator(CPU &c)
     {
-        regs.IP = flags.ZF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
+        if constexpr (sizeof(T) == 2)
+            return c.regs.AX;
+        else
+            return c.regs.AL;
     }
-    case OP_JNZ:
+
+    // [BP], [BP+SI]... ADDRESS THE STACK SEGMENT, EVERYTHING ELSE THE DATA SEGMENT
+    static uint16_t data_segment(CPU &c, uint8_t reg_code)
     {
-        regs.IP = !flags.ZF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
+        return reg_code == REG_BP ? c.regs.SS : c.regs.DS;
     }
-    case OP_JC:
+
+    // valid() IS FALSE WHEN AN OPERAND BYTE NAMES NO REGISTER (SELF-MODIFIED CODE); exec() THEN
+    // STOPS ON AN UNKNOWN OPCODE BEFORE at() WOULD FOLLOW A NULL REGISTER POINTER
+    struct Decoded
     {
-        regs.IP = flags.CF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
-    }
-    case OP_JNC:
+        template <typename T>
+        static bool valid(CPU &) { return true; }
+    };
+
+    static bool valid_register(CPU &c, int off) { return c.get_register_ptr(fetch8(c, off)) != nullptr; }
+
+    struct None : Decoded
     {
-        regs.IP = !flags.CF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
-    }
-    case OP_JS:
+        template <typename T>
+        static Value<T> at(CPU &) { return {0}; }
+    };
+
+    template <int OFF>
+    struct Reg
     {
-        regs.IP = flags.SF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
-    }
-    case OP_JNS:
+        template <typename T>
+        static bool valid(CPU &c)
+        {
+            if constexpr (sizeof(T) == 2)
+                return valid_register(c, OFF);
+            else
+                return c.get_register8_ptr(fetch8(c, OFF)) != nullptr;
+        }
+
+        template <typename T>
+        static RegRef<T> at(CPU &c)
+        {
+            if constexpr (sizeof(T) == 2)
+                return {c.get_register_ptr(fetch8(c, OFF))};
+            else
+                return {c.get_register8_ptr(fetch8(c, OFF))};
+        }
+    };
+
+    template <int OFF>
+    struct Imm : Decoded
     {
-        regs.IP = !flags.SF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
-    }
-    case OP_JO:
+        template <typename T>
+        static Value<T> at(CPU &c)
+        {
+            if constexpr (sizeof(T) == 2)
+                return {fetch16(c, OFF)};
+            else
+                return {fetch8(c, OFF)};
+        }
+    };
+
+    // SHIFT COUNTS ARE ALWAYS ONE BYTE, WHATEVER THE DESTINATION WIDTH
+    template <int OFF, uint8_t MASK = 0xFF>
+    struct Count : Decoded
     {
-        regs.IP = flags.OF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
-    }
-    case OP_JNO:
+        template <typename T>
+        static Value<uint8_t> at(CPU &c) { return {static_cast<uint8_t>(fetch8(c, OFF) & MASK)}; }
+    };
+
+    struct CountCL : Decoded
     {
-        regs.IP = !flags.OF ? FETCH_IMM16(1) : regs.IP + 3;
-        break;
-    }
-        // ===============================================================
-        // == PART 2: DATA TRANSFER
-        // ===============================================================
-    case OP_MOV_REG_IMM:
-    {
-        *FETCH_REG16_PTR(1) = FETCH_IMM16(2);
-        regs.IP += 4;
-        break;
-    }
-    case OP_MOV_REG_REG:
+        template <typename T>
+        static Value<uint8_t> at(CPU &c) { return {c.regs.CL}; }
+    };
+
+    template <int OFF> // imm8 PORT NUMBER
+    struct Port : Decoded
     {
-        *FETCH_REG16_PTR(1) = *FETCH_REG16_PTR(2);
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_REG8_IMM:
+        template <typename T>
+        static Value<uint16_t> at(CPU &c) { return {fetch8(c, OFF)}; }
+    };
+
+    struct PortDX : Decoded
     {
-        *FETCH_REG8_PTR(1) = FETCH_IMM8(2);
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_REG8_REG8:
+        template <typename T>
+        static Value<uint16_t> at(CPU &c) { return {c.regs.DX}; }
+    };
+
+    template <int OFF> // SEGMENT REGISTER
+    struct Seg
     {
-        *FETCH_REG8_PTR(1) = *FETCH_REG8_PTR(2);
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_REG_FROM_MEM_IMM:
+        template <typename T>
+        static bool valid(CPU &c) { return c.get_segment_ptr(fetch8(c, OFF)) != nullptr; }
+
+        template <typename T>
+        static RegRef<uint16_t> at(CPU &c) { return {c.get_segment_ptr(fetch8(c, OFF))}; }
+    };
+
+    template <int OFF> // DS:[imm16]
+    struct MemImm : Decoded
     {
-        *FETCH_REG16_PTR(1) = read_mem16(FETCH_IMM16(2));
-        regs.IP += 4;
-        break;
-    }
-    case OP_MOV_MEM_IMM_FROM_REG:
+        template <typename T>
+        static MemRef<T> at(CPU &c) { return {c, c.regs.DS, fetch16(c, OFF)}; }
+    };
+
+    template <int OFF> // DS:[reg16]
+    struct MemReg
     {
-        uint16_t target_address = FETCH_IMM16(2);
-        uint16_t source_register = *FETCH_REG16_PTR(1);
-        write_mem16(target_address, source_register);
-        regs.IP += 4;
-        break;
-    }
-    case OP_MOV_REG_FROM_MEM_REG:
+        template <typename T>
+        static bool valid(CPU &c) { return valid_register(c, OFF); }
+
+        template <typename T>
+        static MemRef<T> at(CPU &c)
+        {
+            uint8_t reg = fetch8(c, OFF);
+            return {c, data_segment(c, reg), *c.get_register_ptr(reg)};
+        }
+    };
+
+    template <int OFF> // DS:[reg16 + reg16]
+    struct MemRegReg
     {
-        *FETCH_REG16_PTR(1) = read_mem16(*FETCH_REG16_PTR(2));
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_MEM_REG_FROM_REG:
+        template <typename T>
+        static bool valid(CPU &c) { return valid_register(c, OFF) && valid_register(c, OFF + 1); }
+
+        template <typename T>
+        static MemRef<T> at(CPU &c)
+        {
+            uint8_t reg1 = fetch8(c, OFF);
+            uint8_t reg2 = fetch8(c, OFF + 1);
+            uint16_t offset = *c.get_register_ptr(reg1) + *c.get_register_ptr(reg2);
+            return {c, data_segment(c, reg1 == REG_BP ? reg1 : reg2), offset};
+        }
+    };
+
+    template <int OFF> // DS:[reg16 + imm16], THE SUM WRAPS INSIDE THE SEGMENT
+    struct MemRegImm
     {
-        write_mem16(*FETCH_REG16_PTR(2), *FETCH_REG16_PTR(1));
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_REG8_FROM_MEM_IMM:
+        template <typename T>
+        static bool valid(CPU &c) { return valid_register(c, OFF); }
+
+        template <typename T>
+        static MemRef<T> at(CPU &c)
+        {
+            uint8_t reg = fetch8(c, OFF);
+            uint16_t offset = *c.get_register_ptr(reg) + fetch16(c, OFF + 1);
+            return {c, data_segment(c, reg), offset};
+        }
+    };
+
+    // --- OPERATIONS ---
+    struct Mov
     {
-        *FETCH_REG8_PTR(1) = memory[FETCH_IMM16(2)];
-        regs.IP += 4;
-        break;
-    }
-    case OP_MOV_MEM_IMM_FROM_REG8:
+        template <typename T, class D, class S>
+        static void apply(CPU &, const D &d, const S &s) { d.set(s.get()); }
+    };
+
+    struct Xchg
     {
-        memory[FETCH_IMM16(2)] = *FETCH_REG8_PTR(1);
-        regs.IP += 4;
-        break;
-    }
-    case OP_MOV_REG8_FROM_MEM_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &, const D &d, const S &s)
+        {
+            T dv = d.get();
+            d.set(s.get());
+            s.set(dv);
+        }
+    };
+
+    template <bool WITH_CARRY, bool STORE = true>
+    struct AddOp
     {
-        *FETCH_REG8_PTR(1) = memory[*FETCH_REG16_PTR(2)];
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_MEM_REG_FROM_REG8:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            T dv = d.get();
+            T sv = s.get();
+            uint32_t res = (uint32_t)dv + sv + (WITH_CARRY ? c.flags.CF : 0);
+            if (STORE)
+                d.set(res);
+            c.update_flags_add<T>(dv, sv, res);
+        }
+    };
+    using Add = AddOp<false>;
+    using Adc = AddOp<true>;
+
+    template <bool WITH_BORROW, bool STORE = true>
+    struct SubOp
     {
-        memory[*FETCH_REG16_PTR(2)] = *FETCH_REG8_PTR(1);
-        regs.IP += 3;
-        break;
-    }
-    case OP_MOV_REG_FROM_MEM_REG_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            T dv = d.get();
+            T sv = s.get() + (WITH_BORROW ? c.flags.CF : 0); // SBB COMPARES AGAINST src + CF
+            T res = dv - sv;
+            if (STORE)
+                d.set(res);
+            c.update_flags_sub<T>(dv, sv, res);
+        }
+    };
+    using Sub = SubOp<false>;
+    using Sbb = SubOp<true>;
+    using Cmp = SubOp<false, false>;
+
+    template <class F>
+    struct LogicOp
     {
-        uint16_t addr = *FETCH_REG16_PTR(2) + *FETCH_REG16_PTR(3);
-        *FETCH_REG16_PTR(1) = read_mem16(addr);
-        regs.IP += 4;
-        break;
-    }
-    case OP_MOV_MEM_REG_REG_FROM_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            T res = F()(d.get(), s.get());
+            d.set(res);
+            c.update_flags_logical<T>(res);
+        }
+    };
+    using And = LogicOp<std::bit_and<>>;
+    using Or = LogicOp<std::bit_or<>>;
+    using Xor = LogicOp<std::bit_xor<>>;
+
+    struct Not
     {
-        uint16_t addr = *FETCH_REG16_PTR(2) + *FETCH_REG16_PTR(3);
-        write_mem16(addr, *FETCH_REG16_PTR(1));
-        regs.IP += 4;
-        break;
-    }
-    case OP_XCHG_REG_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &, const D &d, const S &) { d.set(~d.get()); }
+    };
+
+    struct Neg
     {
-        std::swap(*FETCH_REG16_PTR(1), *FETCH_REG16_PTR(2));
-        regs.IP += 3;
-        break;
-    }
-    case OP_XCHG_REG8_REG8:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &)
+        {
+            T val = d.get();
+            T res = -val;
+            d.set(res);
+            c.update_flags_sub<T>(0, val, res); // CF = (val != 0)
+        }
+    };
+
+    struct Inc
     {
-        std::swap(*FETCH_REG8_PTR(1), *FETCH_REG8_PTR(2));
-        regs.IP += 3;
-        break;
-    }
-        // ===============================================================
-        // == PART 3: ADVANCED ADRESSING MODES
-        // ===============================================================
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &)
+        {
+            T dv = d.get();
+            d.set(dv + 1);
+            c.update_flags_inc<T>(dv, d.get());
+        }
+    };
 
-    case OP_MOV_MEM_IMM_FROM_IMM:
+    struct Dec
     {
-        uint16_t address = FETCH_IMM16(1);
-        uint16_t value = FETCH_IMM16(3);
-        write_mem16(address, value);
-        regs.IP += 5;
-        break;
-    }
-    case OP_MOV_MEM_IMM_FROM_IMM8:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &)
+        {
+            T dv = d.get();
+            d.set(dv - 1);
+            c.update_flags_dec<T>(dv, d.get());
+        }
+    };
+
+    struct Push
     {
-        uint16_t address = FETCH_IMM16(1);
-        uint16_t value = FETCH_IMM8(3);
-        write_mem8(address, value);
-        regs.IP += 4;
-        break;
-    }
-    // ===============================================================
-    // == PART 4: STACK OPERATIONS
-    // ===============================================================
-    case OP_PUSH_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &s)
+        {
+            c.regs.SP -= 2;
+            c.write_mem16(c.regs.SS, c.regs.SP, s.get());
+        }
+    };
+
+    struct Pop
     {
-        regs.SP -= 2;
-        write_mem16(regs.SP, *FETCH_REG16_PTR(1));
-        regs.IP += 2;
-        break;
-    }
-    case OP_POP_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &)
+        {
+            d.set(c.read_mem16(c.regs.SS, c.regs.SP));
+            c.regs.SP += 2;
+        }
+    };
+
+    // LOCK: Op RUNS WHILE HOLDING THE BUS, SO LOCKED INSTRUCTIONS OF OTHER CORES CANNOT
+    // INTERLEAVE WITH ITS READ AND WRITE. SEE smp.h FOR WHAT THIS GUARANTEES
+    template <class Op>
+    struct Locked
     {
-        *FETCH_REG16_PTR(1) = read_mem16(regs.SP);
-        regs.SP += 2;
-        regs.IP += 2;
-        break;
-    }
-    // ===============================================================
-    // == PART 5: ARITHMETIC LOGICAL OPERATIONS
-    // ===============================================================
-    case OP_ADD_REG_REG:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t *s = FETCH_REG16_PTR(2);
-        uint16_t dv = *d;
-        uint32_t res = (uint32_t)dv + *s;
-        *d = res;
-        update_flags_add(dv, *s, res);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ADD_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        uint16_t dv = *d;
-        uint32_t res = (uint32_t)dv + s;
-        *d = res;
-        update_flags_add(dv, s, res);
-        regs.IP += 4;
-        break;
-    }
-    case OP_SUB_REG_REG:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t *s = FETCH_REG16_PTR(2);
-        uint16_t dv = *d;
-        *d -= *s;
-        update_flags_sub(dv, *s, *d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_SUB_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        uint16_t dv = *d;
-        *d -= s;
-        update_flags_sub(dv, s, *d);
-        regs.IP += 4;
-        break;
-    }
-    case OP_ADC_REG_REG:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t *s = FETCH_REG16_PTR(2);
-        uint16_t dv = *d;
-        uint32_t res = (uint32_t)dv + *s + flags.CF;
-        *d = res;
-        update_flags_add(dv, *s, res);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ADC_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        uint16_t dv = *d;
-        uint32_t res = (uint32_t)dv + s + flags.CF;
-        *d = res;
-        update_flags_add(dv, s, res);
-        regs.IP += 4;
-        break;
-    }
-    case OP_SBB_REG_REG:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t *s = FETCH_REG16_PTR(2);
-        uint16_t dv = *d;
-        uint16_t sv = *s;
-        uint16_t cf = flags.CF;
-        *d = dv - sv - cf;
-        update_flags_sub(dv, sv + cf, *d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_SBB_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        uint16_t dv = *d;
-        uint16_t cf = flags.CF;
-        *d = dv - s - cf;
-        update_flags_sub(dv, s + cf, *d);
-        regs.IP += 4;
-        break;
-    }
-    case OP_CMP_REG_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            if (!c.bus_lock)
+                return Op::template apply<T>(c, d, s);
+            std::lock_guard<std::mutex> hold(*c.bus_lock);
+            Op::template apply<T>(c, d, s);
+        }
+    };
+    using LockXchg = Locked<Xchg>;
+    using LockAdd = Locked<Add>;
+    using LockSub = Locked<Sub>;
+    using LockAnd = Locked<And>;
+    using LockOr = Locked<Or>;
+    using LockXor = Locked<Xor>;
+
+    // --- FLAGS REGISTER ---
+    // CLC/STC/CLD/STD/CLI/STI SET OR CLEAR ONE BIT OF THE PACKED WORD
+    template <uint16_t BIT, bool VALUE>
+    struct SetFlag
+    {
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &)
+        {
+            c.flags.bits = VALUE ? c.flags.bits | BIT : c.flags.bits & ~BIT;
+            if (BIT & (Flags::BIT_IF | Flags::BIT_TF))
+                c.interrupt_check_at = 0;
+        }
+    };
+    using Clc = SetFlag<Flags::BIT_CF, false>;
+    using Stc = SetFlag<Flags::BIT_CF, true>;
+    using Cld = SetFlag<Flags::BIT_DF, false>;
+    using Std = SetFlag<Flags::BIT_DF, true>;
+    using Cli = SetFlag<Flags::BIT_IF, false>;
+    using Sti = SetFlag<Flags::BIT_IF, true>;
+
+    struct Cmc
     {
-        uint16_t d = *FETCH_REG16_PTR(1);
-        uint16_t s = *FETCH_REG16_PTR(2);
-        update_flags_sub(d, s, d - s);
-        regs.IP += 3;
-        break;
-    }
-    case OP_CMP_REG_IMM:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &) { c.flags.CF = !c.flags.CF; }
+    };
+
+    struct Pushf
     {
-        uint16_t d = *FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        update_flags_sub(d, s, d - s);
-        regs.IP += 4;
-        break;
-    }
-    case OP_NEG_REG16:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t val = *d;
-        *d = -val;
-        flags.CF = (val != 0);
-        update_flags_sub(0, val, *d);
-        regs.IP += 2;
-        break;
-    }
-    case OP_NOT_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &) { c.push16(c.flags.word()); }
+    };
+
+    struct Popf
     {
-        *FETCH_REG16_PTR(1) = ~(*FETCH_REG16_PTR(1));
-        regs.IP += 2;
-        break;
-    }
-    case OP_INC_REG:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t dv = *d;
-        (*d)++;
-        update_flags_inc(dv, *d);
-        regs.IP += 2;
-        break;
-    }
-    case OP_DEC_REG:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t dv = *d;
-        (*d)--;
-        update_flags_dec(dv, *d);
-        regs.IP += 2;
-        break;
-    }
-    case OP_AND_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        *d &= s;
-        update_flags_logical(*d);
-        regs.IP += 4;
-        break;
-    }
-    case OP_OR_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        *d |= s;
-        update_flags_logical(*d);
-        regs.IP += 4;
-        break;
-    }
-    case OP_XOR_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint16_t s = FETCH_IMM16(2);
-        *d ^= s;
-        update_flags_logical(*d);
-        regs.IP += 4;
-        break;
-    }
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &)
+        {
+            c.flags.set_word(c.pop16());
+            c.interrupt_check_at = 0; // IF OR TF MAY HAVE CHANGED
+        }
+    };
 
-    case OP_AND_REG_REG:
+    // AH <-> SF ZF - AF - PF - CF, THE LOW BYTE OF THE WORD
+    struct Lahf
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        *d &= *FETCH_REG16_PTR(2);
-        update_flags_logical(*d);
-        regs.IP += 3;
-        break;
-    }
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &) { c.regs.AH = c.flags.word() & 0xFF; }
+    };
 
-    case OP_OR_REG_REG:
+    struct Sahf
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        *d |= *FETCH_REG16_PTR(2);
-        update_flags_logical(*d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_XOR_REG_REG:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &) { c.flags.set_word((c.flags.word() & 0xFF00) | c.regs.AH); }
+    };
+
+    // --- PORT I/O (A WORD IS TWO BYTE PORTS, port AND port + 1) ---
+    struct In
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        *d ^= *FETCH_REG16_PTR(2);
-        update_flags_logical(*d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ADD_REG8_REG8:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t *s = FETCH_REG8_PTR(2);
-        uint8_t dv = *d;
-        uint16_t res = (uint16_t)dv + *s;
-        *d = res;
-        update_flags_add8(dv, *s, res);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ADD_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        uint8_t dv = *d;
-        uint16_t res = (uint16_t)dv + s;
-        *d = res;
-        update_flags_add8(dv, s, res);
-        regs.IP += 3;
-        break;
-    }
-    case OP_SUB_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        uint8_t dv = *d;
-        *d -= s;
-        update_flags_sub8(dv, s, *d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ADC_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        uint8_t dv = *d;
-        uint16_t res = (uint16_t)dv + s + flags.CF;
-        *d = res;
-        update_flags_add8(dv, s, res);
-        regs.IP += 3;
-        break;
-    }
-    case OP_SBB_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        uint8_t dv = *d;
-        uint8_t cf = flags.CF;
-        *d = dv - s - cf;
-        update_flags_sub8(dv, s + cf, *d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_CMP_REG8_IMM:
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            uint16_t port = s.get();
+            T v;
+            if constexpr (sizeof(T) == 2)
+                v = c.device_read(port, true) | (c.device_read(static_cast<uint16_t>(port + 1), true) << 8);
+            else
+                v = c.device_read(port, true);
+            d.set(v);
+            c.interrupt_check_at = 0;
+            c.emit(EVENT_PORT_IN, 0, v, port);
+        }
+    };
+
+    struct Out // dst = PORT, src = VALUE
     {
-        uint8_t d = *FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        update_flags_sub8(d, s, d - s);
-        regs.IP += 3;
-        break;
-    }
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            uint16_t port = d.get();
+            T v = s.get();
+            c.bus.out(port, v & 0xFF, c.instructions);
+            if constexpr (sizeof(T) == 2)
+                c.bus.out(port + 1, v >> 8, c.instructions);
+            c.interrupt_check_at = 0;
+            c.emit(EVENT_PORT_OUT, 0, v, port);
+        }
+    };
 
-    case OP_SUB_REG8_REG8:
+    // --- MULTIPLY (src = MULTIPLIER, THE OTHER FACTOR IS AL / AX) ---
+    // THE DOUBLE WIDTH PRODUCT GOES TO AX (8-BIT) OR DX:AX (16-BIT). CF = OF = THE UPPER HALF
+    // CARRIES INFORMATION (NON-ZERO FOR MUL, NOT A SIGN EXTENSION FOR IMUL). ZF/SF ARE LEFT AS IS.
+    template <typename T>
+    static void store_wide(CPU &c, uint32_t wide)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t *s = FETCH_REG8_PTR(2);
-        uint8_t dv = *d;
-        *d -= *s;
-        update_flags_sub8(dv, *s, *d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ADC_REG8_REG8:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t *s = FETCH_REG8_PTR(2);
-        uint8_t dv = *d;
-        uint16_t res = (uint16_t)dv + *s + flags.CF;
-        *d = res;
-        update_flags_add8(dv, *s, res);
-        regs.IP += 3;
-        break;
-    }
-    case OP_SBB_REG8_REG8:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t *s = FETCH_REG8_PTR(2);
-        uint8_t dv = *d;
-        uint8_t sv = *s;
-        uint8_t cf = flags.CF;
-        *d = dv - sv - cf;
-        update_flags_sub8(dv, sv + cf, *d);
-        regs.IP += 3;
-        break;
+        if constexpr (sizeof(T) == 2)
+        {
+            c.regs.AX = wide & 0xFFFF;
+            c.regs.DX = wide >> 16;
+        }
+        else
+            c.regs.AX = wide & 0xFFFF;
     }
-    case OP_CMP_REG8_REG8:
+
+    template <typename T>
+    static uint32_t load_wide(CPU &c)
     {
-        uint8_t d = *FETCH_REG8_PTR(1);
-        uint8_t s = *FETCH_REG8_PTR(2);
-        update_flags_sub8(d, s, d - s);
-        regs.IP += 3;
-        break;
+        if constexpr (sizeof(T) == 2)
+            return ((uint32_t)c.regs.DX << 16) | c.regs.AX;
+        else
+            return c.regs.AX;
     }
-    case OP_NEG_REG8:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t val = *d;
-        *d = -val;
-        flags.CF = (val != 0);
-        update_flags_sub8(0, val, *d);
-        regs.IP += 2;
-        break;
-    }
-    case OP_NOT_REG8:
+
+    template <bool SIGNED>
+    struct MulOp
     {
-        *FETCH_REG8_PTR(1) = ~(*FETCH_REG8_PTR(1));
-        regs.IP += 2;
-        break;
-    }
-    case OP_INC_REG8:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t dv = *d;
-        (*d)++;
-        update_flags_inc8(dv, *d);
-        regs.IP += 2;
-        break;
-    }
-    case OP_DEC_REG8:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t dv = *d;
-        (*d)--;
-        update_flags_dec8(dv, *d);
-        regs.IP += 2;
-        break;
-    }
-    case OP_AND_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        *d &= s;
-        update_flags_logical8(*d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_OR_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        *d |= s;
-        update_flags_logical8(*d);
-        regs.IP += 3;
-        break;
-    }
-    case OP_XOR_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t s = FETCH_IMM8(2);
-        *d ^= s;
-        update_flags_logical8(*d);
-        regs.IP += 3;
-        break;
-    }
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &, const S &s)
+        {
+            using ST = std::make_signed_t<T>;
+            T a = accumulator<T>(c);
+            bool fits;
+            uint32_t product;
+            if (SIGNED)
+            {
+                int32_t p = (int32_t)(ST)a * (ST)s.get();
+                product = p;
+                fits = p == (ST)p;
+            }
+            else
+            {
+                product = (uint32_t)a * s.get();
+                fits = product <= Width<T>::MAX;
+            }
+            store_wide<T>(c, product);
+            c.flags.CF = c.flags.OF = !fits;
+        }
+    };
+    using Mul = MulOp<false>;
+    using Imul = MulOp<true>;
 
-    case OP_AND_REG8_REG8:
+    // --- SHIFT ROTATE (src = COUNT) ---
+    // CONSTANT TIME: ONE SHIFT OR ROTATE PER INSTRUCTION, WHATEVER THE COUNT.
+    // CF/OF END UP EXACTLY WHERE THE OLD ONE-BIT-PER-ITERATION LOOPS LEFT THEM.
+    template <typename T>
+    static T rotl(T v, unsigned n) // n IN [0, BITS), COMPILES TO A SINGLE rol
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        *d &= *FETCH_REG8_PTR(2);
-        update_flags_logical8(*d);
-        regs.IP += 3;
-        break;
+        n &= Width<T>::BITS - 1;
+        return static_cast<T>((v << n) | (v >> ((Width<T>::BITS - n) & (Width<T>::BITS - 1))));
     }
-    case OP_OR_REG8_REG8:
+
+    template <typename T>
+    static T rotr(T v, unsigned n)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        *d |= *FETCH_REG8_PTR(2);
-        update_flags_logical8(*d);
-        regs.IP += 3;
-        break;
+        n &= Width<T>::BITS - 1;
+        return static_cast<T>((v >> n) | (v << ((Width<T>::BITS - n) & (Width<T>::BITS - 1))));
     }
-    case OP_XOR_REG8_REG8:
+
+    struct Shl
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        *d ^= *FETCH_REG8_PTR(2);
-        update_flags_logical8(*d);
-        regs.IP += 3;
-        break;
-    }
-        // ===============================================================
-        // == PART 6: BIT SHIFTING AND ROTATE
-        // ===============================================================
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
+        {
+            uint8_t count = s.get();
+            T v = count < Width<T>::BITS ? static_cast<T>(d.get() << count) : 0;
+            d.set(v);
+            c.update_flags_logical<T>(v);
+            if (count == 1)
+                c.flags.OF = (v & Width<T>::SIGN) != c.flags.CF;
+        }
+    };
 
-    case OP_SHL_REG_IMM:
+    struct Shr
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
         {
-            flags.CF = (*d & 0x8000);
-            *d <<= 1;
+            T val_before = d.get();
+            uint8_t count = s.get();
+            T v = count < Width<T>::BITS ? static_cast<T>(val_before >> count) : 0;
+            d.set(v);
+            c.update_flags_logical<T>(v);
+            if (count == 1)
+                c.flags.OF = (val_before & Width<T>::SIGN);
         }
-        update_flags_logical(*d);
-        if (count == 1)
-            flags.OF = (*d & 0x8000) != flags.CF;
-        regs.IP += 3;
-        break;
-    }
-    case OP_SHR_REG_IMM:
+    };
+
+    struct Sar
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        uint16_t val_before = *d;
-        for (int i = 0; i < count; ++i)
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
         {
-            flags.CF = (*d & 1);
-            *d >>= 1;
+            std::make_signed_t<T> v = d.get();
+            uint8_t count = s.get();
+            v >>= count < Width<T>::BITS ? count : Width<T>::BITS - 1; // PAST THE WIDTH ONLY SIGN BITS REMAIN
+            d.set(v);
+            c.update_flags_logical<T>(v);
+            c.flags.OF = false;
         }
-        update_flags_logical(*d);
-        if (count == 1)
-            flags.OF = (val_before & 0x8000);
-        regs.IP += 3;
-        break;
-    }
-    case OP_SAR_REG_IMM:
+    };
+
+    struct Rol
     {
-        int16_t *d = (int16_t *)FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
         {
-            flags.CF = (*d & 1);
-            *d >>= 1;
+            uint8_t count = s.get();
+            T v = rotl<T>(d.get(), count);
+            d.set(v);
+            c.flags.CF = count ? (v & 1) : c.flags.CF; // LAST BIT ROTATED OUT OF THE TOP
+            if (count == 1)
+                c.flags.OF = ((v & Width<T>::SIGN) != 0) != c.flags.CF;
         }
-        update_flags_logical(*d);
-        flags.OF = false;
-        regs.IP += 3;
-        break;
-    }
-    case OP_SHL_REG_CL:
+    };
+
+    struct Ror
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
         {
-            flags.CF = (*d & 0x8000);
-            *d <<= 1;
+            uint8_t count = s.get();
+            T v = rotr<T>(d.get(), count);
+            d.set(v);
+            c.flags.CF = count ? (v & Width<T>::SIGN) != 0 : c.flags.CF; // LAST BIT ROTATED OUT OF THE BOTTOM
+            if (count == 1)
+                c.flags.OF = ((v & Width<T>::SIGN) != 0) != ((v & (Width<T>::SIGN >> 1)) != 0);
         }
-        update_flags_logical(*d);
-        if (count == 1)
-            flags.OF = (*d & 0x8000) != flags.CF;
-        regs.IP += 2;
-        break;
-    }
-    case OP_SHR_REG_CL:
+    };
+
+    // RCL/RCR ROTATE THE (BITS + 1)-BIT VALUE CF:dest, SO THE PERIOD IS 17 (OR 9)
+    struct Rcl
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        uint16_t val_before = *d;
-        for (int i = 0; i < count; ++i)
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
         {
-            flags.CF = (*d & 1);
-            *d >>= 1;
+            constexpr unsigned WIDE = Width<T>::BITS + 1;
+            constexpr uint32_t WIDE_MASK = (1u << WIDE) - 1;
+            uint8_t count = s.get();
+            unsigned n = count % WIDE;
+            uint32_t x = ((uint32_t)c.flags.CF << Width<T>::BITS) | d.get();
+            x = ((x << n) | (x >> (WIDE - n))) & WIDE_MASK;
+            d.set(static_cast<T>(x));
+            c.flags.CF = (x >> Width<T>::BITS) & 1;
+            if (count == 1)
+                c.flags.OF = ((x & Width<T>::SIGN) != 0) != c.flags.CF;
         }
-        update_flags_logical(*d);
-        if (count == 1)
-            flags.OF = (val_before & 0x8000);
-        regs.IP += 2;
-        break;
-    }
-    case OP_SAR_REG_CL:
+    };
+
+    struct Rcr
     {
-        int16_t *d = (int16_t *)FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        template <typename T, class D, class S>
+        static void apply(CPU &c, const D &d, const S &s)
         {
-            flags.CF = (*d & 1);
-            *d >>= 1;
+            constexpr unsigned WIDE = Width<T>::BITS + 1;
+            constexpr uint32_t WIDE_MASK = (1u << WIDE) - 1;
+            uint8_t count = s.get();
+            unsigned n = count % WIDE;
+            uint32_t x = ((uint32_t)c.flags.CF << Width<T>::BITS) | d.get();
+            x = ((x >> n) | (x << (WIDE - n))) & WIDE_MASK;
+            d.set(static_cast<T>(x));
+            c.flags.CF = (x >> Width<T>::BITS) & 1;
+            if (count == 1)
+                c.flags.OF = ((x & Width<T>::SIGN) != 0) != ((x & (Width<T>::SIGN >> 1)) != 0);
         }
-        update_flags_logical(*d);
-        flags.OF = false;
-        regs.IP += 2;
-        break;
+    };
+
+    // --- STRING INSTRUCTIONS ---
+    // one() IS THE ARCHITECTURAL SINGLE STEP. bulk() DOES UP TO count STEPS OVER ONE
+    // CONTIGUOUS RUN OF MEMORY WITH memmove/memset/memchr-STYLE LOOPS, LEAVING SI, DI AND
+    // THE FLAGS EXACTLY WHERE count CALLS OF one() WOULD, AND RETURNS HOW MANY IT DID.
+    // A COMPARE STOPS EARLY ON THE ELEMENT THAT ENDS A REPE/REPNE.
+    template <typename T>
+    static uint16_t string_step(CPU &c) { return c.flags.DF ? 0x10000 - sizeof(T) : sizeof(T); }
+
+    template <typename T>
+    static T read_string(CPU &c, uint16_t segment, uint16_t offset)
+    {
+        if constexpr (sizeof(T) == 2)
+            return c.read_mem16(segment, offset);
+        else
+            return c.read_mem8(segment, offset);
+    }
+
+    template <typename T>
+    static void write_string(CPU &c, uint16_t segment, uint16_t offset, T v)
+    {
+        if constexpr (sizeof(T) == 2)
+            c.write_mem16(segment, offset, v);
+        else
+            c.write_mem8(segment, offset, v);
+    }
+
+    template <typename T>
+    static T load(const uint8_t *p)
+    {
+        if constexpr (sizeof(T) == 2)
+            return p[0] | (p[1] << 8);
+        else
+            return p[0];
+    }
+
+    // ELEMENTS THAT FIT THE CONTIGUOUS RUNS AT DS:SI AND/OR ES:DI, AND THE LOWEST OFFSET OF A RUN
+    template <typename T>
+    static uint32_t run_length(CPU &c, uint32_t count, bool use_si, bool use_di)
+    {
+        if (use_si)
+            count = std::min<uint32_t>(count, c.memory.contiguous(c.regs.DS, c.regs.SI, sizeof(T), c.flags.DF));
+        if (use_di)
+            count = std::min<uint32_t>(count, c.memory.contiguous(c.regs.ES, c.regs.DI, sizeof(T), c.flags.DF));
+        return count;
     }
-    case OP_ROL_REG_CL:
+
+    template <typename T>
+    static uint16_t run_start(CPU &c, uint16_t offset, uint32_t n)
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        return c.flags.DF ? offset - (n - 1) * sizeof(T) : offset;
+    }
+
+    // A RUN THAT TOUCHES A DEVICE PAGE MUST GO THROUGH THE BUS ONE ELEMENT AT A TIME
+    template <typename T>
+    static bool run_hits_device(CPU &c, uint16_t segment, uint16_t offset, uint32_t n)
+    {
+        return c.bus.mapped_range(Memory::physical(segment, run_start<T>(c, offset, n)), n * sizeof(T));
+    }
+
+    template <typename T>
+    struct Movs
+    {
+        static void one(CPU &c)
         {
-            bool msb = (*d & 0x8000);
-            *d = (*d << 1) | msb;
-            flags.CF = msb;
+            write_string<T>(c, c.regs.ES, c.regs.DI, read_string<T>(c, c.regs.DS, c.regs.SI));
+            c.regs.SI += string_step<T>(c);
+            c.regs.DI += string_step<T>(c);
         }
-        if (count % 16 != 0 && count != 0)
+
+        template <class R>
+        static uint32_t bulk(CPU &c, uint32_t count)
         {
-            if (count == 1)
-                flags.OF = (*d & 0x8000) != flags.CF;
+            uint32_t n = run_length<T>(c, count, true, true);
+            if (n == 0 || run_hits_device<T>(c, c.regs.DS, c.regs.SI, n) || run_hits_device<T>(c, c.regs.ES, c.regs.DI, n))
+                return one(c), 1;
+
+            uint16_t src_start = run_start<T>(c, c.regs.SI, n);
+            uint16_t dst_start = run_start<T>(c, c.regs.DI, n);
+            uint32_t src = Memory::physical(c.regs.DS, src_start);
+            uint32_t dst = Memory::physical(c.regs.ES, dst_start);
+            uint32_t bytes = n * sizeof(T);
+
+            // AN ELEMENT-BY-ELEMENT COPY ONLY EQUALS memmove WHEN IT NEVER READS WHAT IT JUST WROTE
+            bool hazard = c.flags.DF ? (dst < src && dst + bytes > src) : (dst > src && dst < src + bytes);
+            if (hazard)
+            {
+                for (uint32_t i = 0; i < n; i++)
+                    one(c);
+                return n;
+            }
+
+            uint8_t *to = c.memory.writable_pointer(c.regs.ES, dst_start);
+            std::memmove(to, c.memory.pointer(c.regs.DS, src_start), bytes);
+            c.regs.SI += n * string_step<T>(c);
+            c.regs.DI += n * string_step<T>(c);
+            return n;
         }
-        regs.IP += 2;
-        break;
-    }
-    case OP_ROR_REG_CL:
+    };
+
+    template <typename T>
+    struct Stos
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        static void one(CPU &c)
         {
-            bool lsb = (*d & 1);
-            *d = (*d >> 1) | (lsb << 15);
-            flags.CF = lsb;
+            write_string<T>(c, c.regs.ES, c.regs.DI, accumulator<T>(c));
+            c.regs.DI += string_step<T>(c);
         }
-        if (count % 16 != 0 && count != 0)
+
+        template <class R>
+        static uint32_t bulk(CPU &c, uint32_t count)
         {
-            if (count == 1)
-                flags.OF = (*d & 0x8000) != (*d & 0x4000);
+            uint32_t n = run_length<T>(c, count, false, true);
+            if (n == 0 || run_hits_device<T>(c, c.regs.ES, c.regs.DI, n))
+                return one(c), 1;
+
+            uint8_t *to = c.memory.writable_pointer(c.regs.ES, run_start<T>(c, c.regs.DI, n));
+            T v = accumulator<T>(c);
+            if constexpr (sizeof(T) == 2)
+            {
+                for (uint32_t i = 0; i < n; i++)
+                {
+                    to[2 * i] = v & 0xFF;
+                    to[2 * i + 1] = v >> 8;
+                }
+            }
+            else
+                std::memset(to, v, n);
+            c.regs.DI += n * string_step<T>(c);
+            return n;
         }
-        regs.IP += 2;
-        break;
-    }
-    case OP_RCL_REG_CL:
+    };
+
+    template <typename T>
+    struct Lods
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        static void one(CPU &c)
         {
-            bool msb = (*d & 0x8000);
-            bool old_cf = flags.CF;
-            *d = (*d << 1) | old_cf;
-            flags.CF = msb;
+            accumulator<T>(c) = read_string<T>(c, c.regs.DS, c.regs.SI);
+            c.regs.SI += string_step<T>(c);
         }
-        if (count % 17 != 0 && count != 0)
+    };
+
+    // REPE KEEPS GOING WHILE ELEMENTS ARE EQUAL, REPNE WHILE THEY DIFFER
+    struct RepE
+    {
+        static constexpr bool WHILE_EQUAL = true;
+        static bool stop(const Flags &f) { return !f.ZF; }
+    };
+    struct RepNE
+    {
+        static constexpr bool WHILE_EQUAL = false;
+        static bool stop(const Flags &f) { return f.ZF; }
+    };
+    struct Rep
+    {
+        static bool stop(const Flags &) { return false; }
+    };
+
+    // INDEX (IN EXECUTION ORDER) OF THE ELEMENT THAT ENDS THE REPEAT, n IF NONE DOES
+    template <class R, class Next>
+    static uint32_t find_stop(CPU &c, uint32_t n, Next next)
+    {
+        for (uint32_t k = 0; k < n; k++)
         {
-            if (count == 1)
-                flags.OF = (*d & 0x8000) != flags.CF;
+            uint32_t i = c.flags.DF ? n - 1 - k : k;
+            if (next(i) != R::WHILE_EQUAL)
+                return k;
         }
-        regs.IP += 2;
-        break;
+        return n;
     }
-    case OP_RCR_REG_CL:
+
+    template <typename T>
+    struct Cmps
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        static void one(CPU &c)
         {
-            bool lsb = (*d & 1);
-            bool old_cf = flags.CF;
-            *d = (*d >> 1) | (old_cf << 15);
-            flags.CF = lsb;
+            T a = read_string<T>(c, c.regs.DS, c.regs.SI);
+            T b = read_string<T>(c, c.regs.ES, c.regs.DI);
+            c.update_flags_sub<T>(a, b, a - b);
+            c.regs.SI += string_step<T>(c);
+            c.regs.DI += string_step<T>(c);
         }
-        if (count % 17 != 0 && count != 0)
+
+        template <class R>
+        static uint32_t bulk(CPU &c, uint32_t count)
         {
-            if (count == 1)
-                flags.OF = (*d & 0x8000) != (*d & 0x4000);
+            uint32_t n = run_length<T>(c, count, true, true);
+            if (n == 0 || run_hits_device<T>(c, c.regs.DS, c.regs.SI, n) || run_hits_device<T>(c, c.regs.ES, c.regs.DI, n))
+                return one(c), 1;
+
+            const uint8_t *a = c.memory.pointer(c.regs.DS, run_start<T>(c, c.regs.SI, n));
+            const uint8_t *b = c.memory.pointer(c.regs.ES, run_start<T>(c, c.regs.DI, n));
+            uint32_t k = find_stop<R>(c, n, [&](uint32_t i)
+                                         { return load<T>(a + i * sizeof(T)) == load<T>(b + i * sizeof(T)); });
+            uint32_t done = k < n ? k + 1 : n;
+
+            // FLAGS OF THE LAST COMPARED PAIR, THEN STEP PAST EVERYTHING DONE
+            c.regs.SI += (done - 1) * string_step<T>(c);
+            c.regs.DI += (done - 1) * string_step<T>(c);
+            one(c);
+            return done;
         }
-        regs.IP += 2;
-        break;
-    }
-    case OP_ROL_REG_IMM:
+    };
+
+    template <typename T>
+    struct Scas
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
+        static void one(CPU &c)
         {
-            bool msb = (*d & 0x8000);
-            *d = (*d << 1) | msb;
-            flags.CF = msb;
+            T a = accumulator<T>(c);
+            T b = read_string<T>(c, c.regs.ES, c.regs.DI);
+            c.update_flags_sub<T>(a, b, a - b);
+            c.regs.DI += string_step<T>(c);
         }
-        if (count == 1)
-            flags.OF = ((*d & 0x8000) != flags.CF);
-        regs.IP += 3;
-        break;
-    }
-    case OP_ROR_REG_IMM:
-    {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
+
+        template <class R>
+        static uint32_t bulk(CPU &c, uint32_t count)
         {
-            bool lsb = (*d & 1);
-            *d = (*d >> 1) | (lsb << 15);
-            flags.CF = lsb;
+            uint32_t n = run_length<T>(c, count, false, true);
+            if (n == 0 || run_hits_device<T>(c, c.regs.ES, c.regs.DI, n))
+                return one(c), 1;
+
+            const uint8_t *b = c.memory.pointer(c.regs.ES, run_start<T>(c, c.regs.DI, n));
+            T a = accumulator<T>(c);
+            uint32_t k;
+            if (sizeof(T) == 1 && !R::WHILE_EQUAL && !c.flags.DF)
+            {
+                // REPNE SCASB FORWARD IS A PLAIN memchr
+                const void *hit = std::memchr(b, a, n);
+                k = hit ? static_cast<const uint8_t *>(hit) - b : n;
+            }
+            else
+                k = find_stop<R>(c, n, [&](uint32_t i)
+                                    { return load<T>(b + i * sizeof(T)) == a; });
+            uint32_t done = k < n ? k + 1 : n;
+
+            c.regs.DI += (done - 1) * string_step<T>(c);
+            one(c);
+            return done;
         }
-        if (count == 1)
-            flags.OF = ((*d & 0x8000) != (*d & 0x4000));
-        regs.IP += 3;
-        break;
+    };
+
+    // --- BRANCH CONDITIONS: Always, IfZ, IfNZ... SEE alu.h ---
+
+    // --- HANDLERS ---
+    template <uint8_t OPC, typename T, class Op, class Dst, class Src>
+    static bool exec(CPU &c)
+    {
+        if (!Dst::template valid<T>(c) || !Src::template valid<T>(c))
+            return unknown(c);
+        auto d = Dst::template at<T>(c);
+        auto s = Src::template at<T>(c);
+        Op::template apply<T>(c, d, s);
+        c.regs.IP += OPCODE_TABLE[OPC].length;
+        return true;
     }
-    case OP_RCL_REG_IMM:
+
+    template <class Cond>
+    static bool jump(CPU &c)
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
-        {
-            bool msb = (*d & 0x8000);
-            bool old_cf = flags.CF;
-            *d = (*d << 1) | old_cf;
-            flags.CF = msb;
-        }
-        if (count == 1)
-            flags.OF = ((*d & 0x8000) != flags.CF);
-        regs.IP += 3;
-        break;
+        c.regs.IP = Cond::test(c.flags.bits) ? fetch16(c, 1) : c.regs.IP + 3;
+        return true;
     }
-    case OP_RCR_REG_IMM:
+
+    // DECREMENT CX, THEN BRANCH WHILE IT IS NON-ZERO AND Cond HOLDS
+    template <class Cond>
+    static bool loop(CPU &c)
     {
-        uint16_t *d = FETCH_REG16_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
-        {
-            bool lsb = (*d & 1);
-            bool old_cf = flags.CF;
-            *d = (*d >> 1) | (old_cf << 15);
-            flags.CF = lsb;
-        }
-        if (count == 1)
-            flags.OF = ((*d & 0x8000) != (*d & 0x4000));
-        regs.IP += 3;
-        break;
+        c.regs.CX--;
+        c.regs.IP = (c.regs.CX != 0 && Cond::test(c.flags.bits)) ? fetch16(c, 1) : c.regs.IP + 3;
+        return true;
     }
-    case OP_ROL_REG8_IMM:
+
+    static bool jcxz(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2) & 0x1F;
-        for (int i = 0; i < count; i++)
-        {
-            bool msb = (*d & 0x80);
-            *d = (*d << 1) | msb;
-            flags.CF = msb;
-        }
-        if (count == 1)
-            flags.OF = ((*d & 0x80) != flags.CF);
-        regs.IP += 3;
-        break;
+        c.regs.IP = c.regs.CX == 0 ? fetch16(c, 1) : c.regs.IP + 3;
+        return true;
     }
-    case OP_ROR_REG8_IMM:
+
+    // DX:AX (AX) / src -> QUOTIENT AX (AL), REMAINDER DX (AH). A ZERO DIVISOR OR A QUOTIENT
+    // THAT DOES NOT FIT RAISES INT 0 (DIVIDE ERROR). THE FLAGS ARE LEFT AS IS.
+    template <uint8_t OPC, typename T, bool SIGNED>
+    static bool divide(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2) & 0x1F;
-        for (int i = 0; i < count; i++)
+        using ST = std::make_signed_t<T>;
+        if (!Reg<1>::template valid<T>(c))
+            return unknown(c);
+        T divisor = Reg<1>::template at<T>(c).get();
+        uint32_t dividend = load_wide<T>(c);
+        if (divisor == 0)
+            return divide_error(c, OPCODE_TABLE[OPC].length);
+
+        int64_t quotient, remainder;
+        if (SIGNED)
         {
-            bool lsb = (*d & 1);
-            *d = (*d >> 1) | (lsb << 7);
-            flags.CF = lsb;
+            int64_t n = sizeof(T) == 2 ? (int64_t)(int32_t)dividend : (int64_t)(int16_t)dividend;
+            quotient = n / (ST)divisor; // TRUNCATES TOWARD ZERO, REMAINDER TAKES THE DIVIDEND'S SIGN
+            remainder = n % (ST)divisor;
+            if (quotient < -(int64_t)Width<T>::SIGN || quotient > (int64_t)Width<T>::SIGN - 1)
+                return divide_error(c, OPCODE_TABLE[OPC].length);
         }
-        if (count == 1)
-            flags.OF = ((*d & 0x80) != (*d & 0x40));
-        regs.IP += 3;
-        break;
-    }
-    case OP_RCL_REG8_IMM:
-    {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2) & 0x1F;
-        for (int i = 0; i < count; i++)
+        else
         {
-            bool msb = (*d & 0x80);
-            bool old_cf = flags.CF;
-            *d = (*d << 1) | old_cf;
-            flags.CF = msb;
+            quotient = dividend / divisor;
+            remainder = dividend % divisor;
+            if (quotient > Width<T>::MAX)
+                return divide_error(c, OPCODE_TABLE[OPC].length);
         }
-        if (count == 1)
-            flags.OF = ((*d & 0x80) != flags.CF);
-        regs.IP += 3;
-        break;
+
+        store_wide<T>(c, ((uint32_t)(T)remainder << Width<T>::BITS) | (T)quotient);
+        c.regs.IP += OPCODE_TABLE[OPC].length;
+        return true;
     }
-    case OP_RCR_REG8_IMM:
+
+    // LIKE THE 8086, THE HANDLER RETURNS TO THE NEXT INSTRUCTION. WITHOUT A HANDLER THE CPU STOPS
+    static bool divide_error(CPU &c, uint8_t length)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2) & 0x1F;
-        for (int i = 0; i < count; i++)
-        {
-            bool lsb = (*d & 1);
-            bool old_cf = flags.CF;
-            *d = (*d >> 1) | (old_cf << 7);
-            flags.CF = lsb;
-        }
-        if (count == 1)
-            flags.OF = ((*d & 0x80) != (*d & 0x40));
-        regs.IP += 3;
-        break;
+        if (c.interrupt(VEC_DIVIDE_ERROR, c.regs.IP + length))
+            return true;
+        c.emit(EVENT_FAULT, FAULT_DIVIDE_ERROR, VEC_DIVIDE_ERROR);
+        return false;
     }
-    case OP_SHL_REG8_IMM:
+
+    // --- INTERRUPTS ---
+    static bool software_interrupt(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
-        {
-            flags.CF = (*d & 0x80);
-            *d <<= 1;
-        }
-        update_flags_logical8(*d);
-        if (count == 1)
-            flags.OF = ((*d & 0x80) != flags.CF);
-        regs.IP += 3;
-        break;
+        uint8_t vector = fetch8(c, 1);
+        if (c.interrupt(vector, c.regs.IP + OPCODE_TABLE[OP_INT].length))
+            return true;
+        c.emit(EVENT_FAULT, FAULT_NO_INT_HANDLER, vector);
+        return false;
     }
 
-    case OP_SHR_REG8_IMM:
+    static bool iret(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        uint8_t val_before = *d;
-        for (int i = 0; i < count; ++i)
-        {
-            flags.CF = (*d & 1);
-            *d >>= 1;
-        }
-        update_flags_logical8(*d);
-        if (count == 1)
-            flags.OF = (val_before & 0x80);
-        regs.IP += 3;
-        break;
+        c.regs.IP = c.pop16();
+        c.regs.CS = c.pop16();
+        c.flags.set_word(c.pop16());
+        c.interrupt_check_at = 0; // IF OR TF MAY BE BACK ON
+        return true;
     }
-    case OP_SAR_REG8_IMM:
+
+    static bool call(CPU &c)
     {
-        int8_t *d = (int8_t *)FETCH_REG8_PTR(1);
-        uint8_t count = FETCH_IMM8(2);
-        for (int i = 0; i < count; ++i)
-        {
-            flags.CF = (*d & 1);
-            *d >>= 1;
-        }
-        update_flags_logical8(*d);
-        flags.OF = false;
-        regs.IP += 3;
-        break;
+        uint16_t target = fetch16(c, 1);
+        uint16_t ret_addr = c.regs.IP + 3;
+        c.regs.SP -= 2;
+        c.write_mem16(c.regs.SS, c.regs.SP, ret_addr);
+        c.regs.IP = target;
+        return true;
     }
-    case OP_SHL_REG8_CL:
+
+    static bool ret(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
-        {
-            flags.CF = (*d & 0x80);
-            *d <<= 1;
-        }
-        update_flags_logical8(*d);
-        if (count == 1)
-            flags.OF = ((*d & 0x80) != flags.CF);
-        regs.IP += 2;
-        break;
+        c.regs.IP = c.read_mem16(c.regs.SS, c.regs.SP);
+        c.regs.SP += 2;
+        return true;
     }
-    case OP_SHR_REG8_CL:
+
+    template <uint8_t OPC, class S>
+    static bool string_once(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        uint8_t val_before = *d;
-        for (int i = 0; i < count; ++i)
-        {
-            flags.CF = (*d & 1);
-            *d >>= 1;
-        }
-        update_flags_logical8(*d);
-        if (count == 1)
-            flags.OF = (val_before & 0x80);
-        regs.IP += 2;
-        break;
+        S::one(c);
+        c.regs.IP += OPCODE_TABLE[OPC].length;
+        return true;
     }
-    case OP_SAR_REG8_CL:
+
+    // THE WHOLE REPEAT RUNS INSIDE ONE step(), ONE CONTIGUOUS RUN AT A TIME
+    template <uint8_t OPC, class S, class R>
+    static bool string_rep(CPU &c)
     {
-        int8_t *d = (int8_t *)FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
+        while (c.regs.CX != 0)
         {
-            flags.CF = (*d & 1);
-            *d >>= 1;
+            c.regs.CX -= S::template bulk<R>(c, c.regs.CX);
+            if (R::stop(c.flags))
+                break;
         }
-        update_flags_logical8(*d);
-        flags.OF = false;
-        regs.IP += 2;
-        break;
+        c.regs.IP += OPCODE_TABLE[OPC].length;
+        return true;
     }
-    case OP_ROL_REG8_CL:
+
+    static bool nop(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
-        {
-            bool msb = (*d & 0x80);
-            *d = (*d << 1) | msb;
-            flags.CF = msb;
-        }
-        if (count % 8 != 0 && count != 0)
-        {
-            if (count == 1)
-                flags.OF = ((*d & 0x80) != flags.CF);
-        }
-        regs.IP += 2;
-        break;
+        c.regs.IP += OPCODE_TABLE[OP_NOP].length;
+        return true;
     }
-    case OP_ROR_REG8_CL:
+
+    static bool halt(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
-        {
-            bool lsb = (*d & 1);
-            *d = (*d >> 1) | (lsb << 7);
-            flags.CF = lsb;
-        }
-        if (count % 8 != 0 && count != 0)
-        {
-            if (count == 1)
-                flags.OF = ((*d & 0x80) != (*d & 0x40));
-        }
-        regs.IP += 2;
-        break;
+        c.emit(EVENT_HALT);
+        return false;
     }
-    case OP_RCL_REG8_CL:
+
+    static bool unknown(CPU &c)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
-        {
-            bool msb = (*d & 0x80);
-            bool old_cf = flags.CF;
-            *d = (*d << 1) | old_cf;
-            flags.CF = msb;
-        }
-        if (count % 9 != 0 && count != 0)
-        {
-            if (count == 1)
-                flags.OF = ((*d & 0x80) != flags.CF);
-        }
-        regs.IP += 2;
-        break;
+        c.emit(EVENT_UNKNOWN_OPCODE, fetch8(c, 0));
+        return false;
     }
-    case OP_RCR_REG8_CL:
+};
+
+// ===============================================================
+// == DISPATCH TABLE, BUILT AT COMPILE TIME
+// ===============================================================
+static constexpr std::array<Exec::Handler, 256> make_dispatch_table()
+{
+    using E = Exec;
+    std::array<Exec::Handler, 256> t{};
+    for (auto &handler : t)
+        handler = &E::unknown;
+
+#define ON(OPC, T, OP, DST, ...) t[OPC] = &E::exec<OPC, T, E::OP, E::DST, E::__VA_ARGS__>
+
+    // ===============================================================
+    // == PART 1: PROGRAM CONTROLL BRANCH
+    // ===============================================================
+    t[OP_HALT] = &E::halt;
+    t[OP_NOP] = &E::nop;
+    t[OP_JMP] = &E::jump<Always>;
+    t[OP_CALL] = &E::call;
+    t[OP_INT] = &E::software_interrupt;
+    t[OP_IRET] = &E::iret;
+    t[OP_RET] = &E::ret;
+    t[OP_JZ] = &E::jump<IfZ>;
+    t[OP_JNZ] = &E::jump<IfNZ>;
+    t[OP_JC] = &E::jump<IfC>;
+    t[OP_JNC] = &E::jump<IfNC>;
+    t[OP_JS] = &E::jump<IfS>;
+    t[OP_JNS] = &E::jump<IfNS>;
+    t[OP_JO] = &E::jump<IfO>;
+    t[OP_JNO] = &E::jump<IfNO>;
+    t[OP_JA] = &E::jump<IfA>;
+    t[OP_JBE] = &E::jump<IfBE>;
+    t[OP_JG] = &E::jump<IfG>;
+    t[OP_JGE] = &E::jump<IfGE>;
+    t[OP_JL] = &E::jump<IfL>;
+    t[OP_JLE] = &E::jump<IfLE>;
+    t[OP_LOOP] = &E::loop<Always>;
+    t[OP_LOOPZ] = &E::loop<IfZ>;
+    t[OP_LOOPNZ] = &E::loop<IfNZ>;
+    t[OP_JCXZ] = &E::jcxz;
+
+    // ===============================================================
+    // == PART 2: DATA TRANSFER
+    // ===============================================================
+    ON(OP_MOV_REG_IMM, uint16_t, Mov, Reg<1>, Imm<2>);
+    ON(OP_MOV_REG_REG, uint16_t, Mov, Reg<1>, Reg<2>);
+    ON(OP_MOV_REG8_IMM, uint8_t, Mov, Reg<1>, Imm<2>);
+    ON(OP_MOV_REG8_REG8, uint8_t, Mov, Reg<1>, Reg<2>);
+    ON(OP_MOV_REG_FROM_MEM_IMM, uint16_t, Mov, Reg<1>, MemImm<2>);
+    ON(OP_MOV_MEM_IMM_FROM_REG, uint16_t, Mov, MemImm<2>, Reg<1>);
+    ON(OP_MOV_REG_FROM_MEM_REG, uint16_t, Mov, Reg<1>, MemReg<2>);
+    ON(OP_MOV_MEM_REG_FROM_REG, uint16_t, Mov, MemReg<2>, Reg<1>);
+    ON(OP_MOV_REG8_FROM_MEM_IMM, uint8_t, Mov, Reg<1>, MemImm<2>);
+    ON(OP_MOV_MEM_IMM_FROM_REG8, uint8_t, Mov, MemImm<2>, Reg<1>);
+    ON(OP_MOV_REG8_FROM_MEM_REG, uint8_t, Mov, Reg<1>, MemReg<2>);
+    ON(OP_MOV_MEM_REG_FROM_REG8, uint8_t, Mov, MemReg<2>, Reg<1>);
+    ON(OP_MOV_REG_FROM_MEM_REG_REG, uint16_t, Mov, Reg<1>, MemRegReg<2>);
+    ON(OP_MOV_MEM_REG_REG_FROM_REG, uint16_t, Mov, MemRegReg<2>, Reg<1>);
+    ON(OP_MOV_REG_FROM_MEM_REG_IMM, uint16_t, Mov, Reg<1>, MemRegImm<2>);
+    ON(OP_MOV_MEM_REG_IMM_FROM_REG, uint16_t, Mov, MemRegImm<2>, Reg<1>);
+    ON(OP_MOV_REG8_FROM_MEM_REG_IMM, uint8_t, Mov, Reg<1>, MemRegImm<2>);
+    ON(OP_MOV_MEM_REG_IMM_FROM_REG8, uint8_t, Mov, MemRegImm<2>, Reg<1>);
+    ON(OP_XCHG_REG_REG, uint16_t, Xchg, Reg<1>, Reg<2>);
+    ON(OP_XCHG_REG8_REG8, uint8_t, Xchg, Reg<1>, Reg<2>);
+    ON(OP_XCHG_REG_MEM_REG, uint16_t, LockXchg, Reg<1>, MemReg<2>);
+
+    // ===============================================================
+    // == PART 3: ADVANCED ADRESSING MODES
+    // ===============================================================
+    ON(OP_MOV_MEM_IMM_FROM_IMM, uint16_t, Mov, MemImm<1>, Imm<3>);
+    ON(OP_MOV_MEM_IMM_FROM_IMM8, uint8_t, Mov, MemImm<1>, Imm<3>);
+
+    // SEGMENT REGISTERS
+    ON(OP_MOV_SREG_REG, uint16_t, Mov, Seg<1>, Reg<2>);
+    ON(OP_MOV_REG_SREG, uint16_t, Mov, Reg<1>, Seg<2>);
+
+    // ===============================================================
+    // == PART 4: STACK OPERATIONS
+    // ===============================================================
+    ON(OP_PUSH_REG, uint16_t, Push, None, Reg<1>);
+    ON(OP_POP_REG, uint16_t, Pop, Reg<1>, None);
+    ON(OP_PUSH_SREG, uint16_t, Push, None, Seg<1>);
+    ON(OP_POP_SREG, uint16_t, Pop, Seg<1>, None);
+
+    // ===============================================================
+    // == PART 4.4: PORT I/O
+    // ===============================================================
+    ON(OP_IN_REG8_PORT, uint8_t, In, Reg<1>, Port<2>);
+    ON(OP_IN_REG_PORT, uint16_t, In, Reg<1>, Port<2>);
+    ON(OP_OUT_PORT_REG8, uint8_t, Out, Port<2>, Reg<1>);
+    ON(OP_OUT_PORT_REG, uint16_t, Out, Port<2>, Reg<1>);
+    ON(OP_IN_REG8_DX, uint8_t, In, Reg<1>, PortDX);
+    ON(OP_IN_REG_DX, uint16_t, In, Reg<1>, PortDX);
+    ON(OP_OUT_DX_REG8, uint8_t, Out, PortDX, Reg<1>);
+    ON(OP_OUT_DX_REG, uint16_t, Out, PortDX, Reg<1>);
+
+    // ===============================================================
+    // == PART 4.5: STRING OPERATIONS
+    // ===============================================================
+    t[OP_MOVSB] = &E::string_once<OP_MOVSB, E::Movs<uint8_t>>;
+    t[OP_MOVSW] = &E::string_once<OP_MOVSW, E::Movs<uint16_t>>;
+    t[OP_STOSB] = &E::string_once<OP_STOSB, E::Stos<uint8_t>>;
+    t[OP_STOSW] = &E::string_once<OP_STOSW, E::Stos<uint16_t>>;
+    t[OP_LODSB] = &E::string_once<OP_LODSB, E::Lods<uint8_t>>;
+    t[OP_LODSW] = &E::string_once<OP_LODSW, E::Lods<uint16_t>>;
+    t[OP_CMPSB] = &E::string_once<OP_CMPSB, E::Cmps<uint8_t>>;
+    t[OP_CMPSW] = &E::string_once<OP_CMPSW, E::Cmps<uint16_t>>;
+    t[OP_SCASB] = &E::string_once<OP_SCASB, E::Scas<uint8_t>>;
+    t[OP_SCASW] = &E::string_once<OP_SCASW, E::Scas<uint16_t>>;
+    t[OP_REP_MOVSB] = &E::string_rep<OP_REP_MOVSB, E::Movs<uint8_t>, E::Rep>;
+    t[OP_REP_MOVSW] = &E::string_rep<OP_REP_MOVSW, E::Movs<uint16_t>, E::Rep>;
+    t[OP_REP_STOSB] = &E::string_rep<OP_REP_STOSB, E::Stos<uint8_t>, E::Rep>;
+    t[OP_REP_STOSW] = &E::string_rep<OP_REP_STOSW, E::Stos<uint16_t>, E::Rep>;
+    t[OP_REPE_CMPSB] = &E::string_rep<OP_REPE_CMPSB, E::Cmps<uint8_t>, E::RepE>;
+    t[OP_REPE_CMPSW] = &E::string_rep<OP_REPE_CMPSW, E::Cmps<uint16_t>, E::RepE>;
+    t[OP_REPNE_CMPSB] = &E::string_rep<OP_REPNE_CMPSB, E::Cmps<uint8_t>, E::RepNE>;
+    t[OP_REPNE_CMPSW] = &E::string_rep<OP_REPNE_CMPSW, E::Cmps<uint16_t>, E::RepNE>;
+    t[OP_REPE_SCASB] = &E::string_rep<OP_REPE_SCASB, E::Scas<uint8_t>, E::RepE>;
+    t[OP_REPE_SCASW] = &E::string_rep<OP_REPE_SCASW, E::Scas<uint16_t>, E::RepE>;
+    t[OP_REPNE_SCASB] = &E::string_rep<OP_REPNE_SCASB, E::Scas<uint8_t>, E::RepNE>;
+    t[OP_REPNE_SCASW] = &E::string_rep<OP_REPNE_SCASW, E::Scas<uint16_t>, E::RepNE>;
+
+    // ===============================================================
+    // == PART 5: ARITHMETIC LOGICAL OPERATIONS
+    // ===============================================================
+    ON(OP_ADD_REG_REG, uint16_t, Add, Reg<1>, Reg<2>);
+    ON(OP_ADD_REG_IMM, uint16_t, Add, Reg<1>, Imm<2>);
+    ON(OP_SUB_REG_REG, uint16_t, Sub, Reg<1>, Reg<2>);
+    ON(OP_SUB_REG_IMM, uint16_t, Sub, Reg<1>, Imm<2>);
+    ON(OP_ADC_REG_REG, uint16_t, Adc, Reg<1>, Reg<2>);
+    ON(OP_ADC_REG_IMM, uint16_t, Adc, Reg<1>, Imm<2>);
+    ON(OP_SBB_REG_REG, uint16_t, Sbb, Reg<1>, Reg<2>);
+    ON(OP_SBB_REG_IMM, uint16_t, Sbb, Reg<1>, Imm<2>);
+    ON(OP_CMP_REG_REG, uint16_t, Cmp, Reg<1>, Reg<2>);
+    ON(OP_CMP_REG_IMM, uint16_t, Cmp, Reg<1>, Imm<2>);
+    ON(OP_AND_REG_REG, uint16_t, And, Reg<1>, Reg<2>);
+    ON(OP_AND_REG_IMM, uint16_t, And, Reg<1>, Imm<2>);
+    ON(OP_OR_REG_REG, uint16_t, Or, Reg<1>, Reg<2>);
+    ON(OP_OR_REG_IMM, uint16_t, Or, Reg<1>, Imm<2>);
+    ON(OP_XOR_REG_REG, uint16_t, Xor, Reg<1>, Reg<2>);
+    ON(OP_XOR_REG_IMM, uint16_t, Xor, Reg<1>, Imm<2>);
+    ON(OP_NEG_REG16, uint16_t, Neg, Reg<1>, None);
+    ON(OP_NOT_REG, uint16_t, Not, Reg<1>, None);
+    ON(OP_INC_REG, uint16_t, Inc, Reg<1>, None);
+    ON(OP_DEC_REG, uint16_t, Dec, Reg<1>, None);
+    ON(OP_MUL_REG, uint16_t, Mul, None, Reg<1>);
+    ON(OP_IMUL_REG, uint16_t, Imul, None, Reg<1>);
+    t[OP_DIV_REG] = &E::divide<OP_DIV_REG, uint16_t, false>;
+    t[OP_IDIV_REG] = &E::divide<OP_IDIV_REG, uint16_t, true>;
+
+    ON(OP_ADD_REG8_REG8, uint8_t, Add, Reg<1>, Reg<2>);
+    ON(OP_ADD_REG8_IMM, uint8_t, Add, Reg<1>, Imm<2>);
+    ON(OP_SUB_REG8_REG8, uint8_t, Sub, Reg<1>, Reg<2>);
+    ON(OP_SUB_REG8_IMM, uint8_t, Sub, Reg<1>, Imm<2>);
+    ON(OP_ADC_REG8_REG8, uint8_t, Adc, Reg<1>, Reg<2>);
+    ON(OP_ADC_REG8_IMM, uint8_t, Adc, Reg<1>, Imm<2>);
+    ON(OP_SBB_REG8_REG8, uint8_t, Sbb, Reg<1>, Reg<2>);
+    ON(OP_SBB_REG8_IMM, uint8_t, Sbb, Reg<1>, Imm<2>);
+    ON(OP_CMP_REG8_REG8, uint8_t, Cmp, Reg<1>, Reg<2>);
+    ON(OP_CMP_REG8_IMM, uint8_t, Cmp, Reg<1>, Imm<2>);
+    ON(OP_AND_REG8_REG8, uint8_t, And, Reg<1>, Reg<2>);
+    ON(OP_AND_REG8_IMM, uint8_t, And, Reg<1>, Imm<2>);
+    ON(OP_OR_REG8_REG8, uint8_t, Or, Reg<1>, Reg<2>);
+    ON(OP_OR_REG8_IMM, uint8_t, Or, Reg<1>, Imm<2>);
+    ON(OP_XOR_REG8_REG8, uint8_t, Xor, Reg<1>, Reg<2>);
+    ON(OP_XOR_REG8_IMM, uint8_t, Xor, Reg<1>, Imm<2>);
+    ON(OP_NEG_REG8, uint8_t, Neg, Reg<1>, None);
+    ON(OP_NOT_REG8, uint8_t, Not, Reg<1>, None);
+    ON(OP_INC_REG8, uint8_t, Inc, Reg<1>, None);
+    ON(OP_DEC_REG8, uint8_t, Dec, Reg<1>, None);
+    ON(OP_MUL_REG8, uint8_t, Mul, None, Reg<1>);
+    ON(OP_IMUL_REG8, uint8_t, Imul, None, Reg<1>);
+    t[OP_DIV_REG8] = &E::divide<OP_DIV_REG8, uint8_t, false>;
+    t[OP_IDIV_REG8] = &E::divide<OP_IDIV_REG8, uint8_t, true>;
+
+    // ===============================================================
+    // == PART 6: BIT SHIFTING AND ROTATE
+    // ===============================================================
+    ON(OP_SHL_REG_IMM, uint16_t, Shl, Reg<1>, Count<2>);
+    ON(OP_SHR_REG_IMM, uint16_t, Shr, Reg<1>, Count<2>);
+    ON(OP_SAR_REG_IMM, uint16_t, Sar, Reg<1>, Count<2>);
+    ON(OP_ROL_REG_IMM, uint16_t, Rol, Reg<1>, Count<2>);
+    ON(OP_ROR_REG_IMM, uint16_t, Ror, Reg<1>, Count<2>);
+    ON(OP_RCL_REG_IMM, uint16_t, Rcl, Reg<1>, Count<2>);
+    ON(OP_RCR_REG_IMM, uint16_t, Rcr, Reg<1>, Count<2>);
+    ON(OP_SHL_REG_CL, uint16_t, Shl, Reg<1>, CountCL);
+    ON(OP_SHR_REG_CL, uint16_t, Shr, Reg<1>, CountCL);
+    ON(OP_SAR_REG_CL, uint16_t, Sar, Reg<1>, CountCL);
+    ON(OP_ROL_REG_CL, uint16_t, Rol, Reg<1>, CountCL);
+    ON(OP_ROR_REG_CL, uint16_t, Ror, Reg<1>, CountCL);
+    ON(OP_RCL_REG_CL, uint16_t, Rcl, Reg<1>, CountCL);
+    ON(OP_RCR_REG_CL, uint16_t, Rcr, Reg<1>, CountCL);
+
+    ON(OP_SHL_REG8_IMM, uint8_t, Shl, Reg<1>, Count<2>);
+    ON(OP_SHR_REG8_IMM, uint8_t, Shr, Reg<1>, Count<2>);
+    ON(OP_SAR_REG8_IMM, uint8_t, Sar, Reg<1>, Count<2>);
+    ON(OP_ROL_REG8_IMM, uint8_t, Rol, Reg<1>, Count<2, 0x1F>);
+    ON(OP_ROR_REG8_IMM, uint8_t, Ror, Reg<1>, Count<2, 0x1F>);
+    ON(OP_RCL_REG8_IMM, uint8_t, Rcl, Reg<1>, Count<2, 0x1F>);
+    ON(OP_RCR_REG8_IMM, uint8_t, Rcr, Reg<1>, Count<2, 0x1F>);
+    ON(OP_SHL_REG8_CL, uint8_t, Shl, Reg<1>, CountCL);
+    ON(OP_SHR_REG8_CL, uint8_t, Shr, Reg<1>, CountCL);
+    ON(OP_SAR_REG8_CL, uint8_t, Sar, Reg<1>, CountCL);
+    ON(OP_ROL_REG8_CL, uint8_t, Rol, Reg<1>, CountCL);
+    ON(OP_ROR_REG8_CL, uint8_t, Ror, Reg<1>, CountCL);
+    ON(OP_RCL_REG8_CL, uint8_t, Rcl, Reg<1>, CountCL);
+    ON(OP_RCR_REG8_CL, uint8_t, Rcr, Reg<1>, CountCL);
+
+    // ===============================================================
+    // == PART 7: FLAGS
+    // ===============================================================
+    ON(OP_PUSHF, uint16_t, Pushf, None, None);
+    ON(OP_POPF, uint16_t, Popf, None, None);
+    ON(OP_LAHF, uint16_t, Lahf, None, None);
+    ON(OP_SAHF, uint16_t, Sahf, None, None);
+    ON(OP_CLC, uint16_t, Clc, None, None);
+    ON(OP_STC, uint16_t, Stc, None, None);
+    ON(OP_CMC, uint16_t, Cmc, None, None);
+    ON(OP_CLD, uint16_t, Cld, None, None);
+    ON(OP_STD, uint16_t, Std, None, None);
+    ON(OP_CLI, uint16_t, Cli, None, None);
+    ON(OP_STI, uint16_t, Sti, None, None);
+
+    // ===============================================================
+    // == PART 8: MEMORY READ-MODIFY-WRITE, PLAIN AND LOCKED
+    // ===============================================================
+    ON(OP_ADD_MEM_REG_FROM_REG, uint16_t, Add, MemReg<2>, Reg<1>);
+    ON(OP_SUB_MEM_REG_FROM_REG, uint16_t, Sub, MemReg<2>, Reg<1>);
+    ON(OP_AND_MEM_REG_FROM_REG, uint16_t, And, MemReg<2>, Reg<1>);
+    ON(OP_OR_MEM_REG_FROM_REG, uint16_t, Or, MemReg<2>, Reg<1>);
+    ON(OP_XOR_MEM_REG_FROM_REG, uint16_t, Xor, MemReg<2>, Reg<1>);
+    ON(OP_LOCK_ADD_MEM_REG_FROM_REG, uint16_t, LockAdd, MemReg<2>, Reg<1>);
+    ON(OP_LOCK_SUB_MEM_REG_FROM_REG, uint16_t, LockSub, MemReg<2>, Reg<1>);
+    ON(OP_LOCK_AND_MEM_REG_FROM_REG, uint16_t, LockAnd, MemReg<2>, Reg<1>);
+    ON(OP_LOCK_OR_MEM_REG_FROM_REG, uint16_t, LockOr, MemReg<2>, Reg<1>);
+    ON(OP_LOCK_XOR_MEM_REG_FROM_REG, uint16_t, LockXor, MemReg<2>, Reg<1>);
+
+#undef ON
+    return t;
+}
+
+static constexpr std::array<Exec::Handler, 256> DISPATCH_TABLE = make_dispatch_table();
+
+// THE DISASSEMBLER AND THE CPU MUST AGREE ON WHICH OPCODES EXIST
+static constexpr bool dispatch_matches_opcode_table()
+{
+    for (int i = 0; i < 256; i++)
+        if ((OPCODE_TABLE[i].layout == LAYOUT_INVALID) != (DISPATCH_TABLE[i] == &Exec::unknown))
+            return false;
+    return true;
+}
+static_assert(dispatch_matches_opcode_table(), "OPCODE_TABLE and DISPATCH_TABLE disagree");
+
+inline bool CPU::execute()
+{
+    instruction = memory.fetch(regs.CS, regs.IP, fetch_buffer);
+    instructions++;
+    return DISPATCH_TABLE[instruction[0]](*this);
+}
+
+// ===============================================================
+// == INTERRUPTS
+// ===============================================================
+void Flags::set_word(uint16_t value)
+{
+    bits = (value & (BIT_CF | BIT_ZF | BIT_SF | BIT_TF | BIT_IF | BIT_DF | BIT_OF)) | BIT_RESERVED;
+    parity_source = (value & BIT_PF) ? 0x00 : 0x01; // ANY BYTE WITH THE WANTED PARITY
+    aux_source = value & BIT_AF;
+}
+
+void CPU::push16(uint16_t value)
+{
+    regs.SP -= 2;
+    write_mem16(regs.SS, regs.SP, value);
+}
+
+uint16_t CPU::pop16()
+{
+    uint16_t value = read_mem16(regs.SS, regs.SP);
+    regs.SP += 2;
+    return value;
+}
+
+// PUSH FLAGS, CS, return_ip AND JUMP THROUGH THE VECTOR. FALSE WHEN THE VECTOR IS EMPTY
+bool CPU::interrupt(uint8_t vector, uint16_t return_ip)
+{
+    uint16_t offset = memory.read16(0, vector * 4);
+    uint16_t segment = memory.read16(0, vector * 4 + 2);
+    if (offset == 0 && segment == 0)
+        return false;
+
+    emit(EVENT_INTERRUPT, vector);
+    push16(flags.word());
+    push16(regs.CS);
+    push16(return_ip);
+    flags.IF = false;
+    flags.TF = false;
+    regs.CS = segment;
+    regs.IP = offset;
+    interrupt_check_at = 0;
+    return true;
+}
+
+// THE DEVICE INTERRUPT TO TAKE BEFORE THE NEXT INSTRUCTION (IF IS SET): THE LOWEST PENDING
+// LINE, OR THE LOGGED ONE WHILE REPLAYING
+bool CPU::device_interrupt(uint8_t &vector)
+{
+    if (input_log && input_log->replaying())
+        return input_log->replay(InputLog::DEVICE_INTERRUPT, instructions, vector);
+    uint8_t lines = pic->pending(instructions);
+    if (!lines)
+        return false;
+    int line = 0;
+    while (!(lines & (1 << line)))
+        line++;
+    vector = InterruptController::VECTOR_BASE + line;
+    if (input_log)
+        input_log->record(InputLog::DEVICE_INTERRUPT, instructions, vector);
+    return true;
+}
+
+// step() WHEN instructions >= interrupt_check_at: TAKE WHAT IS PENDING, THEN RUN ONE INSTRUCTION.
+// KEPT OUT OF step() SO THE COMMON PATH NEEDS NO STACK FRAME
+bool CPU::interrupt_then_execute()
+{
+    if (trap_armed)
     {
-        uint8_t *d = FETCH_REG8_PTR(1);
-        uint8_t count = regs.CL;
-        for (int i = 0; i < count; ++i)
-        {
-            bool lsb = (*d & 1);
-            bool old_cf = flags.CF;
-            *d = (*d >> 1) | (old_cf << 7);
-            flags.CF = lsb;
-        }
-        if (count % 9 != 0 && count != 0)
+        trap_armed = false;
+        if (!interrupt(VEC_SINGLE_STEP, regs.IP))
         {
-            if (count == 1)
-                flags.OF = ((*d & 0x80) != (*d & 0x40));
+            emit(EVENT_FAULT, FAULT_NO_TRAP_HANDLER, VEC_SINGLE_STEP);
+            return false;
         }
-        regs.IP += 2;
-        break;
     }
 
-    default:
+    uint8_t vector;
+    if (flags.IF && device_interrupt(vector))
     {
-        std::cerr << "ERROR: Unknown OPCODE 0x" << std::hex << std::setw(2) << std::setfill('0')
-                  << (int)opcode << " at address 0x" << std::setw(4) << (int)regs.IP << std::dec << std::endl;
-        return false;
-    }
+        if (!interrupt(vector, regs.IP))
+        {
+            emit(EVENT_FAULT, FAULT_NO_IRQ_HANDLER, vector - InterruptController::VECTOR_BASE);
+            return false;
+        }
     }
-    return true;
+
+    // THE NEXT TIME ANYTHING CAN HAPPEN WITHOUT AN INSTRUCTION TOUCHING A DEVICE OR IF/TF
+    trap_armed = flags.TF;
+    if (trap_armed)
+        interrupt_check_at = instructions + 1;
+    else if (flags.IF)
+        interrupt_check_at = input_log && input_log->replaying() ? input_log->next_at() : pic->next_event(instructions);
+    else
+        interrupt_check_at = UINT64_MAX;
+    return execute();
+}
+
+void CPU::emit(CpuEventKind kind, uint8_t code, uint16_t value, uint32_t address)
+{
+    events->on_event(CpuEvent{kind, code, regs.CS, regs.IP, value, address, instructions});
+}
+
+void CPU::load_program(const uint8_t *code, size_t size)
+{
+    memory.load(Memory::physical(PROGRAM_SEGMENT, 0), code, size);
+    start_program();
+}
+
+void CPU::start_program()
+{
+    regs.CS = regs.DS = regs.ES = regs.SS = PROGRAM_SEGMENT;
+    regs.IP = 0;
+    interrupt_check_at = 0;
+}
+
+void CPU::save_snapshot(CpuSnapshot &snapshot) const
+{
+    snapshot.regs = regs;
+    snapshot.flags = flags;
+    snapshot.memory = memory;
+    snapshot.instructions = instructions;
+}
+
+void CPU::restore_snapshot(const CpuSnapshot &snapshot)
+{
+    regs = snapshot.regs;
+    flags = snapshot.flags;
+    memory = snapshot.memory;
+    instructions = snapshot.instructions;
+    bus.reset();
+    trap_armed = false;
+    interrupt_check_at = 0;
+}
+
+bool CPU::step()
+{
+    // THE ONLY COST OF INTERRUPT SUPPORT FOR PROGRAMS THAT NEVER ENABLE THEM
+    if (instructions >= interrupt_check_at)
+        return interrupt_then_execute();
+    return execute();
 }
 
 void CPU::run()
@@ -1272,7 +1664,6 @@ void CPU::run()
     while (step())
     {
     }
-    std::cout << "CPU Halted." << std::endl;
 }
 
 //  case OP_MOV_REG_IMM:
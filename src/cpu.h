@@ -1,6 +1,11 @@
 #pragma once
 #include <cstdint>
+#include <mutex>
 #include <vector>
+#include "memory.h"
+#include "devices.h"
+#include "events.h"
+#include "replay.h"
 
 enum OpCode
 {
@@ -116,6 +121,16 @@ enum OpCode
     OP_SBB_REG_REG = 0x5A,
     OP_SBB_REG_IMM = 0x5B,
 
+    // MULTIPLY DIVIDE, 16-BIT: DX:AX, 8-BIT: AH:AL
+    OP_MUL_REG = 0xC0,
+    OP_IMUL_REG = 0xC1,
+    OP_DIV_REG = 0xC2,
+    OP_IDIV_REG = 0xC3,
+    OP_MUL_REG8 = 0xC4,
+    OP_IMUL_REG8 = 0xC5,
+    OP_DIV_REG8 = 0xC6,
+    OP_IDIV_REG8 = 0xC7,
+
     // FUNCTION CALL, BRANCH
     OP_CALL = 0x60,
     OP_RET = 0x61,
@@ -128,6 +143,18 @@ enum OpCode
     OP_JNS = 0x66,
     OP_JO = 0x67,
     OP_JNO = 0x68,
+    OP_JA = 0xCC,  // JNBE, UNSIGNED >
+    OP_JBE = 0xCD, // JNA,  UNSIGNED <=
+    OP_JG = 0xCE,  // JNLE, SIGNED >
+    OP_JGE = 0xCF, // JNL,  SIGNED >=
+    OP_JL = 0xD0,  // JNGE, SIGNED <
+    OP_JLE = 0xD1, // JNG,  SIGNED <=
+
+    // LOOPS (CX IS THE COUNTER)
+    OP_LOOP = 0xC8,
+    OP_LOOPZ = 0xC9,
+    OP_LOOPNZ = 0xCA,
+    OP_JCXZ = 0xCB,
 
     // SYSTEM
     OP_NOP = 0xFF,
@@ -155,7 +182,80 @@ enum OpCode
     OP_MOV_REG_FROM_MEM_REG_IMM = 0x92,
     OP_MOV_MEM_REG_IMM_FROM_REG = 0x93,
     OP_MOV_REG8_FROM_MEM_REG_IMM = 0x94,
-    OP_MOV_MEM_REG_IMM_FROM_REG8 = 0x95
+    OP_MOV_MEM_REG_IMM_FROM_REG8 = 0x95,
+
+    // SEGMENT REGISTERS
+    OP_MOV_SREG_REG = 0x96,
+    OP_MOV_REG_SREG = 0x97,
+    OP_PUSH_SREG = 0x98,
+    OP_POP_SREG = 0x99,
+
+    // STRING INSTRUCTIONS, SOURCE DS:[SI], DESTINATION ES:[DI]
+    OP_MOVSB = 0xA0,
+    OP_MOVSW = 0xA1,
+    OP_STOSB = 0xA2,
+    OP_STOSW = 0xA3,
+    OP_LODSB = 0xA4,
+    OP_LODSW = 0xA5,
+    OP_CMPSB = 0xA6,
+    OP_CMPSW = 0xA7,
+    OP_SCASB = 0xA8,
+    OP_SCASW = 0xA9,
+
+    // REPEATED STRING INSTRUCTIONS (PREFIX FUSED INTO THE OPCODE), COUNT IN CX
+    OP_REP_MOVSB = 0xB0,
+    OP_REP_MOVSW = 0xB1,
+    OP_REP_STOSB = 0xB2,
+    OP_REP_STOSW = 0xB3,
+    OP_REPE_CMPSB = 0xB4,
+    OP_REPE_CMPSW = 0xB5,
+    OP_REPNE_CMPSB = 0xB6,
+    OP_REPNE_CMPSW = 0xB7,
+    OP_REPE_SCASB = 0xB8,
+    OP_REPE_SCASW = 0xB9,
+    OP_REPNE_SCASB = 0xBA,
+    OP_REPNE_SCASW = 0xBB,
+
+    // PORT I/O (PORT = imm8 OR DX)
+    OP_IN_REG8_PORT = 0xD2,
+    OP_IN_REG_PORT = 0xD3,
+    OP_OUT_PORT_REG8 = 0xD4,
+    OP_OUT_PORT_REG = 0xD5,
+    OP_IN_REG8_DX = 0xD6,
+    OP_IN_REG_DX = 0xD7,
+    OP_OUT_DX_REG8 = 0xD8,
+    OP_OUT_DX_REG = 0xD9,
+
+    // INTERRUPTS
+    OP_INT = 0xDA,
+    OP_IRET = 0xDB,
+    OP_CLI = 0xDC,
+    OP_STI = 0xDD,
+
+    // FLAGS
+    OP_PUSHF = 0xDE,
+    OP_POPF = 0xDF,
+    OP_LAHF = 0xE0,
+    OP_SAHF = 0xE1,
+    OP_CLC = 0xE2,
+    OP_STC = 0xE3,
+    OP_CMC = 0xE4,
+    OP_CLD = 0xE5,
+    OP_STD = 0xE6,
+
+    // MEMORY DESTINATION READ-MODIFY-WRITE, [reg16] <- [reg16] op reg16. THE LOCK PREFIX IS
+    // FUSED INTO THE OPCODE LIKE REP; XCHG WITH MEMORY IS ALWAYS LOCKED. SEE smp.h
+    OP_XCHG_REG_MEM_REG = 0xE7,
+    OP_ADD_MEM_REG_FROM_REG = 0xE8,
+    OP_SUB_MEM_REG_FROM_REG = 0xE9,
+    OP_AND_MEM_REG_FROM_REG = 0xEA,
+    OP_OR_MEM_REG_FROM_REG = 0xEB,
+    OP_XOR_MEM_REG_FROM_REG = 0xEC,
+    OP_LOCK_ADD_MEM_REG_FROM_REG = 0xED,
+    OP_LOCK_SUB_MEM_REG_FROM_REG = 0xEE,
+    OP_LOCK_AND_MEM_REG_FROM_REG = 0xEF,
+    OP_LOCK_OR_MEM_REG_FROM_REG = 0xF0,
+    OP_LOCK_XOR_MEM_REG_FROM_REG = 0xF1
 
 };
 
@@ -186,13 +286,111 @@ enum RegisterCode8bit
     REG_MNH = 0x09
 };
 
+enum SegmentCode
+{
+    SEG_ES = 0x00,
+    SEG_CS = 0x01,
+    SEG_SS = 0x02,
+    SEG_DS = 0x03
+};
+
+// DEFAULT DEVICES: I/O PORT BASE AND MEMORY MAPPED PAGE OF EACH
+enum IoPort
+{
+    PORT_CONSOLE = 0x10,  // 0x10 DATA, 0x11 STATUS
+    PORT_KEYBOARD = 0x20, // 0x20 DATA, 0x21 STATUS
+    PORT_TIMER = 0x40,    // 0x40..0x45, SEE TimerDevice
+    PORT_PIC = 0x08       // 0x08 PENDING, 0x09 MASK
+};
+
+enum IoPage : uint32_t
+{
+    MMIO_CONSOLE = 0xFF000,  // F000:F000
+    MMIO_KEYBOARD = 0xFF100, // F000:F100
+    MMIO_TIMER = 0xFF200,    // F000:F200
+    MMIO_PIC = 0xFF300       // F000:F300
+};
+
+// INTERRUPT CONTROLLER LINES, LINE n -> VECTOR 0x08 + n
+enum IrqLine
+{
+    IRQ_TIMER = 0,
+    IRQ_KEYBOARD = 1
+};
+
+// INTERRUPT VECTOR TABLE: 256 FAR POINTERS (OFFSET, SEGMENT) AT PHYSICAL 0x00000.
+// A VECTOR LEFT AT 0000:0000 HAS NO HANDLER, RAISING IT STOPS THE CPU.
+enum InterruptVector : uint8_t
+{
+    VEC_DIVIDE_ERROR = 0x00,
+    VEC_SINGLE_STEP = 0x01,
+    VEC_TIMER = 0x08 + IRQ_TIMER,
+    VEC_KEYBOARD = 0x08 + IRQ_KEYBOARD
+};
+
+// PROGRAMS ARE LOADED RIGHT AFTER THE VECTOR TABLE, ALL SEGMENT REGISTERS POINTING AT THEM
+const uint16_t PROGRAM_SEGMENT = 0x0040;
+
+// THE 16-BIT FLAGS REGISTER, PACKED AT THE 8086 BIT POSITIONS SO THAT bits IS THE WORD ITSELF:
+//   0 CF  2 PF  4 AF  6 ZF  7 SF  8 TF  9 IF  10 DF  11 OF   (BIT 1 IS ALWAYS 1)
+// PF AND AF ARE LAZY: ARITHMETIC ONLY STORES WHAT THEY ARE DERIVED FROM, THEIR BITS IN bits
+// STAY 0 AND word() FILLS THEM IN.
 struct Flags
 {
-    bool CF = false; // CARRY FLAG
-    bool ZF = false; // ZERO FLAG
-    bool SF = false; // SIGN FLAG
-    bool OF = false; // OVERFLOW FLAG
+    enum Bit : uint16_t
+    {
+        BIT_CF = 0x0001,
+        BIT_RESERVED = 0x0002,
+        BIT_PF = 0x0004,
+        BIT_AF = 0x0010,
+        BIT_ZF = 0x0040,
+        BIT_SF = 0x0080,
+        BIT_TF = 0x0100,
+        BIT_IF = 0x0200,
+        BIT_DF = 0x0400,
+        BIT_OF = 0x0800
+    };
+
+    union
+    {
+        uint16_t bits = BIT_RESERVED;
+        struct
+        {
+            bool CF : 1; // CARRY FLAG
+            bool : 1;
+            bool : 1; // PF, SEE parity_source
+            bool : 1;
+            bool : 1; // AF, SEE aux_source
+            bool : 1;
+            bool ZF : 1; // ZERO FLAG
+            bool SF : 1; // SIGN FLAG
+            bool TF : 1; // TRAP FLAG, INT 1 AFTER EVERY INSTRUCTION
+            bool IF : 1; // INTERRUPT FLAG, DEVICE INTERRUPTS ARE ONLY TAKEN WHEN SET
+            bool DF : 1; // DIRECTION FLAG, STRING INSTRUCTIONS STEP SI/DI DOWN WHEN SET
+            bool OF : 1; // OVERFLOW FLAG
+        };
+    };
+    uint8_t parity_source = 0; // LOW BYTE OF THE LAST RESULT, PF = EVEN NUMBER OF 1 BITS IN IT
+    uint8_t aux_source = 0;    // dest ^ src ^ result OF THE LAST ARITHMETIC, AF = BIT 4
+
+    bool PF() const
+    {
+        uint8_t v = parity_source;
+        v ^= v >> 4;
+        v ^= v >> 2;
+        v ^= v >> 1;
+        return !(v & 1);
+    }
+    bool AF() const { return aux_source & 0x10; }
+
+    // THE FLAGS IN mask TAKE THEIR VALUE FROM value, ONE READ-MODIFY-WRITE
+    void assign(uint16_t mask, uint16_t value) { bits = (bits & ~mask) | value; }
+
+    // THE WORD PUSHF/INTERRUPTS PUSH AND POPF/IRET POP
+    uint16_t word() const { return bits | (PF() ? BIT_PF : 0) | (AF() ? BIT_AF : 0); }
+    void set_word(uint16_t value);
 };
+static_assert(sizeof(Flags) == 4, "THE FLAG BITS MUST PACK INTO ONE WORD");
 
 struct Registers
 {
@@ -249,6 +447,22 @@ struct Registers
     uint16_t SI; // SOURCE INDEX
     uint16_t DI; // DESTINATION INDEX
     uint16_t IP; // INSTRUCION POINTER
+
+    // SEGMENT REGISTERS, PHYSICAL ADDRESS = (SEGMENT << 4) + OFFSET
+    uint16_t CS; // CODE SEGMENT    -> IP
+    uint16_t DS; // DATA SEGMENT    -> [imm], [reg], [reg+reg]
+    uint16_t SS; // STACK SEGMENT   -> SP, AND ANY ADDRESS BUILT FROM BP
+    uint16_t ES; // EXTRA SEGMENT
+};
+
+// WHAT restore_snapshot() PUTS BACK: REGISTERS, FLAGS, MEMORY AND THE CLOCK. DEVICE STATE IS NOT
+// PART OF IT, A RESTORE POWERS THE DEVICES ON AFRESH
+struct CpuSnapshot
+{
+    Registers regs;
+    Flags flags;
+    Memory memory;
+    uint64_t instructions = 0;
 };
 
 class CPU
@@ -256,31 +470,75 @@ class CPU
 private:
     uint16_t *get_register_ptr(uint8_t reg_code);
     uint8_t *get_register8_ptr(uint8_t reg_code);
-
-    void write_mem16(uint16_t address, uint16_t value);
-    uint16_t read_mem16(uint16_t address);
-
-    void write_mem8(uint16_t address, uint8_t value);
-    uint8_t read_mem8(uint16_t address);
-
-    // Flag Calculator new auxiliary functions
-    void update_flags_add(uint16_t dest_val, uint16_t src_val, uint32_t result);
-    void update_flags_sub(uint16_t dest_val, uint16_t src_val, uint16_t result);
-    void update_flags_logical(uint16_t result);
-    void update_flags_inc(uint16_t val_before, uint16_t val_after);
-    void update_flags_dec(uint16_t val_before, uint16_t val_after);
-
-    void update_flags_add8(uint8_t dest_val, uint8_t src_val, uint16_t result);
-    void update_flags_sub8(uint8_t dest_val, uint8_t src_val, uint8_t result);
-    void update_flags_logical8(uint8_t result);
-    void update_flags_inc8(uint8_t val_before, uint8_t val_after);
-    void update_flags_dec8(uint8_t val_before, uint8_t val_after);
+    uint16_t *get_segment_ptr(uint8_t seg_code);
+
+    bool word_hits_device(uint16_t segment, uint16_t offset) const;
+    void write_mem16(uint16_t segment, uint16_t offset, uint16_t value);
+    uint16_t read_mem16(uint16_t segment, uint16_t offset);
+
+    void write_mem8(uint16_t segment, uint16_t offset, uint8_t value);
+    uint8_t read_mem8(uint16_t segment, uint16_t offset);
+
+    // BYTES OF THE INSTRUCTION BEING EXECUTED (CS:IP), SET BY step()
+    const uint8_t *instruction = nullptr;
+    uint8_t fetch_buffer[Memory::FETCH_WINDOW];
+
+    // INTERRUPTS. step() ONLY LOOKS AT THEM ONCE instructions REACHES interrupt_check_at,
+    // WHICH STAYS AT UINT64_MAX WHILE NOTHING CAN HAPPEN (IF AND TF CLEAR)
+    uint64_t interrupt_check_at = 0;
+    bool trap_armed = false; // TF WAS SET WHEN THE LAST INSTRUCTION STARTED
+    bool interrupt_then_execute();
+    bool execute();
+    bool interrupt(uint8_t vector, uint16_t return_ip);
+    void push16(uint16_t value);
+    uint16_t pop16();
+
+    // HELD BY LOCKED INSTRUCTIONS, SHARED BY THE CORES OF AN SmpMachine. nullptr: ONE CPU ALONE
+    std::mutex *bus_lock = nullptr;
+
+    // RECORD/REPLAY OF DEVICE INPUT, SEE replay.h. nullptr: THE DEVICES ALWAYS ANSWER
+    InputLog *input_log = nullptr;
+    uint8_t device_read(uint32_t where, bool is_port);
+    bool device_interrupt(uint8_t &vector);
+
+    // REPORTING, SEE events.h. cs/ip/instruction ARE FILLED IN FROM THE CURRENT STATE
+    EventSink *events = &NullEventSink::instance;
+    void emit(CpuEventKind kind, uint8_t code = 0, uint16_t value = 0, uint32_t address = 0);
+
+    // Flag Calculator new auxiliary functions (T = uint16_t OR uint8_t)
+    template <typename T>
+    void update_flags_add(T dest_val, T src_val, uint32_t result);
+    template <typename T>
+    void update_flags_sub(T dest_val, T src_val, T result);
+    template <typename T>
+    void update_flags_logical(T result);
+    template <typename T>
+    void update_flags_inc(T val_before, T val_after);
+    template <typename T>
+    void update_flags_dec(T val_before, T val_after);
+
+    // INSTRUCTION HANDLERS AND DISPATCH TABLE, SEE cpu.cpp
+    friend struct Exec;
+    // RUNS REGISTER-ONLY INSTRUCTIONS OF MANY CPUS AT ONCE, SEE lockstep.h
+    friend class LockstepEngine;
+    // CORES SHARING ONE MEMORY, SEE smp.h
+    friend class SmpMachine;
 
 public:
     Registers regs;
     Flags flags;
 
-    std::vector<uint8_t> memory;
+    Memory memory;
+
+    // DEVICES, OWNED BY THE BUS. ONLY ADDRESSES ON A DEVICE PAGE LEAVE THE PLAIN MEMORY PATH
+    DeviceBus bus;
+    ConsoleDevice *console;
+    KeyboardDevice *keyboard;
+    TimerDevice *timer;
+    InterruptController *pic;
+
+    // RETIRED INSTRUCTIONS, THE CLOCK OF THE DEVICES
+    uint64_t instructions = 0;
 
     // CONSTRUCTOR
     CPU();
@@ -292,4 +550,30 @@ public:
 
     // DEBUG MODE
     bool step();
+
+    // COPIES A PROGRAM TO PROGRAM_SEGMENT:0000 AND POINTS CS/DS/ES/SS AND IP AT IT
+    void load_program(const uint8_t *code, size_t size);
+    // THE SAME FOR A PROGRAM ALREADY WRITTEN THERE (Parser::parse_into)
+    void start_program();
+
+    // RESETS A CPU FOR REUSE INSTEAD OF BUILDING A NEW ONE. THE COPY ONLY TOUCHES PAGES EITHER
+    // SIDE HAS ALLOCATED. TAKE THE SNAPSHOT BEFORE THE PROGRAM TALKS TO A DEVICE (E.G. RIGHT
+    // AFTER load_program)
+    void save_snapshot(CpuSnapshot &snapshot) const;
+    void restore_snapshot(const CpuSnapshot &snapshot);
+
+    // WHERE HALT, FAULTS, INTERRUPTS AND DEVICE ACCESSES ARE REPORTED. nullptr RESTORES THE
+    // DEFAULT, WHICH DROPS THEM. THE SINK MUST OUTLIVE ITS USE BY THIS CPU
+    void set_event_sink(EventSink *sink) { events = sink ? sink : &NullEventSink::instance; }
+
+    // LOGS (RECORDING) OR SUPPLIES (REPLAYING) WHAT THE DEVICES HAND THE PROGRAM, SEE replay.h.
+    // nullptr DETACHES. THE LOG MUST OUTLIVE ITS USE BY THIS CPU
+    void set_input_log(InputLog *log)
+    {
+        input_log = log;
+        interrupt_check_at = 0;
+    }
+
+    // THE HOST CHANGED A DEVICE BEHIND THE PROGRAM'S BACK (E.G. KEYBOARD INPUT)
+    void recheck_interrupts() { interrupt_check_at = 0; }
 };
@@ -0,0 +1,274 @@
+#include "devices.h"
+#include <algorithm>
+
+// ===============================================================
+// == CONSOLE
+// ===============================================================
+uint8_t ConsoleDevice::read(uint8_t reg, uint64_t)
+{
+    return reg == STATUS ? 0x01 : 0x00;
+}
+
+void ConsoleDevice::write(uint8_t reg, uint8_t value, uint64_t)
+{
+    if (reg != DATA)
+        return;
+    if (output.size() < output_limit)
+        output.push_back(static_cast<char>(value));
+    else
+        dropped = true;
+}
+
+void ConsoleDevice::reset()
+{
+    output.clear();
+    dropped = false;
+}
+
+std::string ConsoleDevice::take_output()
+{
+    std::string taken;
+    taken.swap(output);
+    dropped = false;
+    return taken;
+}
+
+// ===============================================================
+// == KEYBOARD
+// ===============================================================
+uint8_t KeyboardDevice::read(uint8_t reg, uint64_t)
+{
+    if ((reg == DATA || reg == STATUS) && queue.empty() && !closed)
+        starving = true;
+    if (reg == STATUS)
+        return queue.empty() ? 0x00 : 0x01;
+    if (reg != DATA || queue.empty())
+        return 0x00;
+    uint8_t value = queue.front();
+    queue.pop_front();
+    return value;
+}
+
+void KeyboardDevice::write(uint8_t, uint8_t, uint64_t)
+{
+    // READ ONLY
+}
+
+void KeyboardDevice::reset()
+{
+    queue.clear();
+    starving = false;
+    closed = false;
+}
+
+void KeyboardDevice::push_input(const std::string &text)
+{
+    queue.insert(queue.end(), text.begin(), text.end());
+    starving = false;
+}
+
+// ===============================================================
+// == TIMER
+// ===============================================================
+bool TimerDevice::expired(uint64_t now) const
+{
+    return (control & ENABLE) && reload != 0 && !acknowledged && now - start >= reload;
+}
+
+uint64_t TimerDevice::deadline() const
+{
+    if (!(control & ENABLE) || reload == 0 || acknowledged)
+        return UINT64_MAX;
+    return start + reload;
+}
+
+void TimerDevice::acknowledge(uint64_t now)
+{
+    if (!expired(now))
+        return;
+    if (control & PERIODIC)
+        start += (now - start) / reload * reload; // SKIP EVERY PERIOD THAT ALREADY ENDED
+    else
+        acknowledged = true;
+}
+
+uint8_t TimerDevice::read(uint8_t reg, uint64_t now)
+{
+    uint16_t count = 0;
+    if ((control & ENABLE) && reload != 0 && !acknowledged)
+        count = now - start >= reload ? 0 : reload - (now - start);
+
+    switch (reg)
+    {
+    case RELOAD_LO:
+        return reload & 0xFF;
+    case RELOAD_HI:
+        return reload >> 8;
+    case CONTROL:
+        return control;
+    case STATUS:
+        return expired(now) ? 0x01 : 0x00;
+    case COUNT_LO:
+        return count & 0xFF;
+    case COUNT_HI:
+        return count >> 8;
+    default:
+        return 0x00;
+    }
+}
+
+void TimerDevice::write(uint8_t reg, uint8_t value, uint64_t now)
+{
+    switch (reg)
+    {
+    case RELOAD_LO:
+        reload = (reload & 0xFF00) | value;
+        break;
+    case RELOAD_HI:
+        reload = (reload & 0x00FF) | (value << 8);
+        break;
+    case CONTROL:
+        control = value & (ENABLE | PERIODIC);
+        start = now;
+        acknowledged = false;
+        break;
+    case STATUS:
+        acknowledge(now);
+        break;
+    default:
+        break;
+    }
+}
+
+void TimerDevice::reset()
+{
+    reload = 0;
+    control = 0;
+    start = 0;
+    acknowledged = false;
+}
+
+// ===============================================================
+// == INTERRUPT CONTROLLER
+// ===============================================================
+uint8_t InterruptController::pending(uint64_t now) const
+{
+    uint8_t lines = 0;
+    for (int line = 0; line < LINES; line++)
+        if (sources[line] && !(mask & (1 << line)) && sources[line]->irq(now))
+            lines |= 1 << line;
+    return lines;
+}
+
+uint64_t InterruptController::next_event(uint64_t now) const
+{
+    uint64_t next = UINT64_MAX;
+    for (int line = 0; line < LINES; line++)
+        if (sources[line] && !(mask & (1 << line)))
+            next = std::min(next, sources[line]->irq_deadline(now));
+    return next;
+}
+
+uint8_t InterruptController::read(uint8_t reg, uint64_t now)
+{
+    switch (reg)
+    {
+    case PENDING:
+        return pending(now);
+    case MASK:
+        return mask;
+    default:
+        return 0x00;
+    }
+}
+
+void InterruptController::write(uint8_t reg, uint8_t value, uint64_t)
+{
+    if (reg == MASK)
+        mask = value;
+}
+
+void InterruptController::reset()
+{
+    mask = 0; // THE LINES STAY CONNECTED
+}
+
+// ===============================================================
+// == BUS
+// ===============================================================
+void DeviceBus::map(std::unique_ptr<Device> device, uint16_t port_base, uint16_t port_count, uint32_t page_address)
+{
+    Device *raw = device.get();
+    devices.push_back(std::move(device));
+
+    for (uint32_t i = 0; i < port_count && port_base + i < PORTS; i++)
+        ports[port_base + i] = {raw, static_cast<uint8_t>(i)};
+
+    if (page_address != NO_PAGE)
+    {
+        uint32_t page = (page_address & (Memory::SIZE - 1)) >> PAGE_BITS;
+        pages.push_back({page, raw});
+        io_pages.set(page);
+    }
+}
+
+void DeviceBus::reset()
+{
+    for (auto &device : devices)
+        device->reset();
+}
+
+Device *DeviceBus::page_device(uint32_t page) const
+{
+    for (const PageSlot &slot : pages)
+        if (slot.page == page)
+            return slot.device;
+    return nullptr;
+}
+
+bool DeviceBus::mapped_range(uint32_t address, uint32_t length) const
+{
+    if (pages.empty() || length == 0)
+        return false;
+    for (uint32_t page = address >> PAGE_BITS; page <= (address + length - 1) >> PAGE_BITS; page++)
+        if (io_pages[page & (PAGES - 1)])
+            return true;
+    return false;
+}
+
+uint8_t DeviceBus::read(uint32_t address, uint64_t now)
+{
+    address &= Memory::SIZE - 1;
+    Device *device = page_device(address >> PAGE_BITS);
+    return device ? device->read(address & (PAGE_SIZE - 1), now) : OPEN_BUS;
+}
+
+void DeviceBus::write(uint32_t address, uint8_t value, uint64_t now)
+{
+    address &= Memory::SIZE - 1;
+    if (Device *device = page_device(address >> PAGE_BITS))
+        device->write(address & (PAGE_SIZE - 1), value, now);
+}
+
+uint8_t DeviceBus::in(uint16_t port, uint64_t now)
+{
+    if (port >= PORTS || !ports[port].device)
+        return OPEN_BUS;
+    return ports[port].device->read(ports[port].reg, now);
+}
+
+void DeviceBus::out(uint16_t port, uint8_t value, uint64_t now)
+{
+    if (port < PORTS && ports[port].device)
+        ports[port].device->write(ports[port].reg, value, now);
+}
+
+bool DeviceBus::external(uint32_t where, bool is_port) const
+{
+    const Device *device;
+    if (is_port)
+        device = where < PORTS ? ports[where].device : nullptr;
+    else
+        device = page_device((where & (Memory::SIZE - 1)) >> PAGE_BITS);
+    return device && device->external();
+}
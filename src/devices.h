@@ -0,0 +1,233 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "memory.h"
+
+// ===============================================================
+// == I/O DEVICES
+// ===============================================================
+// A DEVICE IS A SMALL BANK OF 8-BIT REGISTERS. THE BUS MAKES THEM VISIBLE TWICE:
+//   - AS I/O PORTS (IN/OUT), port_base + REGISTER
+//   - MEMORY MAPPED, ONE 256-BYTE PAGE PER DEVICE, page_base + REGISTER
+// now IS THE CPU'S RETIRED INSTRUCTION COUNT, THE ONLY CLOCK DEVICES SEE.
+class Device
+{
+public:
+    virtual ~Device() = default;
+    virtual uint8_t read(uint8_t reg, uint64_t now) = 0;
+    virtual void write(uint8_t reg, uint8_t value, uint64_t now) = 0;
+    // BACK TO THE POWER-ON STATE
+    virtual void reset() = 0;
+
+    // INTERRUPT LINE, LEVEL TRIGGERED: HIGH UNTIL THE PROGRAM SERVICES THE DEVICE
+    virtual bool irq(uint64_t) const { return false; }
+    // FIRST now AT WHICH irq() CAN TURN TRUE WITHOUT ANY REGISTER ACCESS, UINT64_MAX FOR NEVER
+    virtual uint64_t irq_deadline(uint64_t now) const { return irq(now) ? now : UINT64_MAX; }
+    // READS DEPEND ON THE HOST, NOT ONLY ON WHAT THE PROGRAM WROTE AND now. SEE replay.h
+    virtual bool external() const { return false; }
+};
+
+// CONSOLE OUTPUT. WRITES TO DATA ARE BUFFERED UNTIL THE HOST TAKES THEM.
+//   0: DATA   (W) CHARACTER OUT      (R) 0
+//   1: STATUS (R) BIT0 = READY (ALWAYS)
+class ConsoleDevice : public Device
+{
+public:
+    enum Register
+    {
+        DATA = 0,
+        STATUS = 1
+    };
+
+    uint8_t read(uint8_t reg, uint64_t now) override;
+    void write(uint8_t reg, uint8_t value, uint64_t now) override;
+    void reset() override;
+
+    // EVERYTHING WRITTEN SINCE THE LAST CALL
+    std::string take_output();
+
+    // KEEP AT MOST max BYTES UNTIL THE NEXT take_output(), DROPPING LATER WRITES. SURVIVES reset()
+    void limit_output(size_t max) { output_limit = max; }
+    // A WRITE WAS DROPPED SINCE THE LAST take_output() OR reset()
+    bool output_dropped() const { return dropped; }
+
+private:
+    std::string output;
+    size_t output_limit = SIZE_MAX;
+    bool dropped = false;
+};
+
+// KEYBOARD INPUT QUEUE, FILLED BY THE HOST
+//   0: DATA   (R) NEXT BYTE, 0 WHEN EMPTY
+//   1: STATUS (R) BIT0 = A BYTE IS WAITING
+class KeyboardDevice : public Device
+{
+public:
+    enum Register
+    {
+        DATA = 0,
+        STATUS = 1
+    };
+
+    uint8_t read(uint8_t reg, uint64_t now) override;
+    void write(uint8_t reg, uint8_t value, uint64_t now) override;
+    void reset() override;
+
+    void push_input(const std::string &text);
+    bool has_input() const { return !queue.empty(); }
+
+    // THE PROGRAM READ DATA OR STATUS WHILE THE QUEUE WAS EMPTY, I.E. IT IS WAITING FOR A KEY.
+    // CLEARED BY push_input. AFTER close_input() THE QUEUE IS AT END OF INPUT AND NEVER STARVES
+    bool starved() const { return starving; }
+    void close_input() { closed = true; starving = false; }
+
+    bool irq(uint64_t) const override { return has_input(); }
+    bool external() const override { return true; }
+
+private:
+    std::deque<uint8_t> queue;
+    bool starving = false;
+    bool closed = false;
+};
+
+// PROGRAMMABLE INTERVAL TIMER, COUNTING RETIRED INSTRUCTIONS. NOTHING RUNS PER
+// INSTRUCTION: THE COUNTER IS DERIVED FROM now WHENEVER A REGISTER IS TOUCHED.
+//   0/1: RELOAD  (R/W) PERIOD IN INSTRUCTIONS, LOW/HIGH BYTE
+//   2:   CONTROL (R/W) BIT0 = ENABLE (WRITING IT RESTARTS THE PERIOD), BIT1 = PERIODIC
+//   3:   STATUS  (R)   BIT0 = EXPIRED   (W) ANY VALUE ACKNOWLEDGES
+//   4/5: COUNT   (R)   INSTRUCTIONS LEFT IN THE CURRENT PERIOD
+class TimerDevice : public Device
+{
+public:
+    enum Register
+    {
+        RELOAD_LO = 0,
+        RELOAD_HI = 1,
+        CONTROL = 2,
+        STATUS = 3,
+        COUNT_LO = 4,
+        COUNT_HI = 5
+    };
+    enum Control : uint8_t
+    {
+        ENABLE = 0x01,
+        PERIODIC = 0x02
+    };
+
+    uint8_t read(uint8_t reg, uint64_t now) override;
+    void write(uint8_t reg, uint8_t value, uint64_t now) override;
+    void reset() override;
+
+    bool expired(uint64_t now) const;
+    // FIRST now AT WHICH expired() TURNS TRUE, UINT64_MAX WHEN DISABLED OR ALREADY SIGNALLED
+    uint64_t deadline() const;
+
+    bool irq(uint64_t now) const override { return expired(now); }
+    uint64_t irq_deadline(uint64_t) const override { return deadline(); }
+
+private:
+    uint16_t reload = 0;
+    uint8_t control = 0;
+    uint64_t start = 0; // now WHEN THE CURRENT PERIOD BEGAN
+    bool acknowledged = false;
+
+    void acknowledge(uint64_t now);
+};
+
+// INTERRUPT CONTROLLER, EIGHT LINES, LINE n RAISES VECTOR VECTOR_BASE + n. LINE 0 WINS TIES.
+// THE LINES ARE NOT LATCHED, THEY ARE READ FROM THE CONNECTED DEVICES WHEN ASKED.
+//   0: PENDING (R) ONE BIT PER LINE THAT IS HIGH AND NOT MASKED
+//   1: MASK    (R/W) A SET BIT DISABLES THE LINE
+class InterruptController : public Device
+{
+public:
+    enum Register
+    {
+        PENDING = 0,
+        MASK = 1
+    };
+    static const int LINES = 8;
+    static const uint8_t VECTOR_BASE = 0x08;
+
+    uint8_t read(uint8_t reg, uint64_t now) override;
+    void write(uint8_t reg, uint8_t value, uint64_t now) override;
+    void reset() override;
+
+    void connect(int line, const Device *device) { sources[line] = device; }
+    bool external() const override { return true; } // PENDING FOLLOWS THE KEYBOARD LINE
+
+    uint8_t pending(uint64_t now) const;
+    // EARLIEST now AT WHICH AN UNMASKED LINE CAN GO HIGH ON ITS OWN
+    uint64_t next_event(uint64_t now) const;
+
+private:
+    const Device *sources[LINES] = {};
+    uint8_t mask = 0;
+};
+
+class DeviceBus
+{
+public:
+    static const uint32_t PAGE_BITS = 8;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static const uint32_t PAGES = Memory::SIZE / PAGE_SIZE;
+    static const uint32_t PORTS = 0x100;
+    static const uint8_t OPEN_BUS = 0xFF; // WHAT UNMAPPED PORTS READ AS
+
+    DeviceBus() = default;
+    DeviceBus(const DeviceBus &) = delete;
+    DeviceBus &operator=(const DeviceBus &) = delete;
+
+    // TAKES OWNERSHIP. port_count REGISTERS START AT port_base; page_address IS A
+    // PAGE-ALIGNED PHYSICAL ADDRESS, OR NO_PAGE TO LEAVE THE DEVICE OFF THE MEMORY MAP
+    static const uint32_t NO_PAGE = UINT32_MAX;
+    template <class D>
+    D *attach(std::unique_ptr<D> device, uint16_t port_base, uint16_t port_count, uint32_t page_address)
+    {
+        D *raw = device.get();
+        map(std::move(device), port_base, port_count, page_address);
+        return raw;
+    }
+
+    // THE ONLY COST ORDINARY MEMORY ACCESSES PAY: ONE BIT TEST
+    bool mapped(uint32_t address) const { return io_pages[(address & (Memory::SIZE - 1)) >> PAGE_BITS]; }
+    // ANY DEVICE PAGE IN [address, address + length)? USED BY BULK STRING OPERATIONS
+    bool mapped_range(uint32_t address, uint32_t length) const;
+
+    uint8_t read(uint32_t address, uint64_t now);
+    void write(uint32_t address, uint8_t value, uint64_t now);
+
+    uint8_t in(uint16_t port, uint64_t now);
+    void out(uint16_t port, uint8_t value, uint64_t now);
+
+    // EVERY DEVICE BACK TO POWER-ON, THE MAPPING STAYS
+    void reset();
+
+    // THE DEVICE BEHIND A PORT OR PHYSICAL ADDRESS IS Device::external
+    bool external(uint32_t where, bool is_port) const;
+
+private:
+    struct PortSlot
+    {
+        Device *device = nullptr;
+        uint8_t reg = 0;
+    };
+    struct PageSlot
+    {
+        uint32_t page;
+        Device *device;
+    };
+
+    std::vector<std::unique_ptr<Device>> devices;
+    PortSlot ports[PORTS];
+    std::vector<PageSlot> pages; // ONLY SEARCHED ONCE mapped() SAID YES
+    std::bitset<PAGES> io_pages;
+
+    void map(std::unique_ptr<Device> device, uint16_t port_base, uint16_t port_count, uint32_t page_address);
+    Device *page_device(uint32_t page) const;
+};
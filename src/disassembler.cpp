@@ -0,0 +1,234 @@
+#include "disassembler.h"
+#include "opcodes.h"
+#include "cpu.h"
+
+static const char *const REG16_NAMES[] = {"AX", "BX", "CX", "DX", "MNK", "SP", "SI", "DI", "BP"};
+static const char *const REG8_NAMES[] = {"AL", "AH", "BL", "BH", "CL", "CH", "DL", "DH", "MNL", "MNH"};
+static const char *const SREG_NAMES[] = {"ES", "CS", "SS", "DS"};
+
+// SMALL APPEND-ONLY WRITER, NO ALLOCATION, TRUNCATES SILENTLY
+struct TextOut
+{
+    char *p;
+    char *end;
+
+    void put(char c)
+    {
+        if (p < end)
+            *p++ = c;
+    }
+    void str(const char *s)
+    {
+        while (*s)
+            put(*s++);
+    }
+    void hex(uint16_t v, int digits)
+    {
+        static const char HEX[] = "0123456789ABCDEF";
+        str("0x");
+        for (int i = digits - 1; i >= 0; i--)
+            put(HEX[(v >> (4 * i)) & 0xF]);
+    }
+    void reg16(uint8_t code)
+    {
+        str(code < sizeof(REG16_NAMES) / sizeof(REG16_NAMES[0]) ? REG16_NAMES[code] : "R?");
+    }
+    void reg8(uint8_t code)
+    {
+        str(code < sizeof(REG8_NAMES) / sizeof(REG8_NAMES[0]) ? REG8_NAMES[code] : "R8?");
+    }
+    void sreg(uint8_t code)
+    {
+        str(code < sizeof(SREG_NAMES) / sizeof(SREG_NAMES[0]) ? SREG_NAMES[code] : "S?");
+    }
+    void mem_imm(uint16_t address)
+    {
+        put('[');
+        hex(address, 4);
+        put(']');
+    }
+    void mem_reg(uint8_t code)
+    {
+        put('[');
+        reg16(code);
+        put(']');
+    }
+    void mem_reg_imm(uint8_t code, uint16_t displacement)
+    {
+        put('[');
+        reg16(code);
+        put('+');
+        hex(displacement, 4);
+        put(']');
+    }
+    void sep() { str(", "); }
+};
+
+int Disassembler::decode(const uint8_t *bytes, char *out, size_t out_size)
+{
+    if (out_size == 0)
+        return 1;
+
+    const OpInfo &info = OPCODE_TABLE[bytes[0]];
+    TextOut t{out, out + out_size - 1};
+
+    if (info.layout == LAYOUT_INVALID)
+    {
+        t.str("DB ");
+        t.hex(bytes[0], 2);
+        *t.p = '\0';
+        return 1;
+    }
+
+    auto imm16 = [bytes](int offset)
+    { return (uint16_t)(bytes[offset] | (bytes[offset + 1] << 8)); };
+
+    t.str(info.mnemonic);
+    if (info.layout != LAYOUT_NONE)
+        t.put(' ');
+
+    switch (info.layout)
+    {
+    case LAYOUT_INVALID:
+    case LAYOUT_NONE:
+        break;
+    case LAYOUT_ADDR16:
+        t.hex(imm16(1), 4);
+        break;
+    case LAYOUT_R16:
+        t.reg16(bytes[1]);
+        break;
+    case LAYOUT_R8:
+        t.reg8(bytes[1]);
+        break;
+    case LAYOUT_R16_R16:
+        t.reg16(bytes[1]), t.sep(), t.reg16(bytes[2]);
+        break;
+    case LAYOUT_R8_R8:
+        t.reg8(bytes[1]), t.sep(), t.reg8(bytes[2]);
+        break;
+    case LAYOUT_R16_I16:
+        t.reg16(bytes[1]), t.sep(), t.hex(imm16(2), 4);
+        break;
+    case LAYOUT_R8_I8:
+        t.reg8(bytes[1]), t.sep(), t.hex(bytes[2], 2);
+        break;
+    case LAYOUT_R16_I8:
+        t.reg16(bytes[1]), t.sep(), t.hex(bytes[2], 2);
+        break;
+    case LAYOUT_R16_CL:
+        t.reg16(bytes[1]), t.str(", CL");
+        break;
+    case LAYOUT_R8_CL:
+        t.reg8(bytes[1]), t.str(", CL");
+        break;
+    case LAYOUT_R16_MEMI:
+        t.reg16(bytes[1]), t.sep(), t.mem_imm(imm16(2));
+        break;
+    case LAYOUT_MEMI_R16:
+        t.mem_imm(imm16(2)), t.sep(), t.reg16(bytes[1]);
+        break;
+    case LAYOUT_R8_MEMI:
+        t.reg8(bytes[1]), t.sep(), t.mem_imm(imm16(2));
+        break;
+    case LAYOUT_MEMI_R8:
+        t.mem_imm(imm16(2)), t.sep(), t.reg8(bytes[1]);
+        break;
+    case LAYOUT_R16_MEMR:
+        t.reg16(bytes[1]), t.sep(), t.mem_reg(bytes[2]);
+        break;
+    case LAYOUT_MEMR_R16:
+        t.mem_reg(bytes[2]), t.sep(), t.reg16(bytes[1]);
+        break;
+    case LAYOUT_R8_MEMR:
+        t.reg8(bytes[1]), t.sep(), t.mem_reg(bytes[2]);
+        break;
+    case LAYOUT_MEMR_R8:
+        t.mem_reg(bytes[2]), t.sep(), t.reg8(bytes[1]);
+        break;
+    case LAYOUT_R16_MEMRR:
+        t.reg16(bytes[1]), t.str(", ["), t.reg16(bytes[2]), t.put('+'), t.reg16(bytes[3]), t.put(']');
+        break;
+    case LAYOUT_MEMRR_R16:
+        t.put('['), t.reg16(bytes[2]), t.put('+'), t.reg16(bytes[3]), t.str("], "), t.reg16(bytes[1]);
+        break;
+    case LAYOUT_R16_MEMRI:
+        t.reg16(bytes[1]), t.sep(), t.mem_reg_imm(bytes[2], imm16(3));
+        break;
+    case LAYOUT_MEMRI_R16:
+        t.mem_reg_imm(bytes[2], imm16(3)), t.sep(), t.reg16(bytes[1]);
+        break;
+    case LAYOUT_R8_MEMRI:
+        t.reg8(bytes[1]), t.sep(), t.mem_reg_imm(bytes[2], imm16(3));
+        break;
+    case LAYOUT_MEMRI_R8:
+        t.mem_reg_imm(bytes[2], imm16(3)), t.sep(), t.reg8(bytes[1]);
+        break;
+    case LAYOUT_MEMI_I16:
+        t.mem_imm(imm16(1)), t.sep(), t.hex(imm16(3), 4);
+        break;
+    case LAYOUT_MEMI_I8:
+        t.mem_imm(imm16(1)), t.sep(), t.hex(bytes[3], 2);
+        break;
+    case LAYOUT_SREG:
+        t.sreg(bytes[1]);
+        break;
+    case LAYOUT_SREG_R16:
+        t.sreg(bytes[1]), t.sep(), t.reg16(bytes[2]);
+        break;
+    case LAYOUT_R16_SREG:
+        t.reg16(bytes[1]), t.sep(), t.sreg(bytes[2]);
+        break;
+    case LAYOUT_I8_R8:
+        t.hex(bytes[2], 2), t.sep(), t.reg8(bytes[1]);
+        break;
+    case LAYOUT_I8_R16:
+        t.hex(bytes[2], 2), t.sep(), t.reg16(bytes[1]);
+        break;
+    case LAYOUT_R8_DX:
+        t.reg8(bytes[1]), t.str(", DX");
+        break;
+    case LAYOUT_R16_DX:
+        t.reg16(bytes[1]), t.str(", DX");
+        break;
+    case LAYOUT_DX_R8:
+        t.str("DX, "), t.reg8(bytes[1]);
+        break;
+    case LAYOUT_DX_R16:
+        t.str("DX, "), t.reg16(bytes[1]);
+        break;
+    case LAYOUT_I8:
+        t.hex(bytes[1], 2);
+        break;
+    }
+
+    *t.p = '\0';
+    return info.length;
+}
+
+std::vector<DisassembledLine> Disassembler::disassemble(const CPU &cpu, uint32_t start, uint32_t end)
+{
+    std::vector<DisassembledLine> lines;
+    const uint32_t memory_size = cpu.memory.size();
+    if (end > memory_size)
+        end = memory_size;
+    if (start >= end)
+        return lines;
+    lines.reserve((end - start) / 2 + 1);
+
+    uint8_t window[MAX_INSTRUCTION_LENGTH];
+    uint32_t address = start;
+    while (address < end)
+    {
+        // OPERAND BYTES PAST THE END OF MEMORY WRAP LIKE THE CPU'S 16-BIT IP
+        for (int i = 0; i < MAX_INSTRUCTION_LENGTH; i++)
+            window[i] = cpu.memory[(address + i) % memory_size];
+
+        DisassembledLine line;
+        line.address = address;
+        line.length = Disassembler::decode(window, line.text, sizeof(line.text));
+        lines.push_back(line);
+        address += line.length;
+    }
+    return lines;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CPU;
+
+struct DisassembledLine
+{
+    uint32_t address;
+    uint8_t length;
+    char text[32];
+};
+
+class Disassembler
+{
+public:
+    // DECODE ONE INSTRUCTION FROM bytes (AT LEAST MAX_INSTRUCTION_LENGTH READABLE),
+    // WRITE ITS TEXT INTO out AND RETURN ITS LENGTH. UNKNOWN OPCODES DECODE AS "DB 0xNN".
+    static int decode(const uint8_t *bytes, char *out, size_t out_size);
+
+    // LINEAR SWEEP OVER [start, end) OF CPU MEMORY
+    static std::vector<DisassembledLine> disassemble(const CPU &cpu, uint32_t start, uint32_t end);
+};
@@ -0,0 +1,65 @@
+#include "events.h"
+#include <cstdio>
+
+NullEventSink NullEventSink::instance;
+
+static const char *fault_text(uint8_t fault)
+{
+    switch (fault)
+    {
+    case FAULT_DIVIDE_ERROR:
+        return "Divide error";
+    case FAULT_NO_INT_HANDLER:
+        return "No handler for INT";
+    case FAULT_NO_IRQ_HANDLER:
+        return "No handler for IRQ";
+    case FAULT_NO_TRAP_HANDLER:
+        return "TF is set but INT 0x01 has no handler";
+    default:
+        return "Fault";
+    }
+}
+
+size_t format_event(const CpuEvent &e, char *out, size_t out_size)
+{
+    if (out_size == 0)
+        return 0;
+
+    int n = 0;
+    switch (e.kind)
+    {
+    case EVENT_HALT:
+        n = snprintf(out, out_size, "CPU Halted at %04X:%04X.", e.cs, e.ip);
+        break;
+    case EVENT_UNKNOWN_OPCODE:
+        n = snprintf(out, out_size, "ERROR: Unknown OPCODE 0x%02X at address %04X:%04X", e.code, e.cs, e.ip);
+        break;
+    case EVENT_FAULT:
+        if (e.code == FAULT_NO_INT_HANDLER)
+            n = snprintf(out, out_size, "ERROR: %s 0x%02X at address %04X:%04X", fault_text(e.code), e.value, e.cs, e.ip);
+        else if (e.code == FAULT_NO_IRQ_HANDLER)
+            n = snprintf(out, out_size, "ERROR: %s %u at address %04X:%04X", fault_text(e.code), e.value, e.cs, e.ip);
+        else
+            n = snprintf(out, out_size, "ERROR: %s at address %04X:%04X", fault_text(e.code), e.cs, e.ip);
+        break;
+    case EVENT_INTERRUPT:
+        n = snprintf(out, out_size, "INT 0x%02X at %04X:%04X", e.code, e.cs, e.ip);
+        break;
+    case EVENT_PORT_IN:
+        n = snprintf(out, out_size, "IN  port 0x%02X -> 0x%04X", (unsigned)e.address, e.value);
+        break;
+    case EVENT_PORT_OUT:
+        n = snprintf(out, out_size, "OUT port 0x%02X <- 0x%04X", (unsigned)e.address, e.value);
+        break;
+    case EVENT_MMIO_READ:
+        n = snprintf(out, out_size, "READ  0x%05X -> 0x%02X", (unsigned)e.address, e.value);
+        break;
+    case EVENT_MMIO_WRITE:
+        n = snprintf(out, out_size, "WRITE 0x%05X <- 0x%02X", (unsigned)e.address, e.value);
+        break;
+    }
+
+    if (n < 0)
+        n = 0;
+    return (size_t)n < out_size ? (size_t)n : out_size - 1;
+}
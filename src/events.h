@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ===============================================================
+// == CPU EVENTS
+// ===============================================================
+// THE CPU NEVER PRINTS. EVERYTHING WORTH REPORTING IS A SMALL FIXED-SIZE RECORD
+// HANDED TO AN EventSink, SO REPORTING NEVER ALLOCATES OR TAKES THE STDIO LOCK.
+enum CpuEventKind : uint8_t
+{
+    EVENT_HALT,           // HALT EXECUTED
+    EVENT_UNKNOWN_OPCODE, // code = OPCODE BYTE (ALSO WHEN AN OPERAND BYTE NAMES NO REGISTER)
+    EVENT_FAULT,          // code = CpuFault, value = VECTOR OR IRQ LINE
+    EVENT_INTERRUPT,      // code = VECTOR TAKEN
+    EVENT_PORT_IN,        // address = PORT, value = DATA
+    EVENT_PORT_OUT,
+    EVENT_MMIO_READ, // address = PHYSICAL ADDRESS, value = DATA
+    EVENT_MMIO_WRITE
+};
+
+enum CpuFault : uint8_t
+{
+    FAULT_DIVIDE_ERROR,    // DIV/IDIV WITH NO INT 0 HANDLER
+    FAULT_NO_INT_HANDLER,  // INT n THROUGH AN EMPTY VECTOR
+    FAULT_NO_IRQ_HANDLER,  // DEVICE INTERRUPT THROUGH AN EMPTY VECTOR
+    FAULT_NO_TRAP_HANDLER  // TF SET, INT 1 EMPTY
+};
+
+struct CpuEvent
+{
+    CpuEventKind kind;
+    uint8_t code;
+    uint16_t cs; // WHERE THE INSTRUCTION THAT RAISED IT STARTS
+    uint16_t ip;
+    uint16_t value;
+    uint32_t address;
+    uint64_t instruction; // RETIRED INSTRUCTION COUNT AT THE TIME
+};
+
+class EventSink
+{
+public:
+    virtual ~EventSink() = default;
+    virtual void on_event(const CpuEvent &event) = 0;
+};
+
+// THE DEFAULT: DROPS EVERYTHING
+class NullEventSink : public EventSink
+{
+public:
+    void on_event(const CpuEvent &) override {}
+    static NullEventSink instance;
+};
+
+// KEEPS THE LAST CAPACITY EVENTS, OLDEST OVERWRITTEN FIRST. NO ALLOCATION AFTER CONSTRUCTION
+template <size_t CAPACITY>
+class RingBufferSink : public EventSink
+{
+public:
+    void on_event(const CpuEvent &event) override
+    {
+        ring[total % CAPACITY] = event;
+        total++;
+    }
+
+    // NUMBER OF EVENTS STILL HELD, at(0) IS THE OLDEST OF THEM
+    size_t size() const { return total < CAPACITY ? total : CAPACITY; }
+    const CpuEvent &at(size_t i) const { return ring[(total - size() + i) % CAPACITY]; }
+    // EVERY EVENT SINCE THE LAST clear(), INCLUDING THE OVERWRITTEN ONES
+    uint64_t received() const { return total; }
+    void clear() { total = 0; }
+
+private:
+    CpuEvent ring[CAPACITY];
+    uint64_t total = 0;
+};
+
+// ONE LINE OF TEXT FOR event, TRUNCATED TO FIT out (ALWAYS NUL TERMINATED). RETURNS THE LENGTH
+size_t format_event(const CpuEvent &event, char *out, size_t out_size);
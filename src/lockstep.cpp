@@ -0,0 +1,525 @@
+#include "lockstep.h"
+#include "alu.h"
+#include "opcodes.h"
+#include <cstring>
+
+// ===============================================================
+// == LANE OPERATIONS (16-BIT ONLY)
+// ===============================================================
+// THE SAME ARITHMETIC AS THE Exec OPERATIONS IN cpu.cpp, ON PLAIN VALUES: apply() RETURNS
+// THE RESULT AND FILLS IN THE STATUS BITS AND THE AF SOURCE. flags IS THE LANE'S FLAG WORD
+// BEFORE THE INSTRUCTION (ADC/SBB READ CF FROM IT).
+namespace
+{
+struct LaneMov
+{
+    static const bool STORE = true;
+    static const uint16_t AFFECTS = 0;
+    static uint16_t apply(uint16_t, uint16_t s, uint16_t, uint16_t &, uint8_t &) { return s; }
+};
+
+template <bool WITH_CARRY, bool STORE_RESULT = true>
+struct LaneAddOp
+{
+    static const bool STORE = STORE_RESULT;
+    static const uint16_t AFFECTS = ARITH_FLAGS;
+    static uint16_t apply(uint16_t d, uint16_t s, uint16_t flags, uint16_t &status, uint8_t &aux)
+    {
+        uint32_t res = (uint32_t)d + s + (WITH_CARRY ? (flags & Flags::BIT_CF) : 0);
+        status = add_status<uint16_t>(d, s, res);
+        aux = d ^ s ^ res;
+        return res;
+    }
+};
+
+template <bool WITH_BORROW, bool STORE_RESULT = true>
+struct LaneSubOp
+{
+    static const bool STORE = STORE_RESULT;
+    static const uint16_t AFFECTS = ARITH_FLAGS;
+    static uint16_t apply(uint16_t d, uint16_t s, uint16_t flags, uint16_t &status, uint8_t &aux)
+    {
+        uint16_t sv = s + (WITH_BORROW ? (flags & Flags::BIT_CF) : 0); // SBB COMPARES AGAINST src + CF
+        uint16_t res = d - sv;
+        status = sub_status<uint16_t>(d, sv, res);
+        aux = d ^ sv ^ res;
+        return res;
+    }
+};
+
+template <int KIND> // 0 AND, 1 OR, 2 XOR
+struct LaneLogicOp
+{
+    static const bool STORE = true;
+    static const uint16_t AFFECTS = ARITH_FLAGS;
+    static uint16_t apply(uint16_t d, uint16_t s, uint16_t, uint16_t &status, uint8_t &aux)
+    {
+        uint16_t res = KIND == 0 ? (d & s) : KIND == 1 ? (d | s) : (d ^ s);
+        status = logic_status<uint16_t>(res);
+        aux = 0;
+        return res;
+    }
+};
+
+// UNARY OPERATIONS IGNORE s
+struct LaneInc
+{
+    static const bool STORE = true;
+    static const uint16_t AFFECTS = INC_DEC_FLAGS;
+    static uint16_t apply(uint16_t d, uint16_t, uint16_t, uint16_t &status, uint8_t &aux)
+    {
+        uint16_t res = d + 1;
+        status = inc_status<uint16_t>(d, res);
+        aux = d ^ 1 ^ res;
+        return res;
+    }
+};
+
+struct LaneDec
+{
+    static const bool STORE = true;
+    static const uint16_t AFFECTS = INC_DEC_FLAGS;
+    static uint16_t apply(uint16_t d, uint16_t, uint16_t, uint16_t &status, uint8_t &aux)
+    {
+        uint16_t res = d - 1;
+        status = dec_status<uint16_t>(d, res);
+        aux = d ^ 1 ^ res;
+        return res;
+    }
+};
+
+struct LaneNot
+{
+    static const bool STORE = true;
+    static const uint16_t AFFECTS = 0;
+    static uint16_t apply(uint16_t d, uint16_t, uint16_t, uint16_t &, uint8_t &) { return ~d; }
+};
+
+struct LaneNeg
+{
+    static const bool STORE = true;
+    static const uint16_t AFFECTS = ARITH_FLAGS;
+    static uint16_t apply(uint16_t d, uint16_t, uint16_t, uint16_t &status, uint8_t &aux)
+    {
+        uint16_t res = -d;
+        status = sub_status<uint16_t>(0, d, res); // CF = (d != 0)
+        aux = d ^ res;
+        return res;
+    }
+};
+
+using LaneAdd = LaneAddOp<false>;
+using LaneAdc = LaneAddOp<true>;
+using LaneSub = LaneSubOp<false>;
+using LaneSbb = LaneSubOp<true>;
+using LaneCmp = LaneSubOp<false, false>;
+using LaneAnd = LaneLogicOp<0>;
+using LaneOr = LaneLogicOp<1>;
+using LaneXor = LaneLogicOp<2>;
+
+// THE REGISTER CODES CPU::get_register_ptr ACCEPTS, ANYTHING ELSE IS LEFT TO THE SCALAR CPU
+bool vector_register(uint8_t code)
+{
+    return code <= REG_BP;
+}
+
+uint16_t blend(uint16_t value, uint16_t old, uint16_t mask)
+{
+    return (value & mask) | (old & ~mask);
+}
+} // namespace
+
+// ===============================================================
+// == ENGINE
+// ===============================================================
+LockstepEngine::LockstepEngine(int lanes)
+{
+    count = lanes < 1 ? 1 : lanes > LANES ? LANES : lanes;
+    for (int l = 0; l < count; l++)
+    {
+        machines.emplace_back(new CPU());
+        active[l] = true;
+    }
+}
+
+void LockstepEngine::load_program(const uint8_t *code, size_t size)
+{
+    for (int l = 0; l < count; l++)
+    {
+        machines[l]->load_program(code, size);
+        active[l] = true;
+    }
+}
+
+void LockstepEngine::gather(int l)
+{
+    const CPU &c = *machines[l];
+    r[REG_AX][l] = c.regs.AX;
+    r[REG_BX][l] = c.regs.BX;
+    r[REG_CX][l] = c.regs.CX;
+    r[REG_DX][l] = c.regs.DX;
+    r[REG_MNK][l] = c.regs.MNK;
+    r[REG_SP][l] = c.regs.SP;
+    r[REG_SI][l] = c.regs.SI;
+    r[REG_DI][l] = c.regs.DI;
+    r[REG_BP][l] = c.regs.BP;
+    ip[l] = c.regs.IP;
+    cs[l] = c.regs.CS;
+    flag_bits[l] = c.flags.bits;
+    parity[l] = c.flags.parity_source;
+    aux[l] = c.flags.aux_source;
+    retired[l] = c.instructions;
+    check_at[l] = c.interrupt_check_at;
+}
+
+void LockstepEngine::scatter(int l)
+{
+    CPU &c = *machines[l];
+    c.regs.AX = r[REG_AX][l];
+    c.regs.BX = r[REG_BX][l];
+    c.regs.CX = r[REG_CX][l];
+    c.regs.DX = r[REG_DX][l];
+    c.regs.MNK = r[REG_MNK][l];
+    c.regs.SP = r[REG_SP][l];
+    c.regs.SI = r[REG_SI][l];
+    c.regs.DI = r[REG_DI][l];
+    c.regs.BP = r[REG_BP][l];
+    c.regs.IP = ip[l];
+    c.regs.CS = cs[l];
+    c.flags.bits = flag_bits[l];
+    c.flags.parity_source = parity[l];
+    c.flags.aux_source = aux[l];
+    c.instructions = retired[l];
+}
+
+void LockstepEngine::scalar_step(int l)
+{
+    scatter(l);
+    active[l] = machines[l]->step();
+    gather(l);
+    scalar_count++;
+}
+
+// EVERY LANE LOOP WORKS ON LOCAL COPIES: dst/src/mask MAY POINT ANYWHERE (dst == src, src == A
+// MEMBER ARRAY...), LOCALS CANNOT ALIAS, SO THE LOOPS VECTORIZE WITHOUT RUNTIME OVERLAP CHECKS
+void LockstepEngine::advance(uint16_t length, const uint16_t *mask)
+{
+    alignas(32) uint16_t m[LANES];
+    std::memcpy(m, mask, sizeof(m));
+    for (int l = 0; l < LANES; l++)
+    {
+        ip[l] += length & m[l];
+        retired[l] += m[l] & 1;
+    }
+}
+
+template <class Op>
+void LockstepEngine::alu_lanes(uint16_t *dst, const uint16_t *src, const uint16_t *mask, uint8_t length)
+{
+    alignas(32) uint16_t m[LANES], d[LANES], s[LANES], f[LANES];
+    alignas(32) uint8_t p[LANES], a[LANES];
+    std::memcpy(m, mask, sizeof(m));
+    std::memcpy(d, dst, sizeof(d));
+    std::memcpy(s, src, sizeof(s));
+    std::memcpy(f, flag_bits, sizeof(f));
+    std::memcpy(p, parity, sizeof(p));
+    std::memcpy(a, aux, sizeof(a));
+
+    for (int l = 0; l < LANES; l++)
+    {
+        uint16_t status = 0;
+        uint8_t half = 0;
+        uint16_t res = Op::apply(d[l], s[l], f[l], status, half);
+        d[l] = blend(res, d[l], m[l]);
+        f[l] = (f[l] & ~(Op::AFFECTS & m[l])) | (status & Op::AFFECTS & m[l]);
+        p[l] = (uint8_t)blend(res & 0xFF, p[l], m[l]);
+        a[l] = (uint8_t)blend(half, a[l], m[l]);
+    }
+
+    if (Op::STORE)
+        std::memcpy(dst, d, sizeof(d));
+    if (Op::AFFECTS)
+    {
+        std::memcpy(flag_bits, f, sizeof(f));
+        std::memcpy(parity, p, sizeof(p));
+        std::memcpy(aux, a, sizeof(a));
+    }
+    advance(length, mask);
+}
+
+// BRANCHES SET IP THEMSELVES, advance(0, ...) ONLY RETIRES THEM
+template <class Cond>
+void LockstepEngine::jump_lanes(uint16_t target, const uint16_t *mask)
+{
+    alignas(32) uint16_t m[LANES];
+    std::memcpy(m, mask, sizeof(m));
+    for (int l = 0; l < LANES; l++)
+    {
+        uint16_t next = Cond::test(flag_bits[l]) ? target : (uint16_t)(ip[l] + 3);
+        ip[l] = blend(next, ip[l], m[l]);
+    }
+    advance(0, mask);
+}
+
+// DECREMENT CX, THEN BRANCH WHILE IT IS NON-ZERO AND Cond HOLDS
+template <class Cond>
+void LockstepEngine::loop_lanes(uint16_t target, const uint16_t *mask)
+{
+    alignas(32) uint16_t m[LANES];
+    std::memcpy(m, mask, sizeof(m));
+    uint16_t(&cx)[LANES] = r[REG_CX];
+    for (int l = 0; l < LANES; l++)
+    {
+        uint16_t counter = cx[l] - 1;
+        uint16_t next = (counter != 0 && Cond::test(flag_bits[l])) ? target : (uint16_t)(ip[l] + 3);
+        cx[l] = blend(counter, cx[l], m[l]);
+        ip[l] = blend(next, ip[l], m[l]);
+    }
+    advance(0, mask);
+}
+
+void LockstepEngine::jcxz_lanes(uint16_t target, const uint16_t *mask)
+{
+    alignas(32) uint16_t m[LANES];
+    std::memcpy(m, mask, sizeof(m));
+    const uint16_t(&cx)[LANES] = r[REG_CX];
+    for (int l = 0; l < LANES; l++)
+    {
+        uint16_t next = cx[l] == 0 ? target : (uint16_t)(ip[l] + 3);
+        ip[l] = blend(next, ip[l], m[l]);
+    }
+    advance(0, mask);
+}
+
+bool LockstepEngine::vector_step(const uint8_t *code, const uint16_t *mask)
+{
+    const uint8_t opcode = code[0];
+    const uint8_t length = OPCODE_TABLE[opcode].length;
+    const uint16_t operand16 = code[1] | (code[2] << 8); // Jcc/JMP/LOOP TARGET
+    alignas(32) uint16_t broadcast[LANES];
+
+    switch (OPCODE_TABLE[opcode].layout)
+    {
+    case LAYOUT_R16_R16:
+    case LAYOUT_R16_I16:
+    case LAYOUT_R16:
+        if (!vector_register(code[1]))
+            return false;
+        if (OPCODE_TABLE[opcode].layout == LAYOUT_R16_R16 && !vector_register(code[2]))
+            return false;
+        break;
+    default:
+        break;
+    }
+
+    // SOURCE OPERAND: A REGISTER ROW OR THE IMMEDIATE IN EVERY LANE
+    const uint16_t *src = broadcast;
+    if (OPCODE_TABLE[opcode].layout == LAYOUT_R16_R16)
+        src = r[code[2]];
+    else
+    {
+        uint16_t imm = code[2] | (code[3] << 8);
+        for (int l = 0; l < LANES; l++)
+            broadcast[l] = imm;
+    }
+    uint16_t *dst = r[code[1] <= REG_BP ? code[1] : 0];
+
+    switch (opcode)
+    {
+    case OP_MOV_REG_REG:
+    case OP_MOV_REG_IMM:
+        alu_lanes<LaneMov>(dst, src, mask, length);
+        return true;
+    case OP_ADD_REG_REG:
+    case OP_ADD_REG_IMM:
+        alu_lanes<LaneAdd>(dst, src, mask, length);
+        return true;
+    case OP_ADC_REG_REG:
+    case OP_ADC_REG_IMM:
+        alu_lanes<LaneAdc>(dst, src, mask, length);
+        return true;
+    case OP_SUB_REG_REG:
+    case OP_SUB_REG_IMM:
+        alu_lanes<LaneSub>(dst, src, mask, length);
+        return true;
+    case OP_SBB_REG_REG:
+    case OP_SBB_REG_IMM:
+        alu_lanes<LaneSbb>(dst, src, mask, length);
+        return true;
+    case OP_CMP_REG_REG:
+    case OP_CMP_REG_IMM:
+        alu_lanes<LaneCmp>(dst, src, mask, length);
+        return true;
+    case OP_AND_REG_REG:
+    case OP_AND_REG_IMM:
+        alu_lanes<LaneAnd>(dst, src, mask, length);
+        return true;
+    case OP_OR_REG_REG:
+    case OP_OR_REG_IMM:
+        alu_lanes<LaneOr>(dst, src, mask, length);
+        return true;
+    case OP_XOR_REG_REG:
+    case OP_XOR_REG_IMM:
+        alu_lanes<LaneXor>(dst, src, mask, length);
+        return true;
+    case OP_INC_REG:
+        alu_lanes<LaneInc>(dst, dst, mask, length);
+        return true;
+    case OP_DEC_REG:
+        alu_lanes<LaneDec>(dst, dst, mask, length);
+        return true;
+    case OP_NOT_REG:
+        alu_lanes<LaneNot>(dst, dst, mask, length);
+        return true;
+    case OP_NEG_REG16:
+        alu_lanes<LaneNeg>(dst, dst, mask, length);
+        return true;
+
+    case OP_NOP:
+        advance(length, mask);
+        return true;
+
+    case OP_JMP:
+        jump_lanes<Always>(operand16, mask);
+        return true;
+    case OP_JZ:
+        jump_lanes<IfZ>(operand16, mask);
+        return true;
+    case OP_JNZ:
+        jump_lanes<IfNZ>(operand16, mask);
+        return true;
+    case OP_JC:
+        jump_lanes<IfC>(operand16, mask);
+        return true;
+    case OP_JNC:
+        jump_lanes<IfNC>(operand16, mask);
+        return true;
+    case OP_JS:
+        jump_lanes<IfS>(operand16, mask);
+        return true;
+    case OP_JNS:
+        jump_lanes<IfNS>(operand16, mask);
+        return true;
+    case OP_JO:
+        jump_lanes<IfO>(operand16, mask);
+        return true;
+    case OP_JNO:
+        jump_lanes<IfNO>(operand16, mask);
+        return true;
+    case OP_JA:
+        jump_lanes<IfA>(operand16, mask);
+        return true;
+    case OP_JBE:
+        jump_lanes<IfBE>(operand16, mask);
+        return true;
+    case OP_JG:
+        jump_lanes<IfG>(operand16, mask);
+        return true;
+    case OP_JGE:
+        jump_lanes<IfGE>(operand16, mask);
+        return true;
+    case OP_JL:
+        jump_lanes<IfL>(operand16, mask);
+        return true;
+    case OP_JLE:
+        jump_lanes<IfLE>(operand16, mask);
+        return true;
+    case OP_LOOP:
+        loop_lanes<Always>(operand16, mask);
+        return true;
+    case OP_LOOPZ:
+        loop_lanes<IfZ>(operand16, mask);
+        return true;
+    case OP_LOOPNZ:
+        loop_lanes<IfNZ>(operand16, mask);
+        return true;
+    case OP_JCXZ:
+        jcxz_lanes(operand16, mask);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+int LockstepEngine::run(uint64_t max_steps)
+{
+    for (int l = 0; l < count; l++)
+        gather(l);
+
+    alignas(32) uint16_t in_group[LANES], vector_mask[LANES];
+    int running_lanes = 0, vector_lanes = 0, leader = 0;
+    uint64_t headroom = 0; // VECTOR STEPS LEFT BEFORE SOME LANE OF THE GROUP IS DUE AN INTERRUPT CHECK
+    bool regroup = true;
+
+    for (uint64_t steps = 0; steps < max_steps; steps++)
+    {
+        if (regroup)
+        {
+            // THE GROUP: RUNNING LANES AT THE LOWEST CS:IP
+            uint32_t at[LANES];
+            uint32_t lowest = UINT32_MAX;
+            for (int l = 0; l < LANES; l++)
+            {
+                at[l] = ((uint32_t)cs[l] << 16 | ip[l]) | (active[l] ? 0 : UINT32_MAX); // LANES >= count ARE NEVER ACTIVE
+                lowest = at[l] < lowest ? at[l] : lowest;
+            }
+            if (lowest == UINT32_MAX)
+                break;
+
+            // LANES WITH AN INTERRUPT CHECK DUE GO THROUGH step(), WHICH DOES IT
+            running_lanes = vector_lanes = 0;
+            headroom = UINT64_MAX;
+            for (int l = 0; l < LANES; l++)
+            {
+                in_group[l] = at[l] == lowest ? 0xFFFF : 0;
+                vector_mask[l] = in_group[l] & (retired[l] < check_at[l] ? 0xFFFF : 0);
+                running_lanes += active[l];
+                vector_lanes += vector_mask[l] & 1;
+                if (vector_mask[l] && check_at[l] - retired[l] < headroom)
+                    headroom = check_at[l] - retired[l];
+            }
+            leader = 0;
+            while (!in_group[leader])
+                leader++;
+        }
+
+        bool vectorized = false;
+        bool branch = false;
+        if (vector_lanes > 0)
+        {
+            uint8_t scratch[Memory::FETCH_WINDOW];
+            const uint8_t *code = machines[leader]->memory.fetch(cs[leader], ip[leader], scratch);
+            vectorized = vector_step(code, vector_mask);
+            branch = OPCODE_TABLE[code[0]].layout == LAYOUT_ADDR16;
+            if (vectorized)
+            {
+                vector_count += vector_lanes;
+                headroom--;
+            }
+        }
+
+        if (vectorized && vector_lanes == running_lanes)
+        {
+            // EVERY RUNNING LANE RAN THE SAME NON-BRANCH INSTRUCTION: THEY ARE STILL TOGETHER,
+            // SO THE GROUP STAYS AS IT IS UNTIL SOMEONE IS DUE A CHECK
+            regroup = branch || headroom == 0;
+            continue;
+        }
+
+        for (int l = 0; l < count; l++)
+        {
+            if (in_group[l] && !(vectorized && vector_mask[l]))
+                scalar_step(l);
+        }
+        regroup = true;
+    }
+
+    int still_running = 0;
+    for (int l = 0; l < count; l++)
+    {
+        scatter(l);
+        still_running += active[l];
+    }
+    return still_running;
+}
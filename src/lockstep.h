@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "cpu.h"
+
+// ===============================================================
+// == LOCKSTEP: MANY CPUS ON ONE INSTRUCTION STREAM
+// ===============================================================
+// FOR RUNNING ONE PROGRAM OVER MANY INPUTS (GRADING, PARAMETER SWEEPS). EVERY LANE IS A
+// COMPLETE CPU, BUT THE REGISTERS OF ALL LANES ARE KEPT HERE AS STRUCTURE OF ARRAYS WHILE
+// run() IS ACTIVE. EACH STEP PICKS THE RUNNING LANES WITH THE LOWEST CS:IP (LAGGING LANES
+// CATCH UP, DIVERGED LANES MEET AGAIN AFTER THE BRANCH) AND:
+//   - REGISTER-ONLY INSTRUCTIONS (16-BIT MOV/ALU/INC/DEC/NOT/NEG, Jcc, JMP, LOOPs, NOP) RUN FOR
+//     ALL OF THEM IN ONE MASKED LOOP OVER THE LANES, WHICH THE COMPILER VECTORIZES
+//   - ANYTHING ELSE (MEMORY, STACK, I/O, INTERRUPTS...) RUNS THROUGH THE LANE'S OWN
+//     CPU::step(), SO cpu.cpp STAYS THE ONE DEFINITION OF THE INSTRUCTION SET
+//
+// THE INSTRUCTION BYTES OF A GROUP ARE FETCHED FROM ITS FIRST LANE ONLY: ALL LANES MUST RUN
+// THE SAME CODE. A PROGRAM THAT REWRITES ITS OWN CODE DIFFERENTLY PER LANE NEEDS SEPARATE CPUs.
+class LockstepEngine
+{
+public:
+    static const int LANES = 16;
+
+    explicit LockstepEngine(int lanes = LANES); // CLAMPED TO 1..LANES
+    LockstepEngine(const LockstepEngine &) = delete;
+    LockstepEngine &operator=(const LockstepEngine &) = delete;
+
+    int lanes() const { return count; }
+
+    // SET UP (REGISTERS, MEMORY, KEYBOARD INPUT, EVENT SINK) AND INSPECT EACH MACHINE HERE.
+    // NOT WHILE run() IS ACTIVE: THE REGISTERS ARE ONLY WRITTEN BACK WHEN IT RETURNS.
+    CPU &lane(int i) { return *machines[i]; }
+
+    // CPU::load_program ON EVERY LANE, ALL OF THEM START RUNNING AGAIN
+    void load_program(const uint8_t *code, size_t size);
+
+    // RUNS UNTIL EVERY LANE STOPPED (HALT, FAULT) OR max_steps GROUP STEPS WENT BY.
+    // RETURNS THE NUMBER OF LANES STILL RUNNING
+    int run(uint64_t max_steps = UINT64_MAX);
+
+    bool running(int i) const { return active[i]; }
+
+    // LANE INSTRUCTIONS EXECUTED BY THE VECTOR LOOPS / BY CPU::step(), SINCE CONSTRUCTION
+    uint64_t vector_instructions() const { return vector_count; }
+    uint64_t scalar_instructions() const { return scalar_count; }
+
+private:
+    std::vector<std::unique_ptr<CPU>> machines;
+    int count;
+    bool active[LANES] = {};
+
+    // STRUCTURE OF ARRAYS STATE, [REGISTER CODE][LANE] FOR THE GENERAL REGISTERS.
+    // SEGMENT REGISTERS OTHER THAN CS ARE ONLY USED BY CPU::step() AND STAY IN THE CPU
+    alignas(32) uint16_t r[REG_BP + 1][LANES] = {};
+    alignas(32) uint16_t ip[LANES] = {};
+    alignas(32) uint16_t cs[LANES] = {};
+    alignas(32) uint16_t flag_bits[LANES] = {};
+    alignas(32) uint8_t parity[LANES] = {};
+    alignas(32) uint8_t aux[LANES] = {};
+    alignas(32) uint64_t retired[LANES] = {};
+    alignas(32) uint64_t check_at[LANES] = {}; // CPU::interrupt_check_at, THE LANE NEEDS step() FROM THERE ON
+
+    uint64_t vector_count = 0;
+    uint64_t scalar_count = 0;
+
+    void gather(int l);
+    void scatter(int l);
+    void scalar_step(int l);
+
+    // EXECUTES code FOR THE LANES WHOSE mask IS 0xFFFF. FALSE: NOT A VECTOR INSTRUCTION
+    bool vector_step(const uint8_t *code, const uint16_t *mask);
+
+    template <class Op>
+    void alu_lanes(uint16_t *dst, const uint16_t *src, const uint16_t *mask, uint8_t length);
+    template <class Cond>
+    void jump_lanes(uint16_t target, const uint16_t *mask);
+    template <class Cond>
+    void loop_lanes(uint16_t target, const uint16_t *mask);
+    void jcxz_lanes(uint16_t target, const uint16_t *mask);
+    void advance(uint16_t length, const uint16_t *mask); // IP += length, ONE MORE RETIRED
+};
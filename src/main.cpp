@@ -1,9 +1,88 @@
 #include "mainwindow.h"
+#include "objfile.h"
+#include "parser.h"
+#include "service.h"
 
 #include <QApplication>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static GradingService *serving = nullptr;
+
+static void stop_serving(int)
+{
+    if (serving)
+        serving->stop();
+}
 
 int main(int argc, char *argv[])
 {
+    // --serve <socket> [workers] [include_dir]: THE GRADING SERVICE INSTEAD OF THE WINDOW, SEE service.h
+    if (argc >= 3 && std::strcmp(argv[1], "--serve") == 0)
+    {
+        long workers = 0;
+        if (argc >= 4)
+        {
+            char *end = nullptr;
+            errno = 0;
+            workers = std::strtol(argv[3], &end, 10);
+            if (end == argv[3] || *end != '\0' || errno != 0 || workers < 0 || workers > GradingService::MAX_WORKERS)
+            {
+                std::fprintf(stderr, "ERROR: Worker count must be 0 (one per hardware thread) to %u, not %s\n",
+                             GradingService::MAX_WORKERS, argv[3]);
+                return 1;
+            }
+        }
+        GradingService service(static_cast<unsigned>(workers), argc >= 5 ? argv[4] : "");
+        serving = &service;
+        std::signal(SIGINT, stop_serving);
+        std::signal(SIGTERM, stop_serving);
+        bool served = service.serve(argv[2]);
+        serving = nullptr;
+        if (!served)
+        {
+            std::fprintf(stderr, "%s\n", service.get_last_error().c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    // --assemble <source|-> <object> [include_dir]: STREAMS A SOURCE OF ANY SIZE (- = STDIN) INTO
+    // AN OBJECT FILE WITHOUT THE WINDOW. INCLUDE LOOKS NEXT TO THE SOURCE UNLESS include_dir IS GIVEN
+    if (argc >= 4 && std::strcmp(argv[1], "--assemble") == 0)
+    {
+        Parser parser;
+        ObjectFile object;
+        bool from_stdin = std::strcmp(argv[2], "-") == 0;
+        if (argc >= 5)
+            parser.set_include_dir(argv[4]);
+        else if (!from_stdin)
+            parser.set_include_dir(std::filesystem::path(argv[2]).parent_path().string());
+
+        std::ifstream file;
+        if (!from_stdin)
+        {
+            file.open(argv[2], std::ios::binary);
+            if (!file.is_open())
+            {
+                std::fprintf(stderr, "ERROR: Could not open file %s\n", argv[2]);
+                return 1;
+            }
+        }
+        if (!object.assemble_stream(from_stdin ? std::cin : file, parser, argv[3]))
+        {
+            std::fprintf(stderr, "%s\n", object.get_last_error().c_str());
+            return 1;
+        }
+        return 0;
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -1,6 +1,7 @@
 #include "mainwindow.h"
 #include "cpu.h"
 #include "parser.h"
+#include "disassembler.h"
 #include "userdialog.h"
 
 
@@ -9,8 +10,10 @@
 #include <QHBoxLayout>
 #include <QGroupBox>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QHeaderView>
+#include <QLineEdit>
 #include "stardialog.h"
 #include <QSettings>
 #include <QMessageBox>
@@ -27,6 +30,7 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
     cpu = new CPU();
+    cpu->set_event_sink(&cpuEvents);
     parser = new Parser();
 
     setupUI();
@@ -97,14 +101,25 @@ void MainWindow::setupUI()
     QFont font("Monospace");
     font.setStyleHint(QFont::TypeWriter);
     codeEditor->setFont(font);
+    connect(codeEditor, &CodeEditor::breakpointToggled, this, [this](int) { rebuildBreakpoints(); });
 
     // === TERMINAL ===
     terminalOutput = new QPlainTextEdit;
     terminalOutput->setReadOnly(true);
     terminalOutput->setMaximumHeight(120);
 
+    // === KEYBOARD === (Enter'a basınca satır + '\n' klavye kuyruğuna eklenir)
+    keyboardInput = new QLineEdit;
+    keyboardInput->setPlaceholderText("Keyboard input (port 0x20)...");
+    connect(keyboardInput, &QLineEdit::returnPressed, this, [this]() {
+        cpu->keyboard->push_input(keyboardInput->text().toStdString() + "\n");
+        cpu->recheck_interrupts(); // klavye hattı (IRQ 1) artık aktif olabilir
+        terminalOutput->appendPlainText("[Keyboard] " + keyboardInput->text());
+        keyboardInput->clear();
+    });
+
     // === REGISTER TABLE ===
-    QStringList regs = {"AX","BX","CX","DX","SP","BP","SI","DI","IP"};
+    QStringList regs = {"AX","BX","CX","DX","SP","BP","SI","DI","IP","CS","DS","SS","ES"};
     registerTable = new QTableWidget(regs.size(), 5);
     QStringList headers = {"Register", "Hex", "Dec", "Low", "High"};
     registerTable->setHorizontalHeaderLabels(headers);
@@ -121,15 +136,34 @@ void MainWindow::setupUI()
     zf = new QLabel("ZF: ✘");
     sf = new QLabel("SF: ✘");
     of = new QLabel("OF: ✘");
-
+    pf = new QLabel("PF: ✘");
+    af = new QLabel("AF: ✘");
+    df = new QLabel("DF: ✘");
+    iflag = new QLabel("IF: ✘");
+    tf = new QLabel("TF: ✘");
+    flagsWord = new QLabel("FLAGS: 0x0002");
+
+    // üst satır: durum flagleri, alt satır: kontrol flagleri + 16-bit FLAGS word
     QHBoxLayout *flagsLayout = new QHBoxLayout;
     flagsLayout->addWidget(cf);
     flagsLayout->addWidget(zf);
     flagsLayout->addWidget(sf);
     flagsLayout->addWidget(of);
+    flagsLayout->addWidget(pf);
+    flagsLayout->addWidget(af);
+
+    QHBoxLayout *controlFlagsLayout = new QHBoxLayout;
+    controlFlagsLayout->addWidget(df);
+    controlFlagsLayout->addWidget(iflag);
+    controlFlagsLayout->addWidget(tf);
+    controlFlagsLayout->addWidget(flagsWord);
+
+    QVBoxLayout *flagsRows = new QVBoxLayout;
+    flagsRows->addLayout(flagsLayout);
+    flagsRows->addLayout(controlFlagsLayout);
 
     QGroupBox *flagsBox = new QGroupBox("Flags");
-    flagsBox->setLayout(flagsLayout);
+    flagsBox->setLayout(flagsRows);
 
     QVBoxLayout *rightLayout = new QVBoxLayout;
     rightLayout->addWidget(registerTable);
@@ -158,6 +192,7 @@ void MainWindow::setupUI()
     mainLayout->addWidget(centerSplitter, 6);
     mainLayout->addWidget(memoryTabs, 3);
     mainLayout->addWidget(terminalOutput, 1);
+    mainLayout->addWidget(keyboardInput);
     central->setLayout(mainLayout);
 
     setCentralWidget(central);
@@ -169,48 +204,74 @@ void MainWindow::setupUI()
 
 void MainWindow::on_actionAssemble_triggered()
 {
-    QString code = codeEditor->toPlainText();
-    machine_code = parser->parse_from_string(code.toStdString());
+    // kod ara vektör olmadan doğrudan vektör tablosunun hemen arkasına (0040:0000) derlenir
+    QByteArray code = codeEditor->toPlainText().toUtf8();
+    parser->parse_into(code.constData(), code.size(), cpu->memory, PROGRAM_SEGMENT);
 
-    if (machine_code.empty() && !parser->get_last_error().empty()) {
+    if (!parser->get_last_error().empty()) {
         terminalOutput->appendPlainText(QString::fromStdString(parser->get_last_error()));
+        sourceMap.clear();
     } else {
         terminalOutput->appendPlainText("[Assemble] OK - Machine code generated");
-        std::copy(machine_code.begin(), machine_code.end(), cpu->memory.begin());
-        cpu->regs.IP = 0; // program counter reset
+        // CS/DS/ES/SS programa bakar
+        cpu->start_program();
+        sourceMap = parser->get_source_map();
     }
+    rebuildBreakpoints();
     updateRegisters();
     updateFlags();
     updateMemoryView();
+    updateExecutionLine();
 }
 
 void MainWindow::on_actionRun_triggered()
 {
     terminalOutput->appendPlainText("[Run] CPU started...");
-    cpu->run();
+    bool stopped = false;
+    if (breakpointAddresses.empty()) {
+        cpu->run();
+    } else {
+        // ilk adım her zaman atılır, yoksa aynı breakpoint'te takılı kalırız
+        bool running = cpu->step();
+        while (running && !breakpointAddresses.count(cpu->regs.IP))
+            running = cpu->step();
+        stopped = running;
+    }
+    flushConsole();
+    flushEvents();
     updateRegisters();
     updateFlags();
     updateMemoryView();
-    terminalOutput->appendPlainText("[Run] CPU halted.");
+    updateExecutionLine();
+    if (stopped)
+        terminalOutput->appendPlainText(QString("[Run] Breakpoint hit at line %1.").arg(sourceMap.line_for_address(cpu->regs.IP)));
+    else
+        terminalOutput->appendPlainText("[Run] CPU halted.");
 }
 
 void MainWindow::on_actionStep_triggered()
 {
     terminalOutput->appendPlainText("[Step] Executing instruction...");
     cpu->step();
+    flushConsole();
+    flushEvents();
     updateRegisters();
     updateFlags();
     updateMemoryView();
+    updateExecutionLine();
 }
 
 void MainWindow::on_actionReset_triggered()
 {
     delete cpu;
     cpu = new CPU();
+    cpu->set_event_sink(&cpuEvents);
+    cpuEvents.clear();
     terminalOutput->appendPlainText("[Reset] CPU and memory reset.");
     updateRegisters();
     updateFlags();
     updateMemoryView();
+    codeEditor->highlightExecutionLine(-1);
 }
 
 void MainWindow::on_actionLoadFile_triggered()
@@ -220,6 +281,7 @@ void MainWindow::on_actionLoadFile_triggered()
         QFile file(filename);
         if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
             codeEditor->setPlainText(file.readAll());
+            parser->set_include_dir(QFileInfo(filename).absolutePath().toStdString());
             terminalOutput->appendPlainText("[LoadFile] " + filename);
         } else {
             QMessageBox::warning(this, "Error", "Cannot open file!");
@@ -229,6 +291,30 @@ void MainWindow::on_actionLoadFile_triggered()
 
 // === UPDATE HELPERS ===
 
+void MainWindow::flushConsole()
+{
+    // programın console cihazına yazdıkları
+    QString text = QString::fromStdString(cpu->console->take_output());
+    if (!text.isEmpty())
+        terminalOutput->appendPlainText(text);
+}
+
+void MainWindow::flushEvents()
+{
+    // halt / hata olayları; port, MMIO ve kesme olayları terminali boğmasın diye gösterilmez
+    if (cpuEvents.received() > cpuEvents.size())
+        terminalOutput->appendPlainText(QString("[CPU] %1 older events dropped").arg(cpuEvents.received() - cpuEvents.size()));
+    char line[96];
+    for (size_t i = 0; i < cpuEvents.size(); i++) {
+        const CpuEvent &event = cpuEvents.at(i);
+        if (event.kind != EVENT_HALT && event.kind != EVENT_FAULT && event.kind != EVENT_UNKNOWN_OPCODE)
+            continue;
+        format_event(event, line, sizeof(line));
+        terminalOutput->appendPlainText(QString("[CPU] ") + line);
+    }
+    cpuEvents.clear();
+}
+
 void MainWindow::updateRegisters()
 {
     auto setRow = [&](int row, uint16_t val) {
@@ -258,6 +344,34 @@ void MainWindow::updateRegisters()
     setRow(6, cpu->regs.SI);
     setRow(7, cpu->regs.DI);
     setRow(8, cpu->regs.IP);
+    setRow(9, cpu->regs.CS);
+    setRow(10, cpu->regs.DS);
+    setRow(11, cpu->regs.SS);
+    setRow(12, cpu->regs.ES);
+}
+
+void MainWindow::updateExecutionLine()
+{
+    codeEditor->highlightExecutionLine(sourceMap.line_for_address(cpu->regs.IP));
+}
+
+void MainWindow::rebuildBreakpoints()
+{
+    // editor satırı -> adres; kod üretmeyen satırdaki breakpoint bir sonraki komuta kayar
+    breakpointAddresses.clear();
+    if (sourceMap.empty())
+        return;
+
+    QSet<int> snapped;
+    for (int line : codeEditor->breakpointLines()) {
+        int addr = sourceMap.address_for_line(line);
+        if (addr < 0)
+            continue;
+        breakpointAddresses.insert(addr);
+        snapped.insert(sourceMap.line_for_address(addr));
+    }
+    if (snapped != codeEditor->breakpointLines())
+        codeEditor->setBreakpointLines(snapped);
 }
 
 void MainWindow::updateFlags()
@@ -266,18 +380,29 @@ void MainWindow::updateFlags()
     zf->setText(QString("ZF: %1").arg(cpu->flags.ZF ? "✔" : "✘"));
     sf->setText(QString("SF: %1").arg(cpu->flags.SF ? "✔" : "✘"));
     of->setText(QString("OF: %1").arg(cpu->flags.OF ? "✔" : "✘"));
+    pf->setText(QString("PF: %1").arg(cpu->flags.PF() ? "✔" : "✘"));
+    af->setText(QString("AF: %1").arg(cpu->flags.AF() ? "✔" : "✘"));
+    df->setText(QString("DF: %1").arg(cpu->flags.DF ? "✔" : "✘"));
+    iflag->setText(QString("IF: %1").arg(cpu->flags.IF ? "✔" : "✘"));
+    tf->setText(QString("TF: %1").arg(cpu->flags.TF ? "✔" : "✘"));
+    flagsWord->setText(QString("FLAGS: 0x%1").arg(cpu->flags.word(), 4, 16, QChar('0')).toUpper());
 }
 void MainWindow::updateMemoryView()
 {
-    // === Instruction Memory (0x0000 - 0x00FF) ===
+    // === Instruction Memory (CS:0x0000 - CS:0x00FF) ===
     int inst_rows = 0x0100; // 256 satır
+    uint32_t code_base = Memory::physical(cpu->regs.CS, 0);
     instructionMemoryTable->setRowCount(inst_rows);
-    instructionMemoryTable->setColumnCount(2);
-    instructionMemoryTable->setHorizontalHeaderLabels({"Addr", "Value"});
+    instructionMemoryTable->setColumnCount(3);
+    instructionMemoryTable->setHorizontalHeaderLabels({"Addr", "Value", "Disassembly"});
+
+    // canlı disassembly: her komutun ilk byte'ının satırına yazılır
+    std::vector<DisassembledLine> listing = Disassembler::disassemble(*cpu, code_base, code_base + inst_rows);
+    size_t next_line = 0;
 
     for (int addr = 0; addr < inst_rows; addr++) {
         auto *item = new QTableWidgetItem(
-            QString("%1").arg(cpu->memory[addr], 2, 16, QChar('0')).toUpper());
+            QString("%1").arg(cpu->memory[code_base + addr], 2, 16, QChar('0')).toUpper());
 
         // IP highlight → yeşil arkaplan + siyah yazı
         if (addr == cpu->regs.IP) {
@@ -288,9 +413,15 @@ void MainWindow::updateMemoryView()
         instructionMemoryTable->setItem(addr, 0, new QTableWidgetItem(
                                                      QString("0x%1").arg(addr, 4, 16, QChar('0')).toUpper()));
         instructionMemoryTable->setItem(addr, 1, item);
+
+        QString text;
+        if (next_line < listing.size() && listing[next_line].address == code_base + addr)
+            text = listing[next_line++].text;
+        instructionMemoryTable->setItem(addr, 2, new QTableWidgetItem(text));
     }
 
-    // === Stack Memory (0xFFFE -> 0xFF00) ===
+    // === Stack Memory (SS:0xFFFE -> SS:0xFF00) ===
+    uint32_t stack_base = Memory::physical(cpu->regs.SS, 0);
     int stack_start = 0xFFFE;
     int stack_end   = 0xFF00;
     int stack_rows  = stack_start - stack_end + 1;
@@ -301,7 +432,7 @@ void MainWindow::updateMemoryView()
 
     for (int addr = stack_start, row = 0; addr >= stack_end; addr--, row++) {
         auto *item = new QTableWidgetItem(
-            QString("%1").arg(static_cast<int>(cpu->memory[addr]), 2, 16, QChar('0')).toUpper());
+            QString("%1").arg(static_cast<int>(cpu->memory[stack_base + addr]), 2, 16, QChar('0')).toUpper());
 
         // SP highlight → sarı arkaplan + siyah yazı
         if (addr == cpu->regs.SP || addr == cpu->regs.SP + 1) {
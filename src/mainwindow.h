@@ -2,12 +2,16 @@
 
 #include <QMainWindow>
 #include <QPlainTextEdit>
+#include <QLineEdit>
 #include <QTableWidget>
 #include <QTabWidget>
 #include <QLabel>
 #include <QToolBar>
 #include <QAction>
 #include "codeeditor.h"
+#include "sourcemap.h"
+#include "events.h"
+#include <unordered_set>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -44,6 +48,7 @@ private:
     // UI bileşenleri
     CodeEditor *codeEditor;
     QPlainTextEdit *terminalOutput;
+    QLineEdit      *keyboardInput;
     QTableWidget   *registerTable;
     QTabWidget     *memoryTabs;
     QTableWidget   *instructionMemoryTable;
@@ -53,6 +58,12 @@ private:
     QLabel *zf;
     QLabel *sf;
     QLabel *of;
+    QLabel *pf;
+    QLabel *af;
+    QLabel *df;
+    QLabel *iflag;
+    QLabel *tf;
+    QLabel *flagsWord;
 
     QAction *actAssemble;
     QAction *actRun;
@@ -63,11 +74,19 @@ private:
     // CPU & Parser
     CPU *cpu;
     Parser *parser;
-    std::vector<uint8_t> machine_code;
+
+    // Debugger
+    SourceMap sourceMap;
+    RingBufferSink<256> cpuEvents; // CPU olayları, run/step sonrası terminale aktarılır
+    std::unordered_set<uint32_t> breakpointAddresses;
 
     // Helpers
     void setupUI();
     void updateRegisters();
     void updateFlags();
     void updateMemoryView();
+    void updateExecutionLine();
+    void flushConsole();
+    void flushEvents();
+    void rebuildBreakpoints();
 };
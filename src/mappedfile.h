@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+// READ-ONLY VIEW OF A WHOLE FILE, mmap'ED WHERE AVAILABLE. AN EMPTY OR MISSING FILE HAS
+// data() == nullptr; opened() TELLS THEM APART
+class MappedFile
+{
+private:
+    const uint8_t *data_ptr = nullptr;
+    size_t data_size = 0;
+    bool is_open = false;
+    std::vector<uint8_t> fallback;
+#ifndef _WIN32
+    void *mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const std::string &filename)
+    {
+#ifndef _WIN32
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+        {
+            if (st.st_size == 0)
+                is_open = true;
+            else
+            {
+                void *p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+                    mapping = p;
+                    data_ptr = static_cast<const uint8_t *>(p);
+                    data_size = st.st_size;
+                    is_open = true;
+                }
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open())
+            return;
+        fallback.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data_ptr = fallback.data();
+        data_size = fallback.size();
+        is_open = true;
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (mapping)
+            ::munmap(mapping, data_size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool opened() const { return is_open; }
+    const uint8_t *data() const { return data_ptr; }
+    const char *text() const { return reinterpret_cast<const char *>(data_ptr); }
+    size_t size() const { return data_size; }
+};
@@ -0,0 +1,134 @@
+#include "memory.h"
+#include <algorithm>
+#include <cstring>
+
+alignas(64) const uint8_t Memory::ZERO_PAGE[Memory::PAGE_SIZE] = {};
+
+// EVERY UNTOUCHED 64 KiB REGION FINDS ITS PAGES HERE
+struct Memory::ZeroView
+{
+    const uint8_t *view[TABLE_PAGES];
+    constexpr ZeroView() : view()
+    {
+        for (auto &page_view : view)
+            page_view = ZERO_PAGE;
+    }
+};
+const Memory::ZeroView Memory::ZERO_VIEW; // CONSTANT INITIALIZED, READY BEFORE ANY STATIC Memory
+
+Memory::Memory()
+{
+    for (auto &table_view : directory)
+        table_view = ZERO_VIEW.view;
+}
+
+Memory::Memory(const Memory &other) : Memory()
+{
+    *this = other;
+}
+
+// GOES THROUGH THE DIRECTORIES, SO EITHER SIDE MAY BE A WINDOW (SEE share)
+Memory &Memory::operator=(const Memory &other)
+{
+    if (this == &other)
+        return *this;
+    for (uint32_t t = 0; t < TABLES; t++)
+    {
+        for (uint32_t i = 0; i < TABLE_PAGES; i++)
+        {
+            const uint8_t *source = other.directory[t][i];
+            if (source != ZERO_PAGE)
+            {
+                uint8_t *target = writable(t * TABLE_PAGES + i);
+                if (target != source)
+                    std::memcpy(target, source, PAGE_SIZE);
+            }
+            else if (directory[t][i] != ZERO_PAGE)
+            {
+                if (tables[t])
+                {
+                    tables[t]->pages[i].reset();
+                    tables[t]->view[i] = ZERO_PAGE;
+                    allocated--;
+                }
+                else // A WINDOW: THE SHARED PAGE STAYS, ITS BYTES BECOME ZERO
+                    std::memset(const_cast<uint8_t *>(directory[t][i]), 0, PAGE_SIZE);
+            }
+        }
+    }
+    return *this;
+}
+
+uint8_t *Memory::allocate(uint32_t page)
+{
+    std::unique_ptr<Table> &table = tables[page >> TABLE_BITS];
+    if (!table)
+    {
+        table.reset(new Table());
+        std::copy(ZERO_VIEW.view, ZERO_VIEW.view + TABLE_PAGES, table->view);
+        directory[page >> TABLE_BITS] = table->view;
+    }
+    uint32_t slot = page & (TABLE_PAGES - 1);
+    table->pages[slot].reset(new Page());
+    table->view[slot] = table->pages[slot]->bytes;
+    allocated++;
+    return table->pages[slot]->bytes;
+}
+
+void Memory::drop(uint32_t table)
+{
+    if (!tables[table])
+    {
+        directory[table] = ZERO_VIEW.view; // NOTHING OWNED, AT MOST A WINDOW TO DETACH
+        return;
+    }
+    for (const auto &page : tables[table]->pages)
+        if (page)
+            allocated--;
+    tables[table].reset();
+    directory[table] = ZERO_VIEW.view;
+}
+
+uint16_t Memory::read16_split(uint16_t segment, uint16_t offset) const
+{
+    return read8(physical(segment, offset)) | (read8(physical(segment, offset + 1)) << 8);
+}
+
+void Memory::write16_split(uint16_t segment, uint16_t offset, uint16_t value)
+{
+    write8(physical(segment, offset), value & 0xFF);
+    write8(physical(segment, offset + 1), (value >> 8) & 0xFF);
+}
+
+void Memory::load(uint32_t address, const uint8_t *data, size_t size)
+{
+    size = std::min<size_t>(size, SIZE);
+    address &= SIZE - 1;
+    while (size > 0)
+    {
+        uint32_t page = address >> PAGE_BITS;
+        uint32_t start = address & PAGE_MASK;
+        size_t chunk = std::min<size_t>(size, PAGE_SIZE - start);
+        std::memcpy(writable(page) + start, data, chunk);
+        data += chunk;
+        size -= chunk;
+        address = (address + chunk) & (SIZE - 1);
+    }
+}
+
+void Memory::clear()
+{
+    for (uint32_t t = 0; t < TABLES; t++)
+        drop(t);
+}
+
+void Memory::share(Memory &shared)
+{
+    if (&shared == this)
+        return;
+    clear();
+    for (uint32_t page = 0; page < PAGES; page++)
+        shared.writable(page);
+    for (uint32_t t = 0; t < TABLES; t++)
+        directory[t] = shared.directory[t];
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// ===============================================================
+// == 1 MiB SEGMENTED MEMORY, ALLOCATED 4 KiB AT A TIME
+// ===============================================================
+// PHYSICAL ADDRESS = (SEGMENT << 4) + OFFSET, 20 BITS, WRAPPING AT 1 MiB.
+// OFFSETS ARE 16-BIT AND WRAP INSIDE THEIR SEGMENT (A WORD AT ds:0xFFFF
+// HAS ITS HIGH BYTE AT ds:0x0000), EXACTLY LIKE THE 8086.
+//
+// THE 1 MiB IS SPLIT INTO 256 PAGES THAT ARE ONLY ALLOCATED ON THE FIRST
+// WRITE. UNTOUCHED PAGES READ AS ZERO FROM ONE SHARED ZERO PAGE, SO A
+// PROGRAM OF A FEW HUNDRED BYTES WITH A SMALL STACK COSTS 8 KiB, NOT 1 MiB.
+//
+// PAGES ARE FOUND THROUGH A TWO LEVEL TABLE: A DIRECTORY OF 16 ENTRIES, ONE PER
+// 64 KiB, EACH POINTING TO THE 16 PAGE POINTERS OF ITS REGION. A REGION NOTHING
+// WAS WRITTEN TO POINTS TO ONE SHARED ZERO TABLE, SO AN EMPTY Memory IS A FEW
+// HUNDRED BYTES AND CONSTRUCTING ONE IS 16 POINTER STORES.
+class Memory
+{
+public:
+    static const uint32_t SIZE = 0x100000;        // 20-BIT PHYSICAL ADDRESS SPACE
+    static const uint32_t SEGMENT_SIZE = 0x10000; // OFFSETS WRAP HERE
+    static const uint32_t PAGE_BITS = 12;         // ALLOCATION UNIT, 4 KiB
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+    static const uint32_t PAGES = SIZE / PAGE_SIZE;
+    static const uint32_t TABLE_BITS = 4; // PAGES PER TABLE, 16 = 64 KiB
+    static const uint32_t TABLE_PAGES = 1u << TABLE_BITS;
+    static const uint32_t TABLE_SHIFT = PAGE_BITS + TABLE_BITS;
+    static const uint32_t TABLES = PAGES / TABLE_PAGES;
+    static const uint32_t FETCH_WINDOW = 8; // >= LONGEST INSTRUCTION
+
+private:
+    struct Page
+    {
+        alignas(64) uint8_t bytes[PAGE_SIZE];
+    };
+
+    // EVERY UNTOUCHED PAGE OF EVERY CPU READS FROM HERE
+    static const uint8_t ZERO_PAGE[PAGE_SIZE];
+    // AND EVERY UNTOUCHED 64 KiB REGION FINDS ITS PAGES HERE
+    struct ZeroView;
+    static const ZeroView ZERO_VIEW;
+
+    // ONE 64 KiB REGION
+    struct Table
+    {
+        const uint8_t *view[TABLE_PAGES]; // READ POINTER OF EVERY PAGE, THE ZERO PAGE UNTIL WRITTEN
+        std::unique_ptr<Page> pages[TABLE_PAGES];
+    };
+
+    const uint8_t *const *directory[TABLES]; // view OF EVERY TABLE, THE SHARED ZERO VIEW UNTIL WRITTEN
+    std::unique_ptr<Table> tables[TABLES];
+    size_t allocated = 0;
+
+    // address IS ALREADY MASKED TO 20 BITS
+    const uint8_t *page_view(uint32_t address) const
+    {
+        return directory[address >> TABLE_SHIFT][(address >> PAGE_BITS) & (TABLE_PAGES - 1)];
+    }
+
+    uint8_t *allocate(uint32_t page);
+    void drop(uint32_t table); // BACK TO THE ZERO TABLE
+    // A PAGE IS ALLOCATED EXACTLY WHEN ITS VIEW IS NOT THE ZERO PAGE, SO A WRITE FINDS ITS
+    // PAGE WITH THE SAME TWO LOADS AS A READ
+    uint8_t *writable(uint32_t page)
+    {
+        const uint8_t *bytes = directory[page >> TABLE_BITS][page & (TABLE_PAGES - 1)];
+        return bytes != ZERO_PAGE ? const_cast<uint8_t *>(bytes) : allocate(page);
+    }
+
+    // SLOW PATH OF THE WORD AND FETCH ACCESSORS: BYTE BY BYTE WITH OFFSET WRAP
+    uint16_t read16_split(uint16_t segment, uint16_t offset) const;
+    void write16_split(uint16_t segment, uint16_t offset, uint16_t value);
+
+public:
+    Memory();
+    Memory(const Memory &other);
+    Memory &operator=(const Memory &other);
+
+    static uint32_t physical(uint16_t segment, uint16_t offset)
+    {
+        return (((uint32_t)segment << 4) + offset) & (SIZE - 1);
+    }
+
+    // PHYSICAL BYTE ACCESS
+    uint8_t read8(uint32_t address) const
+    {
+        address &= SIZE - 1;
+        return page_view(address)[address & PAGE_MASK];
+    }
+    void write8(uint32_t address, uint8_t value)
+    {
+        address &= SIZE - 1;
+        writable(address >> PAGE_BITS)[address & PAGE_MASK] = value;
+    }
+
+    // PHYSICAL LITTLE ENDIAN WORD ACCESS (LOADERS, TOOLS)
+    uint16_t read16(uint32_t address) const { return read8(address) | (read8(address + 1) << 8); }
+    void write16(uint32_t address, uint16_t value)
+    {
+        write8(address, value & 0xFF);
+        write8(address + 1, (value >> 8) & 0xFF);
+    }
+
+    // SEGMENT:OFFSET ACCESS USED BY THE CPU
+    uint8_t read8(uint16_t segment, uint16_t offset) const { return read8(physical(segment, offset)); }
+    void write8(uint16_t segment, uint16_t offset, uint8_t value) { write8(physical(segment, offset), value); }
+
+    // ONE UNALIGNED LOAD/STORE UNLESS THE WORD STRADDLES A PAGE OR THE SEGMENT END
+    uint16_t read16(uint16_t segment, uint16_t offset) const
+    {
+        uint32_t address = physical(segment, offset);
+        if ((address & PAGE_MASK) == PAGE_MASK || offset == 0xFFFF)
+            return read16_split(segment, offset);
+        const uint8_t *p = page_view(address) + (address & PAGE_MASK);
+        return p[0] | (p[1] << 8);
+    }
+    void write16(uint16_t segment, uint16_t offset, uint16_t value)
+    {
+        uint32_t address = physical(segment, offset);
+        if ((address & PAGE_MASK) == PAGE_MASK || offset == 0xFFFF)
+            return write16_split(segment, offset, value);
+        uint8_t *p = writable(address >> PAGE_BITS) + (address & PAGE_MASK);
+        p[0] = value & 0xFF;
+        p[1] = (value >> 8) & 0xFF;
+    }
+
+    // INSTRUCTION FETCH: FETCH_WINDOW BYTES STARTING AT segment:offset. THEY ARE READ IN
+    // PLACE UNLESS THE WINDOW CROSSES A PAGE OR THE SEGMENT END, THEN GATHERED INTO scratch.
+    const uint8_t *fetch(uint16_t segment, uint16_t offset, uint8_t *scratch) const
+    {
+        uint32_t address = physical(segment, offset);
+        if ((address & PAGE_MASK) <= PAGE_SIZE - FETCH_WINDOW && offset <= SEGMENT_SIZE - FETCH_WINDOW)
+            return page_view(address) + (address & PAGE_MASK);
+        for (uint32_t i = 0; i < FETCH_WINDOW; i++)
+            scratch[i] = read8(physical(segment, offset + i));
+        return scratch;
+    }
+
+    // STRING INSTRUCTION SUPPORT: HOW MANY size-BYTE ELEMENTS, STARTING AT segment:offset AND
+    // STEPPING UP (OR DOWN), LIE IN ONE CONTIGUOUS RUN OF A PAGE WITHOUT WRAPPING THE OFFSET.
+    // 0 MEANS THE FIRST ELEMENT ITSELF STRADDLES A BOUNDARY.
+    size_t contiguous(uint16_t segment, uint16_t offset, unsigned size, bool backward) const
+    {
+        uint32_t in_page = physical(segment, offset) & PAGE_MASK;
+        if (!backward)
+        {
+            uint32_t page_room = PAGE_SIZE - in_page;
+            uint32_t segment_room = SEGMENT_SIZE - offset;
+            return (page_room < segment_room ? page_room : segment_room) / size;
+        }
+        if (offset > SEGMENT_SIZE - size || in_page > PAGE_SIZE - size)
+            return 0;
+        return (in_page < offset ? in_page : offset) / size + 1;
+    }
+
+    // DIRECT POINTERS INTO A RUN RETURNED BY contiguous(). TAKE THE WRITABLE ONE FIRST:
+    // ALLOCATING A PAGE MOVES ITS READ POINTER OFF THE ZERO PAGE.
+    const uint8_t *pointer(uint16_t segment, uint16_t offset) const
+    {
+        uint32_t address = physical(segment, offset);
+        return page_view(address) + (address & PAGE_MASK);
+    }
+    uint8_t *writable_pointer(uint16_t segment, uint16_t offset)
+    {
+        uint32_t address = physical(segment, offset);
+        return writable(address >> PAGE_BITS) + (address & PAGE_MASK);
+    }
+
+    // BULK COPY TO A PHYSICAL ADDRESS, WRAPS AT 1 MiB
+    void load(uint32_t address, const uint8_t *data, size_t size);
+
+    // DROP EVERY PAGE, MEMORY READS AS ZERO AGAIN. A WINDOW (SEE share) IS DETACHED
+    void clear();
+
+    // MAKES THIS Memory A WINDOW ONTO shared (THE CORES OF AN SmpMachine): EVERY PAGE OF shared
+    // IS ALLOCATED NOW AND THIS DIRECTORY POINTS AT ITS TABLES, SO BOTH READ AND WRITE THE SAME
+    // BYTES AND NO ACCESS THROUGH EITHER EVER ALLOCATES OR CHANGES A TABLE AGAIN. THAT IS WHAT
+    // LETS CORES ON DIFFERENT HOST THREADS USE IT WITHOUT A LOCK. shared MUST OUTLIVE THE WINDOW
+    // AND MUST NOT BE CLEARED OR ASSIGNED TO MEANWHILE (THAT FREES PAGES); GO THROUGH A WINDOW
+    void share(Memory &shared);
+
+    uint8_t operator[](uint32_t address) const { return read8(address); }
+    size_t size() const { return SIZE; }
+    size_t allocated_bytes() const { return allocated * PAGE_SIZE; } // OWNED PAGES ONLY
+};
@@ -0,0 +1,324 @@
+#include "objfile.h"
+#include "cpu.h"
+#include "mappedfile.h"
+#include "parser.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static const char OBJECT_MAGIC[4] = {'X', '8', '6', 'O'};
+static const uint16_t OBJECT_VERSION = 1;
+static const size_t HEADER_SIZE = 28;
+
+// BOUNDS CHECKED LITTLE ENDIAN CURSOR
+struct ByteReader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    bool ok = true;
+
+    bool need(size_t n)
+    {
+        if (!ok || (size_t)(end - p) < n)
+            ok = false;
+        return ok;
+    }
+    uint16_t u16()
+    {
+        if (!need(2))
+            return 0;
+        uint16_t v = p[0] | (p[1] << 8);
+        p += 2;
+        return v;
+    }
+    uint32_t u32()
+    {
+        if (!need(4))
+            return 0;
+        uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        p += 4;
+        return v;
+    }
+    const uint8_t *take(size_t n)
+    {
+        if (!need(n))
+            return nullptr;
+        const uint8_t *start = p;
+        p += n;
+        return start;
+    }
+};
+
+static void put_u16(std::vector<uint8_t> &out, uint16_t v)
+{
+    out.push_back(v & 0xFF);
+    out.push_back((v >> 8) & 0xFF);
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back((v >> (8 * i)) & 0xFF);
+}
+
+struct ObjectHeader
+{
+    uint32_t entry;
+    uint32_t segment_count;
+    uint32_t symbol_count;
+    uint32_t reloc_count;
+    uint32_t line_count;
+};
+
+static bool read_header(ByteReader &in, ObjectHeader &header, std::string &error)
+{
+    const uint8_t *magic = in.take(4);
+    if (!magic || std::memcmp(magic, OBJECT_MAGIC, 4) != 0)
+    {
+        error = "ERROR: Not an X86O object file";
+        return false;
+    }
+    if (in.u16() != OBJECT_VERSION)
+    {
+        error = "ERROR: Unsupported object file version";
+        return false;
+    }
+    in.u16(); // RESERVED
+    header.entry = in.u32();
+    header.segment_count = in.u32();
+    header.symbol_count = in.u32();
+    header.reloc_count = in.u32();
+    header.line_count = in.u32();
+    if (!in.ok)
+    {
+        error = "ERROR: Truncated object file header";
+        return false;
+    }
+    return true;
+}
+
+ObjectImage ObjectFile::from_assembly(const std::vector<uint8_t> &machine_code, const Parser &parser)
+{
+    ObjectImage image;
+    image.entry = 0;
+    image.segments.push_back({0, machine_code});
+
+    for (const auto &label : parser.get_labels())
+        image.symbols.push_back({label.first, label.second});
+    std::sort(image.symbols.begin(), image.symbols.end(),
+              [](const ObjectSymbol &a, const ObjectSymbol &b)
+              { return a.address < b.address || (a.address == b.address && a.name < b.name); });
+
+    for (uint16_t reloc : parser.get_relocations())
+        image.relocations.push_back(reloc);
+
+    for (const auto &entry : parser.get_source_map().entries())
+        image.lines.push_back({entry.address, entry.line});
+
+    return image;
+}
+
+std::vector<uint8_t> ObjectFile::serialize(const ObjectImage &image)
+{
+    size_t total = HEADER_SIZE + image.relocations.size() * 4 + image.lines.size() * 8;
+    for (const auto &segment : image.segments)
+        total += 8 + segment.bytes.size();
+    for (const auto &symbol : image.symbols)
+        total += 6 + symbol.name.size();
+
+    std::vector<uint8_t> out;
+    out.reserve(total);
+    for (char c : OBJECT_MAGIC)
+        out.push_back(c);
+    put_u16(out, OBJECT_VERSION);
+    put_u16(out, 0);
+    put_u32(out, image.entry);
+    put_u32(out, image.segments.size());
+    put_u32(out, image.symbols.size());
+    put_u32(out, image.relocations.size());
+    put_u32(out, image.lines.size());
+
+    for (const auto &segment : image.segments)
+    {
+        put_u32(out, segment.address);
+        put_u32(out, segment.bytes.size());
+        out.insert(out.end(), segment.bytes.begin(), segment.bytes.end());
+    }
+    for (const auto &symbol : image.symbols)
+    {
+        put_u32(out, symbol.address);
+        put_u16(out, symbol.name.size());
+        out.insert(out.end(), symbol.name.begin(), symbol.name.end());
+    }
+    for (uint32_t reloc : image.relocations)
+        put_u32(out, reloc);
+    for (const auto &line : image.lines)
+    {
+        put_u32(out, line.address);
+        put_u32(out, line.line);
+    }
+    return out;
+}
+
+bool ObjectFile::deserialize(const uint8_t *data, size_t size, ObjectImage &image)
+{
+    last_error = "";
+    ByteReader in{data, data + size};
+    ObjectHeader header;
+    if (!read_header(in, header, last_error))
+        return false;
+
+    image = ObjectImage();
+    image.entry = header.entry;
+    for (uint32_t i = 0; i < header.segment_count && in.ok; i++)
+    {
+        ObjectSegment segment;
+        segment.address = in.u32();
+        uint32_t length = in.u32();
+        const uint8_t *bytes = in.take(length);
+        if (bytes)
+            segment.bytes.assign(bytes, bytes + length);
+        image.segments.push_back(std::move(segment));
+    }
+    for (uint32_t i = 0; i < header.symbol_count && in.ok; i++)
+    {
+        ObjectSymbol symbol;
+        symbol.address = in.u32();
+        uint16_t length = in.u16();
+        const uint8_t *name = in.take(length);
+        if (name)
+            symbol.name.assign(reinterpret_cast<const char *>(name), length);
+        image.symbols.push_back(std::move(symbol));
+    }
+    for (uint32_t i = 0; i < header.reloc_count && in.ok; i++)
+        image.relocations.push_back(in.u32());
+    for (uint32_t i = 0; i < header.line_count && in.ok; i++)
+    {
+        LineRecord line;
+        line.address = in.u32();
+        line.line = in.u32();
+        image.lines.push_back(line);
+    }
+
+    if (!in.ok)
+    {
+        last_error = "ERROR: Truncated object file";
+        return false;
+    }
+    return true;
+}
+
+bool ObjectFile::write(const std::string &filename, const ObjectImage &image)
+{
+    last_error = "";
+    std::vector<uint8_t> bytes = serialize(image);
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        last_error = "ERROR: Could not create file " + filename;
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    if (!file)
+    {
+        last_error = "ERROR: Could not write file " + filename;
+        return false;
+    }
+    return true;
+}
+
+bool ObjectFile::assemble_stream(std::istream &source, Parser &parser, const std::string &filename)
+{
+    last_error = "";
+    std::vector<uint8_t> machine_code(Memory::SEGMENT_SIZE);
+    size_t size = parser.stream_into(source, machine_code.data(), machine_code.size());
+    if (!parser.get_last_error().empty())
+    {
+        last_error = parser.get_last_error();
+        return false;
+    }
+    machine_code.resize(size);
+    return write(filename, from_assembly(machine_code, parser));
+}
+
+bool ObjectFile::read(const std::string &filename, ObjectImage &image)
+{
+    MappedFile file(filename);
+    if (!file.data())
+    {
+        last_error = "ERROR: Could not open file " + filename;
+        return false;
+    }
+    return deserialize(file.data(), file.size(), image);
+}
+
+bool ObjectFile::load(const std::string &filename, CPU &cpu, uint16_t base)
+{
+    last_error = "";
+    MappedFile file(filename);
+    if (!file.data())
+    {
+        last_error = "ERROR: Could not open file " + filename;
+        return false;
+    }
+
+    ByteReader in{file.data(), file.data() + file.size()};
+    ObjectHeader header;
+    if (!read_header(in, header, last_error))
+        return false;
+
+    // ADDRESSES IN THE OBJECT ARE OFFSETS IN THE PROGRAM SEGMENT, AS WITH CPU::load_program().
+    // base MOVES THEM ALL UP, THEY MUST STAY INSIDE THE SEGMENT
+    const uint32_t program = Memory::physical(PROGRAM_SEGMENT, 0);
+    for (uint32_t i = 0; i < header.segment_count; i++)
+    {
+        uint64_t offset = (uint64_t)in.u32() + base;
+        uint32_t length = in.u32();
+        const uint8_t *bytes = in.take(length);
+        if (!bytes)
+        {
+            last_error = "ERROR: Truncated object file";
+            return false;
+        }
+        if (offset > Memory::SEGMENT_SIZE || length > Memory::SEGMENT_SIZE - offset)
+        {
+            last_error = "ERROR: Object segment does not fit in the program segment";
+            return false;
+        }
+        cpu.memory.load(program + offset, bytes, length);
+    }
+
+    // SYMBOLS ARE NOT NEEDED TO RUN, SKIP OVER THEM
+    for (uint32_t i = 0; i < header.symbol_count && in.ok; i++)
+    {
+        in.u32();
+        in.take(in.u16());
+    }
+
+    // EACH RELOCATION IS A WORD HOLDING A PROGRAM OFFSET
+    for (uint32_t i = 0; i < header.reloc_count && in.ok; i++)
+    {
+        uint64_t offset = (uint64_t)in.u32() + base;
+        if (offset + 1 >= Memory::SEGMENT_SIZE)
+        {
+            last_error = "ERROR: Relocation outside of the program segment";
+            return false;
+        }
+        const uint16_t at = static_cast<uint16_t>(offset);
+        cpu.memory.write16(PROGRAM_SEGMENT, at, cpu.memory.read16(PROGRAM_SEGMENT, at) + base);
+    }
+
+    if (!in.ok)
+    {
+        last_error = "ERROR: Truncated object file";
+        return false;
+    }
+    cpu.start_program();
+    cpu.regs.IP = header.entry + base;
+    return true;
+}
+
+std::string ObjectFile::get_last_error()
+{
+    return last_error;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class CPU;
+class Parser;
+
+// ===============================================================
+// == X86O OBJECT FORMAT (ALL FIELDS LITTLE ENDIAN)
+// ===============================================================
+//  HEADER       "X86O" u16 version  u16 reserved  u32 entry
+//               u32 segment_count  u32 symbol_count  u32 reloc_count  u32 line_count
+//  SEGMENTS     { u32 address  u32 size  u8 bytes[size] } * segment_count
+//  SYMBOLS      { u32 address  u16 name_len  char name[name_len] } * symbol_count
+//  RELOCATIONS  { u32 address } * reloc_count   (16-BIT WORDS HOLDING AN ABSOLUTE CODE ADDRESS)
+//  LINES        { u32 address  u32 line } * line_count   (SORTED BY ADDRESS)
+
+struct ObjectSegment
+{
+    uint32_t address = 0;
+    std::vector<uint8_t> bytes;
+};
+
+struct ObjectSymbol
+{
+    std::string name;
+    uint32_t address = 0;
+};
+
+struct LineRecord
+{
+    uint32_t address;
+    uint32_t line;
+};
+
+struct ObjectImage
+{
+    uint32_t entry = 0;
+    std::vector<ObjectSegment> segments;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<uint32_t> relocations;
+    std::vector<LineRecord> lines;
+};
+
+class ObjectFile
+{
+private:
+    std::string last_error;
+
+public:
+    // BUILD AN IMAGE FROM THE PARSER'S LAST ASSEMBLY (CODE IS ASSEMBLED AT 0x0000)
+    static ObjectImage from_assembly(const std::vector<uint8_t> &machine_code, const Parser &parser);
+
+    static std::vector<uint8_t> serialize(const ObjectImage &image);
+    bool deserialize(const uint8_t *data, size_t size, ObjectImage &image);
+
+    bool write(const std::string &filename, const ObjectImage &image);
+
+    // ASSEMBLES source WITH Parser::stream_into() AND WRITES THE OBJECT TO filename. THE SOURCE IS
+    // NEVER HELD WHOLE, THE CODE BUFFER IS ONE SEGMENT, SO ANY SIZE OF SOURCE TEXT WORKS
+    bool assemble_stream(std::istream &source, Parser &parser, const std::string &filename);
+    bool read(const std::string &filename, ObjectImage &image);
+
+    // FAST PATH: MAP THE FILE AND COPY SEGMENTS STRAIGHT INTO CPU MEMORY AT PROGRAM_SEGMENT:base,
+    // APPLY RELOCATIONS, SET THE SEGMENT REGISTERS LIKE CPU::load_program() AND POINT IP AT THE ENTRY
+    bool load(const std::string &filename, CPU &cpu, uint16_t base = 0);
+
+    std::string get_last_error();
+};
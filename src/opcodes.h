@@ -0,0 +1,336 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "cpu.h"
+
+// ===============================================================
+// == OPCODE METADATA SHARED BY THE CPU, DISASSEMBLER AND TOOLS
+// ===============================================================
+// OPERAND LAYOUT = ENCODED BYTES AFTER THE OPCODE (IN ORDER) -> PRINTED FORM
+enum OperandLayout : uint8_t
+{
+    LAYOUT_INVALID,   // NOT AN OPCODE
+    LAYOUT_NONE,      // -
+    LAYOUT_ADDR16,    // [imm16]              -> 0x1234
+    LAYOUT_R16,       // [r16]                -> AX
+    LAYOUT_R8,        // [r8]                 -> AL
+    LAYOUT_R16_R16,   // [r16 d][r16 s]       -> AX, BX
+    LAYOUT_R8_R8,     // [r8 d][r8 s]         -> AL, BL
+    LAYOUT_R16_I16,   // [r16][imm16]         -> AX, 0x1234
+    LAYOUT_R8_I8,     // [r8][imm8]           -> AL, 0x12
+    LAYOUT_R16_I8,    // [r16][imm8]          -> AX, 3 (SHIFT COUNT)
+    LAYOUT_R16_CL,    // [r16]                -> AX, CL
+    LAYOUT_R8_CL,     // [r8]                 -> AL, CL
+    LAYOUT_R16_MEMI,  // [r16][imm16]         -> AX, [0x1234]
+    LAYOUT_MEMI_R16,  // [r16][imm16]         -> [0x1234], AX
+    LAYOUT_R8_MEMI,   // [r8][imm16]          -> AL, [0x1234]
+    LAYOUT_MEMI_R8,   // [r8][imm16]          -> [0x1234], AL
+    LAYOUT_R16_MEMR,  // [r16][r16 a]         -> AX, [BX]
+    LAYOUT_MEMR_R16,  // [r16][r16 a]         -> [BX], AX
+    LAYOUT_R8_MEMR,   // [r8][r16 a]          -> AL, [BX]
+    LAYOUT_MEMR_R8,   // [r8][r16 a]          -> [BX], AL
+    LAYOUT_R16_MEMRR, // [r16][r16 a][r16 b]  -> AX, [BX+SI]
+    LAYOUT_MEMRR_R16, // [r16][r16 a][r16 b]  -> [BX+SI], AX
+    LAYOUT_R16_MEMRI, // [r16][r16 a][imm16]  -> AX, [BX+0x0004]
+    LAYOUT_MEMRI_R16, // [r16][r16 a][imm16]  -> [BX+0x0004], AX
+    LAYOUT_R8_MEMRI,  // [r8][r16 a][imm16]   -> AL, [BX+0x0004]
+    LAYOUT_MEMRI_R8,  // [r8][r16 a][imm16]   -> [BX+0x0004], AL
+    LAYOUT_MEMI_I16,  // [imm16 a][imm16]     -> [0x1234], 0x5678
+    LAYOUT_MEMI_I8,   // [imm16 a][imm8]      -> [0x1234], 0x56
+    LAYOUT_SREG,      // [sreg]               -> DS
+    LAYOUT_SREG_R16,  // [sreg][r16]          -> DS, AX
+    LAYOUT_R16_SREG,  // [r16][sreg]          -> AX, DS
+    LAYOUT_I8_R8,     // [r8][imm8]           -> 0x12, AL   (OUT)
+    LAYOUT_I8_R16,    // [r16][imm8]          -> 0x12, AX   (OUT)
+    LAYOUT_R8_DX,     // [r8]                 -> AL, DX     (IN)
+    LAYOUT_R16_DX,    // [r16]                -> AX, DX     (IN)
+    LAYOUT_DX_R8,     // [r8]                 -> DX, AL     (OUT)
+    LAYOUT_DX_R16,    // [r16]                -> DX, AX     (OUT)
+    LAYOUT_I8,        // [imm8]               -> 0x21       (INT)
+};
+
+struct OpInfo
+{
+    const char *mnemonic;
+    uint8_t length; // INCLUDING THE OPCODE BYTE
+    OperandLayout layout;
+};
+
+static const int MAX_INSTRUCTION_LENGTH = 5;
+
+constexpr uint8_t layout_operand_bytes(OperandLayout layout)
+{
+    switch (layout)
+    {
+    case LAYOUT_INVALID:
+    case LAYOUT_NONE:
+        return 0;
+    case LAYOUT_R16:
+    case LAYOUT_R8:
+    case LAYOUT_R16_CL:
+    case LAYOUT_R8_CL:
+    case LAYOUT_SREG:
+    case LAYOUT_R8_DX:
+    case LAYOUT_R16_DX:
+    case LAYOUT_DX_R8:
+    case LAYOUT_DX_R16:
+    case LAYOUT_I8:
+        return 1;
+    case LAYOUT_ADDR16:
+    case LAYOUT_R16_R16:
+    case LAYOUT_R8_R8:
+    case LAYOUT_R8_I8:
+    case LAYOUT_R16_I8:
+    case LAYOUT_R16_MEMR:
+    case LAYOUT_MEMR_R16:
+    case LAYOUT_R8_MEMR:
+    case LAYOUT_MEMR_R8:
+    case LAYOUT_SREG_R16:
+    case LAYOUT_R16_SREG:
+    case LAYOUT_I8_R8:
+    case LAYOUT_I8_R16:
+        return 2;
+    case LAYOUT_R16_I16:
+    case LAYOUT_R16_MEMI:
+    case LAYOUT_MEMI_R16:
+    case LAYOUT_R8_MEMI:
+    case LAYOUT_MEMI_R8:
+    case LAYOUT_R16_MEMRR:
+    case LAYOUT_MEMRR_R16:
+    case LAYOUT_MEMI_I8:
+        return 3;
+    case LAYOUT_MEMI_I16:
+    case LAYOUT_R16_MEMRI:
+    case LAYOUT_MEMRI_R16:
+    case LAYOUT_R8_MEMRI:
+    case LAYOUT_MEMRI_R8:
+        return 4;
+    }
+    return 0;
+}
+
+constexpr std::array<OpInfo, 256> make_opcode_table()
+{
+    std::array<OpInfo, 256> t{};
+    for (auto &info : t)
+        info = {nullptr, 1, LAYOUT_INVALID};
+
+    auto op = [&t](OpCode code, const char *mnemonic, OperandLayout layout)
+    {
+        t[code] = {mnemonic, static_cast<uint8_t>(1 + layout_operand_bytes(layout)), layout};
+    };
+
+    // PROGRAM CONTROL
+    op(OP_HALT, "HALT", LAYOUT_NONE);
+    op(OP_NOP, "NOP", LAYOUT_NONE);
+    op(OP_RET, "RET", LAYOUT_NONE);
+    op(OP_JMP, "JMP", LAYOUT_ADDR16);
+    op(OP_CALL, "CALL", LAYOUT_ADDR16);
+    op(OP_JZ, "JZ", LAYOUT_ADDR16);
+    op(OP_JNZ, "JNZ", LAYOUT_ADDR16);
+    op(OP_JC, "JC", LAYOUT_ADDR16);
+    op(OP_JNC, "JNC", LAYOUT_ADDR16);
+    op(OP_JS, "JS", LAYOUT_ADDR16);
+    op(OP_JNS, "JNS", LAYOUT_ADDR16);
+    op(OP_JO, "JO", LAYOUT_ADDR16);
+    op(OP_JNO, "JNO", LAYOUT_ADDR16);
+    op(OP_JA, "JA", LAYOUT_ADDR16);
+    op(OP_JBE, "JBE", LAYOUT_ADDR16);
+    op(OP_JG, "JG", LAYOUT_ADDR16);
+    op(OP_JGE, "JGE", LAYOUT_ADDR16);
+    op(OP_JL, "JL", LAYOUT_ADDR16);
+    op(OP_JLE, "JLE", LAYOUT_ADDR16);
+    op(OP_LOOP, "LOOP", LAYOUT_ADDR16);
+    op(OP_LOOPZ, "LOOPZ", LAYOUT_ADDR16);
+    op(OP_LOOPNZ, "LOOPNZ", LAYOUT_ADDR16);
+    op(OP_JCXZ, "JCXZ", LAYOUT_ADDR16);
+
+    // DATA TRANSFER
+    op(OP_MOV_REG_IMM, "MOV", LAYOUT_R16_I16);
+    op(OP_MOV_REG_REG, "MOV", LAYOUT_R16_R16);
+    op(OP_MOV_REG8_IMM, "MOV", LAYOUT_R8_I8);
+    op(OP_MOV_REG8_REG8, "MOV", LAYOUT_R8_R8);
+    op(OP_MOV_REG_FROM_MEM_IMM, "MOV", LAYOUT_R16_MEMI);
+    op(OP_MOV_MEM_IMM_FROM_REG, "MOV", LAYOUT_MEMI_R16);
+    op(OP_MOV_REG_FROM_MEM_REG, "MOV", LAYOUT_R16_MEMR);
+    op(OP_MOV_MEM_REG_FROM_REG, "MOV", LAYOUT_MEMR_R16);
+    op(OP_MOV_REG8_FROM_MEM_IMM, "MOV", LAYOUT_R8_MEMI);
+    op(OP_MOV_MEM_IMM_FROM_REG8, "MOV", LAYOUT_MEMI_R8);
+    op(OP_MOV_REG8_FROM_MEM_REG, "MOV", LAYOUT_R8_MEMR);
+    op(OP_MOV_MEM_REG_FROM_REG8, "MOV", LAYOUT_MEMR_R8);
+    op(OP_MOV_REG_FROM_MEM_REG_REG, "MOV", LAYOUT_R16_MEMRR);
+    op(OP_MOV_MEM_REG_REG_FROM_REG, "MOV", LAYOUT_MEMRR_R16);
+    op(OP_MOV_REG_FROM_MEM_REG_IMM, "MOV", LAYOUT_R16_MEMRI);
+    op(OP_MOV_MEM_REG_IMM_FROM_REG, "MOV", LAYOUT_MEMRI_R16);
+    op(OP_MOV_REG8_FROM_MEM_REG_IMM, "MOV", LAYOUT_R8_MEMRI);
+    op(OP_MOV_MEM_REG_IMM_FROM_REG8, "MOV", LAYOUT_MEMRI_R8);
+    op(OP_MOV_MEM_IMM_FROM_IMM, "MOV", LAYOUT_MEMI_I16);
+    op(OP_MOV_MEM_IMM_FROM_IMM8, "MOV", LAYOUT_MEMI_I8);
+    op(OP_XCHG_REG_REG, "XCHG", LAYOUT_R16_R16);
+    op(OP_XCHG_REG8_REG8, "XCHG", LAYOUT_R8_R8);
+    op(OP_MOV_SREG_REG, "MOV", LAYOUT_SREG_R16);
+    op(OP_MOV_REG_SREG, "MOV", LAYOUT_R16_SREG);
+
+    // STACK
+    op(OP_PUSH_REG, "PUSH", LAYOUT_R16);
+    op(OP_POP_REG, "POP", LAYOUT_R16);
+    op(OP_PUSH_SREG, "PUSH", LAYOUT_SREG);
+    op(OP_POP_SREG, "POP", LAYOUT_SREG);
+
+    // STRING
+    op(OP_MOVSB, "MOVSB", LAYOUT_NONE);
+    op(OP_MOVSW, "MOVSW", LAYOUT_NONE);
+    op(OP_STOSB, "STOSB", LAYOUT_NONE);
+    op(OP_STOSW, "STOSW", LAYOUT_NONE);
+    op(OP_LODSB, "LODSB", LAYOUT_NONE);
+    op(OP_LODSW, "LODSW", LAYOUT_NONE);
+    op(OP_CMPSB, "CMPSB", LAYOUT_NONE);
+    op(OP_CMPSW, "CMPSW", LAYOUT_NONE);
+    op(OP_SCASB, "SCASB", LAYOUT_NONE);
+    op(OP_SCASW, "SCASW", LAYOUT_NONE);
+    op(OP_REP_MOVSB, "REP MOVSB", LAYOUT_NONE);
+    op(OP_REP_MOVSW, "REP MOVSW", LAYOUT_NONE);
+    op(OP_REP_STOSB, "REP STOSB", LAYOUT_NONE);
+    op(OP_REP_STOSW, "REP STOSW", LAYOUT_NONE);
+    op(OP_REPE_CMPSB, "REPE CMPSB", LAYOUT_NONE);
+    op(OP_REPE_CMPSW, "REPE CMPSW", LAYOUT_NONE);
+    op(OP_REPNE_CMPSB, "REPNE CMPSB", LAYOUT_NONE);
+    op(OP_REPNE_CMPSW, "REPNE CMPSW", LAYOUT_NONE);
+    op(OP_REPE_SCASB, "REPE SCASB", LAYOUT_NONE);
+    op(OP_REPE_SCASW, "REPE SCASW", LAYOUT_NONE);
+    op(OP_REPNE_SCASB, "REPNE SCASB", LAYOUT_NONE);
+    op(OP_REPNE_SCASW, "REPNE SCASW", LAYOUT_NONE);
+
+    // PORT I/O
+    op(OP_IN_REG8_PORT, "IN", LAYOUT_R8_I8);
+    op(OP_IN_REG_PORT, "IN", LAYOUT_R16_I8);
+    op(OP_OUT_PORT_REG8, "OUT", LAYOUT_I8_R8);
+    op(OP_OUT_PORT_REG, "OUT", LAYOUT_I8_R16);
+    op(OP_IN_REG8_DX, "IN", LAYOUT_R8_DX);
+    op(OP_IN_REG_DX, "IN", LAYOUT_R16_DX);
+    op(OP_OUT_DX_REG8, "OUT", LAYOUT_DX_R8);
+    op(OP_OUT_DX_REG, "OUT", LAYOUT_DX_R16);
+
+    // INTERRUPTS
+    op(OP_INT, "INT", LAYOUT_I8);
+    op(OP_IRET, "IRET", LAYOUT_NONE);
+    op(OP_CLI, "CLI", LAYOUT_NONE);
+    op(OP_STI, "STI", LAYOUT_NONE);
+
+    // FLAGS
+    op(OP_PUSHF, "PUSHF", LAYOUT_NONE);
+    op(OP_POPF, "POPF", LAYOUT_NONE);
+    op(OP_LAHF, "LAHF", LAYOUT_NONE);
+    op(OP_SAHF, "SAHF", LAYOUT_NONE);
+    op(OP_CLC, "CLC", LAYOUT_NONE);
+    op(OP_STC, "STC", LAYOUT_NONE);
+    op(OP_CMC, "CMC", LAYOUT_NONE);
+    op(OP_CLD, "CLD", LAYOUT_NONE);
+    op(OP_STD, "STD", LAYOUT_NONE);
+
+    // MEMORY READ-MODIFY-WRITE, LOCKED OR NOT
+    op(OP_XCHG_REG_MEM_REG, "XCHG", LAYOUT_R16_MEMR);
+    op(OP_ADD_MEM_REG_FROM_REG, "ADD", LAYOUT_MEMR_R16);
+    op(OP_SUB_MEM_REG_FROM_REG, "SUB", LAYOUT_MEMR_R16);
+    op(OP_AND_MEM_REG_FROM_REG, "AND", LAYOUT_MEMR_R16);
+    op(OP_OR_MEM_REG_FROM_REG, "OR", LAYOUT_MEMR_R16);
+    op(OP_XOR_MEM_REG_FROM_REG, "XOR", LAYOUT_MEMR_R16);
+    op(OP_LOCK_ADD_MEM_REG_FROM_REG, "LOCK ADD", LAYOUT_MEMR_R16);
+    op(OP_LOCK_SUB_MEM_REG_FROM_REG, "LOCK SUB", LAYOUT_MEMR_R16);
+    op(OP_LOCK_AND_MEM_REG_FROM_REG, "LOCK AND", LAYOUT_MEMR_R16);
+    op(OP_LOCK_OR_MEM_REG_FROM_REG, "LOCK OR", LAYOUT_MEMR_R16);
+    op(OP_LOCK_XOR_MEM_REG_FROM_REG, "LOCK XOR", LAYOUT_MEMR_R16);
+
+    // 16-BIT ARITHMETIC LOGICAL
+    op(OP_ADD_REG_REG, "ADD", LAYOUT_R16_R16);
+    op(OP_ADD_REG_IMM, "ADD", LAYOUT_R16_I16);
+    op(OP_SUB_REG_REG, "SUB", LAYOUT_R16_R16);
+    op(OP_SUB_REG_IMM, "SUB", LAYOUT_R16_I16);
+    op(OP_ADC_REG_REG, "ADC", LAYOUT_R16_R16);
+    op(OP_ADC_REG_IMM, "ADC", LAYOUT_R16_I16);
+    op(OP_SBB_REG_REG, "SBB", LAYOUT_R16_R16);
+    op(OP_SBB_REG_IMM, "SBB", LAYOUT_R16_I16);
+    op(OP_CMP_REG_REG, "CMP", LAYOUT_R16_R16);
+    op(OP_CMP_REG_IMM, "CMP", LAYOUT_R16_I16);
+    op(OP_AND_REG_REG, "AND", LAYOUT_R16_R16);
+    op(OP_AND_REG_IMM, "AND", LAYOUT_R16_I16);
+    op(OP_OR_REG_REG, "OR", LAYOUT_R16_R16);
+    op(OP_OR_REG_IMM, "OR", LAYOUT_R16_I16);
+    op(OP_XOR_REG_REG, "XOR", LAYOUT_R16_R16);
+    op(OP_XOR_REG_IMM, "XOR", LAYOUT_R16_I16);
+    op(OP_NEG_REG16, "NEG", LAYOUT_R16);
+    op(OP_NOT_REG, "NOT", LAYOUT_R16);
+    op(OP_INC_REG, "INC", LAYOUT_R16);
+    op(OP_DEC_REG, "DEC", LAYOUT_R16);
+    op(OP_MUL_REG, "MUL", LAYOUT_R16);
+    op(OP_IMUL_REG, "IMUL", LAYOUT_R16);
+    op(OP_DIV_REG, "DIV", LAYOUT_R16);
+    op(OP_IDIV_REG, "IDIV", LAYOUT_R16);
+
+    // 8-BIT ARITHMETIC LOGICAL
+    op(OP_ADD_REG8_REG8, "ADD", LAYOUT_R8_R8);
+    op(OP_ADD_REG8_IMM, "ADD", LAYOUT_R8_I8);
+    op(OP_SUB_REG8_REG8, "SUB", LAYOUT_R8_R8);
+    op(OP_SUB_REG8_IMM, "SUB", LAYOUT_R8_I8);
+    op(OP_ADC_REG8_REG8, "ADC", LAYOUT_R8_R8);
+    op(OP_ADC_REG8_IMM, "ADC", LAYOUT_R8_I8);
+    op(OP_SBB_REG8_REG8, "SBB", LAYOUT_R8_R8);
+    op(OP_SBB_REG8_IMM, "SBB", LAYOUT_R8_I8);
+    op(OP_CMP_REG8_REG8, "CMP", LAYOUT_R8_R8);
+    op(OP_CMP_REG8_IMM, "CMP", LAYOUT_R8_I8);
+    op(OP_AND_REG8_REG8, "AND", LAYOUT_R8_R8);
+    op(OP_AND_REG8_IMM, "AND", LAYOUT_R8_I8);
+    op(OP_OR_REG8_REG8, "OR", LAYOUT_R8_R8);
+    op(OP_OR_REG8_IMM, "OR", LAYOUT_R8_I8);
+    op(OP_XOR_REG8_REG8, "XOR", LAYOUT_R8_R8);
+    op(OP_XOR_REG8_IMM, "XOR", LAYOUT_R8_I8);
+    op(OP_NEG_REG8, "NEG", LAYOUT_R8);
+    op(OP_NOT_REG8, "NOT", LAYOUT_R8);
+    op(OP_INC_REG8, "INC", LAYOUT_R8);
+    op(OP_DEC_REG8, "DEC", LAYOUT_R8);
+    op(OP_MUL_REG8, "MUL", LAYOUT_R8);
+    op(OP_IMUL_REG8, "IMUL", LAYOUT_R8);
+    op(OP_DIV_REG8, "DIV", LAYOUT_R8);
+    op(OP_IDIV_REG8, "IDIV", LAYOUT_R8);
+
+    // 16-BIT SHIFT ROTATE
+    op(OP_SHL_REG_IMM, "SHL", LAYOUT_R16_I8);
+    op(OP_SHR_REG_IMM, "SHR", LAYOUT_R16_I8);
+    op(OP_SAR_REG_IMM, "SAR", LAYOUT_R16_I8);
+    op(OP_ROL_REG_IMM, "ROL", LAYOUT_R16_I8);
+    op(OP_ROR_REG_IMM, "ROR", LAYOUT_R16_I8);
+    op(OP_RCL_REG_IMM, "RCL", LAYOUT_R16_I8);
+    op(OP_RCR_REG_IMM, "RCR", LAYOUT_R16_I8);
+    op(OP_SHL_REG_CL, "SHL", LAYOUT_R16_CL);
+    op(OP_SHR_REG_CL, "SHR", LAYOUT_R16_CL);
+    op(OP_SAR_REG_CL, "SAR", LAYOUT_R16_CL);
+    op(OP_ROL_REG_CL, "ROL", LAYOUT_R16_CL);
+    op(OP_ROR_REG_CL, "ROR", LAYOUT_R16_CL);
+    op(OP_RCL_REG_CL, "RCL", LAYOUT_R16_CL);
+    op(OP_RCR_REG_CL, "RCR", LAYOUT_R16_CL);
+
+    // 8-BIT SHIFT ROTATE
+    op(OP_SHL_REG8_IMM, "SHL", LAYOUT_R8_I8);
+    op(OP_SHR_REG8_IMM, "SHR", LAYOUT_R8_I8);
+    op(OP_SAR_REG8_IMM, "SAR", LAYOUT_R8_I8);
+    op(OP_ROL_REG8_IMM, "ROL", LAYOUT_R8_I8);
+    op(OP_ROR_REG8_IMM, "ROR", LAYOUT_R8_I8);
+    op(OP_RCL_REG8_IMM, "RCL", LAYOUT_R8_I8);
+    op(OP_RCR_REG8_IMM, "RCR", LAYOUT_R8_I8);
+    op(OP_SHL_REG8_CL, "SHL", LAYOUT_R8_CL);
+    op(OP_SHR_REG8_CL, "SHR", LAYOUT_R8_CL);
+    op(OP_SAR_REG8_CL, "SAR", LAYOUT_R8_CL);
+    op(OP_ROL_REG8_CL, "ROL", LAYOUT_R8_CL);
+    op(OP_ROR_REG8_CL, "ROR", LAYOUT_R8_CL);
+    op(OP_RCL_REG8_CL, "RCL", LAYOUT_R8_CL);
+    op(OP_RCR_REG8_CL, "RCR", LAYOUT_R8_CL);
+
+    return t;
+}
+
+inline constexpr std::array<OpInfo, 256> OPCODE_TABLE = make_opcode_table();
+
+static_assert(OPCODE_TABLE[OP_MOV_MEM_IMM_FROM_IMM].length == MAX_INSTRUCTION_LENGTH, "longest encoding");
+static_assert(OPCODE_TABLE[OP_MOV_REG_IMM].length == 4, "reg16, imm16");
+static_assert(OPCODE_TABLE[OP_SHL_REG_CL].length == 2, "reg16, CL");
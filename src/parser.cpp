@@ -1,11 +1,16 @@
 #include "parser.h"
 #include "cpu.h"
-#include <fstream>
+#include "mappedfile.h"
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 #include <unordered_map>
 #include <cctype>
+#include <filesystem>
+#include <memory>
+#include <list>
+#include <mutex>
 
 // STATIC MAPS AND HELPER STRUCTS/ENUMS REMAIN UNCHANGED AS THEY ARE WELL-DESIGNED
 static const std::unordered_map<std::string, RegisterCode> RegisterMap = {
@@ -14,14 +19,58 @@ static const std::unordered_map<std::string, RegisterCode> RegisterMap = {
 static const std::unordered_map<std::string, RegisterCode8bit> RegisterMap8 = {
     {"AL", REG_AL}, {"AH", REG_AH}, {"BL", REG_BL}, {"BH", REG_BH}, {"CL", REG_CL}, {"CH", REG_CH}, {"DL", REG_DL}, {"DH", REG_DH}, {"MNL", REG_MNL}, {"MNH", REG_MNH}};
 
+static const std::unordered_map<std::string, SegmentCode> SegmentMap = {
+    {"ES", SEG_ES}, {"CS", SEG_CS}, {"SS", SEG_SS}, {"DS", SEG_DS}};
+
+// BRANCHES TAKING A LABEL, ALIASES INCLUDED (JE == JZ, JB == JC...)
+static const std::unordered_map<std::string, OpCode> BranchMap = {
+    {"JMP", OP_JMP}, {"CALL", OP_CALL},
+    {"JZ", OP_JZ}, {"JE", OP_JZ}, {"JNZ", OP_JNZ}, {"JNE", OP_JNZ},
+    {"JC", OP_JC}, {"JB", OP_JC}, {"JNAE", OP_JC}, {"JNC", OP_JNC}, {"JAE", OP_JNC}, {"JNB", OP_JNC},
+    {"JS", OP_JS}, {"JNS", OP_JNS}, {"JO", OP_JO}, {"JNO", OP_JNO},
+    {"JA", OP_JA}, {"JNBE", OP_JA}, {"JBE", OP_JBE}, {"JNA", OP_JBE},
+    {"JG", OP_JG}, {"JNLE", OP_JG}, {"JGE", OP_JGE}, {"JNL", OP_JGE},
+    {"JL", OP_JL}, {"JNGE", OP_JL}, {"JLE", OP_JLE}, {"JNG", OP_JLE},
+    {"LOOP", OP_LOOP}, {"LOOPZ", OP_LOOPZ}, {"LOOPE", OP_LOOPZ}, {"LOOPNZ", OP_LOOPNZ}, {"LOOPNE", OP_LOOPNZ},
+    {"JCXZ", OP_JCXZ}};
+
+// STRING INSTRUCTIONS AND THEIR REPEAT PREFIXES ASSEMBLE TO ONE FUSED OPCODE BYTE
+static const std::unordered_map<std::string, OpCode> StringOpMap = {
+    {"MOVSB", OP_MOVSB}, {"MOVSW", OP_MOVSW}, {"STOSB", OP_STOSB}, {"STOSW", OP_STOSW}, {"LODSB", OP_LODSB}, {"LODSW", OP_LODSW}, {"CMPSB", OP_CMPSB}, {"CMPSW", OP_CMPSW}, {"SCASB", OP_SCASB}, {"SCASW", OP_SCASW}};
+
+static const std::unordered_map<std::string, OpCode> RepStringOpMap = {
+    {"REP MOVSB", OP_REP_MOVSB}, {"REP MOVSW", OP_REP_MOVSW}, {"REP STOSB", OP_REP_STOSB}, {"REP STOSW", OP_REP_STOSW},
+    {"REP CMPSB", OP_REPE_CMPSB}, {"REPE CMPSB", OP_REPE_CMPSB}, {"REPZ CMPSB", OP_REPE_CMPSB},
+    {"REP CMPSW", OP_REPE_CMPSW}, {"REPE CMPSW", OP_REPE_CMPSW}, {"REPZ CMPSW", OP_REPE_CMPSW},
+    {"REPNE CMPSB", OP_REPNE_CMPSB}, {"REPNZ CMPSB", OP_REPNE_CMPSB}, {"REPNE CMPSW", OP_REPNE_CMPSW}, {"REPNZ CMPSW", OP_REPNE_CMPSW},
+    {"REP SCASB", OP_REPE_SCASB}, {"REPE SCASB", OP_REPE_SCASB}, {"REPZ SCASB", OP_REPE_SCASB},
+    {"REP SCASW", OP_REPE_SCASW}, {"REPE SCASW", OP_REPE_SCASW}, {"REPZ SCASW", OP_REPE_SCASW},
+    {"REPNE SCASB", OP_REPNE_SCASB}, {"REPNZ SCASB", OP_REPNE_SCASB}, {"REPNE SCASW", OP_REPNE_SCASW}, {"REPNZ SCASW", OP_REPNE_SCASW}};
+
+// OPERANDLESS FLAG INSTRUCTIONS
+static const std::unordered_map<std::string, OpCode> FlagOpMap = {
+    {"PUSHF", OP_PUSHF}, {"POPF", OP_POPF}, {"LAHF", OP_LAHF}, {"SAHF", OP_SAHF},
+    {"CLC", OP_CLC}, {"STC", OP_STC}, {"CMC", OP_CMC}, {"CLD", OP_CLD}, {"STD", OP_STD}, {"CLI", OP_CLI}, {"STI", OP_STI}};
+
+// MEMORY DESTINATION READ-MODIFY-WRITE, [reg16] op= reg16: { PLAIN, LOCK PREFIXED }
+static const std::unordered_map<std::string, std::pair<OpCode, OpCode>> MemRmwOpMap = {
+    {"ADD", {OP_ADD_MEM_REG_FROM_REG, OP_LOCK_ADD_MEM_REG_FROM_REG}},
+    {"SUB", {OP_SUB_MEM_REG_FROM_REG, OP_LOCK_SUB_MEM_REG_FROM_REG}},
+    {"AND", {OP_AND_MEM_REG_FROM_REG, OP_LOCK_AND_MEM_REG_FROM_REG}},
+    {"OR", {OP_OR_MEM_REG_FROM_REG, OP_LOCK_OR_MEM_REG_FROM_REG}},
+    {"XOR", {OP_XOR_MEM_REG_FROM_REG, OP_LOCK_XOR_MEM_REG_FROM_REG}},
+    {"XCHG", {OP_XCHG_REG_MEM_REG, OP_XCHG_REG_MEM_REG}}}; // XCHG WITH MEMORY IS ALWAYS LOCKED
+
 enum OperandType
 {
     TYPE_NONE,
     TYPE_REG16,
     TYPE_REG8,
+    TYPE_SREG,
     TYPE_MEM_FROM_REG,
     TYPE_MEM_FROM_IMM,
     TYPE_MEM_REG_REG,
+    TYPE_MEM_REG_IMM,
     TYPE_IMMEDIATE,
     TYPE_LABEL
 };
@@ -40,7 +89,7 @@ std::string trim(const std::string &str)
 {
     size_t first = str.find_first_not_of(" \t\n\r");
     if (std::string::npos == first)
-        return str;
+        return "";
     size_t last = str.find_last_not_of(" \t\n\r");
     return str.substr(first, (last - first + 1));
 }
@@ -75,6 +124,36 @@ static bool try_parse_number(const std::string &s, uint16_t &out)
     }
 }
 
+static bool is_rep_prefix(const std::string &command)
+{
+    return command == "REP" || command == "REPE" || command == "REPZ" || command == "REPNE" || command == "REPNZ";
+}
+
+// "MOVSB" OR "REP MOVSB" (command ALREADY UPPERCASE) -> ITS OPCODE
+static bool lookup_string_op(const std::string &command, const std::string &rest, OpCode &opc)
+{
+    std::string operand = trim(rest);
+    std::transform(operand.begin(), operand.end(), operand.begin(), ::toupper);
+    const auto &map = operand.empty() ? StringOpMap : RepStringOpMap;
+    auto it = map.find(operand.empty() ? command : command + " " + operand);
+    if (it == map.end())
+        return false;
+    opc = it->second;
+    return true;
+}
+
+// "LOCK ADD [BX], AX": LIKE REP THE PREFIX IS FUSED INTO THE OPCODE, SO IT ONLY
+// CHANGES WHICH ONE IS EMITTED. TRUE WHEN command WAS "LOCK" AND IS NOW THE INSTRUCTION
+static bool strip_lock_prefix(std::string &command, std::stringstream &ss)
+{
+    if (command != "LOCK")
+        return false;
+    command.clear();
+    ss >> command;
+    std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+    return true;
+}
+
 Operand parse_operand(std::string op_str)
 {
     Operand op;
@@ -103,6 +182,12 @@ Operand parse_operand(std::string op_str)
         op.reg_code = RegisterMap8.at(op_upper);
         return op;
     }
+    if (SegmentMap.count(op_upper))
+    {
+        op.type = TYPE_SREG;
+        op.reg_code = SegmentMap.at(op_upper);
+        return op;
+    }
     if (op_str.front() == '[' && op_str.back() == ']')
     {
         std::string content = trim(op_str.substr(1, op_str.length() - 2));
@@ -121,6 +206,14 @@ Operand parse_operand(std::string op_str)
                 op.reg_code2 = RegisterMap.at(reg2_str);
                 return op;
             }
+            uint16_t displacement;
+            if (RegisterMap.count(reg1_str) && try_parse_number(reg2_str, displacement))
+            {
+                op.type = TYPE_MEM_REG_IMM;
+                op.reg_code = RegisterMap.at(reg1_str);
+                op.value = displacement;
+                return op;
+            }
         }
         std::string content_upper = content;
         std::transform(content_upper.begin(), content_upper.end(), content_upper.begin(), ::toupper);
@@ -161,590 +254,1326 @@ Operand parse_operand(std::string op_str)
     return op;
 }
 
-// MAIN PARSING LOGIC, FIXED AND ROBUST VERSION
-std::vector<uint8_t> Parser::parse_from_string(const std::string &code_string)
+// CALLS line(begin, end) FOR EACH LINE OF A SOURCE TEXT, WITHOUT ITS '\n'. LIKE getline, A
+// FINAL NEWLINE ADDS NO EMPTY LINE
+template <typename LineFn>
+static void for_each_line(const char *text, size_t length, LineFn line)
 {
-    label_map.clear();
-    last_error = "";
-    std::vector<uint8_t> machine_code;
+    const char *end = text + length;
+    for (const char *p = text; p < end;)
+    {
+        const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (!newline)
+            newline = end;
+        line(p, newline);
+        p = newline + 1;
+    }
+}
+
+// ===============================================================
+// == INCLUDE CACHE
+// ===============================================================
+// INCLUDED FILES ARE READ AND COMMENT-STRIPPED ONCE PER (PATH, MTIME) AND SHARED
+// BY EVERY PARSER IN THE PROCESS, SO A BATCH OF SUBMISSIONS THAT ALL INCLUDE THE
+// SAME LIBRARY ONLY READS IT ONCE. THE LINES STILL GO THROUGH preprocess_line()
+// IN EVERY PARSER: THEIR MEANING DEPENDS ON THE MACROS DEFINED BEFORE THE INCLUDE.
+// A NEWER MTIME REPLACES THE ENTRY, THE LEAST RECENTLY USED PATH GOES FIRST WHEN FULL.
+static const size_t MAX_CACHED_INCLUDES = 64;
 
-    std::stringstream code_stream(code_string);
-    std::string line;
-    std::vector<std::string> lines;
-    while (std::getline(code_stream, line))
+struct CachedInclude
+{
+    std::filesystem::file_time_type mtime;
+    std::shared_ptr<const std::vector<std::string>> lines;
+    std::list<std::string>::iterator lru_pos;
+};
+
+static std::mutex include_cache_mutex;
+static std::unordered_map<std::string, CachedInclude> include_cache;
+static std::list<std::string> include_lru; // FRONT = MOST RECENTLY USED
+
+static std::shared_ptr<const std::vector<std::string>> load_include(const std::filesystem::path &path, IncludeDependency &dependency)
+{
+    std::error_code ec;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+    if (ec)
+        canonical = path;
+    std::filesystem::file_time_type mtime = std::filesystem::last_write_time(canonical, ec);
+    if (ec)
+        return nullptr;
+
+    const std::string key = canonical.string();
+    dependency.path = key;
+    dependency.mtime = mtime;
     {
-        lines.push_back(line);
+        std::lock_guard<std::mutex> lock(include_cache_mutex);
+        auto it = include_cache.find(key);
+        if (it != include_cache.end() && it->second.mtime == mtime)
+        {
+            include_lru.splice(include_lru.begin(), include_lru, it->second.lru_pos);
+            return it->second.lines;
+        }
     }
 
-    // ===============================================================
-    // == FIRST PASS: CALCULATE ADDRESS FOR LABELS
-    // ===============================================================
-    uint16_t current_address = 0;
-    for (const auto &current_line : lines)
+    MappedFile file(canonical.string());
+    if (!file.opened())
+        return nullptr;
+
+    auto lines = std::make_shared<std::vector<std::string>>();
+    auto keep_cleaned = [&](const char *begin, const char *end)
+    {
+        std::string cleaned = clean_line(std::string(begin, end));
+        if (!cleaned.empty())
+            lines->push_back(cleaned);
+    };
+    for_each_line(file.text(), file.size(), keep_cleaned);
+
+    std::lock_guard<std::mutex> lock(include_cache_mutex);
+    auto it = include_cache.find(key);
+    if (it != include_cache.end())
     {
-        std::string cleaned_line = clean_line(current_line);
-        if (cleaned_line.empty())
+        // STALE (OR JUST STORED BY ANOTHER PARSER): REPLACE IT IN PLACE
+        it->second.mtime = mtime;
+        it->second.lines = lines;
+        include_lru.splice(include_lru.begin(), include_lru, it->second.lru_pos);
+        return lines;
+    }
+    while (include_cache.size() >= MAX_CACHED_INCLUDES)
+    {
+        include_cache.erase(include_lru.back());
+        include_lru.pop_back();
+    }
+    include_lru.push_front(key);
+    include_cache[key] = {mtime, lines, include_lru.begin()};
+    return lines;
+}
+
+// SPLIT "a, b, c" INTO TRIMMED MACRO ARGUMENTS
+static std::vector<std::string> split_macro_args(const std::string &rest)
+{
+    std::vector<std::string> args;
+    if (trim(rest).empty())
+        return args;
+    std::stringstream ss(rest);
+    std::string arg;
+    while (std::getline(ss, arg, ','))
+        args.push_back(trim(arg));
+    return args;
+}
+
+// %1..%n -> ARGUMENTS, %%name -> NAME UNIQUE TO THIS EXPANSION
+static std::string substitute_macro_line(const std::string &line, const std::vector<std::string> &args, int serial)
+{
+    std::string out;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        if (line[i] != '%' || i + 1 >= line.size())
         {
+            out += line[i];
             continue;
         }
-        if (cleaned_line.back() == ':')
+        if (line[i + 1] == '%')
         {
-            std::string label = cleaned_line.substr(0, cleaned_line.length() - 1);
-            label_map[trim(label)] = current_address;
+            out += "__M" + std::to_string(serial) + "_";
+            i++;
+            continue;
         }
-        else
+        size_t j = i + 1;
+        while (j < line.size() && std::isdigit((unsigned char)line[j]))
+            j++;
+        if (j == i + 1)
         {
-            std::stringstream ss(cleaned_line);
-            std::string command;
-            ss >> command;
-            std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+            out += line[i];
+            continue;
+        }
+        size_t index = std::stoul(line.substr(i + 1, j - i - 1));
+        if (index >= 1 && index <= args.size())
+            out += args[index - 1];
+        i = j - 1;
+    }
+    return out;
+}
 
-            std::string rest;
-            std::getline(ss, rest);
+bool Parser::preprocess(const std::vector<std::string> &input, const std::string &dir, int origin_line, int depth, std::vector<SourceLine> &out)
+{
+    MacroRecording recording;
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        int line_number = origin_line > 0 ? origin_line : (int)i + 1;
+        if (!preprocess_line(input[i], dir, line_number, depth, recording, out))
+            return false;
+    }
 
-            Operand op1, op2;
-            auto comma_pos = rest.find(',');
-            if (comma_pos != std::string::npos)
-            {
-                op1 = parse_operand(rest.substr(0, comma_pos));
-                op2 = parse_operand(rest.substr(comma_pos + 1));
-            }
-            else
-            {
-                op1 = parse_operand(rest);
-            }
+    if (recording.macro)
+    {
+        last_error = "ERROR: Unterminated %macro on line -> " + std::to_string(recording.line);
+        return false;
+    }
+    return true;
+}
 
-            // INSTRUCTION SIZE
-            if (op1.type == TYPE_NONE && op2.type == TYPE_NONE)
-            {
-                current_address += 1; // 0 OPERAND (HALT, RET, NOP)
-            }
-            else if (op2.type == TYPE_NONE)
-            { // ONE OPERAND
-                if (op1.type == TYPE_LABEL)
-                    current_address += 3; // JMP, CALL, Jxx
-                else
-                    current_address += 2; // PUSH, POP, INC, DEC, NOT, NEG
-            }
-            else
-            {
-                // 16-bit reg + IMM16
-                if (op1.type == TYPE_REG16 && op2.type == TYPE_IMMEDIATE)
-                {
-                    current_address += 4;
-                }
-                else if (op1.type == TYPE_REG8 && op2.type == TYPE_IMMEDIATE)
-                {
-                    current_address += 3;
-                }
-                else if ((op1.type == TYPE_REG16 && op2.type == TYPE_MEM_FROM_IMM) ||
-                         (op1.type == TYPE_MEM_FROM_IMM && op2.type == TYPE_REG16))
-                {
-                    current_address += 4;
-                }
-                else if ((op1.type == TYPE_REG8 && op2.type == TYPE_MEM_FROM_IMM) || (op1.type == TYPE_MEM_FROM_IMM && op2.type == TYPE_REG8))
-                {
-                    current_address += 4;
-                }
-                else if (op1.type == TYPE_REG16 && op2.type == TYPE_REG16)
-                {
-                    current_address += 3;
-                }
-                else if (op1.type == TYPE_REG8 && op2.type == TYPE_REG8)
-                {
-                    current_address += 3;
-                }
-                else if (op1.type == TYPE_MEM_FROM_IMM && op2.type == TYPE_IMMEDIATE)
-                {
-                    if (op2.value <= 0xFF)
-                    {
-                        current_address += 4;
-                    }
-                    else
-                    {
-                        current_address += 5;
-                    }
-                }
-                else
-                {
-                    current_address += 3;
-                }
-            }
-        }
+bool Parser::preprocess_line(const std::string &raw, const std::string &dir, int line_number, int depth, MacroRecording &recording, std::vector<SourceLine> &out)
+{
+    const int MAX_DEPTH = 16;
+
+    auto generate_error = [&](const std::string &message)
+    {
+        last_error = "ERROR: " + message + " on line -> " + std::to_string(line_number);
+        return false;
+    };
+
+    std::string cleaned = clean_line(raw);
+    if (cleaned.empty())
+        return true;
+
+    std::stringstream ss(cleaned);
+    std::string command;
+    ss >> command;
+    std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+    std::string rest;
+    std::getline(ss, rest);
+    rest = trim(rest);
+
+    if (recording.macro)
+    {
+        if (command == "%ENDMACRO")
+            recording.macro = nullptr;
+        else if (command == "%MACRO")
+            return generate_error("Nested %macro definitions are not allowed");
+        else
+            recording.macro->body.push_back(cleaned);
+        return true;
     }
 
-    // ===============================================================
-    // == SECOND PASS: Generate machine code
-    // ===============================================================
-    int line_number = 0;
-    for (const auto &current_line : lines)
+    if (command == "%MACRO")
     {
-        line_number++;
-        std::string cleaned_line = clean_line(current_line);
+        std::stringstream header(rest);
+        std::string name;
+        int param_count = 0;
+        header >> name;
+        if (name.empty())
+            return generate_error("%macro requires a name");
+        if (!(header >> param_count))
+            param_count = 0;
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
 
-        if (cleaned_line.empty() || cleaned_line.back() == ':')
-            continue;
+        Macro macro;
+        macro.param_count = param_count;
+        recording.macro = &(macro_map[name] = macro);
+        recording.line = line_number;
+    }
+    else if (command == "%ENDMACRO")
+    {
+        return generate_error("%endmacro without %macro");
+    }
+    else if (command == "INCLUDE")
+    {
+        if (rest.size() < 2 || rest.front() != '"' || rest.back() != '"')
+            return generate_error("INCLUDE requires a quoted file name");
+        if (depth >= MAX_DEPTH)
+            return generate_error("INCLUDE nested too deeply");
 
-        std::stringstream ss(cleaned_line);
-        std::string command_str;
-        ss >> command_str;
+        std::filesystem::path path(rest.substr(1, rest.size() - 2));
+        if (path.is_relative() && !dir.empty())
+            path = std::filesystem::path(dir) / path;
 
-        if (command_str.empty())
-        {
-            continue;
-        }
+        IncludeDependency dependency;
+        auto lines = load_include(path, dependency);
+        if (!lines)
+            return generate_error("Could not open include file " + path.string());
+        includes.push_back(dependency);
+        if (!preprocess(*lines, path.parent_path().string(), line_number, depth + 1, out))
+            return false;
+    }
+    else if (macro_map.count(command))
+    {
+        const Macro &macro = macro_map.at(command);
+        std::vector<std::string> args = split_macro_args(rest);
+        if ((int)args.size() != macro.param_count)
+            return generate_error("Macro " + command + " expects " + std::to_string(macro.param_count) + " argument(s)");
+        if (depth >= MAX_DEPTH)
+            return generate_error("Macro " + command + " expanded too deeply");
 
-        std::transform(command_str.begin(), command_str.end(), command_str.begin(), ::toupper);
+        int serial = ++macro_serial;
+        std::vector<std::string> expanded;
+        expanded.reserve(macro.body.size());
+        for (const auto &body_line : macro.body)
+            expanded.push_back(substitute_macro_line(body_line, args, serial));
+        if (!preprocess(expanded, dir, line_number, depth + 1, out))
+            return false;
+    }
+    else
+    {
+        out.push_back({cleaned, line_number});
+    }
+    return true;
+}
 
-        std::string rest;
-        std::getline(ss, rest);
+// ===============================================================
+// == CODE SINKS
+// ===============================================================
+// push_back() STORES INTO THE CURRENT WINDOW IN PLACE AND ONLY CALLS next_window() WHEN IT IS
+// FULL. PAST THE LAST WINDOW THE BYTES ARE COUNTED BUT DROPPED, SO size() STAYS THE ADDRESS
+class CodeSink
+{
+public:
+    virtual ~CodeSink() = default;
 
-        Operand op1, op2;
-        auto comma_pos = rest.find(',');
-        if (comma_pos != std::string::npos)
-        {
-            op1 = parse_operand(rest.substr(0, comma_pos));
-            op2 = parse_operand(rest.substr(comma_pos + 1));
-        }
-        else
+    void push_back(uint8_t byte)
+    {
+        if (cursor == limit && !next_window())
         {
-            op1 = parse_operand(rest);
+            overflow = true;
+            written++;
+            return;
         }
+        *cursor++ = byte;
+        written++;
+    }
+    size_t size() const { return written; }
+    bool overflowed() const { return overflow; }
 
-        auto generate_error = [&](const std::string &message)
-        {
-            last_error = "ERROR: " + message + " on line -> " + std::to_string(line_number);
-            return std::vector<uint8_t>{};
-        };
+    // REWRITES AN EMITTED BYTE (A BRANCH TARGET KNOWN ONLY LATER). DROPPED BYTES STAY DROPPED
+    virtual void patch(size_t at, uint8_t byte) = 0;
 
-#define IS_REG16(op) ((op).type == TYPE_REG16)
-#define IS_REG8(op) ((op).type == TYPE_REG8)
-#define IS_IMM(op) ((op).type == TYPE_IMMEDIATE)
-#define IS_MEM_IMM(op) ((op).type == TYPE_MEM_FROM_IMM)
-#define IS_MEM_REG(op) ((op).type == TYPE_MEM_FROM_REG)
-#define IS_MEM_REG_REG(op) ((op).type == TYPE_MEM_REG_REG)
-#define IS_LABEL(op) ((op).type == TYPE_LABEL)
-#define IS_CL(op) (IS_REG8(op) && (op).reg_code == REG_CL)
+protected:
+    uint8_t *cursor = nullptr;
+    uint8_t *limit = nullptr;
+    size_t written = 0;
+    bool overflow = false;
 
-        // --- 0-Operand Instructions ---
-        if (op1.type == TYPE_NONE)
-        {
-            if (command_str == "HALT")
-                machine_code.push_back(OP_HALT);
-            else if (command_str == "RET")
-                machine_code.push_back(OP_RET);
-            else if (command_str == "NOP")
-                machine_code.push_back(OP_NOP);
-            else
-                return generate_error("Unknown or operandless command: " + command_str);
-        }
-        // --- 1-Operand Instructions ---
-        else if (op2.type == TYPE_NONE)
-        {
-            // Branch Instructions
-            if (command_str[0] == 'J' || command_str == "CALL")
-            {
-                if (!IS_LABEL(op1))
-                    return generate_error("Jump/Call commands require a label");
-                if (label_map.count(op1.str_val) == 0)
-                    return generate_error("Unknown label: " + op1.str_val);
-
-                uint16_t addr = label_map.at(op1.str_val);
-                OpCode opc = OP_HALT;
-                if (command_str == "JMP")
-                    opc = OP_JMP;
-                else if (command_str == "CALL")
-                    opc = OP_CALL;
-                else if (command_str == "JZ")
-                    opc = OP_JZ;
-                else if (command_str == "JNZ")
-                    opc = OP_JNZ;
-                else if (command_str == "JC")
-                    opc = OP_JC;
-                else if (command_str == "JNC")
-                    opc = OP_JNC;
-                else if (command_str == "JS")
-                    opc = OP_JS;
-                else if (command_str == "JNS")
-                    opc = OP_JNS;
-                else if (command_str == "JO")
-                    opc = OP_JO;
-                else if (command_str == "JNO")
-                    opc = OP_JNO;
-                else
-                    return generate_error("Unknown jump instruction: " + command_str);
+    // MAKES [cursor, limit) THE ROOM FOR THE BYTES FROM written ON. FALSE: THERE IS NO MORE
+    virtual bool next_window() = 0;
+};
 
-                machine_code.push_back(opc);
-                machine_code.push_back(addr & 0xFF);
-                machine_code.push_back((addr >> 8) & 0xFF);
-            }
-            // Other 1-Operand
-            else
-            {
-                OpCode opc16 = OP_HALT, opc8 = OP_HALT;
-                if (command_str == "PUSH")
-                {
-                    if (IS_REG16(op1))
-                    {
-                        opc16 = OP_PUSH_REG;
-                    }
-                    else
-                    {
-                        return generate_error("PUSH requires a 16-bit register");
-                    }
-                }
-                else if (command_str == "POP")
-                {
-                    if (IS_REG16(op1))
-                    {
-                        opc16 = OP_POP_REG;
-                    }
-                    else
-                    {
-                        return generate_error("POP requires a 16-bit register");
-                    }
-                }
-                else if (command_str == "INC")
-                {
-                    opc16 = OP_INC_REG;
-                    opc8 = OP_INC_REG8;
-                }
-                else if (command_str == "DEC")
-                {
-                    opc16 = OP_DEC_REG;
-                    opc8 = OP_DEC_REG8;
-                }
-                else if (command_str == "NEG")
-                {
-                    opc16 = OP_NEG_REG16;
-                    opc8 = OP_NEG_REG8;
-                }
-                else if (command_str == "NOT")
-                {
-                    opc16 = OP_NOT_REG;
-                    opc8 = OP_NOT_REG8;
-                }
-                else
-                    return generate_error("Unknown 1-operand command: " + command_str);
+// parse_from_string(): A VECTOR, TRIMMED TO THE CODE AT THE END
+class VectorSink : public CodeSink
+{
+public:
+    std::vector<uint8_t> take()
+    {
+        bytes.resize(written);
+        return std::move(bytes);
+    }
 
-                if (IS_REG16(op1))
-                {
-                    if (opc16 == OP_HALT)
-                        return generate_error(command_str + " does not support 16-bit registers.");
-                    machine_code.push_back(opc16);
-                    machine_code.push_back(op1.reg_code);
-                }
-                else if (IS_REG8(op1))
-                {
-                    if (opc8 == OP_HALT)
-                        return generate_error(command_str + " does not support 8-bit registers.");
-                    machine_code.push_back(opc8);
-                    machine_code.push_back(op1.reg_code);
-                }
-                else
-                {
-                    return generate_error(command_str + " requires a register operand.");
-                }
-            }
-        }
-        // --- 2-Operand Instructions ---
-        else
-        {
-            // Shift/Rotate Instructions
-            if (command_str == "SHL" || command_str == "SAL" || command_str == "SHR" || command_str == "SAR" || command_str == "ROL" || command_str == "ROR" || command_str == "RCL" || command_str == "RCR")
-            {
-                if (!IS_IMM(op2) && !IS_CL(op2))
-                    return generate_error("Shift/Rotate requires an immediate value or CL as the second operand");
+    void patch(size_t at, uint8_t byte) override { bytes[at] = byte; }
 
-                OpCode opc16 = OP_HALT, opc8 = OP_HALT;
+private:
+    std::vector<uint8_t> bytes;
 
-                if (IS_CL(op2))
-                {
-                    if (command_str == "SHL" || command_str == "SAL")
-                    {
-                        opc16 = OP_SHL_REG_CL;
-                        opc8 = OP_SHL_REG8_CL;
-                    }
-                    else if (command_str == "SHR")
-                    {
-                        opc16 = OP_SHR_REG_CL;
-                        opc8 = OP_SHR_REG8_CL;
-                    }
-                    else if (command_str == "SAR")
-                    {
-                        opc16 = OP_SAR_REG_CL;
-                        opc8 = OP_SAR_REG8_CL;
-                    }
-                    else if (command_str == "ROL")
-                    {
-                        opc16 = OP_ROL_REG_CL;
-                        opc8 = OP_ROL_REG8_CL;
-                    }
-                    else if (command_str == "ROR")
-                    {
-                        opc16 = OP_ROR_REG_CL;
-                        opc8 = OP_ROR_REG8_CL;
-                    }
-                    else if (command_str == "RCL")
-                    {
-                        opc16 = OP_RCL_REG_CL;
-                        opc8 = OP_RCL_REG8_CL;
-                    }
-                    else if (command_str == "RCR")
-                    {
-                        opc16 = OP_RCR_REG_CL;
-                        opc8 = OP_RCR_REG8_CL;
-                    }
-                }
-                else
-                { // IS_IMM
-                    if (command_str == "SHL" || command_str == "SAL")
-                    {
-                        opc16 = OP_SHL_REG_IMM;
-                        opc8 = OP_SHL_REG8_IMM;
-                    }
-                    else if (command_str == "SHR")
-                    {
-                        opc16 = OP_SHR_REG_IMM;
-                        opc8 = OP_SHR_REG8_IMM;
-                    }
-                    else if (command_str == "SAR")
-                    {
-                        opc16 = OP_SAR_REG_IMM;
-                        opc8 = OP_SAR_REG8_IMM;
-                    }
-                    else if (command_str == "ROL")
-                    {
-                        opc16 = OP_ROL_REG_IMM;
-                        opc8 = OP_ROL_REG8_IMM;
-                    }
-                    else if (command_str == "ROR")
-                    {
-                        opc16 = OP_ROR_REG_IMM;
-                        opc8 = OP_ROR_REG8_IMM;
-                    }
-                    else if (command_str == "RCL")
-                    {
-                        opc16 = OP_RCL_REG_IMM;
-                        opc8 = OP_RCL_REG8_IMM;
-                    }
-                    else if (command_str == "RCR")
-                    {
-                        opc16 = OP_RCR_REG_IMM;
-                        opc8 = OP_RCR_REG8_IMM;
-                    }
-                }
+    bool next_window() override
+    {
+        bytes.resize(std::max<size_t>(256, bytes.size() * 2));
+        cursor = bytes.data() + written;
+        limit = bytes.data() + bytes.size();
+        return true;
+    }
+};
 
-                if (IS_REG16(op1))
-                {
-                    machine_code.push_back(opc16);
-                    machine_code.push_back(op1.reg_code);
-                }
-                else if (IS_REG8(op1))
-                {
-                    machine_code.push_back(opc8);
-                    machine_code.push_back(op1.reg_code);
-                }
-                else
-                {
-                    return generate_error("Shift/Rotate commands require a register as the first operand");
-                }
+// A CALLER'S BUFFER
+class SpanSink : public CodeSink
+{
+public:
+    SpanSink(uint8_t *out, size_t capacity) : start(out), capacity(capacity)
+    {
+        cursor = out;
+        limit = out + capacity;
+    }
 
-                if (IS_IMM(op2))
-                    machine_code.push_back(op2.value & 0xFF);
-            }
-            // General 2-Operand Instructions (MOV, ADD, SUB, etc.)
-            else
-            {
-// Opcode lookup table
-#define SET_OPCODES(name)             \
-    op_r_r = OP_##name##_REG_REG;     \
-    op_r_i = OP_##name##_REG_IMM;     \
-    op_r8_r8 = OP_##name##_REG8_REG8; \
-    op_r8_i = OP_##name##_REG8_IMM;
+    void patch(size_t at, uint8_t byte) override
+    {
+        if (at < capacity)
+            start[at] = byte;
+    }
 
-                OpCode op_r_r = OP_HALT, op_r_i = OP_HALT, op_r8_r8 = OP_HALT, op_r8_i = OP_HALT;
-                if (command_str == "MOV")
-                {
-                    SET_OPCODES(MOV);
-                }
-                else if (command_str == "ADD")
-                {
-                    SET_OPCODES(ADD);
-                }
-                else if (command_str == "SUB")
-                {
-                    SET_OPCODES(SUB);
-                }
-                else if (command_str == "CMP")
-                {
-                    SET_OPCODES(CMP);
-                }
-                else if (command_str == "AND")
-                {
-                    SET_OPCODES(AND);
-                }
-                else if (command_str == "OR")
-                {
-                    SET_OPCODES(OR);
-                }
-                else if (command_str == "XOR")
-                {
-                    SET_OPCODES(XOR);
-                }
-                else if (command_str == "ADC")
-                {
-                    SET_OPCODES(ADC);
-                }
-                else if (command_str == "SBB")
-                {
-                    SET_OPCODES(SBB);
-                }
-                else if (command_str == "XCHG")
-                {
-                    op_r_r = OP_XCHG_REG_REG;
-                    op_r8_r8 = OP_XCHG_REG8_REG8;
-                }
-                else
-                    return generate_error("Unknown command: " + command_str);
+private:
+    uint8_t *start;
+    size_t capacity;
 
-                // Operand combination handling
-                if (IS_REG16(op1) && IS_REG16(op2))
-                {
-                    machine_code.push_back(op_r_r);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.reg_code);
-                }
-                else if (IS_REG8(op1) && IS_REG8(op2))
-                {
-                    machine_code.push_back(op_r8_r8);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.reg_code);
-                }
-                else if (IS_REG16(op1) && IS_IMM(op2))
-                {
-                    machine_code.push_back(op_r_i);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.value & 0xFF);
-                    machine_code.push_back((op2.value >> 8) & 0xFF);
-                }
-                else if (IS_REG8(op1) && IS_IMM(op2))
-                {
-                    machine_code.push_back(op_r8_i);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.value & 0xFF);
-                }
-                else if (IS_REG16(op1) && IS_MEM_IMM(op2))
-                {
-                    machine_code.push_back(OP_MOV_REG_FROM_MEM_IMM);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.value & 0xFF);
-                    machine_code.push_back((op2.value >> 8) & 0xFF);
-                }
-                else if (IS_MEM_IMM(op1) && IS_REG16(op2))
-                {
-                    machine_code.push_back(OP_MOV_MEM_IMM_FROM_REG);
-                    machine_code.push_back(op2.reg_code);
-                    machine_code.push_back(op1.value & 0xFF);
-                    machine_code.push_back((op1.value >> 8) & 0xFF);
-                }
-                else if (IS_REG16(op1) && IS_MEM_REG(op2))
-                {
-                    machine_code.push_back(OP_MOV_REG_FROM_MEM_REG);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.reg_code);
-                }
-                else if (IS_MEM_REG(op1) && IS_REG16(op2))
-                {
-                    machine_code.push_back(OP_MOV_MEM_REG_FROM_REG);
-                    machine_code.push_back(op2.reg_code);
-                    machine_code.push_back(op1.reg_code);
+    bool next_window() override { return false; }
+};
+
+// segment:0000 ON, ONE PAGE RUN AT A TIME. ONLY PAGES THE CODE REACHES ARE ALLOCATED
+class MemorySink : public CodeSink
+{
+public:
+    MemorySink(Memory &memory, uint16_t segment) : memory(memory), segment(segment) {}
+
+    void patch(size_t at, uint8_t byte) override
+    {
+        if (at < Memory::SEGMENT_SIZE)
+            memory.write8(segment, static_cast<uint16_t>(at), byte);
+    }
+
+private:
+    Memory &memory;
+    uint16_t segment;
+
+    bool next_window() override
+    {
+        if (written >= Memory::SEGMENT_SIZE)
+            return false;
+        const uint16_t offset = static_cast<uint16_t>(written);
+        cursor = memory.writable_pointer(segment, offset);
+        limit = cursor + memory.contiguous(segment, offset, 1, false);
+        return true;
+    }
+};
+
+// ===============================================================
+// == ASSEMBLY
+// ===============================================================
+std::vector<uint8_t> Parser::parse_from_string(const std::string &code_string)
+{
+    VectorSink machine_code;
+    if (!assemble(code_string.data(), code_string.size(), machine_code))
+        return {};
+    return machine_code.take();
+}
+
+size_t Parser::parse_into(const char *text, size_t length, uint8_t *out, size_t capacity)
+{
+    SpanSink machine_code(out, capacity);
+    return assemble(text, length, machine_code) ? machine_code.size() : 0;
+}
+
+size_t Parser::parse_into(const char *text, size_t length, Memory &memory, uint16_t segment)
+{
+    MemorySink machine_code(memory, segment);
+    return assemble(text, length, machine_code) ? machine_code.size() : 0;
+}
+
+size_t Parser::stream_into(std::istream &source, uint8_t *out, size_t capacity)
+{
+    SpanSink machine_code(out, capacity);
+    return assemble_stream(source, machine_code) ? machine_code.size() : 0;
+}
+
+size_t Parser::stream_into(std::istream &source, Memory &memory, uint16_t segment)
+{
+    MemorySink machine_code(memory, segment);
+    return assemble_stream(source, machine_code) ? machine_code.size() : 0;
+}
+
+size_t Parser::load_file(const std::string &filename, CPU &cpu)
+{
+    MappedFile file(filename);
+    if (!file.opened())
+    {
+        last_error = "ERROR: Could not open file " + filename;
+        return 0;
+    }
+    include_dir = std::filesystem::path(filename).parent_path().string();
+    size_t size = parse_into(file.text(), file.size(), cpu.memory, PROGRAM_SEGMENT);
+    if (last_error.empty())
+        cpu.start_program();
+    return size;
+}
+
+// "name:" -> name
+static std::string label_name(const std::string &cleaned_line)
+{
+    return trim(cleaned_line.substr(0, cleaned_line.length() - 1));
+}
+
+// FIRST PASS: BYTES THE SECOND PASS EMITS FOR ONE (NON-LABEL) LINE
+static uint16_t instruction_size(const std::string &cleaned_line)
+{
+    std::stringstream ss(cleaned_line);
+    std::string command;
+    ss >> command;
+    std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+    strip_lock_prefix(command, ss);
+
+    std::string rest;
+    std::getline(ss, rest);
+
+    Operand op1, op2;
+    auto comma_pos = rest.find(',');
+    if (comma_pos != std::string::npos)
+    {
+        op1 = parse_operand(rest.substr(0, comma_pos));
+        op2 = parse_operand(rest.substr(comma_pos + 1));
+    }
+    else
+    {
+        op1 = parse_operand(rest);
+    }
+
+    // INSTRUCTION SIZE
+    OpCode string_opc;
+    if (lookup_string_op(command, rest, string_opc))
+    {
+        return 1; // MOVSB, REP STOSW...
+    }
+    else if (command == "IN" || command == "OUT")
+    {
+        bool via_dx = (op1.type == TYPE_REG16 && op1.reg_code == REG_DX && command == "OUT") ||
+                      (op2.type == TYPE_REG16 && op2.reg_code == REG_DX && command == "IN");
+        return via_dx ? 2 : 3;
+    }
+    else if (op1.type == TYPE_NONE && op2.type == TYPE_NONE)
+    {
+        return 1; // 0 OPERAND (HALT, RET, NOP, IRET, PUSHF, CLC...)
+    }
+    else if (op2.type == TYPE_NONE)
+    { // ONE OPERAND
+        if (op1.type == TYPE_LABEL)
+            return 3; // JMP, CALL, Jxx
+        else
+            return 2; // PUSH, POP, INC, DEC, NOT, NEG
+    }
+    else
+    {
+        // 16-bit reg + IMM16
+        if (op1.type == TYPE_REG16 && op2.type == TYPE_IMMEDIATE)
+        {
+            return 4;
+        }
+        else if (op1.type == TYPE_REG8 && op2.type == TYPE_IMMEDIATE)
+        {
+            return 3;
+        }
+        else if ((op1.type == TYPE_REG16 && op2.type == TYPE_MEM_FROM_IMM) ||
+                 (op1.type == TYPE_MEM_FROM_IMM && op2.type == TYPE_REG16))
+        {
+            return 4;
+        }
+        else if ((op1.type == TYPE_REG8 && op2.type == TYPE_MEM_FROM_IMM) || (op1.type == TYPE_MEM_FROM_IMM && op2.type == TYPE_REG8))
+        {
+            return 4;
+        }
+        else if (op1.type == TYPE_REG16 && op2.type == TYPE_REG16)
+        {
+            return 3;
+        }
+        else if (op1.type == TYPE_REG8 && op2.type == TYPE_REG8)
+        {
+            return 3;
+        }
+        else if (op1.type == TYPE_MEM_REG_REG || op2.type == TYPE_MEM_REG_REG)
+        {
+            return 4;
+        }
+        else if (op1.type == TYPE_MEM_REG_IMM || op2.type == TYPE_MEM_REG_IMM)
+        {
+            return 5;
+        }
+        else if (op1.type == TYPE_MEM_FROM_IMM && op2.type == TYPE_IMMEDIATE)
+        {
+            if (op2.value <= 0xFF)
+            {
+                return 4;
+            }
+            else
+            {
+                return 5;
+            }
+        }
+        else
+        {
+            return 3;
+        }
+    }
+}
+
+// SECOND PASS FOR ONE LINE
+bool Parser::emit_line(const SourceLine &current_line, CodeSink &machine_code)
+{
+    int line_number = current_line.line;
+    const std::string &cleaned_line = current_line.text;
+
+    if (cleaned_line.back() == ':')
+        return true;
+
+    source_map.add(machine_code.size(), line_number);
+
+    std::stringstream ss(cleaned_line);
+    std::string command_str;
+    ss >> command_str;
+
+    if (command_str.empty())
+    {
+        return true;
+    }
+
+    std::transform(command_str.begin(), command_str.end(), command_str.begin(), ::toupper);
+    const bool locked = strip_lock_prefix(command_str, ss);
+
+    std::string rest;
+    std::getline(ss, rest);
+
+    Operand op1, op2;
+    auto comma_pos = rest.find(',');
+    if (comma_pos != std::string::npos)
+    {
+        op1 = parse_operand(rest.substr(0, comma_pos));
+        op2 = parse_operand(rest.substr(comma_pos + 1));
+    }
+    else
+    {
+        op1 = parse_operand(rest);
+    }
+
+    auto generate_error = [&](const std::string &message)
+    {
+        last_error = "ERROR: " + message + " on line -> " + std::to_string(line_number);
+        return false;
+    };
+
+#define IS_REG16(op) ((op).type == TYPE_REG16)
+#define IS_REG8(op) ((op).type == TYPE_REG8)
+#define IS_SREG(op) ((op).type == TYPE_SREG)
+#define IS_IMM(op) ((op).type == TYPE_IMMEDIATE)
+#define IS_MEM_IMM(op) ((op).type == TYPE_MEM_FROM_IMM)
+#define IS_MEM_REG(op) ((op).type == TYPE_MEM_FROM_REG)
+#define IS_MEM_REG_REG(op) ((op).type == TYPE_MEM_REG_REG)
+#define IS_MEM_REG_IMM(op) ((op).type == TYPE_MEM_REG_IMM)
+#define IS_LABEL(op) ((op).type == TYPE_LABEL)
+#define IS_CL(op) (IS_REG8(op) && (op).reg_code == REG_CL)
+
+    // --- Memory read-modify-write, the only instructions LOCK accepts ---
+    auto rmw = MemRmwOpMap.find(command_str);
+    if (rmw != MemRmwOpMap.end() && IS_MEM_REG(op1) && IS_REG16(op2))
+    {
+        machine_code.push_back(locked ? rmw->second.second : rmw->second.first);
+        machine_code.push_back(op2.reg_code);
+        machine_code.push_back(op1.reg_code);
+        return true;
+    }
+    if (command_str == "XCHG" && IS_REG16(op1) && IS_MEM_REG(op2))
+    {
+        machine_code.push_back(OP_XCHG_REG_MEM_REG);
+        machine_code.push_back(op1.reg_code);
+        machine_code.push_back(op2.reg_code);
+        return true;
+    }
+    if (locked)
+        return generate_error("LOCK only applies to ADD/SUB/AND/OR/XOR [reg16], reg16 and XCHG reg16, [reg16]");
+
+    // --- String Instructions (with or without a REP prefix) ---
+    OpCode string_opc;
+    if (lookup_string_op(command_str, rest, string_opc))
+    {
+        machine_code.push_back(string_opc);
+        return true;
+    }
+    if (is_rep_prefix(command_str))
+        return generate_error(command_str + " can not be used with " + trim(rest));
+
+    // --- 0-Operand Instructions ---
+    if (op1.type == TYPE_NONE)
+    {
+        if (command_str == "HALT")
+            machine_code.push_back(OP_HALT);
+        else if (command_str == "RET")
+            machine_code.push_back(OP_RET);
+        else if (command_str == "NOP")
+            machine_code.push_back(OP_NOP);
+        else if (command_str == "IRET")
+            machine_code.push_back(OP_IRET);
+        else if (FlagOpMap.count(command_str))
+            machine_code.push_back(FlagOpMap.at(command_str));
+        else
+            return generate_error("Unknown or operandless command: " + command_str);
+    }
+    // --- 1-Operand Instructions ---
+    else if (op2.type == TYPE_NONE)
+    {
+        // Branch Instructions
+        if (command_str[0] == 'J' || BranchMap.count(command_str))
+        {
+            if (!IS_LABEL(op1))
+                return generate_error("Jump/Call/Loop commands require a label");
+            // STREAMING: LATER LINES MAY STILL DEFINE (OR REDEFINE) IT, LOOKED UP AT THE END
+            if (label_fixups)
+                label_fixups->push_back({static_cast<uint32_t>(machine_code.size() + 1), op1.str_val, line_number});
+            else if (label_map.count(op1.str_val) == 0)
+                return generate_error("Unknown label: " + op1.str_val);
+            if (BranchMap.count(command_str) == 0)
+                return generate_error("Unknown jump instruction: " + command_str);
+
+            uint16_t addr = label_fixups ? 0 : label_map.at(op1.str_val);
+            OpCode opc = BranchMap.at(command_str);
+
+            machine_code.push_back(opc);
+            relocations.push_back(machine_code.size());
+            machine_code.push_back(addr & 0xFF);
+            machine_code.push_back((addr >> 8) & 0xFF);
+        }
+        // Software Interrupt
+        else if (command_str == "INT")
+        {
+            if (!IS_IMM(op1) || op1.value > 0xFF)
+                return generate_error("INT requires a vector number between 0 and 0xFF");
+            machine_code.push_back(OP_INT);
+            machine_code.push_back(op1.value);
+        }
+        // Other 1-Operand
+        else
+        {
+            OpCode opc16 = OP_HALT, opc8 = OP_HALT;
+            if ((command_str == "PUSH" || command_str == "POP") && IS_SREG(op1))
+            {
+                if (command_str == "POP" && op1.reg_code == SEG_CS)
+                    return generate_error("POP CS is not allowed");
+                machine_code.push_back(command_str == "PUSH" ? OP_PUSH_SREG : OP_POP_SREG);
+                machine_code.push_back(op1.reg_code);
+                return true;
+            }
+            if (command_str == "PUSH")
+            {
+                if (IS_REG16(op1))
+                {
+                    opc16 = OP_PUSH_REG;
                 }
-                else if (IS_REG8(op1) && IS_MEM_IMM(op2))
+                else
                 {
-                    machine_code.push_back(OP_MOV_REG8_FROM_MEM_IMM);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.value & 0xFF);
-                    machine_code.push_back((op2.value >> 8) & 0xFF);
+                    return generate_error("PUSH requires a 16-bit register");
                 }
-                else if (IS_MEM_IMM(op1) && IS_REG8(op2))
+            }
+            else if (command_str == "POP")
+            {
+                if (IS_REG16(op1))
                 {
-                    machine_code.push_back(OP_MOV_MEM_IMM_FROM_REG8);
-                    machine_code.push_back(op2.reg_code);
-                    machine_code.push_back(op1.value & 0xFF);
-                    machine_code.push_back((op1.value >> 8) & 0xFF);
+                    opc16 = OP_POP_REG;
+                }
+                else
+                {
+                    return generate_error("POP requires a 16-bit register");
+                }
+            }
+            else if (command_str == "INC")
+            {
+                opc16 = OP_INC_REG;
+                opc8 = OP_INC_REG8;
+            }
+            else if (command_str == "DEC")
+            {
+                opc16 = OP_DEC_REG;
+                opc8 = OP_DEC_REG8;
+            }
+            else if (command_str == "NEG")
+            {
+                opc16 = OP_NEG_REG16;
+                opc8 = OP_NEG_REG8;
+            }
+            else if (command_str == "NOT")
+            {
+                opc16 = OP_NOT_REG;
+                opc8 = OP_NOT_REG8;
+            }
+            else if (command_str == "MUL")
+            {
+                opc16 = OP_MUL_REG;
+                opc8 = OP_MUL_REG8;
+            }
+            else if (command_str == "IMUL")
+            {
+                opc16 = OP_IMUL_REG;
+                opc8 = OP_IMUL_REG8;
+            }
+            else if (command_str == "DIV")
+            {
+                opc16 = OP_DIV_REG;
+                opc8 = OP_DIV_REG8;
+            }
+            else if (command_str == "IDIV")
+            {
+                opc16 = OP_IDIV_REG;
+                opc8 = OP_IDIV_REG8;
+            }
+            else
+                return generate_error("Unknown 1-operand command: " + command_str);
+
+            if (IS_REG16(op1))
+            {
+                if (opc16 == OP_HALT)
+                    return generate_error(command_str + " does not support 16-bit registers.");
+                machine_code.push_back(opc16);
+                machine_code.push_back(op1.reg_code);
+            }
+            else if (IS_REG8(op1))
+            {
+                if (opc8 == OP_HALT)
+                    return generate_error(command_str + " does not support 8-bit registers.");
+                machine_code.push_back(opc8);
+                machine_code.push_back(op1.reg_code);
+            }
+            else
+            {
+                return generate_error(command_str + " requires a register operand.");
+            }
+        }
+    }
+    // --- 2-Operand Instructions ---
+    else
+    {
+        // Shift/Rotate Instructions
+        if (command_str == "SHL" || command_str == "SAL" || command_str == "SHR" || command_str == "SAR" || command_str == "ROL" || command_str == "ROR" || command_str == "RCL" || command_str == "RCR")
+        {
+            if (!IS_IMM(op2) && !IS_CL(op2))
+                return generate_error("Shift/Rotate requires an immediate value or CL as the second operand");
+
+            OpCode opc16 = OP_HALT, opc8 = OP_HALT;
+
+            if (IS_CL(op2))
+            {
+                if (command_str == "SHL" || command_str == "SAL")
+                {
+                    opc16 = OP_SHL_REG_CL;
+                    opc8 = OP_SHL_REG8_CL;
+                }
+                else if (command_str == "SHR")
+                {
+                    opc16 = OP_SHR_REG_CL;
+                    opc8 = OP_SHR_REG8_CL;
+                }
+                else if (command_str == "SAR")
+                {
+                    opc16 = OP_SAR_REG_CL;
+                    opc8 = OP_SAR_REG8_CL;
+                }
+                else if (command_str == "ROL")
+                {
+                    opc16 = OP_ROL_REG_CL;
+                    opc8 = OP_ROL_REG8_CL;
+                }
+                else if (command_str == "ROR")
+                {
+                    opc16 = OP_ROR_REG_CL;
+                    opc8 = OP_ROR_REG8_CL;
+                }
+                else if (command_str == "RCL")
+                {
+                    opc16 = OP_RCL_REG_CL;
+                    opc8 = OP_RCL_REG8_CL;
+                }
+                else if (command_str == "RCR")
+                {
+                    opc16 = OP_RCR_REG_CL;
+                    opc8 = OP_RCR_REG8_CL;
+                }
+            }
+            else
+            { // IS_IMM
+                if (command_str == "SHL" || command_str == "SAL")
+                {
+                    opc16 = OP_SHL_REG_IMM;
+                    opc8 = OP_SHL_REG8_IMM;
+                }
+                else if (command_str == "SHR")
+                {
+                    opc16 = OP_SHR_REG_IMM;
+                    opc8 = OP_SHR_REG8_IMM;
                 }
-                else if (IS_REG8(op1) && IS_MEM_REG(op2))
+                else if (command_str == "SAR")
                 {
-                    machine_code.push_back(OP_MOV_REG8_FROM_MEM_REG);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.reg_code);
+                    opc16 = OP_SAR_REG_IMM;
+                    opc8 = OP_SAR_REG8_IMM;
                 }
-                else if (IS_MEM_REG(op1) && IS_REG8(op2))
+                else if (command_str == "ROL")
                 {
-                    machine_code.push_back(OP_MOV_MEM_REG_FROM_REG8);
-                    machine_code.push_back(op2.reg_code);
-                    machine_code.push_back(op1.reg_code);
+                    opc16 = OP_ROL_REG_IMM;
+                    opc8 = OP_ROL_REG8_IMM;
                 }
-                else if (IS_REG16(op1) && IS_MEM_REG_REG(op2))
+                else if (command_str == "ROR")
                 {
-                    machine_code.push_back(OP_MOV_REG_FROM_MEM_REG_REG);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op2.reg_code);
-                    machine_code.push_back(op2.reg_code2);
+                    opc16 = OP_ROR_REG_IMM;
+                    opc8 = OP_ROR_REG8_IMM;
                 }
-                else if (IS_MEM_REG_REG(op1) && IS_REG16(op2))
+                else if (command_str == "RCL")
                 {
-                    machine_code.push_back(OP_MOV_MEM_REG_REG_FROM_REG);
-                    machine_code.push_back(op2.reg_code);
-                    machine_code.push_back(op1.reg_code);
-                    machine_code.push_back(op1.reg_code2);
+                    opc16 = OP_RCL_REG_IMM;
+                    opc8 = OP_RCL_REG8_IMM;
                 }
-                else if (IS_MEM_IMM(op1) && IS_IMM(op2))
+                else if (command_str == "RCR")
                 {
-                    if (op2.value <= 0xFF)
-                    {
-                        machine_code.push_back(OP_MOV_MEM_IMM_FROM_IMM8);
-                        machine_code.push_back(op1.value & 0xFF);
-                        machine_code.push_back((op1.value >> 8) & 0xFF);
-                        machine_code.push_back(op2.value & 0xFF);
-                    }
-                    else
-                    {
-                        machine_code.push_back(OP_MOV_MEM_IMM_FROM_IMM);
-                        machine_code.push_back((op1.value & 0xFF));
-                        machine_code.push_back((op1.value >> 8) & 0xFF);
-                        machine_code.push_back(op2.value & 0xFF);
-                        machine_code.push_back((op2.value >> 8) & 0xFF);
-                    }
+                    opc16 = OP_RCR_REG_IMM;
+                    opc8 = OP_RCR_REG8_IMM;
                 }
+            }
+
+            if (IS_REG16(op1))
+            {
+                machine_code.push_back(opc16);
+                machine_code.push_back(op1.reg_code);
+            }
+            else if (IS_REG8(op1))
+            {
+                machine_code.push_back(opc8);
+                machine_code.push_back(op1.reg_code);
+            }
+            else
+            {
+                return generate_error("Shift/Rotate commands require a register as the first operand");
+            }
+
+            if (IS_IMM(op2))
+                machine_code.push_back(op2.value & 0xFF);
+        }
+        // Port I/O (IN reg, imm8 / IN reg, DX / OUT imm8, reg / OUT DX, reg)
+        else if (command_str == "IN" || command_str == "OUT")
+        {
+            bool is_in = command_str == "IN";
+            const Operand &reg = is_in ? op1 : op2;
+            const Operand &port = is_in ? op2 : op1;
+            if (!IS_REG16(reg) && !IS_REG8(reg))
+                return generate_error(command_str + " requires a register for the data");
+
+            if (IS_REG16(port) && port.reg_code == REG_DX)
+            {
+                if (is_in)
+                    machine_code.push_back(IS_REG16(reg) ? OP_IN_REG_DX : OP_IN_REG8_DX);
+                else
+                    machine_code.push_back(IS_REG16(reg) ? OP_OUT_DX_REG : OP_OUT_DX_REG8);
+                machine_code.push_back(reg.reg_code);
+            }
+            else if (IS_IMM(port))
+            {
+                if (port.value > 0xFF)
+                    return generate_error("Port number must be 0-255, use DX for a computed port");
+                if (is_in)
+                    machine_code.push_back(IS_REG16(reg) ? OP_IN_REG_PORT : OP_IN_REG8_PORT);
                 else
+                    machine_code.push_back(IS_REG16(reg) ? OP_OUT_PORT_REG : OP_OUT_PORT_REG8);
+                machine_code.push_back(reg.reg_code);
+                machine_code.push_back(port.value & 0xFF);
+            }
+            else
+            {
+                return generate_error(command_str + " requires an imm8 port number or DX");
+            }
+        }
+        // Segment Register Moves (MOV SREG, R16 / MOV R16, SREG)
+        else if (IS_SREG(op1) || IS_SREG(op2))
+        {
+            if (command_str != "MOV")
+                return generate_error("Segment registers can only be used with MOV, PUSH and POP");
+            if (IS_SREG(op1) && op1.reg_code == SEG_CS)
+                return generate_error("CS can not be loaded with MOV");
+
+            if (IS_SREG(op1) && IS_REG16(op2))
+            {
+                machine_code.push_back(OP_MOV_SREG_REG);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+            }
+            else if (IS_REG16(op1) && IS_SREG(op2))
+            {
+                machine_code.push_back(OP_MOV_REG_SREG);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+            }
+            else
+            {
+                return generate_error("Segment registers can only be moved to or from a 16-bit register");
+            }
+        }
+        // General 2-Operand Instructions (MOV, ADD, SUB, etc.)
+        else
+        {
+// Opcode lookup table
+#define SET_OPCODES(name)             \
+op_r_r = OP_##name##_REG_REG;     \
+op_r_i = OP_##name##_REG_IMM;     \
+op_r8_r8 = OP_##name##_REG8_REG8; \
+op_r8_i = OP_##name##_REG8_IMM;
+
+            OpCode op_r_r = OP_HALT, op_r_i = OP_HALT, op_r8_r8 = OP_HALT, op_r8_i = OP_HALT;
+            if (command_str == "MOV")
+            {
+                SET_OPCODES(MOV);
+            }
+            else if (command_str == "ADD")
+            {
+                SET_OPCODES(ADD);
+            }
+            else if (command_str == "SUB")
+            {
+                SET_OPCODES(SUB);
+            }
+            else if (command_str == "CMP")
+            {
+                SET_OPCODES(CMP);
+            }
+            else if (command_str == "AND")
+            {
+                SET_OPCODES(AND);
+            }
+            else if (command_str == "OR")
+            {
+                SET_OPCODES(OR);
+            }
+            else if (command_str == "XOR")
+            {
+                SET_OPCODES(XOR);
+            }
+            else if (command_str == "ADC")
+            {
+                SET_OPCODES(ADC);
+            }
+            else if (command_str == "SBB")
+            {
+                SET_OPCODES(SBB);
+            }
+            else if (command_str == "XCHG")
+            {
+                op_r_r = OP_XCHG_REG_REG;
+                op_r8_r8 = OP_XCHG_REG8_REG8;
+            }
+            else
+                return generate_error("Unknown command: " + command_str);
+
+            // Operand combination handling
+            if (IS_REG16(op1) && IS_REG16(op2))
+            {
+                machine_code.push_back(op_r_r);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+            }
+            else if (IS_REG8(op1) && IS_REG8(op2))
+            {
+                machine_code.push_back(op_r8_r8);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+            }
+            else if (IS_REG16(op1) && IS_IMM(op2))
+            {
+                machine_code.push_back(op_r_i);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.value & 0xFF);
+                machine_code.push_back((op2.value >> 8) & 0xFF);
+            }
+            else if (IS_REG8(op1) && IS_IMM(op2))
+            {
+                machine_code.push_back(op_r8_i);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.value & 0xFF);
+            }
+            else if (IS_REG16(op1) && IS_MEM_IMM(op2))
+            {
+                machine_code.push_back(OP_MOV_REG_FROM_MEM_IMM);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.value & 0xFF);
+                machine_code.push_back((op2.value >> 8) & 0xFF);
+            }
+            else if (IS_MEM_IMM(op1) && IS_REG16(op2))
+            {
+                machine_code.push_back(OP_MOV_MEM_IMM_FROM_REG);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op1.value & 0xFF);
+                machine_code.push_back((op1.value >> 8) & 0xFF);
+            }
+            else if (IS_REG16(op1) && IS_MEM_REG(op2))
+            {
+                machine_code.push_back(OP_MOV_REG_FROM_MEM_REG);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+            }
+            else if (IS_MEM_REG(op1) && IS_REG16(op2))
+            {
+                machine_code.push_back(OP_MOV_MEM_REG_FROM_REG);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op1.reg_code);
+            }
+            else if (IS_REG8(op1) && IS_MEM_IMM(op2))
+            {
+                machine_code.push_back(OP_MOV_REG8_FROM_MEM_IMM);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.value & 0xFF);
+                machine_code.push_back((op2.value >> 8) & 0xFF);
+            }
+            else if (IS_MEM_IMM(op1) && IS_REG8(op2))
+            {
+                machine_code.push_back(OP_MOV_MEM_IMM_FROM_REG8);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op1.value & 0xFF);
+                machine_code.push_back((op1.value >> 8) & 0xFF);
+            }
+            else if (IS_REG8(op1) && IS_MEM_REG(op2))
+            {
+                machine_code.push_back(OP_MOV_REG8_FROM_MEM_REG);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+            }
+            else if (IS_MEM_REG(op1) && IS_REG8(op2))
+            {
+                machine_code.push_back(OP_MOV_MEM_REG_FROM_REG8);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op1.reg_code);
+            }
+            else if (IS_REG16(op1) && IS_MEM_REG_REG(op2))
+            {
+                machine_code.push_back(OP_MOV_REG_FROM_MEM_REG_REG);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op2.reg_code2);
+            }
+            else if (IS_MEM_REG_REG(op1) && IS_REG16(op2))
+            {
+                machine_code.push_back(OP_MOV_MEM_REG_REG_FROM_REG);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op1.reg_code2);
+            }
+            else if ((IS_REG16(op1) || IS_REG8(op1)) && IS_MEM_REG_IMM(op2))
+            {
+                machine_code.push_back(IS_REG16(op1) ? OP_MOV_REG_FROM_MEM_REG_IMM : OP_MOV_REG8_FROM_MEM_REG_IMM);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op2.value & 0xFF);
+                machine_code.push_back((op2.value >> 8) & 0xFF);
+            }
+            else if (IS_MEM_REG_IMM(op1) && (IS_REG16(op2) || IS_REG8(op2)))
+            {
+                machine_code.push_back(IS_REG16(op2) ? OP_MOV_MEM_REG_IMM_FROM_REG : OP_MOV_MEM_REG_IMM_FROM_REG8);
+                machine_code.push_back(op2.reg_code);
+                machine_code.push_back(op1.reg_code);
+                machine_code.push_back(op1.value & 0xFF);
+                machine_code.push_back((op1.value >> 8) & 0xFF);
+            }
+            else if (IS_MEM_IMM(op1) && IS_IMM(op2))
+            {
+                if (op2.value <= 0xFF)
                 {
-                    return generate_error("Invalid operand combination for " + command_str);
+                    machine_code.push_back(OP_MOV_MEM_IMM_FROM_IMM8);
+                    machine_code.push_back(op1.value & 0xFF);
+                    machine_code.push_back((op1.value >> 8) & 0xFF);
+                    machine_code.push_back(op2.value & 0xFF);
+                }
+                else
+                {
+                    machine_code.push_back(OP_MOV_MEM_IMM_FROM_IMM);
+                    machine_code.push_back((op1.value & 0xFF));
+                    machine_code.push_back((op1.value >> 8) & 0xFF);
+                    machine_code.push_back(op2.value & 0xFF);
+                    machine_code.push_back((op2.value >> 8) & 0xFF);
                 }
             }
+            else
+            {
+                return generate_error("Invalid operand combination for " + command_str);
+            }
         }
     }
+    return true;
+}
 
+void Parser::reset()
+{
+    label_map.clear();
+    macro_map.clear();
+    relocations.clear();
+    includes.clear();
+    source_map.clear();
+    macro_serial = 0;
     last_error = "";
-    return machine_code;
+}
+
+// MAIN PARSING LOGIC, FIXED AND ROBUST VERSION
+bool Parser::assemble(const char *text, size_t length, CodeSink &machine_code)
+{
+    reset();
+
+    std::vector<std::string> raw_lines;
+    auto keep_line = [&](const char *begin, const char *end)
+    {
+        raw_lines.emplace_back(begin, end);
+    };
+    for_each_line(text, length, keep_line);
+
+    // ===============================================================
+    // == PREPROCESS: EXPAND INCLUDE AND %macro INVOCATIONS
+    // ===============================================================
+    std::vector<SourceLine> lines;
+    if (!preprocess(raw_lines, include_dir, 0, 0, lines))
+    {
+        return false;
+    }
+
+    // ===============================================================
+    // == FIRST PASS: CALCULATE ADDRESS FOR LABELS
+    // ===============================================================
+    uint16_t current_address = 0;
+    for (const auto &current_line : lines)
+    {
+        const std::string &cleaned_line = current_line.text;
+        if (cleaned_line.back() == ':')
+            label_map[label_name(cleaned_line)] = current_address;
+        else
+            current_address += instruction_size(cleaned_line);
+    }
+
+    // ===============================================================
+    // == SECOND PASS: Generate machine code
+    // ===============================================================
+    for (const auto &current_line : lines)
+    {
+        if (!emit_line(current_line, machine_code))
+            return false;
+    }
+
+    if (machine_code.overflowed())
+    {
+        last_error = "ERROR: Program does not fit (" + std::to_string(machine_code.size()) + " bytes)";
+        return false;
+    }
+    source_map.finish(machine_code.size());
+    last_error = "";
+    return true;
+}
+
+// ===============================================================
+// == STREAMING ASSEMBLY
+// ===============================================================
+// EACH LINE IS PREPROCESSED, SIZED LIKE THE FIRST PASS DOES (SO LABELS GET THE SAME ADDRESSES)
+// AND EMITTED AS SOON AS IT IS READ; BRANCHES LEAVE A LabelFixup. ERRORS COME OUT AS IN
+// assemble(): AFTER A LINE FAILS, THE REST IS STILL PREPROCESSED (THOSE ERRORS WIN) AND SCANNED
+// FOR LABELS, AND A BRANCH BEFORE THE FAILED LINE TO A LABEL THAT NEVER APPEARS WINS NEXT
+bool Parser::assemble_stream(std::istream &source, CodeSink &machine_code)
+{
+    static const size_t CHUNK_SIZE = 1 << 16;
+
+    reset();
+    std::vector<LabelFixup> fixups;
+    label_fixups = &fixups;
+
+    MacroRecording recording;
+    std::vector<SourceLine> expanded; // ONE SOURCE LINE AFTER INCLUDE / MACRO EXPANSION
+    int line_number = 0;
+    uint16_t current_address = 0;
+    std::string emit_error; // FIRST LINE THAT FAILED, NOTHING IS EMITTED AFTER IT
+
+    // FALSE STOPS READING, last_error SAYS WHY
+    auto assemble_line = [&](const std::string &raw)
+    {
+        expanded.clear();
+        if (!preprocess_line(raw, include_dir, ++line_number, 0, recording, expanded))
+            return false;
+        for (const SourceLine &current_line : expanded)
+        {
+            if (current_line.text.back() == ':')
+            {
+                label_map[label_name(current_line.text)] = current_address;
+                continue;
+            }
+            current_address += instruction_size(current_line.text);
+            if (!emit_error.empty())
+                continue;
+            if (!emit_line(current_line, machine_code))
+                emit_error = last_error;
+            else if (machine_code.overflowed())
+            {
+                last_error = "ERROR: Program does not fit (" + std::to_string(machine_code.size()) + " bytes) on line -> " + std::to_string(current_line.line);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::vector<char> chunk(CHUNK_SIZE);
+    std::string line; // A LINE CUT BY THE END OF A CHUNK CONTINUES IN THE NEXT ONE
+    bool reading = true;
+    while (reading)
+    {
+        source.read(chunk.data(), chunk.size());
+        const size_t got = source.gcount();
+        if (got == 0)
+            break;
+        const char *p = chunk.data();
+        const char *end = p + got;
+        while (reading)
+        {
+            const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!newline)
+            {
+                line.append(p, end);
+                break;
+            }
+            line.append(p, newline);
+            reading = assemble_line(line);
+            line.clear();
+            p = newline + 1;
+        }
+    }
+    if (reading && !line.empty())
+        reading = assemble_line(line);
+    label_fixups = nullptr;
+
+    if (!reading)
+        return false;
+    if (source.bad())
+    {
+        last_error = "ERROR: Could not read the source";
+        return false;
+    }
+    if (recording.macro)
+    {
+        last_error = "ERROR: Unterminated %macro on line -> " + std::to_string(recording.line);
+        return false;
+    }
+    for (const LabelFixup &fixup : fixups)
+    {
+        auto label = label_map.find(fixup.label);
+        if (label == label_map.end())
+        {
+            last_error = "ERROR: Unknown label: " + fixup.label + " on line -> " + std::to_string(fixup.line);
+            return false;
+        }
+        machine_code.patch(fixup.at, label->second & 0xFF);
+        machine_code.patch(fixup.at + 1, label->second >> 8);
+    }
+    if (!emit_error.empty())
+    {
+        last_error = emit_error;
+        return false;
+    }
+    source_map.finish(machine_code.size());
+    last_error = "";
+    return true;
 }
 
 std::vector<uint8_t> Parser::parse(const std::string &filename)
 {
-    std::ifstream file(filename);
-    if (!file.is_open())
+    MappedFile file(filename);
+    if (!file.opened())
     {
         last_error = "ERROR: Could not open file " + filename;
         return {};
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    file.close();
-    return parse_from_string(buffer.str());
+    include_dir = std::filesystem::path(filename).parent_path().string();
+    VectorSink machine_code;
+    if (!assemble(file.text(), file.size(), machine_code))
+        return {};
+    return machine_code.take();
+}
+
+void Parser::set_include_dir(const std::string &dir)
+{
+    include_dir = dir;
 }
 
 std::string Parser::get_last_error()
 {
     return last_error;
 }
+
+const std::unordered_map<std::string, uint16_t> &Parser::get_labels() const
+{
+    return label_map;
+}
+
+const std::vector<uint16_t> &Parser::get_relocations() const
+{
+    return relocations;
+}
+
+const std::vector<IncludeDependency> &Parser::get_includes() const
+{
+    return includes;
+}
+
+const SourceMap &Parser::get_source_map() const
+{
+    return source_map;
+}
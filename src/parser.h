@@ -3,14 +3,79 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <filesystem>
+#include <iosfwd>
 #include <unordered_map>
 #include "cpu.h"
+#include "sourcemap.h"
+
+// ONE CLEANED SOURCE LINE AFTER MACRO / INCLUDE EXPANSION
+struct SourceLine
+{
+    std::string text;
+    int line; // LINE IN THE ASSEMBLED FILE (INCLUDED / EXPANDED LINES KEEP THE LINE THAT PULLED THEM IN)
+};
+
+// A FILE PULLED IN WITH INCLUDE, AS SEEN WHEN IT WAS READ
+struct IncludeDependency
+{
+    std::string path;
+    std::filesystem::file_time_type mtime;
+};
+
+// WHERE THE SECOND PASS WRITES THE MACHINE CODE (parser.cpp)
+class CodeSink;
+
+// COMMENT AND SURROUNDING WHITESPACE STRIPPING SHARED BY EVERY SOURCE CONSUMER
+std::string clean_line(std::string line);
 
 class Parser
 {
 private:
+    struct Macro
+    {
+        int param_count = 0;
+        std::vector<std::string> body;
+    };
+
     std::unordered_map<std::string, uint16_t> label_map;
+    std::unordered_map<std::string, Macro> macro_map;
+    std::vector<uint16_t> relocations;
+    std::vector<IncludeDependency> includes;
+    SourceMap source_map;
     std::string last_error;
+    std::string include_dir;
+    int macro_serial = 0;
+
+    // A %macro WHOSE BODY IS STILL BEING READ
+    struct MacroRecording
+    {
+        Macro *macro = nullptr;
+        int line = 0;
+    };
+
+    // A BRANCH TARGET THE STREAMING ASSEMBLER FILLS IN ONCE EVERY LABEL IS KNOWN
+    struct LabelFixup
+    {
+        uint32_t at; // CODE OFFSET OF THE ADDRESS WORD
+        std::string label;
+        int line;
+    };
+    std::vector<LabelFixup> *label_fixups = nullptr; // SET WHILE STREAMING
+
+    void reset();
+
+    // %macro / %endmacro / INCLUDE EXPANSION
+    bool preprocess(const std::vector<std::string> &input, const std::string &dir, int origin_line, int depth, std::vector<SourceLine> &out);
+    bool preprocess_line(const std::string &raw, const std::string &dir, int line_number, int depth, MacroRecording &recording, std::vector<SourceLine> &out);
+
+    // SECOND PASS FOR ONE LINE
+    bool emit_line(const SourceLine &current_line, CodeSink &machine_code);
+
+    // BOTH PASSES OVER length BYTES OF SOURCE, THE CODE GOES STRAIGHT INTO machine_code
+    bool assemble(const char *text, size_t length, CodeSink &machine_code);
+    // ONE PASS OVER A STREAM, SEE stream_into()
+    bool assemble_stream(std::istream &source, CodeSink &machine_code);
 
 public:
     // Test Parser -> C++ Terminal
@@ -19,5 +84,34 @@ public:
     // Parser -> QT C++ UI
     std::vector<uint8_t> parse_from_string(const std::string &code_string);
 
+    // ZERO-COPY VARIANTS: THE CODE IS WRITTEN WHERE IT WILL RUN, WITH NO VECTOR IN BETWEEN. THEY
+    // RETURN THE CODE SIZE, OR 0 AND get_last_error() ON AN ERROR (INCLUDING CODE THAT DOES NOT
+    // FIT), WHEN THE DESTINATION MAY ALREADY HOLD PART OF IT
+    size_t parse_into(const char *text, size_t length, uint8_t *out, size_t capacity);
+    // INTO segment:0000 OF memory, AT MOST ONE SEGMENT
+    size_t parse_into(const char *text, size_t length, Memory &memory, uint16_t segment);
+    // A SOURCE FILE (mmap'ED, INCLUDE RESOLVED NEXT TO IT) INTO cpu, STARTED LIKE load_program()
+    size_t load_file(const std::string &filename, CPU &cpu);
+
+    // STREAMING ASSEMBLY FOR SOURCES TOO LARGE TO HOLD. source IS READ IN CHUNKS AND ASSEMBLED IN
+    // ONE PASS, BRANCH TARGETS ARE PATCHED IN AT THE END. WHAT STAYS RESIDENT IS THE LABELS,
+    // MACROS AND INCLUDED FILES PLUS A FEW BYTES PER EMITTED INSTRUCTION (FIXUPS, RELOCATIONS,
+    // SOURCE MAP), SO PEAK MEMORY FOLLOWS THE CODE (AT MOST ONE SEGMENT), NOT THE SOURCE TEXT.
+    // SAME RESULT AND ERRORS AS parse_into(), EXCEPT THAT CODE OUTGROWING THE DESTINATION STOPS
+    // THE ASSEMBLY AT THE LINE THAT OVERFLOWED
+    size_t stream_into(std::istream &source, uint8_t *out, size_t capacity);
+    size_t stream_into(std::istream &source, Memory &memory, uint16_t segment);
+
+    // RELATIVE INCLUDE "file" PATHS ARE RESOLVED AGAINST THIS DIRECTORY
+    void set_include_dir(const std::string &dir);
+
     std::string get_last_error();
+
+    // SYMBOLS AND ABSOLUTE-ADDRESS FIXUPS OF THE LAST SUCCESSFUL ASSEMBLY
+    const std::unordered_map<std::string, uint16_t> &get_labels() const;
+    const std::vector<uint16_t> &get_relocations() const;
+    const std::vector<IncludeDependency> &get_includes() const;
+
+    // MACHINE CODE ADDRESS -> EDITOR LINE OF THE LAST SUCCESSFUL ASSEMBLY
+    const SourceMap &get_source_map() const;
 };
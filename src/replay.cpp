@@ -0,0 +1,174 @@
+#include "replay.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+static const char LOG_MAGIC[4] = {'X', '8', '6', 'R'};
+static const uint16_t LOG_VERSION = 1;
+static const size_t HEADER_SIZE = 6;
+
+void InputLog::start_recording()
+{
+    log.clear();
+    count = 0;
+    last_at = 0;
+    mode = MODE_RECORDING;
+}
+
+void InputLog::start_replay()
+{
+    position = 0;
+    replayed = 0;
+    last_at = 0;
+    diverge_count = UINT64_MAX;
+    mode = MODE_REPLAYING;
+    advance();
+}
+
+void InputLog::stop()
+{
+    mode = MODE_IDLE;
+}
+
+void InputLog::record(Kind kind, uint64_t at, uint8_t data)
+{
+    if (mode != MODE_RECORDING)
+        return;
+    uint64_t key = (at - last_at) << 1 | kind;
+    while (key >= 0x80)
+    {
+        log.push_back(static_cast<uint8_t>(key) | 0x80);
+        key >>= 7;
+    }
+    log.push_back(static_cast<uint8_t>(key));
+    log.push_back(data);
+    last_at = at;
+    count++;
+}
+
+// ONE ENTRY, position MOVES PAST IT. FALSE WHEN IT IS CUT SHORT
+bool InputLog::decode(const uint8_t *data, size_t size, size_t &position, uint64_t &key, uint8_t &value)
+{
+    key = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        if (position >= size || shift > 63)
+            return false;
+        uint8_t byte = data[position++];
+        key |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    if (position >= size)
+        return false;
+    value = data[position++];
+    return true;
+}
+
+// DECODES THE NEXT ENTRY INTO head_*, OR ENDS THE REPLAY
+void InputLog::advance()
+{
+    uint64_t key;
+    if (position >= log.size() || !decode(log.data(), log.size(), position, key, head_data))
+    {
+        head_at = UINT64_MAX;
+        mode = MODE_IDLE;
+        return;
+    }
+    last_at += key >> 1;
+    head_at = last_at;
+    head_kind = static_cast<Kind>(key & 1);
+}
+
+void InputLog::diverge(uint64_t at)
+{
+    diverge_count = at;
+    head_at = UINT64_MAX;
+    mode = MODE_IDLE;
+}
+
+bool InputLog::replay(Kind kind, uint64_t at, uint8_t &data)
+{
+    if (mode != MODE_REPLAYING)
+        return false;
+    if (head_at != at || head_kind != kind)
+    {
+        // A READ THE LOG DOES NOT HAVE, OR AN ENTRY THE RUN WENT PAST WITHOUT USING.
+        // AN INTERRUPT CHECK AHEAD OF THE NEXT ENTRY IS FINE: NO INTERRUPT BEFORE THIS INSTRUCTION
+        if (kind == DEVICE_READ || head_at <= at)
+            diverge(at);
+        return false;
+    }
+    data = head_data;
+    replayed++;
+    advance();
+    return true;
+}
+
+bool InputLog::save(const std::string &filename)
+{
+    last_error = "";
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        last_error = "ERROR: Could not create file " + filename;
+        return false;
+    }
+    const char header[HEADER_SIZE] = {LOG_MAGIC[0], LOG_MAGIC[1], LOG_MAGIC[2], LOG_MAGIC[3],
+                                      static_cast<char>(LOG_VERSION & 0xFF), static_cast<char>(LOG_VERSION >> 8)};
+    file.write(header, HEADER_SIZE);
+    file.write(reinterpret_cast<const char *>(log.data()), log.size());
+    if (!file)
+    {
+        last_error = "ERROR: Could not write file " + filename;
+        return false;
+    }
+    return true;
+}
+
+bool InputLog::load(const std::string &filename)
+{
+    last_error = "";
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        last_error = "ERROR: Could not open file " + filename;
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < HEADER_SIZE || !std::equal(LOG_MAGIC, LOG_MAGIC + 4, bytes.begin()))
+    {
+        last_error = "ERROR: Not an input log: " + filename;
+        return false;
+    }
+    if ((bytes[4] | bytes[5] << 8) != LOG_VERSION)
+    {
+        last_error = "ERROR: Unsupported input log version";
+        return false;
+    }
+
+    // EVERY ENTRY MUST DECODE, SO REPLAY NEVER MEETS A BROKEN ONE
+    size_t entries = 0;
+    size_t at = HEADER_SIZE;
+    uint64_t key;
+    uint8_t value;
+    while (at < bytes.size())
+    {
+        if (!decode(bytes.data(), bytes.size(), at, key, value))
+        {
+            last_error = "ERROR: Truncated input log";
+            return false;
+        }
+        entries++;
+    }
+
+    log.assign(bytes.begin() + HEADER_SIZE, bytes.end());
+    count = entries;
+    mode = MODE_IDLE;
+    return true;
+}
+
+std::string InputLog::get_last_error()
+{
+    return last_error;
+}
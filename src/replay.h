@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == RECORD / REPLAY OF NONDETERMINISTIC INPUT
+// ===============================================================
+// A CPU'S RUN FOLLOWS FROM ITS START STATE EXCEPT FOR TWO THINGS THE HOST DECIDES: WHAT READS
+// OF THE EXTERNAL DEVICES RETURN (Device::external: THE KEYBOARD, WHOSE INPUT ARRIVES WHENEVER
+// THE HOST PUSHES IT, AND THE INTERRUPT CONTROLLER THAT FOLLOWS IT) AND THE INSTRUCTIONS BEFORE
+// WHICH DEVICE INTERRUPTS ARE TAKEN. THE TIMER RUNS ON RETIRED INSTRUCTIONS AND NEEDS NO LOG.
+// RECORDING LOGS EXACTLY THOSE TWO, KEYED BY THE RETIRED INSTRUCTION COUNT. REPLAYING FEEDS THEM
+// BACK INSTEAD OF ASKING THE DEVICES, SO THE SAME PROGRAM FROM THE SAME START STATE RUNS THE SAME
+// WAY, BIT FOR BIT, WITHOUT THE HOST THAT FED IT. NOTHING IS LOGGED PER INSTRUCTION; BETWEEN TWO
+// ENTRIES THE CPU RUNS AT FULL SPEED.
+//
+// THE LOG HOLDS NO PROGRAM OR START STATE: LOAD THE SAME PROGRAM INTO A FRESH CPU, ATTACH THE
+// LOG WITH CPU::set_input_log AND start_replay() BEFORE THE FIRST step().
+//
+// FILE FORMAT: "X86R" u16 version, THEN ONE ENTRY PER EVENT
+//   varint((instruction - previous entry's instruction) << 1 | kind)  u8 data
+//   kind DEVICE_READ: data = THE BYTE READ, DEVICE_INTERRUPT: data = THE VECTOR TAKEN
+// VARINTS ARE 7 BITS PER BYTE, LOW GROUP FIRST, HIGH BIT = MORE FOLLOW. A KEY PRESS THAT THE
+// PROGRAM READS FROM AN INTERRUPT HANDLER COSTS ABOUT 6 BYTES.
+class InputLog
+{
+public:
+    enum Kind : uint8_t
+    {
+        DEVICE_READ = 0,     // IN, OR A READ OF A DEVICE PAGE, FROM AN EXTERNAL DEVICE
+        DEVICE_INTERRUPT = 1 // AN IRQ TAKEN BEFORE THE INSTRUCTION (TF TRAPS AND INT n ARE NOT INPUT)
+    };
+
+    // DROPS WHATEVER WAS LOGGED
+    void start_recording();
+    // FROM THE FIRST ENTRY. PAST THE LAST ONE THE DEVICES ANSWER AGAIN
+    void start_replay();
+    void stop();
+
+    bool recording() const { return mode == MODE_RECORDING; }
+    bool replaying() const { return mode == MODE_REPLAYING; }
+
+    // THE RUN ASKED FOR SOMETHING OTHER THAN WHAT WAS RECORDED AT THAT POINT (A DIFFERENT
+    // PROGRAM OR START STATE). REPLAY STOPPED THERE AND THE DEVICES ANSWER FROM THEN ON
+    bool diverged() const { return diverge_count != UINT64_MAX; }
+    uint64_t diverged_at() const { return diverge_count; }
+    // REPLAY USED EVERY ENTRY
+    bool finished() const { return replayed == count && !diverged(); }
+
+    size_t entries() const { return count; }
+    size_t size_bytes() const { return log.size(); }
+
+    bool save(const std::string &filename);
+    bool load(const std::string &filename);
+    std::string get_last_error();
+
+    // --- FOR THE CPU, at = ITS instructions ---
+    void record(Kind kind, uint64_t at, uint8_t data);
+    // TRUE AND data SET WHEN THE NEXT ENTRY IS kind AT at. A DEVICE READ WHERE THE LOG HAS NONE,
+    // OR AN ENTRY THE RUN WENT PAST WITHOUT USING, IS A DIVERGENCE
+    bool replay(Kind kind, uint64_t at, uint8_t &data);
+    // INSTRUCTION COUNT OF THE NEXT ENTRY, UINT64_MAX WHEN NONE IS LEFT
+    uint64_t next_at() const { return replaying() ? head_at : UINT64_MAX; }
+
+private:
+    enum Mode : uint8_t
+    {
+        MODE_IDLE,
+        MODE_RECORDING,
+        MODE_REPLAYING
+    };
+
+    std::vector<uint8_t> log; // THE ENTRIES, WITHOUT THE FILE HEADER
+    size_t count = 0;
+    uint64_t last_at = 0; // RECORDING: at OF THE LAST ENTRY
+    Mode mode = MODE_IDLE;
+
+    // REPLAY CURSOR, head_* IS THE DECODED ENTRY AT position
+    size_t position = 0;
+    size_t replayed = 0;
+    uint64_t head_at = UINT64_MAX;
+    Kind head_kind = DEVICE_READ;
+    uint8_t head_data = 0;
+    uint64_t diverge_count = UINT64_MAX;
+
+    std::string last_error;
+
+    void advance();
+    void diverge(uint64_t at);
+    static bool decode(const uint8_t *data, size_t size, size_t &position, uint64_t &key, uint8_t &value);
+};
@@ -0,0 +1,216 @@
+#include "scheduler.h"
+#include <algorithm>
+
+void Scheduler::StopSink::on_event(const CpuEvent &event)
+{
+    if (event.kind == EVENT_HALT || event.kind == EVENT_FAULT || event.kind == EVENT_UNKNOWN_OPCODE)
+    {
+        seen = true;
+        last = event;
+    }
+}
+
+Scheduler::Scheduler(unsigned threads, uint64_t slice) : slice(slice ? slice : DEFAULT_SLICE)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(&Scheduler::worker, this);
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        shutting_down = true;
+    }
+    work_available.notify_all();
+    for (auto &thread : workers)
+        thread.join();
+}
+
+Scheduler::Job *Scheduler::find(JobId id) const
+{
+    return id < jobs.size() ? jobs[id].get() : nullptr;
+}
+
+Scheduler::JobId Scheduler::submit(const uint8_t *code, size_t size, uint64_t budget)
+{
+    // BUILT OUTSIDE THE LOCK, WORKERS KEEP RUNNING MEANWHILE
+    std::unique_ptr<Job> job(new Job());
+    job->cpu.reset(new CPU());
+    job->cpu->set_event_sink(&job->stop);
+    job->cpu->load_program(code, size);
+    job->budget = budget;
+
+    std::lock_guard<std::mutex> guard(lock);
+    JobId id = static_cast<JobId>(jobs.size());
+    ready.push_back(job.get());
+    jobs.push_back(std::move(job));
+    work_available.notify_one();
+    return id;
+}
+
+// ONLY FOR A JOB NO WORKER IS RUNNING, WITH THE LOCK HELD
+void Scheduler::deliver_input(Job &job)
+{
+    if (!job.cpu)
+        return;
+    if (!job.inbox.empty())
+    {
+        job.cpu->keyboard->push_input(job.inbox);
+        job.cpu->recheck_interrupts();
+        job.inbox.clear();
+    }
+    if (job.close_pending)
+    {
+        job.cpu->keyboard->close_input();
+        job.close_pending = false;
+    }
+}
+
+void Scheduler::send_input(JobId id, const std::string &text)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Job *job = find(id);
+    if (!job || !job->cpu || text.empty())
+        return;
+    job->inbox += text;
+    if (job->state == JOB_WAITING_INPUT)
+    {
+        deliver_input(*job);
+        job->state = JOB_READY;
+        ready.push_back(job);
+        work_available.notify_one();
+    }
+}
+
+void Scheduler::close_input(JobId id)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Job *job = find(id);
+    if (!job || !job->cpu)
+        return;
+    job->close_pending = true;
+    if (job->state == JOB_WAITING_INPUT)
+    {
+        deliver_input(*job);
+        job->state = JOB_READY;
+        ready.push_back(job);
+        work_available.notify_one();
+    }
+}
+
+Scheduler::JobStatus Scheduler::status(JobId id) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    JobStatus result = {JOB_STOPPED, 0, false, {}};
+    if (Job *job = find(id))
+    {
+        result.state = job->state;
+        result.instructions = job->instructions;
+        // THE SINK IS ONLY WRITTEN DURING A SLICE; ONCE STOPPED NO WORKER TOUCHES IT AGAIN
+        if (job->state == JOB_STOPPED && job->stop.seen)
+        {
+            result.has_stop_event = true;
+            result.stop_event = job->stop.last;
+        }
+    }
+    return result;
+}
+
+std::string Scheduler::take_output(JobId id)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::string taken;
+    if (Job *job = find(id))
+        taken.swap(job->output);
+    return taken;
+}
+
+Scheduler::JobState Scheduler::wait(JobId id)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    Job *job = find(id);
+    if (!job)
+        return JOB_STOPPED;
+    job_parked.wait(guard, [job] { return !busy(job->state); });
+    return job->state;
+}
+
+void Scheduler::wait_idle()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    job_parked.wait(guard, [this] { return ready.empty() && running == 0; });
+}
+
+bool Scheduler::release(JobId id)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Job *job = find(id);
+    if (!job || busy(job->state))
+        return false;
+    job->cpu.reset();
+    job->inbox.clear();
+    return true;
+}
+
+size_t Scheduler::job_count() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return jobs.size();
+}
+
+void Scheduler::worker()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;)
+    {
+        work_available.wait(guard, [this] { return shutting_down || !ready.empty(); });
+        if (shutting_down)
+            return;
+
+        Job *job = ready.front();
+        ready.pop_front();
+        job->state = JOB_RUNNING;
+        running++;
+        deliver_input(*job);
+        const uint64_t quota = std::min(slice, job->budget);
+        guard.unlock();
+
+        // THE SLICE. ENDS EARLY ON HALT/FAULT OR WHEN THE PROGRAM STARTS WAITING FOR A KEY
+        CPU &cpu = *job->cpu;
+        const uint64_t start = cpu.instructions;
+        bool alive = true;
+        while (cpu.instructions - start < quota)
+        {
+            alive = cpu.step();
+            if (!alive || cpu.keyboard->starved())
+                break;
+        }
+        std::string output = cpu.console->take_output();
+
+        guard.lock();
+        running--;
+        const uint64_t ran = cpu.instructions - start;
+        job->budget -= std::min(ran, job->budget);
+        job->instructions = cpu.instructions;
+        job->output += output;
+
+        if (!alive)
+            job->state = JOB_STOPPED;
+        else if (job->budget == 0)
+            job->state = JOB_OUT_OF_BUDGET;
+        else if (cpu.keyboard->starved() && job->inbox.empty() && !job->close_pending)
+            job->state = JOB_WAITING_INPUT;
+        else
+        {
+            // BACK OF THE QUEUE: EVERY READY JOB GETS A SLICE BEFORE THIS ONE GETS ANOTHER
+            job->state = JOB_READY;
+            ready.push_back(job);
+        }
+
+        if (job->state != JOB_READY || (ready.empty() && running == 0))
+            job_parked.notify_all();
+    }
+}
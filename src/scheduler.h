@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cpu.h"
+#include "events.h"
+
+// ===============================================================
+// == TIME-SLICED SCHEDULER FOR MANY CPUS
+// ===============================================================
+// KEEPS ANY NUMBER OF PROGRAMS ALIVE AT ONCE (AN ONLINE JUDGE, A CLASSROOM) ON A SMALL POOL
+// OF HOST THREADS. A JOB IS ONE CPU; A WORKER TAKES THE NEXT READY JOB, RUNS IT FOR AT MOST
+// slice INSTRUCTIONS AND PUTS IT BACK. A JOB THAT READS AN EMPTY KEYBOARD IS PARKED, COSTING
+// NOTHING, UNTIL send_input() OR close_input(). THE CPU IS ITS OWN CONTINUATION: BETWEEN
+// TWO step() CALLS ITS WHOLE STATE IS IN THE OBJECT, SO SUSPENDING NEEDS NO STACK.
+//
+// TIME IS VIRTUAL (RETIRED INSTRUCTIONS, SEE devices.h): A PARKED JOB'S TIMER DOES NOT RUN.
+class Scheduler
+{
+public:
+    using JobId = uint32_t;
+    static const uint64_t DEFAULT_SLICE = 20000;
+
+    enum JobState : uint8_t
+    {
+        JOB_READY,         // QUEUED FOR A WORKER
+        JOB_RUNNING,       // A WORKER IS IN ITS SLICE
+        JOB_WAITING_INPUT, // READ AN EMPTY KEYBOARD, PARKED UNTIL send_input/close_input
+        JOB_STOPPED,       // HALT OR A FAULT, SEE JobStatus::stop
+        JOB_OUT_OF_BUDGET  // RAN ITS WHOLE INSTRUCTION BUDGET
+    };
+
+    struct JobStatus
+    {
+        JobState state;
+        uint64_t instructions; // RETIRED SO FAR
+        bool has_stop_event;
+        CpuEvent stop_event; // THE HALT/FAULT/UNKNOWN OPCODE EVENT THAT ENDED A STOPPED JOB
+    };
+
+    // threads == 0: ONE PER HARDWARE THREAD
+    explicit Scheduler(unsigned threads = 0, uint64_t slice = DEFAULT_SLICE);
+    ~Scheduler(); // ABANDONS UNFINISHED JOBS ONCE THE RUNNING SLICES END
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // LOADS code WITH CPU::load_program ON A NEW CPU AND QUEUES IT. budget = TOTAL INSTRUCTIONS
+    JobId submit(const uint8_t *code, size_t size, uint64_t budget = UINT64_MAX);
+
+    // KEYBOARD INPUT. A PARKED JOB BECOMES READY AGAIN
+    void send_input(JobId id, const std::string &text);
+    // NO MORE INPUT WILL COME: READS OF AN EMPTY KEYBOARD RETURN 0 INSTEAD OF PARKING THE JOB
+    void close_input(JobId id);
+
+    JobStatus status(JobId id) const;
+    // CONSOLE OUTPUT SINCE THE LAST CALL
+    std::string take_output(JobId id);
+
+    // BLOCKS UNTIL THE JOB IS NEITHER READY NOR RUNNING, RETURNS ITS STATE THEN
+    JobState wait(JobId id);
+    // BLOCKS UNTIL NO JOB IS READY OR RUNNING (ALL FINISHED OR PARKED)
+    void wait_idle();
+
+    // FREES THE CPU OF A JOB THAT IS NOT READY OR RUNNING. ITS STATUS STAYS AVAILABLE
+    bool release(JobId id);
+
+    size_t job_count() const;
+
+private:
+    // KEEPS ONLY THE EVENT THAT STOPPED THE CPU
+    class StopSink : public EventSink
+    {
+    public:
+        void on_event(const CpuEvent &event) override;
+        bool seen = false;
+        CpuEvent last = {};
+    };
+
+    struct Job
+    {
+        std::unique_ptr<CPU> cpu;
+        JobState state = JOB_READY;
+        uint64_t budget = UINT64_MAX; // INSTRUCTIONS LEFT
+        uint64_t instructions = 0;    // COPY OF cpu->instructions, READABLE WHILE RUNNING
+        std::string inbox;            // INPUT THAT ARRIVED DURING A SLICE, DELIVERED BEFORE THE NEXT
+        bool close_pending = false;
+        std::string output;
+        StopSink stop;
+    };
+
+    uint64_t slice;
+    std::vector<std::unique_ptr<Job>> jobs; // INDEXED BY JobId, NEVER SHRINKS
+    std::deque<Job *> ready;
+    unsigned running = 0;
+    bool shutting_down = false;
+
+    // ONE LOCK FOR EVERY FIELD ABOVE. A RUNNING JOB'S CPU BELONGS TO ITS WORKER ALONE
+    mutable std::mutex lock;
+    std::condition_variable work_available;
+    std::condition_variable job_parked; // A JOB LEFT JOB_RUNNING
+    std::vector<std::thread> workers;
+
+    void worker();
+    Job *find(JobId id) const;
+    void deliver_input(Job &job);
+    static bool busy(JobState state) { return state == JOB_READY || state == JOB_RUNNING; }
+};
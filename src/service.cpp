@@ -0,0 +1,436 @@
+#include "service.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// KEEPS ONLY THE EVENT THAT STOPPED THE CPU
+class JobStopSink : public EventSink
+{
+public:
+    void on_event(const CpuEvent &event) override
+    {
+        if (event.kind == EVENT_HALT || event.kind == EVENT_FAULT || event.kind == EVENT_UNKNOWN_OPCODE)
+            last = event;
+    }
+    CpuEvent last = {};
+};
+
+GradingService::GradingService(unsigned workers_count, const std::string &include_dir, size_t cache_capacity)
+    : include_dir(include_dir), assemblies(cache_capacity)
+{
+    if (workers_count == 0)
+        workers_count = std::max(1u, std::thread::hardware_concurrency());
+    if (workers_count > MAX_WORKERS)
+        workers_count = MAX_WORKERS;
+    for (unsigned i = 0; i < workers_count; i++)
+        workers.emplace_back(&GradingService::worker, this);
+}
+
+GradingService::~GradingService()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        shutting_down = true;
+    }
+    work_available.notify_all();
+    for (auto &thread : workers)
+        thread.join();
+}
+
+const char *GradingService::status_name(Status status)
+{
+    switch (status)
+    {
+    case STATUS_HALT:
+        return "HALT";
+    case STATUS_FAULT:
+        return "FAULT";
+    case STATUS_UNKNOWN_OPCODE:
+        return "UNKNOWN_OPCODE";
+    case STATUS_BUDGET:
+        return "BUDGET";
+    default:
+        return "ASSEMBLY_ERROR";
+    }
+}
+
+std::string GradingService::get_last_error()
+{
+    return last_error;
+}
+
+// ===============================================================
+// == WORKERS
+// ===============================================================
+std::vector<GradingService::Result> GradingService::run_batch(const std::vector<Job> &jobs)
+{
+    std::vector<Result> results(jobs.size());
+    if (jobs.empty())
+        return results;
+
+    Batch batch;
+    batch.jobs = &jobs;
+    batch.results = &results;
+    std::unique_lock<std::mutex> guard(lock);
+    queue.push_back(&batch);
+    work_available.notify_all();
+    batch_done.wait(guard, [&] { return batch.done == jobs.size(); });
+    return results;
+}
+
+void GradingService::worker()
+{
+    // THIS WORKER'S MACHINE, RESET FROM clean FOR EVERY JOB INSTEAD OF BUILT AGAIN
+    Parser parser;
+    CPU cpu;
+    cpu.console->limit_output(MAX_OUTPUT);
+    CpuSnapshot clean;
+    cpu.save_snapshot(clean);
+
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;)
+    {
+        work_available.wait(guard, [this] { return shutting_down || !queue.empty(); });
+        if (shutting_down)
+            return;
+
+        Batch *batch = queue.front();
+        const size_t index = batch->next++;
+        if (batch->next == batch->jobs->size())
+            queue.pop_front();
+        guard.unlock();
+
+        run_job((*batch->jobs)[index], (*batch->results)[index], parser, cpu, clean);
+
+        guard.lock();
+        if (++batch->done == batch->jobs->size())
+            batch_done.notify_all();
+    }
+}
+
+void GradingService::run_job(const Job &job, Result &result, Parser &parser, CPU &cpu, const CpuSnapshot &clean)
+{
+    std::shared_ptr<const AssemblyResult> program = assemblies.assemble(parser, job.source, include_dir);
+    if (!program->error.empty() || program->machine_code.empty())
+    {
+        result.status = STATUS_ASSEMBLY_ERROR;
+        result.error = program->error.empty() ? "ERROR: Nothing to run" : program->error;
+        return;
+    }
+
+    cpu.restore_snapshot(clean);
+    cpu.load_program(program->machine_code.data(), program->machine_code.size());
+    if (!job.input.empty())
+        cpu.keyboard->push_input(job.input);
+    cpu.keyboard->close_input(); // NOBODY WILL TYPE MORE: READS PAST THE END RETURN 0
+
+    JobStopSink stop;
+    cpu.set_event_sink(&stop);
+    // run_batch() CALLERS ARE NOT CHECKED LIKE SOCKET REQUESTS, SO THE CAP IS APPLIED HERE TOO
+    const uint64_t budget = job.budget == 0 ? DEFAULT_BUDGET : job.budget > MAX_BUDGET ? MAX_BUDGET : job.budget;
+    bool alive = true;
+    while (alive && cpu.instructions < budget)
+        alive = cpu.step();
+    cpu.set_event_sink(nullptr);
+
+    if (alive)
+        result.status = STATUS_BUDGET;
+    else if (stop.last.kind == EVENT_HALT)
+        result.status = STATUS_HALT;
+    else
+    {
+        result.status = stop.last.kind == EVENT_FAULT ? STATUS_FAULT : STATUS_UNKNOWN_OPCODE;
+        char text[128];
+        format_event(stop.last, text, sizeof(text));
+        result.error = text;
+    }
+    result.instructions = cpu.instructions;
+    result.regs = cpu.regs;
+    result.flags = cpu.flags.word();
+    const bool truncated = cpu.console->output_dropped();
+    result.output = cpu.console->take_output();
+    if (truncated)
+        result.output += TRUNCATED;
+}
+
+// ===============================================================
+// == SOCKET SERVER
+// ===============================================================
+#ifndef _WIN32
+
+// BUFFERED READS OF HEADER LINES AND RAW PAYLOADS FROM ONE CONNECTION
+class SocketReader
+{
+private:
+    static const size_t MAX_LINE = 256;
+    int fd;
+    std::string pending;
+    size_t position = 0;
+
+    bool fill()
+    {
+        if (position == pending.size())
+        {
+            pending.clear();
+            position = 0;
+        }
+        char chunk[65536];
+        ssize_t got;
+        do
+            got = ::recv(fd, chunk, sizeof(chunk), 0);
+        while (got < 0 && errno == EINTR);
+        if (got <= 0)
+            return false;
+        pending.append(chunk, got);
+        return true;
+    }
+
+public:
+    explicit SocketReader(int fd) : fd(fd) {}
+
+    // FALSE AT END OF STREAM, OR ON A LINE TOO LONG TO BE A HEADER (too_long SET)
+    bool line(std::string &out, bool &too_long)
+    {
+        too_long = false;
+        for (;;)
+        {
+            size_t end = pending.find('\n', position);
+            if (end != std::string::npos)
+            {
+                out.assign(pending, position, end - position);
+                position = end + 1;
+                if (!out.empty() && out.back() == '\r')
+                    out.pop_back();
+                return true;
+            }
+            if (pending.size() - position > MAX_LINE)
+            {
+                too_long = true;
+                return false;
+            }
+            if (!fill())
+                return false;
+        }
+    }
+
+    bool bytes(size_t count, std::string &out)
+    {
+        out.clear();
+        out.reserve(count);
+        while (out.size() < count)
+        {
+            if (position == pending.size() && !fill())
+                return false;
+            size_t take = std::min(count - out.size(), pending.size() - position);
+            out.append(pending, position, take);
+            position += take;
+        }
+        return true;
+    }
+};
+
+static bool write_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// payload, OR AS MUCH OF IT AS room LEAVES FOLLOWED BY TRUNCATED. room SHRINKS BY THE BYTES KEPT
+static std::string fit(const std::string &payload, size_t &room)
+{
+    if (payload.size() <= room)
+    {
+        room -= payload.size();
+        return payload;
+    }
+    std::string cut = payload.substr(0, room) + GradingService::TRUNCATED;
+    room = 0;
+    return cut;
+}
+
+static void append_result(std::string &out, const GradingService::Result &result, size_t &room)
+{
+    const std::string output = fit(result.output, room);
+    const std::string error = fit(result.error, room);
+    const Registers &r = result.regs;
+    char header[256];
+    snprintf(header, sizeof(header),
+             "RESULT %s %llu %04X %04X %04X %04X %04X %04X %04X %04X %04X %04X %zu %zu\n",
+             GradingService::status_name(result.status), (unsigned long long)result.instructions,
+             r.AX, r.BX, r.CX, r.DX, r.SP, r.BP, r.SI, r.DI, r.IP, result.flags,
+             output.size(), error.size());
+    out += header;
+    out += output;
+    out += error;
+}
+
+void GradingService::connection(int fd)
+{
+    SocketReader reader(fd);
+    std::vector<Job> jobs;
+    size_t batch_bytes = 0;
+    std::string line, error;
+    bool too_long;
+    while (reader.line(line, too_long))
+    {
+        if (line == "QUIT")
+            break;
+
+        if (line == "RUN")
+        {
+            std::vector<Result> results = run_batch(jobs);
+            std::string reply;
+            size_t room = MAX_REPLY_BYTES;
+            for (const Result &result : results)
+                append_result(reply, result, room);
+            reply += "DONE " + std::to_string(results.size()) + "\n";
+            jobs.clear();
+            batch_bytes = 0;
+            if (!write_all(fd, reply))
+                break;
+            continue;
+        }
+
+        std::istringstream header(line);
+        std::string word, extra;
+        unsigned long long budget = 0, source_length = 0, input_length = 0;
+        if (!(header >> word >> budget >> source_length >> input_length) || word != "JOB" || (header >> extra))
+        {
+            error = "Malformed request: " + line;
+            break;
+        }
+        if (budget > MAX_BUDGET)
+        {
+            error = "Budget above " + std::to_string(MAX_BUDGET) + " instructions";
+            break;
+        }
+        if (source_length > MAX_PAYLOAD || input_length > MAX_PAYLOAD)
+        {
+            error = "Source or input longer than " + std::to_string(MAX_PAYLOAD) + " bytes";
+            break;
+        }
+        if (jobs.size() >= MAX_BATCH)
+        {
+            error = "More than " + std::to_string(MAX_BATCH) + " jobs in one batch";
+            break;
+        }
+        // BOTH LENGTHS ARE AT MOST MAX_PAYLOAD, SO THE SUM CANNOT WRAP
+        batch_bytes += source_length + input_length;
+        if (batch_bytes > MAX_BATCH_BYTES)
+        {
+            error = "More than " + std::to_string(MAX_BATCH_BYTES) + " bytes in one batch";
+            break;
+        }
+        Job job;
+        job.budget = budget;
+        if (!reader.bytes(source_length, job.source) || !reader.bytes(input_length, job.input))
+            break; // THE CLIENT WENT AWAY
+        jobs.push_back(std::move(job));
+    }
+    if (too_long)
+        error = "Request line too long";
+    if (!error.empty())
+        write_all(fd, "ERROR " + error + "\n");
+
+    std::lock_guard<std::mutex> guard(connections_lock);
+    connections.erase(std::find(connections.begin(), connections.end(), fd));
+    ::close(fd);
+    connection_closed.notify_all();
+}
+
+bool GradingService::serve(const std::string &socket_path)
+{
+    last_error = "";
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        last_error = "ERROR: Invalid socket path " + socket_path;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // A SOCKET FILE LEFT BY AN EARLIER RUN IS REPLACED, ANY OTHER FILE IS NOT
+    struct stat st;
+    if (::lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        ::unlink(socket_path.c_str());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        last_error = "ERROR: Could not create a socket";
+        return false;
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0)
+    {
+        last_error = "ERROR: Could not listen on " + socket_path + ": " + std::strerror(errno);
+        ::close(listener);
+        return false;
+    }
+
+    // POLLING WITH A TIMEOUT SO stop() NEEDS NOTHING BUT THE FLAG
+    while (!stopping)
+    {
+        pollfd ready = {listener, POLLIN, 0};
+        if (::poll(&ready, 1, 200) <= 0)
+            continue;
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0)
+            continue; // EINTR, A CLIENT THAT ALREADY LEFT, OR OUT OF DESCRIPTORS FOR NOW
+        std::lock_guard<std::mutex> guard(connections_lock);
+        if (connections.size() >= MAX_CONNECTIONS)
+        {
+            write_all(client, "ERROR More than " + std::to_string(MAX_CONNECTIONS) + " connections\n");
+            ::close(client);
+            continue;
+        }
+        connections.push_back(client);
+        std::thread(&GradingService::connection, this, client).detach();
+    }
+
+    // NO NEW REQUESTS; A BATCH IN FLIGHT STILL GETS ITS RESULTS
+    ::close(listener);
+    {
+        std::unique_lock<std::mutex> guard(connections_lock);
+        for (int fd : connections)
+            ::shutdown(fd, SHUT_RD);
+        connection_closed.wait(guard, [this] { return connections.empty(); });
+    }
+    ::unlink(socket_path.c_str());
+    stopping = false;
+    return true;
+}
+
+#else
+
+bool GradingService::serve(const std::string &)
+{
+    last_error = "ERROR: The grading service needs Unix domain sockets";
+    return false;
+}
+
+#endif
+
+void GradingService::stop()
+{
+    stopping = true;
+}
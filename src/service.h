@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "asmcache.h"
+#include "cpu.h"
+#include "events.h"
+
+// ===============================================================
+// == GRADING SERVICE
+// ===============================================================
+// ONE LONG-LIVED PROCESS GRADES SUBMISSIONS FOR ANY NUMBER OF CLIENTS, SO A SUBMISSION PAYS
+// NEITHER A PROCESS START NOR A CPU CONSTRUCTION. EACH WORKER THREAD OWNS A Parser AND A CPU; A
+// JOB RESTORES THE CPU FROM A CLEAN SNAPSHOT, LOADS THE PROGRAM, GIVES IT ITS WHOLE INPUT ON THE
+// KEYBOARD (READS PAST THE END RETURN 0) AND RUNS IT UNTIL HALT, A FAULT OR THE BUDGET. ALL
+// WORKERS SHARE ONE AssemblyCache, SO A SOURCE SEEN BEFORE (A REFERENCE SOLUTION, A PROGRAM
+// BUILT ON THE SAME INCLUDE LIBRARY) IS NOT ASSEMBLED AGAIN.
+//
+// WIRE PROTOCOL, UNIX STREAM SOCKET. HEADER LINES ARE TEXT, LENGTHS ARE BYTES, PAYLOADS ARE RAW:
+//   REQUEST   "JOB <budget> <source_length> <input_length>\n" <source> <input>   ANY NUMBER OF
+//             "RUN\n"              RUNS THE JOBS SENT SINCE THE LAST RUN AS ONE BATCH
+//             "QUIT\n" OR EOF      ENDS THE CONNECTION
+//   RESPONSE  FOR EACH JOB OF THE BATCH, IN ORDER:
+//             "RESULT <status> <instructions> <AX> <BX> <CX> <DX> <SP> <BP> <SI> <DI> <IP> <FLAGS>
+//                     <output_length> <error_length>\n" <output> <error>          (ONE LINE)
+//             THEN "DONE <job_count>\n"
+//   status IS HALT, FAULT, UNKNOWN_OPCODE, BUDGET OR ASSEMBLY_ERROR, REGISTERS ARE 4 HEX DIGITS,
+//   error IS THE ASSEMBLER'S MESSAGE OR THE EVENT THAT STOPPED THE CPU. budget 0 = DEFAULT_BUDGET,
+//   AT MOST MAX_BUDGET.
+//   A JOB KEEPS THE FIRST MAX_OUTPUT BYTES OF ITS CONSOLE OUTPUT; WHEN IT WROTE MORE, output
+//   ENDS IN TRUNCATED AFTER THEM. THE output AND error PAYLOADS OF ONE REPLY SEND AT MOST
+//   MAX_REPLY_BYTES OF THEIR BYTES TOGETHER, IN ORDER: A PAYLOAD CUT SHORT OR LEFT OUT BY THAT
+//   IS FOLLOWED BY TRUNCATED TOO. A MARKER DOES NOT COUNT AGAINST THE LIMIT THAT ADDED IT.
+//   A MALFORMED REQUEST, ONE PAST A LIMIT BELOW, OR A CONNECTION BEYOND MAX_CONNECTIONS IS
+//   ANSWERED WITH "ERROR <message>\n" AND THE CONNECTION IS CLOSED.
+class GradingService
+{
+public:
+    static const uint64_t DEFAULT_BUDGET = 10000000;
+    static const uint64_t MAX_BUDGET = 100000000; // INSTRUCTIONS, ABOUT A SECOND OF ONE WORKER
+    static const size_t MAX_OUTPUT = 1 << 20; // CONSOLE BYTES KEPT PER JOB
+    static const size_t MAX_REPLY_BYTES = 16 << 20; // OUTPUTS AND ERRORS OF ONE REPLY TOGETHER
+    static constexpr const char *TRUNCATED = "\n[TRUNCATED]\n";
+    static const size_t MAX_PAYLOAD = 16 << 20; // PER SOURCE AND PER INPUT
+    static const size_t MAX_BATCH = 4096;
+    static const size_t MAX_BATCH_BYTES = 64 << 20; // SOURCES AND INPUTS OF ONE BATCH TOGETHER
+    static const size_t MAX_CONNECTIONS = 64;
+    static const unsigned MAX_WORKERS = 256;
+
+    struct Job
+    {
+        std::string source;
+        std::string input;
+        uint64_t budget = 0;
+    };
+
+    enum Status : uint8_t
+    {
+        STATUS_HALT,
+        STATUS_FAULT,
+        STATUS_UNKNOWN_OPCODE,
+        STATUS_BUDGET,        // STILL RUNNING WHEN THE BUDGET RAN OUT
+        STATUS_ASSEMBLY_ERROR // NOTHING RAN
+    };
+
+    struct Result
+    {
+        Status status = STATUS_ASSEMBLY_ERROR;
+        uint64_t instructions = 0;
+        Registers regs = {};
+        uint16_t flags = 0;
+        std::string output; // CONSOLE
+        std::string error;
+    };
+
+    // workers == 0: ONE PER HARDWARE THREAD, NEVER MORE THAN MAX_WORKERS. include_dir IS WHERE INCLUDE LOOKS, cache_capacity
+    // THE NUMBER OF ASSEMBLIES KEPT WARM
+    explicit GradingService(unsigned workers = 0, const std::string &include_dir = "", size_t cache_capacity = 1024);
+    ~GradingService();
+    GradingService(const GradingService &) = delete;
+    GradingService &operator=(const GradingService &) = delete;
+
+    // RUNS jobs ON THE WORKERS, results[i] IS jobs[i]'S. THREAD SAFE, BATCHES RUN IN ARRIVAL ORDER
+    std::vector<Result> run_batch(const std::vector<Job> &jobs);
+
+    // ACCEPTS CONNECTIONS ON socket_path (REPLACING A STALE SOCKET FILE) UNTIL stop(), ONE THREAD
+    // PER CONNECTION AND AT MOST MAX_CONNECTIONS OPEN. FALSE WHEN THE SOCKET CANNOT BE SET UP, SEE get_last_error()
+    bool serve(const std::string &socket_path);
+    // FROM ANY THREAD: serve() RETURNS ONCE THE OPEN CONNECTIONS ARE CLOSED
+    void stop();
+
+    static const char *status_name(Status status);
+
+    AssemblyCache &cache() { return assemblies; }
+    std::string get_last_error();
+
+private:
+    struct Batch
+    {
+        const std::vector<Job> *jobs;
+        std::vector<Result> *results;
+        size_t next = 0; // FIRST JOB NOT TAKEN BY A WORKER
+        size_t done = 0;
+    };
+
+    std::string include_dir;
+    AssemblyCache assemblies;
+    std::string last_error;
+
+    // ONE LOCK FOR THE QUEUE AND EVERY Batch IN IT
+    std::mutex lock;
+    std::condition_variable work_available;
+    std::condition_variable batch_done;
+    std::deque<Batch *> queue; // BATCHES WITH JOBS NOT TAKEN YET
+    bool shutting_down = false;
+    std::vector<std::thread> workers;
+
+    // serve() STATE. EACH CONNECTION THREAD REMOVES ITS OWN DESCRIPTOR WHEN IT ENDS
+    std::atomic<bool> stopping{false};
+    std::mutex connections_lock;
+    std::condition_variable connection_closed;
+    std::vector<int> connections;
+
+    void worker();
+    void run_job(const Job &job, Result &result, Parser &parser, CPU &cpu, const CpuSnapshot &clean);
+    void connection(int fd);
+};
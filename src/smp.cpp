@@ -0,0 +1,100 @@
+#include "smp.h"
+#include <algorithm>
+#include <thread>
+
+SmpMachine::SmpMachine(int cores)
+{
+    count = cores < 1 ? 1 : cores > MAX_CORES ? MAX_CORES : cores;
+    for (int i = 0; i < count; i++)
+    {
+        machines.emplace_back(new CPU());
+        machines[i]->memory.share(shared);
+        machines[i]->bus_lock = &bus;
+        active[i] = true;
+    }
+}
+
+void SmpMachine::load_program(const uint8_t *code, size_t size)
+{
+    for (int i = 0; i < count; i++)
+    {
+        CPU &c = *machines[i];
+        c.load_program(code, size); // SAME BYTES TO THE SAME SHARED ADDRESS, AND THE REGISTERS
+        c.regs.AX = i;
+        c.regs.SP = 0xFFFE - i * CORE_STACK;
+        active[i] = true;
+    }
+}
+
+int SmpMachine::still_running() const
+{
+    int running = 0;
+    for (int i = 0; i < count; i++)
+        running += active[i];
+    return running;
+}
+
+int SmpMachine::run_interleaved(uint64_t max_instructions, uint64_t seed)
+{
+    // THE CORES THAT MAY STILL STEP, IN CORE ORDER
+    int order[MAX_CORES];
+    uint64_t start[MAX_CORES];
+    int ready = 0;
+    for (int i = 0; i < count; i++)
+    {
+        start[i] = machines[i]->instructions;
+        if (active[i] && max_instructions > 0)
+            order[ready++] = i;
+    }
+
+    uint64_t state = seed;
+    int turn = 0;
+    while (ready > 0)
+    {
+        int pick = turn % ready;
+        if (seed != 0)
+        {
+            // XORSHIFT64, NEVER 0 FOR A NON-ZERO seed
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            pick = static_cast<int>(state % ready);
+        }
+
+        int i = order[pick];
+        CPU &c = *machines[i];
+        active[i] = c.step();
+        if (!active[i] || c.instructions - start[i] >= max_instructions)
+        {
+            // THE OTHERS KEEP THEIR ORDER, THE NEXT IN TURN MOVES INTO pick
+            std::copy(order + pick + 1, order + ready, order + pick);
+            ready--;
+            turn = pick;
+        }
+        else
+            turn = pick + 1;
+    }
+    return still_running();
+}
+
+int SmpMachine::run_parallel(uint64_t max_instructions)
+{
+    // EACH THREAD ONLY TOUCHES ITS OWN CORE AND active[i]; THEY SHARE NOTHING BUT THE
+    // MEMORY PAGES AND THE BUS LOCK
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; i++)
+    {
+        if (!active[i])
+            continue;
+        threads.emplace_back([this, i, max_instructions]
+                             {
+                                 CPU &c = *machines[i];
+                                 bool alive = true;
+                                 for (uint64_t n = 0; alive && n < max_instructions; n++)
+                                     alive = c.step();
+                                 active[i] = alive; });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    return still_running();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "cpu.h"
+
+// ===============================================================
+// == SMP: SEVERAL CORES SHARING ONE MEMORY
+// ===============================================================
+// FOR TEACHING SYNCHRONIZATION. EVERY CORE IS A COMPLETE CPU (REGISTERS, FLAGS, IP AND ITS OWN
+// DEVICES: CONSOLE, KEYBOARD, TIMER, PIC); ITS memory IS A WINDOW ONTO ONE SHARED 1 MiB (SEE
+// Memory::share). load_program() STARTS EVERY CORE ON THE SAME CODE WITH ITS CORE NUMBER IN AX
+// AND ITS OWN CORE_STACK BYTES OF STACK, SO A PROGRAM BRANCHES ON AX TO SPLIT THE WORK.
+//
+// TWO WAYS TO RUN:
+//   run_interleaved()  ONE HOST THREAD, ONE INSTRUCTION OF ONE CORE AT A TIME, IN TURN OR IN A
+//                      SEEDED PSEUDO-RANDOM ORDER. THE SAME seed GIVES THE SAME INTERLEAVING AND
+//                      THE SAME RESULT EVERY TIME, SO A RACE THAT SHOWED UP ONCE CAN BE REPLAYED.
+//   run_parallel()     ONE HOST THREAD PER CORE, AS FAST AS THE HOST ALLOWS. NOT REPRODUCIBLE,
+//                      LOCK-DISCIPLINED PROGRAMS ONLY (BELOW).
+//
+// MEMORY ORDERING
+//   INTERLEAVED: SEQUENTIALLY CONSISTENT. INSTRUCTIONS NEVER OVERLAP (A REP STRING INSTRUCTION
+//   IS ONE INSTRUCTION) AND EVERY CORE SEES EVERY WRITE AS SOON AS IT IS MADE.
+//   PARALLEL: ONLY FOR LOCK-DISCIPLINED PROGRAMS. A SHARED WORD THAT ONE CORE WRITES WHILE
+//   ANOTHER MAY ACCESS IT MUST BE TOUCHED ONLY BY LOCKED INSTRUCTIONS (LOCK ADD/SUB/AND/OR/XOR
+//   [reg16], reg16 AND XCHG reg16, [reg16], WHICH IS ALWAYS LOCKED), OR ONLY INSIDE A SPINLOCK
+//   TAKEN AND RELEASED WITH XCHG (NOT MOV). FOR SUCH A PROGRAM:
+//     1. A CORE SEES ITS OWN READS AND WRITES IN PROGRAM ORDER.
+//     2. LOCKED INSTRUCTIONS ARE ATOMIC WITH RESPECT TO EACH OTHER AND HAPPEN IN ONE ORDER ALL
+//        CORES AGREE ON.
+//     3. A LOCKED INSTRUCTION IS A FULL BARRIER: WHATEVER A CORE WROTE BEFORE ONE IS VISIBLE TO
+//        EVERY CORE AFTER ITS NEXT LOCKED INSTRUCTION THAT COMES LATER IN THAT ORDER.
+//   SUCH A PROGRAM GIVES THE SAME RESULT IN BOTH MODES. ANYTHING ELSE (A FLAG POLLED WITH MOV,
+//   ADD [BX], AX ON A SHARED COUNTER) HAS PLAIN ACCESSES OF TWO CORES RACING. THEY ARE PLAIN HOST
+//   LOADS AND STORES, SO THAT IS A DATA RACE BETWEEN HOST THREADS: UNDEFINED BEHAVIOUR OF THE
+//   SIMULATOR ITSELF, NOT ONLY A WRONG ANSWER. RUN RACE DEMONSTRATIONS WITH run_interleaved().
+class SmpMachine
+{
+public:
+    static const int MAX_CORES = 16;
+    static const uint16_t CORE_STACK = 0x0400; // CORE n STARTS AT SP = 0xFFFE - n * CORE_STACK
+
+    explicit SmpMachine(int cores = 2); // CLAMPED TO 1..MAX_CORES
+    SmpMachine(const SmpMachine &) = delete;
+    SmpMachine &operator=(const SmpMachine &) = delete;
+
+    int cores() const { return count; }
+
+    // SET UP (REGISTERS, KEYBOARD INPUT, EVENT SINK) AND INSPECT EACH CORE HERE, NOT WHILE A
+    // run_*() IS ACTIVE. WRITING ANY CORE'S memory WRITES THE SHARED MEMORY
+    CPU &core(int i) { return *machines[i]; }
+    Memory &memory() { return machines[0]->memory; }
+
+    // COPIES code TO PROGRAM_SEGMENT:0000 OF THE SHARED MEMORY AND STARTS EVERY CORE THERE,
+    // AX = CORE NUMBER, SP AS ABOVE
+    void load_program(const uint8_t *code, size_t size);
+
+    // RUN UNTIL EVERY CORE STOPPED (HALT, FAULT) OR RETIRED max_instructions MORE.
+    // RETURN THE NUMBER OF CORES STILL RUNNING
+    // seed == 0: THE CORES TAKE TURNS, OTHERWISE THE NEXT CORE IS DRAWN FROM seed
+    int run_interleaved(uint64_t max_instructions = UINT64_MAX, uint64_t seed = 0);
+    int run_parallel(uint64_t max_instructions = UINT64_MAX);
+
+    bool running(int i) const { return active[i]; }
+
+private:
+    Memory shared; // ONLY REACHED THROUGH THE CORES' WINDOWS, DECLARED FIRST SO IT OUTLIVES THEM
+    std::mutex bus; // THE LOCK OF LOCKED INSTRUCTIONS, CPU::bus_lock OF EVERY CORE
+    std::vector<std::unique_ptr<CPU>> machines;
+    int count;
+    bool active[MAX_CORES] = {};
+
+    int still_running() const;
+};
@@ -0,0 +1,69 @@
+#include "sourcemap.h"
+#include <algorithm>
+
+void SourceMap::clear()
+{
+    table.clear();
+    end_address = 0;
+}
+
+void SourceMap::add(uint32_t address, uint32_t line)
+{
+    if (!table.empty())
+    {
+        // A LINE SPLIT OVER SEVERAL ADDS (MACRO EXPANSION, INCLUDE) IS ONE INTERVAL
+        if (table.back().line == line)
+            return;
+        // THE PREVIOUS LINE EMITTED NOTHING
+        if (table.back().address == address)
+        {
+            table.back().line = line;
+            return;
+        }
+    }
+    table.push_back({address, line});
+}
+
+void SourceMap::finish(uint32_t end)
+{
+    end_address = end;
+    if (!table.empty() && table.back().address >= end)
+        table.pop_back();
+}
+
+int SourceMap::line_for_address(uint32_t address) const
+{
+    if (address >= end_address)
+        return -1;
+    auto it = std::upper_bound(table.begin(), table.end(), address,
+                               [](uint32_t a, const Entry &e)
+                               { return a < e.address; });
+    if (it == table.begin())
+        return -1;
+    return (int)std::prev(it)->line;
+}
+
+int SourceMap::address_for_line(uint32_t line) const
+{
+    auto it = std::lower_bound(table.begin(), table.end(), line,
+                               [](const Entry &e, uint32_t l)
+                               { return e.line < l; });
+    if (it == table.end())
+        return -1;
+    return (int)it->address;
+}
+
+const std::vector<SourceMap::Entry> &SourceMap::entries() const
+{
+    return table;
+}
+
+uint32_t SourceMap::end() const
+{
+    return end_address;
+}
+
+bool SourceMap::empty() const
+{
+    return table.empty();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// ADDRESS -> SOURCE LINE INTERVAL TABLE PRODUCED BY THE ASSEMBLER.
+// ENTRY i COVERS [entries[i].address, entries[i + 1].address) (THE LAST ONE UP TO end_address).
+// CODE IS EMITTED IN SOURCE ORDER, SO BOTH COLUMNS ARE SORTED AND EITHER
+// DIRECTION IS A BINARY SEARCH.
+class SourceMap
+{
+public:
+    struct Entry
+    {
+        uint32_t address;
+        uint32_t line;
+    };
+
+private:
+    std::vector<Entry> table;
+    uint32_t end_address = 0;
+
+public:
+    void clear();
+
+    // CALLED WITH NON-DECREASING address AND line
+    void add(uint32_t address, uint32_t line);
+    void finish(uint32_t end);
+
+    // SOURCE LINE OWNING address, -1 IF NO CODE WAS EMITTED THERE
+    int line_for_address(uint32_t address) const;
+
+    // FIRST ADDRESS OF THE FIRST LINE >= line THAT EMITTED CODE, -1 IF NONE
+    int address_for_line(uint32_t line) const;
+
+    const std::vector<Entry> &entries() const;
+    uint32_t end() const;
+    bool empty() const;
+};
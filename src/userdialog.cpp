@@ -35,7 +35,11 @@ UserGuideDialog::UserGuideDialog(QWidget *parent) : QDialog(parent) {
            "<ul>"
            "<li>Line numbers are displayed on the left.</li>"
            "<li>Errors are highlighted in <span style='color:red'>red</span>.</li>"
+           "<li>The line being executed is highlighted in <span style='color:green'>green</span> while stepping.</li>"
+           "<li>Click a line number to toggle a breakpoint; <b>Run</b> stops before executing that line.</li>"
            "<li>Comments start with <code>;</code>.</li>"
+           "<li><code>INCLUDE \"file.asm\"</code> pulls in another source file (relative to the loaded file).</li>"
+           "<li><code>%macro NAME n</code> ... <code>%endmacro</code> defines a macro; use <code>%1</code>..<code>%n</code> for arguments and <code>%%label</code> for labels local to one expansion.</li>"
            "<li>The editor supports both writing new code and loading files from disk.</li>"
            "</ul>"
            );
@@ -64,7 +68,9 @@ UserGuideDialog::UserGuideDialog(QWidget *parent) : QDialog(parent) {
     addTab("Instruction Set",
            "<h2>Instruction Set</h2>"
            "<h3>Program Control</h3>"
-           "<p>HALT, NOP, JMP, CALL, RET, JZ, JNZ, JC, JNC, JS, JNS, JO, JNO</p>"
+           "<p>HALT, NOP, JMP, CALL, RET, JZ, JNZ, JC, JNC, JS, JNS, JO, JNO<br>"
+           "JA, JBE (unsigned), JG, JGE, JL, JLE (signed), JE/JNE/JB/JAE aliases<br>"
+           "LOOP, LOOPZ/LOOPE, LOOPNZ/LOOPNE, JCXZ</p>"
            "<h3>Data Transfer</h3>"
            "<p>MOV reg16, imm16<br>"
            "MOV reg16, reg16<br>"
@@ -82,12 +88,34 @@ UserGuideDialog::UserGuideDialog(QWidget *parent) : QDialog(parent) {
            "MOV [reg+reg], reg16</p>"
            "<p><i>Coming Soon: [REG+IMM], [REG+REG+IMM], [REG8] addressing modes.</i></p>"
            "<h3>Stack</h3>"
-           "<p>PUSH reg16, POP reg16</p>"
+           "<p>PUSH reg16, POP reg16, PUSH sreg, POP sreg</p>"
+           "<h3>String</h3>"
+           "<p>MOVSB/W, STOSB/W, LODSB/W, CMPSB/W, SCASB/W (source DS:[SI], destination ES:[DI])<br>"
+           "REP MOVS/STOS, REPE/REPNE CMPS/SCAS (count in CX)</p>"
            "<h3>Arithmetic / Logic</h3>"
            "<p>ADD, SUB, ADC, SBB, CMP, INC, DEC, NEG, NOT, AND, OR, XOR</p>"
+           "<p>MUL, IMUL, DIV, IDIV reg (8-bit: AH:AL, 16-bit: DX:AX; divide by zero stops the CPU)</p>"
+           "<p>ADD, SUB, AND, OR, XOR [reg16], reg16 (memory destination)<br>"
+           "LOCK ADD/SUB/AND/OR/XOR [reg16], reg16 and XCHG reg16, [reg16] are atomic across the cores "
+           "of a multi-core machine (XCHG with memory is always locked)</p>"
            "<h3>Shift / Rotate</h3>"
            "<p>SHL, SHR, SAR, ROL, ROR, RCL, RCR (immediate or CL, 8-bit and 16-bit)</p>"
            "<p><i>Coming Soon: Memory operand arithmetic (e.g., ADD AX, [1234h]).</i></p>"
+           "<h3>I/O</h3>"
+           "<p>IN reg, imm8 / IN reg, DX<br>"
+           "OUT imm8, reg / OUT DX, reg</p>"
+           "<p>Console: port 10h (data), 11h (status), memory FF000h<br>"
+           "Keyboard: port 20h (data), 21h (status), memory FF100h<br>"
+           "Timer: port 40h-45h (reload lo/hi, control, status, count lo/hi), memory FF200h<br>"
+           "Interrupt controller: port 08h (pending), 09h (mask), memory FF300h</p>"
+           "<h3>Interrupts</h3>"
+           "<p>INT imm8, IRET, CLI, STI</p>"
+           "<h3>Flags</h3>"
+           "<p>PUSHF, POPF, LAHF, SAHF, CLC, STC, CMC, CLD, STD<br>"
+           "FLAGS word: CF(0) PF(2) AF(4) ZF(6) SF(7) TF(8) IF(9) DF(10) OF(11)</p>"
+           "<p>The vector table sits at 0000:0000, four bytes per vector (offset, segment); "
+           "programs are loaded at 0040:0000. An empty vector stops the CPU.<br>"
+           "INT 0: divide error, INT 1: single step (TF), INT 8: timer, INT 9: keyboard (only while IF is set)</p>"
            );
 
     // === Errors & Reporting ===
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdio>
+
+// ===============================================================
+// == MINIMAL CHECKS FOR THE TEST PROGRAMS
+// ===============================================================
+// A FAILED CHECK PRINTS WHERE AND WHAT, THEN THE TEST GOES ON. main() ENDS WITH
+// return check_report(); SO THE EXIT CODE IS THE NUMBER OF FAILURES (0 = PASSED).
+// BOTH MACROS ARE EXPRESSIONS (TRUE = PASSED), SO A TABLE LOOP CAN PRINT ITS ROW ON FAILURE.
+inline int check_failures = 0;
+
+inline bool check_true(bool passed, const char *expression, const char *file, int line)
+{
+    if (!passed)
+    {
+        std::printf("%s:%d: CHECK FAILED: %s\n", file, line, expression);
+        check_failures++;
+    }
+    return passed;
+}
+
+inline bool check_equal(unsigned long long actual, unsigned long long expected, const char *expression, const char *file, int line)
+{
+    if (actual != expected)
+    {
+        std::printf("%s:%d: CHECK FAILED: %s = 0x%llX, EXPECTED 0x%llX\n", file, line, expression, actual, expected);
+        check_failures++;
+    }
+    return actual == expected;
+}
+
+#define CHECK(condition) check_true((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) check_equal((unsigned long long)(actual), (unsigned long long)(expected), #actual, __FILE__, __LINE__)
+
+inline int check_report()
+{
+    if (check_failures)
+        std::printf("%d CHECK(S) FAILED\n", check_failures);
+    return check_failures;
+}
@@ -0,0 +1,726 @@
+#include "differential.h"
+#include "lockstep.h"
+#include "opcodes.h"
+#include "parser.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+// ===============================================================
+// == RANDOM INSTRUCTION STREAMS
+// ===============================================================
+// ANY OPCODE OF OPCODE_TABLE, WITH OPERANDS CHOSEN SO THAT NOTHING WRITES THE CODE
+// (LockstepEngine FETCHES FOR EVERY LANE FROM ONE) AND EVERY PROGRAM ENDS:
+//   - JUMPS, CALLS AND LOOPS ONLY GO FORWARD, TO AN INSTRUCTION BOUNDARY
+//   - MEMORY OPERANDS ARE PRECEDED BY MOVs THAT PUT THEIR ADDRESS IN THE DATA AREA, STRING
+//     INSTRUCTIONS BY MOVs OF SI, DI AND A SMALL CX; SP IS NEVER A DESTINATION
+//   - NOTHING CHANGES A SEGMENT REGISTER OR RETURNS THROUGH THE STACK
+// INT, DIVIDE ERRORS AND TRAPS FIND AN EMPTY VECTOR TABLE AND STOP THE CPU, WHICH IS CHECKED TOO
+static const uint16_t DATA_START = 0x2000; // THE CODE, REPEATS WRITTEN OUT OR NOT, ENDS BELOW
+static const uint16_t DATA_END = 0xF000;
+static const uint16_t STACK_TOP = 0xFF00; // ROOM FOR A POP PER INSTRUCTION WITHOUT WRAPPING
+
+static const uint8_t DEST16[] = {REG_AX, REG_BX, REG_CX, REG_DX, REG_MNK, REG_SI, REG_DI, REG_BP};
+static const uint8_t SOURCE16[] = {REG_AX, REG_BX, REG_CX, REG_DX, REG_MNK, REG_SP, REG_SI, REG_DI, REG_BP};
+static const uint8_t BASE16[] = {REG_BX, REG_SI, REG_DI, REG_BP};
+
+static bool generated(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case OP_RET:
+    case OP_IRET:
+    case OP_POP_SREG:
+    case OP_MOV_SREG_REG:
+        return false;
+    default:
+        return OPCODE_TABLE[opcode].layout != LAYOUT_INVALID;
+    }
+}
+
+// HOW MANY OPERAND BYTES, FROM THE FIRST, ARE REGISTER OR SEGMENT CODES
+static unsigned register_bytes(uint8_t layout)
+{
+    switch (layout)
+    {
+    case LAYOUT_INVALID:
+    case LAYOUT_NONE:
+    case LAYOUT_ADDR16:
+    case LAYOUT_MEMI_I16:
+    case LAYOUT_MEMI_I8:
+    case LAYOUT_SREG_R16: // NOT GENERATED
+    case LAYOUT_I8:
+        return 0;
+    case LAYOUT_R16_R16:
+    case LAYOUT_R8_R8:
+    case LAYOUT_R16_MEMR:
+    case LAYOUT_MEMR_R16:
+    case LAYOUT_R8_MEMR:
+    case LAYOUT_MEMR_R8:
+    case LAYOUT_R16_MEMRI:
+    case LAYOUT_MEMRI_R16:
+    case LAYOUT_R8_MEMRI:
+    case LAYOUT_MEMRI_R8:
+    case LAYOUT_R16_SREG:
+        return 2;
+    case LAYOUT_R16_MEMRR:
+    case LAYOUT_MEMRR_R16:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+// WHAT SEES THE ADDRESS OR THE COUNT OF AN INSTRUCTION: THE RETURN ADDRESS CALL PUSHES, THE
+// TIMER (IN) AND THE INTERRUPTS IT RAISES ONCE IF IS SET (STI, POPF)
+static bool layout_dependent(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case OP_CALL:
+    case OP_IN_REG8_PORT:
+    case OP_IN_REG_PORT:
+    case OP_IN_REG8_DX:
+    case OP_IN_REG_DX:
+    case OP_STI:
+    case OP_POPF:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_string_op(uint8_t opcode)
+{
+    return opcode >= OP_MOVSB && opcode <= OP_REPNE_SCASW;
+}
+
+// A REPEATED STRING INSTRUCTION AS A LOOP: JCXZ end / single / loop single. REP STOPS ON CX = 0,
+// REPE ALSO ON ZF = 0, REPNE ON ZF = 1: THE CONDITIONS OF LOOP, LOOPZ AND LOOPNZ
+struct Repeat
+{
+    uint8_t opcode, single, loop;
+};
+
+static const Repeat REPEATS[] = {
+    {OP_REP_MOVSB, OP_MOVSB, OP_LOOP},
+    {OP_REP_MOVSW, OP_MOVSW, OP_LOOP},
+    {OP_REP_STOSB, OP_STOSB, OP_LOOP},
+    {OP_REP_STOSW, OP_STOSW, OP_LOOP},
+    {OP_REPE_CMPSB, OP_CMPSB, OP_LOOPZ},
+    {OP_REPE_CMPSW, OP_CMPSW, OP_LOOPZ},
+    {OP_REPNE_CMPSB, OP_CMPSB, OP_LOOPNZ},
+    {OP_REPNE_CMPSW, OP_CMPSW, OP_LOOPNZ},
+    {OP_REPE_SCASB, OP_SCASB, OP_LOOPZ},
+    {OP_REPE_SCASW, OP_SCASW, OP_LOOPZ},
+    {OP_REPNE_SCASB, OP_SCASB, OP_LOOPNZ},
+    {OP_REPNE_SCASW, OP_SCASW, OP_LOOPNZ},
+};
+
+static const Repeat *find_repeat(uint8_t opcode)
+{
+    for (const Repeat &r : REPEATS)
+        if (r.opcode == opcode)
+            return &r;
+    return nullptr;
+}
+
+struct Instruction
+{
+    uint8_t bytes[MAX_INSTRUCTION_LENGTH];
+    uint8_t length;
+    bool branch;   // LAYOUT_ADDR16, TARGET PATCHED BY assemble()
+    bool guarded;  // AFTER AN ADDRESS SETUP MOV, NO BRANCH MAY LAND HERE
+    size_t target; // INDEX OF THE INSTRUCTION A BRANCH GOES TO
+};
+
+static Instruction make(std::initializer_list<uint8_t> bytes)
+{
+    Instruction ins{};
+    for (uint8_t b : bytes)
+        ins.bytes[ins.length++] = b;
+    return ins;
+}
+
+static Instruction mov_imm(uint8_t reg, uint16_t value)
+{
+    return make({OP_MOV_REG_IMM, reg, static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)});
+}
+
+static uint16_t data_address(FuzzInput &in)
+{
+    return DATA_START + in.below(DATA_END - DATA_START);
+}
+
+// fixed_layout LEAVES OUT WHAT layout_dependent() SEES AND PICKS A REPEATED STRING INSTRUCTION
+// EVERY THIRD TIME
+static std::vector<Instruction> random_program(FuzzInput &in, bool fixed_layout)
+{
+    static std::vector<uint8_t> all, layout_free;
+    if (all.empty())
+        for (int i = 0; i < 256; i++)
+            if (generated(i))
+            {
+                all.push_back(i);
+                if (!layout_dependent(i))
+                    layout_free.push_back(i);
+            }
+    const std::vector<uint8_t> &opcodes = fixed_layout ? layout_free : all;
+
+    std::vector<Instruction> program;
+    const unsigned count = 1 + in.below(96);
+    // ONE PROGRAM IN EIGHT HAS AN OPERAND BYTE THAT NAMES NO REGISTER, AS SELF-MODIFIED CODE
+    // COULD: EVERY SIDE MUST STOP THERE ON AN UNKNOWN OPCODE
+    const unsigned broken = in.below(8) == 0 ? in.below(count) : count;
+    for (unsigned n = 0; n < count; n++)
+    {
+        const uint8_t opcode = fixed_layout && in.below(3) == 0 ? REPEATS[in.below(sizeof(REPEATS) / sizeof(REPEATS[0]))].opcode
+                                                                : opcodes[in.below(opcodes.size())];
+        const OpInfo &info = OPCODE_TABLE[opcode];
+        auto dest16 = [&]
+        { return DEST16[in.below(sizeof(DEST16))]; };
+        auto source16 = [&]
+        { return SOURCE16[in.below(sizeof(SOURCE16))]; };
+        auto reg8 = [&]
+        { return static_cast<uint8_t>(in.below(REG_MNH + 1)); };
+        auto base = [&]
+        { return BASE16[in.below(sizeof(BASE16))]; };
+        // THE ADDRESS SETUP OF A MEMORY OPERAND, THEN ITS BASE REGISTER(S)
+        const size_t setups = program.size();
+        uint8_t base1 = 0, base2 = 0;
+        uint16_t displacement = 0;
+        switch (info.layout)
+        {
+        case LAYOUT_R16_MEMR:
+        case LAYOUT_MEMR_R16:
+        case LAYOUT_R8_MEMR:
+        case LAYOUT_MEMR_R8:
+            base1 = base();
+            program.push_back(mov_imm(base1, data_address(in)));
+            break;
+        case LAYOUT_R16_MEMRR:
+        case LAYOUT_MEMRR_R16:
+            base1 = base();
+            do
+                base2 = base();
+            while (base2 == base1);
+            program.push_back(mov_imm(base1, data_address(in)));
+            program.push_back(mov_imm(base2, in.below(0x100)));
+            break;
+        case LAYOUT_R16_MEMRI:
+        case LAYOUT_MEMRI_R16:
+        case LAYOUT_R8_MEMRI:
+        case LAYOUT_MEMRI_R8:
+            base1 = base();
+            displacement = in.below(0x100);
+            program.push_back(mov_imm(base1, data_address(in)));
+            break;
+        default:
+            if (is_string_op(opcode))
+            {
+                program.push_back(mov_imm(REG_SI, data_address(in) | 0x20));
+                program.push_back(mov_imm(REG_DI, data_address(in) | 0x20));
+                program.push_back(mov_imm(REG_CX, in.below(17)));
+            }
+            break;
+        }
+
+        // A MEMORY OPERAND'S OWN REGISTER MUST NOT BE ONE OF ITS BASES: XCHG BX, [BX] WOULD
+        // LEAVE THE DATA AREA FOR THE NEXT ONE. THE REGISTER ITSELF IS FINE AS A SOURCE
+        auto dest_not_base = [&]
+        {
+            uint8_t r;
+            do
+                r = dest16();
+            while (r == base1 || r == base2);
+            return r;
+        };
+
+        const uint16_t imm = in.below(3) ? in.word() : (in.below(2) ? 0x7FFF : 0x8000);
+        const uint8_t lo = imm & 0xFF, hi = imm >> 8;
+        const uint16_t address = data_address(in);
+        Instruction ins{};
+        switch (info.layout)
+        {
+        case LAYOUT_INVALID:
+        case LAYOUT_NONE:
+            ins = make({opcode});
+            break;
+        case LAYOUT_ADDR16:
+            ins = make({opcode, 0, 0});
+            ins.branch = true;
+            break;
+        case LAYOUT_R16:
+            // PUSH MAY TAKE SP, EVERYTHING ELSE WRITES ITS OPERAND
+            ins = make({opcode, opcode == OP_PUSH_REG ? source16() : dest16()});
+            break;
+        case LAYOUT_R8:
+        case LAYOUT_R8_CL:
+        case LAYOUT_R8_DX:
+        case LAYOUT_DX_R8:
+            ins = make({opcode, reg8()});
+            break;
+        case LAYOUT_R16_R16:
+            // XCHG WRITES BOTH
+            ins = make({opcode, dest16(), opcode == OP_XCHG_REG_REG ? dest16() : source16()});
+            break;
+        case LAYOUT_R8_R8:
+            ins = make({opcode, reg8(), reg8()});
+            break;
+        case LAYOUT_R16_I16:
+            ins = make({opcode, dest16(), lo, hi});
+            break;
+        case LAYOUT_R8_I8:
+        case LAYOUT_I8_R8:
+            ins = make({opcode, reg8(), lo});
+            break;
+        case LAYOUT_R16_I8:
+        case LAYOUT_I8_R16:
+            ins = make({opcode, info.layout == LAYOUT_R16_I8 ? dest16() : source16(), lo});
+            break;
+        case LAYOUT_R16_CL:
+        case LAYOUT_R16_DX:
+            ins = make({opcode, dest16()});
+            break;
+        case LAYOUT_DX_R16:
+            ins = make({opcode, source16()});
+            break;
+        case LAYOUT_R16_MEMI:
+            ins = make({opcode, dest16(), static_cast<uint8_t>(address), static_cast<uint8_t>(address >> 8)});
+            break;
+        case LAYOUT_MEMI_R16:
+            ins = make({opcode, source16(), static_cast<uint8_t>(address), static_cast<uint8_t>(address >> 8)});
+            break;
+        case LAYOUT_R8_MEMI:
+        case LAYOUT_MEMI_R8:
+            ins = make({opcode, reg8(), static_cast<uint8_t>(address), static_cast<uint8_t>(address >> 8)});
+            break;
+        case LAYOUT_R16_MEMR:
+            ins = make({opcode, dest_not_base(), base1});
+            break;
+        case LAYOUT_MEMR_R16:
+            ins = make({opcode, source16(), base1});
+            break;
+        case LAYOUT_R8_MEMR:
+        case LAYOUT_MEMR_R8:
+            ins = make({opcode, reg8(), base1});
+            break;
+        case LAYOUT_R16_MEMRR:
+            ins = make({opcode, dest_not_base(), base1, base2});
+            break;
+        case LAYOUT_MEMRR_R16:
+            ins = make({opcode, source16(), base1, base2});
+            break;
+        case LAYOUT_R16_MEMRI:
+            ins = make({opcode, dest_not_base(), base1, static_cast<uint8_t>(displacement), 0});
+            break;
+        case LAYOUT_MEMRI_R16:
+            ins = make({opcode, source16(), base1, static_cast<uint8_t>(displacement), 0});
+            break;
+        case LAYOUT_R8_MEMRI:
+        case LAYOUT_MEMRI_R8:
+            ins = make({opcode, reg8(), base1, static_cast<uint8_t>(displacement), 0});
+            break;
+        case LAYOUT_MEMI_I16:
+            ins = make({opcode, static_cast<uint8_t>(address), static_cast<uint8_t>(address >> 8), lo, hi});
+            break;
+        case LAYOUT_MEMI_I8:
+            ins = make({opcode, static_cast<uint8_t>(address), static_cast<uint8_t>(address >> 8), lo});
+            break;
+        case LAYOUT_SREG:
+        case LAYOUT_R16_SREG:
+            ins = info.layout == LAYOUT_SREG ? make({opcode, static_cast<uint8_t>(in.below(4))})
+                                             : make({opcode, dest16(), static_cast<uint8_t>(in.below(4))});
+            break;
+        case LAYOUT_SREG_R16:
+            ins = make({OP_NOP});
+            break;
+        case LAYOUT_I8:
+            ins = make({opcode, lo});
+            break;
+        }
+        const unsigned registers = ins.bytes[0] == opcode ? register_bytes(info.layout) : 0;
+        if (n == broken && registers)
+            ins.bytes[1 + in.below(registers)] = 0x10 + in.below(0xF0);
+        for (size_t i = setups + 1; i < program.size(); i++)
+            program[i].guarded = true;
+        ins.guarded = program.size() != setups;
+        program.push_back(ins);
+    }
+    program.push_back(make({OP_HALT}));
+
+    // BRANCH TARGETS: ONE OF THE NEXT FEW INSTRUCTIONS, NEVER BETWEEN A SETUP AND ITS USER
+    for (size_t i = 0; i < program.size(); i++)
+        if (program[i].branch)
+        {
+            size_t target = i + 1 + in.below(6);
+            while (target < program.size() && program[target].guarded)
+                target++;
+            program[i].target = target < program.size() ? target : program.size() - 1;
+        }
+    return program;
+}
+
+// THE MACHINE CODE OF program, WITH EVERY REPEATED STRING INSTRUCTION WRITTEN OUT AS A LOOP IF
+// expand_repeats
+static std::vector<uint8_t> assemble(const std::vector<Instruction> &program, bool expand_repeats)
+{
+    auto branch = [](uint8_t opcode, uint16_t to)
+    { return make({opcode, static_cast<uint8_t>(to), static_cast<uint8_t>(to >> 8)}); };
+
+    std::vector<uint16_t> at;
+    uint16_t size = 0;
+    for (const Instruction &ins : program)
+    {
+        at.push_back(size);
+        size += expand_repeats && find_repeat(ins.bytes[0]) ? 2 * 3 + 1 : ins.length;
+    }
+
+    std::vector<uint8_t> code;
+    code.reserve(size);
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        std::vector<Instruction> out(1, program[i]);
+        const Repeat *repeat = expand_repeats ? find_repeat(program[i].bytes[0]) : nullptr;
+        if (repeat)
+            out = {branch(OP_JCXZ, at[i] + 7), make({repeat->single}), branch(repeat->loop, at[i] + 3)};
+        else if (program[i].branch)
+            out[0] = branch(program[i].bytes[0], at[program[i].target]);
+        for (const Instruction &ins : out)
+            code.insert(code.end(), ins.bytes, ins.bytes + ins.length);
+    }
+    return code;
+}
+
+// ===============================================================
+// == PROGRAM SETUP AND REPORTS
+// ===============================================================
+struct StartState
+{
+    uint16_t ax, bx, cx, dx, mnk, si, di, bp;
+    uint16_t flags;
+};
+
+static void apply(CPU &cpu, const StartState &s)
+{
+    cpu.regs.AX = s.ax;
+    cpu.regs.BX = s.bx;
+    cpu.regs.CX = s.cx;
+    cpu.regs.DX = s.dx;
+    cpu.regs.MNK = s.mnk;
+    cpu.regs.SI = s.si;
+    cpu.regs.DI = s.di;
+    cpu.regs.BP = s.bp;
+    cpu.regs.SP = STACK_TOP;
+    cpu.flags.set_word(s.flags);
+}
+
+static void print_code(const std::vector<uint8_t> &code)
+{
+    std::printf("    CODE:");
+    for (uint8_t b : code)
+        std::printf(" %02X", b);
+    std::printf("\n");
+}
+
+// ===============================================================
+// == BULK REPEATS AGAINST WRITTEN-OUT LOOPS
+// ===============================================================
+// HOW A CPU STOPPED: HALT, AN UNKNOWN OPCODE OR WHICH FAULT
+struct StopSink : EventSink
+{
+    int stop = -1;
+
+    void on_event(const CpuEvent &event) override
+    {
+        if (event.kind == EVENT_HALT || event.kind == EVENT_UNKNOWN_OPCODE || event.kind == EVENT_FAULT)
+            stop = event.kind << 8 | event.code;
+    }
+};
+
+// RUNS TO THE END. FALSE IF IT DOES NOT GET THERE: FORWARD-ONLY CODE AND REPEATS OF AT MOST 16
+// ELEMENTS RETIRE A FEW THOUSAND INSTRUCTIONS
+static bool run_to_end(CPU &cpu)
+{
+    while (cpu.instructions < 100000)
+        if (!cpu.step())
+            return true;
+    return false;
+}
+
+bool check_strings(FuzzInput &in, DifferentialStats &stats)
+{
+    const std::vector<Instruction> program = random_program(in, true);
+    const std::vector<uint8_t> bulk_code = assemble(program, false);
+    const std::vector<uint8_t> loop_code = assemble(program, true);
+    StartState setup{in.word(), in.word(), in.word(), in.word(), in.word(), in.word(), in.word(), in.word(),
+                     static_cast<uint16_t>(in.word() & ~(Flags::BIT_TF | Flags::BIT_IF))};
+    // DATA OF A FEW SMALL VALUES, SO CMPS AND SCAS FIND BOTH EQUAL AND DIFFERENT ELEMENTS
+    uint8_t pattern[61];
+    for (uint8_t &b : pattern)
+        b = in.below(3);
+    std::vector<uint8_t> data(DATA_END - DATA_START);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = pattern[i % sizeof(pattern)];
+
+    CPU bulk, loop;
+    StopSink bulk_stop, loop_stop;
+    bulk.set_event_sink(&bulk_stop);
+    loop.set_event_sink(&loop_stop);
+    bulk.load_program(bulk_code.data(), bulk_code.size());
+    loop.load_program(loop_code.data(), loop_code.size());
+    for (CPU *cpu : {&bulk, &loop})
+    {
+        cpu->memory.load(Memory::physical(PROGRAM_SEGMENT, DATA_START), data.data(), data.size());
+        apply(*cpu, setup);
+    }
+
+    std::string what;
+    if (!run_to_end(bulk) || !run_to_end(loop))
+        what = "DOES NOT END";
+    else if (bulk_stop.stop != loop_stop.stop)
+        what = "STOPS DIFFERENTLY";
+    else
+    {
+        const Registers &x = bulk.regs, &y = loop.regs;
+        char text[160];
+        std::snprintf(text, sizeof(text), "AX %04X/%04X CX %04X/%04X SI %04X/%04X DI %04X/%04X FLAGS %04X/%04X", x.AX,
+                      y.AX, x.CX, y.CX, x.SI, y.SI, x.DI, y.DI, bulk.flags.word(), loop.flags.word());
+        if (x.AX != y.AX || x.BX != y.BX || x.CX != y.CX || x.DX != y.DX || x.MNK != y.MNK || x.SP != y.SP ||
+            x.BP != y.BP || x.SI != y.SI || x.DI != y.DI || bulk.flags.word() != loop.flags.word())
+            what = text;
+        for (uint32_t offset = DATA_START; what.empty() && offset < 0x10000; offset++)
+            if (bulk.memory.read8(PROGRAM_SEGMENT, offset) != loop.memory.read8(PROGRAM_SEGMENT, offset))
+                what = std::string(text) + " (MEMORY DIFFERS)";
+        if (what.empty() && bulk.console->take_output() != loop.console->take_output())
+            what = std::string(text) + " (CONSOLE OUTPUT DIFFERS)";
+    }
+    if (!what.empty())
+    {
+        std::printf("STRING PATHS DIFFER: BULK / LOOPED: %s\n", what.c_str());
+        print_code(bulk_code);
+        return false;
+    }
+    stats.programs++;
+    stats.instructions += loop.instructions;
+    return true;
+}
+
+// ===============================================================
+// == LOCKSTEP LANES AGAINST CPU::step()
+// ===============================================================
+static bool same_memory(const Memory &a, const Memory &b)
+{
+    for (uint32_t page = 0; page < Memory::PAGES; page++)
+    {
+        const uint16_t segment = page << (Memory::PAGE_BITS - 4);
+        const uint8_t *x = a.pointer(segment, 0);
+        const uint8_t *y = b.pointer(segment, 0);
+        if (x != y && std::memcmp(x, y, Memory::PAGE_SIZE) != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool same_state(const CPU &lane, bool lane_running, const CPU &ref, bool ref_running, std::string &what)
+{
+    const Registers &x = lane.regs, &y = ref.regs;
+    char text[160];
+    std::snprintf(text, sizeof(text), "AX %04X/%04X BX %04X/%04X CX %04X/%04X DX %04X/%04X IP %04X/%04X FLAGS %04X/%04X",
+                  x.AX, y.AX, x.BX, y.BX, x.CX, y.CX, x.DX, y.DX, x.IP, y.IP, lane.flags.word(), ref.flags.word());
+    what = text;
+    if (lane_running != ref_running)
+        return what += " (RUNNING DIFFERS)", false;
+    if (lane.instructions != ref.instructions)
+        return what += " (INSTRUCTION COUNT DIFFERS)", false;
+    if (x.AX != y.AX || x.BX != y.BX || x.CX != y.CX || x.DX != y.DX || x.MNK != y.MNK || x.SP != y.SP ||
+        x.BP != y.BP || x.SI != y.SI || x.DI != y.DI || x.IP != y.IP || x.CS != y.CS || x.DS != y.DS ||
+        x.SS != y.SS || x.ES != y.ES || lane.flags.word() != ref.flags.word())
+        return false;
+    if (!same_memory(lane.memory, ref.memory))
+        return what += " (MEMORY DIFFERS)", false;
+    return true;
+}
+
+bool check_engines(FuzzInput &in, DifferentialStats &stats)
+{
+    const std::vector<uint8_t> code = assemble(random_program(in, false), false);
+    const int lanes = 1 + in.below(LockstepEngine::LANES);
+    const uint64_t block = 1 + in.below(64);
+
+    LockstepEngine engine(lanes);
+    engine.load_program(code.data(), code.size());
+    std::vector<std::unique_ptr<CPU>> reference;
+    std::vector<bool> reference_running;
+    for (int l = 0; l < lanes; l++)
+    {
+        StartState setup{in.word(), in.word(), in.word(), in.word(), in.word(), in.word(), in.word(), in.word(),
+                         static_cast<uint16_t>(in.word() & ~(Flags::BIT_TF | Flags::BIT_IF))};
+        apply(engine.lane(l), setup);
+        reference.push_back(std::make_unique<CPU>());
+        reference.back()->load_program(code.data(), code.size());
+        apply(*reference.back(), setup);
+        reference_running.push_back(true);
+    }
+
+    // FORWARD-ONLY CODE RETIRES AT MOST A FEW INSTRUCTIONS PER BYTE, THE LIMIT IS A SAFETY NET
+    for (int blocks = 0; blocks < 100000; blocks++)
+    {
+        const int left = engine.run(block);
+        for (int l = 0; l < lanes; l++)
+        {
+            CPU &lane = engine.lane(l);
+            CPU &ref = *reference[l];
+            // A TRAP OR IRQ WITHOUT A HANDLER STOPS THE CPU BEFORE IT RETIRES ANYTHING: A STOPPED
+            // LANE MAY BE ONE FAILED step() AHEAD AT THE SAME COUNT
+            while (reference_running[l] && (ref.instructions < lane.instructions ||
+                                            (!engine.running(l) && ref.instructions == lane.instructions)))
+                reference_running[l] = ref.step();
+            std::string what;
+            bool same = same_state(lane, engine.running(l), ref, reference_running[l], what);
+            if (same && lane.console->take_output() != ref.console->take_output())
+                same = false, what += " (CONSOLE OUTPUT DIFFERS)";
+            if (!same)
+            {
+                std::printf("ENGINES DIFFER: LANE %d OF %d AFTER BLOCK %d (%llu INSTRUCTIONS): %s\n", l, lanes, blocks,
+                            (unsigned long long)ref.instructions, what.c_str());
+                print_code(code);
+                return false;
+            }
+        }
+        if (left == 0)
+            break;
+    }
+
+    stats.programs++;
+    for (const auto &cpu : reference)
+        stats.instructions += cpu->instructions;
+    return true;
+}
+
+// ===============================================================
+// == RANDOM ASSEMBLY
+// ===============================================================
+static std::string random_source(FuzzInput &in)
+{
+    static const char *const REG16[] = {"AX", "BX", "CX", "DX", "SI", "DI", "BP", "SP"};
+    static const char *const REG8[] = {"AL", "AH", "BL", "BH", "CL", "CH", "DL", "DH"};
+    static const char *const ALU[] = {"ADD", "SUB", "AND", "OR", "XOR", "CMP", "MOV", "ADC", "SBB", "XCHG"};
+    static const char *const SHIFT[] = {"SHL", "SHR", "SAR", "ROL", "ROR", "RCL", "RCR"};
+    static const char *const BRANCH[] = {"JMP", "JZ", "JNZ", "JC", "JA", "JLE", "LOOP", "CALL", "JCXZ", "JFOO"};
+    static const char *const PLAIN[] = {"HALT", "NOP", "RET", "IRET", "PUSHF", "POPF", "CLC", "STD", "REP STOSB", "MOVSW", "REPE CMPSB"};
+    auto pick = [&](auto &table) -> const char *
+    { return table[in.below(sizeof(table) / sizeof(table[0]))]; };
+
+    std::string source;
+    if (in.below(2))
+        source += "%macro TWICE 1\nINC %1\nINC %1\n%endmacro\n";
+    const unsigned lines = in.below(160);
+    const unsigned labels = lines / 16 + 1;
+    for (unsigned i = 0; i < lines && !in.exhausted(); i++)
+    {
+        char line[96];
+        switch (in.below(17))
+        {
+        case 0:
+            std::snprintf(line, sizeof(line), "MOV %s, 0x%X", pick(REG16), in.word());
+            break;
+        case 1:
+            std::snprintf(line, sizeof(line), "%s %s, %s", pick(ALU), pick(REG16), pick(REG16));
+            break;
+        case 2:
+            std::snprintf(line, sizeof(line), "%s %s, %u", pick(ALU), pick(REG8), in.below(300));
+            break;
+        case 3:
+            std::snprintf(line, sizeof(line), "%s L%u", pick(BRANCH), in.below(labels + 1));
+            break;
+        case 4:
+            std::snprintf(line, sizeof(line), "L%u:", in.below(labels));
+            break;
+        case 5:
+            std::snprintf(line, sizeof(line), "PUSH %s ; comment", pick(REG16));
+            break;
+        case 6:
+            std::snprintf(line, sizeof(line), "MOV [%s], %s", pick(REG16), pick(REG16));
+            break;
+        case 7:
+            std::snprintf(line, sizeof(line), "MOV AX, [0x%X]\r", in.word());
+            break;
+        case 8:
+            std::snprintf(line, sizeof(line), "MOV %s, [%s+%s]", pick(REG16), pick(REG16), pick(REG16));
+            break;
+        case 9:
+            std::snprintf(line, sizeof(line), "MOV [%s+%u], %s", pick(REG16), in.below(0x10000), in.below(2) ? pick(REG16) : pick(REG8));
+            break;
+        case 10:
+            std::snprintf(line, sizeof(line), "TWICE %s", pick(REG16));
+            break;
+        case 11:
+            std::snprintf(line, sizeof(line), "%s", pick(PLAIN));
+            break;
+        case 12:
+            std::snprintf(line, sizeof(line), "%s %s, %s", pick(SHIFT), in.below(2) ? pick(REG16) : pick(REG8), in.below(2) ? "CL" : "3");
+            break;
+        case 13:
+            std::snprintf(line, sizeof(line), "MOV [0x%X], 0x%X", in.word(), in.word());
+            break;
+        case 14:
+            std::snprintf(line, sizeof(line), "LOCK ADD [%s], %s", pick(REG16), pick(REG16));
+            break;
+        case 15:
+            std::snprintf(line, sizeof(line), "   ");
+            break;
+        default:
+            // ANYTHING: MOSTLY ERRORS, WHICH MUST COME OUT THE SAME TOO
+            std::snprintf(line, sizeof(line), "%c%c %s", 'A' + in.below(26), 'A' + in.below(26), pick(REG16));
+            break;
+        }
+        source += line;
+        source += '\n';
+    }
+    for (unsigned l = 0; l < labels; l++)
+        source += "L" + std::to_string(l) + ":\n";
+    source += "HALT";
+    if (in.below(2))
+        source += '\n';
+    return source;
+}
+
+// ONE PATH'S RESULT NEXT TO parse_from_string's
+static bool same_assembly(const char *path, const std::vector<uint8_t> &code, const std::string &error,
+                          const Parser &reference, const uint8_t *bytes, size_t size, Parser &parser,
+                          const std::string &source)
+{
+    bool same = parser.get_last_error() == error;
+    if (same && error.empty())
+        same = size == code.size() && std::memcmp(bytes, code.data(), size) == 0 &&
+               parser.get_labels() == reference.get_labels() && parser.get_relocations() == reference.get_relocations();
+    if (!same)
+        std::printf("ASSEMBLERS DIFFER: parse_from_string / %s: %zu/%zu BYTES, ERRORS \"%s\" / \"%s\"\n----\n%s\n----\n", path,
+                    code.size(), size, error.c_str(), parser.get_last_error().c_str(), source.c_str());
+    return same;
+}
+
+bool check_assembler(FuzzInput &in, DifferentialStats &stats)
+{
+    const std::string source = random_source(in);
+    static uint8_t buffer[Memory::SEGMENT_SIZE];
+
+    Parser reference, parser;
+    const std::vector<uint8_t> code = reference.parse_from_string(source);
+    const std::string error = reference.get_last_error();
+
+    size_t size = parser.parse_into(source.data(), source.size(), buffer, sizeof(buffer));
+    if (!same_assembly("parse_into", code, error, reference, buffer, size, parser, source))
+        return false;
+    std::istringstream stream(source);
+    size = parser.stream_into(stream, buffer, sizeof(buffer));
+    if (!same_assembly("stream_into", code, error, reference, buffer, size, parser, source))
+        return false;
+
+    stats.sources++;
+    stats.source_bytes += source.size();
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ===============================================================
+// == DIFFERENTIAL CHECKS: FAST PATHS AGAINST THE REFERENCE ONES
+// ===============================================================
+// SHARED BY THE libFuzzer TARGET (fuzz_engines.cpp) AND THE STANDALONE RUNNER
+// (fuzz_runner.cpp). EVERY RANDOM CHOICE IS TAKEN FROM A FuzzInput, SO ONE INPUT
+// ALWAYS REPRODUCES THE SAME PROGRAM, WHOEVER GENERATED IT.
+
+// THE INPUT BYTES AS A STREAM OF CHOICES. PAST THE END EVERY CHOICE IS 0
+class FuzzInput
+{
+public:
+    FuzzInput(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+    uint8_t byte() { return at < size ? data[at++] : 0; }
+    uint16_t word() { return byte() | (byte() << 8); }
+    unsigned below(unsigned n) { return n ? word() % n : 0; } // n <= 0x10000
+    bool exhausted() const { return at >= size; }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t at = 0;
+};
+
+struct DifferentialStats
+{
+    uint64_t programs = 0;
+    uint64_t instructions = 0; // RETIRED BY THE REFERENCE SIDE OF EACH COMPARISON
+    uint64_t sources = 0;
+    uint64_t source_bytes = 0;
+};
+
+// A RANDOM INSTRUCTION STREAM (NO CALL, IN, STI OR POPF: THEY SEE ADDRESSES AND COUNTS), RUN
+// TWICE ON CPU::step(): AS GENERATED, SO EVERY REP/REPE/REPNE STRING INSTRUCTION TAKES THE BULK
+// PATH, AND WITH EACH OF THEM WRITTEN OUT AS A LOOP OF ITS ONE-ELEMENT FORM (JCXZ / op / LOOP,
+// LOOPZ OR LOOPNZ). THE REGISTERS BUT IP, THE FLAGS, THE DATA AND STACK MEMORY, THE CONSOLE
+// OUTPUT AND HOW THE CPU STOPPED MUST BE EQUAL. FALSE (AND A REPORT ON stdout) ON A DIFFERENCE
+bool check_strings(FuzzInput &input, DifferentialStats &stats);
+
+// A RANDOM INSTRUCTION STREAM OVER EVERY OPCODE OF OPCODE_TABLE, RUN ON 1..16 LANES OF A
+// LockstepEngine AND ON ONE CPU::step() LOOP PER LANE. AFTER EVERY run() BLOCK EACH REFERENCE
+// CPU IS STEPPED TO ITS LANE'S INSTRUCTION COUNT AND THE REGISTERS, FLAGS, MEMORY, CONSOLE
+// OUTPUT AND RUNNING STATE MUST BE EQUAL. FALSE (AND A REPORT ON stdout) ON THE FIRST DIFFERENCE
+bool check_engines(FuzzInput &input, DifferentialStats &stats);
+
+// RANDOM ASSEMBLY (MACROS, LABELS, BAD LINES INCLUDED) THROUGH Parser::parse_from_string,
+// Parser::parse_into AND Parser::stream_into: THE SAME BYTES, LABELS AND RELOCATIONS, OR THE
+// SAME ERROR
+bool check_assembler(FuzzInput &input, DifferentialStats &stats);
+
+// EVERY CHECK, FOR THE RUNNERS: fuzz_runner DOES ALL OF THEM PER ITERATION, THE FIRST BYTE OF A
+// libFuzzer INPUT PICKS ONE
+typedef bool (*DifferentialCheck)(FuzzInput &input, DifferentialStats &stats);
+static const DifferentialCheck DIFFERENTIAL_CHECKS[] = {check_strings, check_engines, check_assembler};
+static const size_t DIFFERENTIAL_CHECK_COUNT = sizeof(DIFFERENTIAL_CHECKS) / sizeof(DIFFERENTIAL_CHECKS[0]);
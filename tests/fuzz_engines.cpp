@@ -0,0 +1,17 @@
+#include "differential.h"
+
+#include <cstdlib>
+
+// libFuzzer ENTRY POINT (clang -fsanitize=fuzzer), SEE tests/CMakeLists.txt. THE FIRST BYTE
+// PICKS THE CHECK, THE REST ARE ITS CHOICES. A DIFFERENCE ABORTS, SO libFuzzer KEEPS THE INPUT;
+// fuzz_runner REPLAYS SUCH A FILE WITHOUT clang.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size == 0)
+        return 0;
+    FuzzInput input(data + 1, size - 1);
+    DifferentialStats stats;
+    if (!DIFFERENTIAL_CHECKS[data[0] % DIFFERENTIAL_CHECK_COUNT](input, stats))
+        std::abort();
+    return 0;
+}
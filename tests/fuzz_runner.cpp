@@ -0,0 +1,81 @@
+#include "differential.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+// ===============================================================
+// == STANDALONE DIFFERENTIAL RUNNER, NO libFuzzer NEEDED
+// ===============================================================
+//   fuzz_runner [iterations [seed]]   RANDOM INPUTS, EVERY CHECK PER ITERATION, THEN THROUGHPUT
+//   fuzz_runner FILE...               REPLAYS INPUTS SAVED BY THE libFuzzer TARGET
+// THE EXIT CODE IS THE NUMBER OF INPUTS THAT FOUND A DIFFERENCE
+static bool is_number(const char *text)
+{
+    char *end;
+    std::strtoul(text, &end, 10);
+    return *text && !*end;
+}
+
+static int replay(int count, char **files)
+{
+    int failures = 0;
+    DifferentialStats stats;
+    for (int i = 0; i < count; i++)
+    {
+        std::ifstream file(files[i], std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.is_open() || data.empty())
+        {
+            std::printf("%s: CANNOT READ\n", files[i]);
+            failures++;
+            continue;
+        }
+        FuzzInput input(data.data() + 1, data.size() - 1);
+        bool same = DIFFERENTIAL_CHECKS[data[0] % DIFFERENTIAL_CHECK_COUNT](input, stats);
+        std::printf("%s: %s\n", files[i], same ? "SAME" : "DIFFERENT");
+        failures += !same;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !is_number(argv[1]))
+        return replay(argc - 1, argv + 1);
+
+    const unsigned long iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    const unsigned long seed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::random_device()();
+
+    std::mt19937 random(seed);
+    std::vector<uint8_t> data(4096);
+    DifferentialStats stats;
+    int failures = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations && failures < 10; i++)
+    {
+        for (uint8_t &b : data)
+            b = random();
+        bool same = true;
+        for (DifferentialCheck check : DIFFERENTIAL_CHECKS)
+        {
+            FuzzInput input(data.data(), data.size());
+            same &= check(input, stats);
+        }
+        if (!same)
+        {
+            std::printf("    ITERATION %lu, SEED %lu\n", i, seed);
+            failures++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::printf("SEED %lu: %llu PROGRAMS (%.1f M INSTRUCTIONS/S), %llu SOURCES (%.1f MB/S), %d DIFFERENT\n", seed,
+                (unsigned long long)stats.programs, stats.instructions / seconds / 1e6, (unsigned long long)stats.sources,
+                stats.source_bytes / seconds / 1e6, failures);
+    return failures;
+}
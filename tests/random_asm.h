@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+// ===============================================================
+// == RANDOM ASSEMBLY SOURCES
+// ===============================================================
+// FOR TESTS THAT ASSEMBLE ONE SOURCE THROUGH SEVERAL PATHS AND COMPARE. lines RANDOM LINES:
+// INSTRUCTIONS, LABELS (SOME DEFINED TWICE), FORWARD AND BACKWARD BRANCHES, A MACRO, COMMENTS,
+// BLANK LINES AND CR LINE ENDS, SOMETIMES AN INCLUDE OF "lib.inc" (THE TEST WRITES IT). EVERY
+// LABEL USED IS DEFINED AT THE END, SO MOST BRANCHES NEED A FIXUP. error PICKS A BROKEN SOURCE:
+// 0 NONE, 1 AN UNKNOWN INSTRUCTION MIDWAY, 2 A MACRO CALL WITHOUT ITS ARGUMENT, 3 A MACRO NEVER
+// CLOSED AT THE END OF THE INPUT, 4 BRANCHES TO UNKNOWN INSTRUCTIONS AND UNDEFINED LABELS
+inline std::string random_asm(std::mt19937 &random, int lines, int error = 0)
+{
+    static const char *const REG16[] = {"AX", "BX", "CX", "DX", "SI", "DI", "BP"};
+    static const char *const REG8[] = {"AL", "AH", "BL", "BH", "CL", "CH", "DL", "DH"};
+    static const char *const ALU[] = {"ADD", "SUB", "AND", "OR", "XOR", "CMP", "MOV"};
+    static const char *const BRANCH[] = {"JMP", "JZ", "JNZ", "JC", "JA", "JLE", "LOOP", "CALL", "JCXZ", "JFOO"};
+    auto below = [&](unsigned n) { return static_cast<int>(random() % n); };
+
+    std::string source = "%macro TWICE 1\nINC %1\nINC %1\n%endmacro\n";
+    if (below(3) == 0)
+        source += "INCLUDE \"lib.inc\"\n";
+    const int labels = lines / 20 + 1;
+    const bool broken_branches = error == 4;
+    for (int i = 0; i < lines; i++)
+    {
+        char line[128];
+        switch (below(13))
+        {
+        case 0:
+            std::snprintf(line, sizeof(line), "MOV %s, 0x%X", REG16[below(7)], below(65536));
+            break;
+        case 1:
+            std::snprintf(line, sizeof(line), "%s %s, %s", ALU[below(7)], REG16[below(7)], REG16[below(7)]);
+            break;
+        case 2:
+            std::snprintf(line, sizeof(line), "%s %s, %d", ALU[below(7)], REG8[below(8)], below(256));
+            break;
+        case 3:
+            std::snprintf(line, sizeof(line), "%s L%d", BRANCH[below(broken_branches ? 10 : 9)],
+                          below(labels + (broken_branches ? 2 : 0)));
+            break;
+        case 4:
+            std::snprintf(line, sizeof(line), "L%d:", below(2) ? i / 20 : below(labels));
+            break;
+        case 5:
+            std::snprintf(line, sizeof(line), "PUSH %s ; comment", REG16[below(7)]);
+            break;
+        case 6:
+            std::snprintf(line, sizeof(line), "MOV [BX], %s", REG16[below(4)]);
+            break;
+        case 7:
+            std::snprintf(line, sizeof(line), "MOV AX, [0x%X]\r", below(65536));
+            break;
+        case 8:
+            std::snprintf(line, sizeof(line), "TWICE %s", REG16[below(7)]);
+            break;
+        case 9:
+            std::snprintf(line, sizeof(line), "%s", below(2) ? "REP STOSB" : "MOVSW");
+            break;
+        case 10:
+            std::snprintf(line, sizeof(line), "   ");
+            break;
+        case 11:
+            std::snprintf(line, sizeof(line), "MOV [0x%X], 0x%X", below(65536), below(65536));
+            break;
+        default:
+            std::snprintf(line, sizeof(line), "SHL %s, 1", REG16[below(7)]);
+            break;
+        }
+        source += line;
+        source += '\n';
+    }
+    for (int l = 0; l < labels; l++)
+        source += "L" + std::to_string(l) + ":\n";
+
+    if (error == 1)
+        source.insert(source.find('\n', source.size() / 2), "\nFROB AX");
+    else if (error == 2)
+        source.insert(source.find('\n', source.size() / 3), "\nTWICE");
+    else if (error == 3)
+        source += "%macro OPEN 0\nNOP\n";
+    source += "HALT";
+    if (below(2))
+        source += "\n";
+    return source;
+}
@@ -0,0 +1,120 @@
+#include "asmcache.h"
+#include "check.h"
+#include "util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+// ===============================================================
+// == AssemblyCache: SOURCE KEYS AND INCLUDE INVALIDATION
+// ===============================================================
+namespace fs = std::filesystem;
+
+static void test_keys()
+{
+    // SPACING OUTSIDE QUOTES DOES NOT MATTER, COMMENTS AND BLANK LINES NEITHER
+    CHECK(AssemblyCache::key_for("MOV AX , [ BX+SI ]\nHALT\n", "") == AssemblyCache::key_for("MOV AX,[BX+SI]\n\n; DONE\nHALT\n", ""));
+    CHECK(!(AssemblyCache::key_for("MOV AX, BX\n", "") == AssemblyCache::key_for("MOV AX, CX\n", "")));
+
+    // EXCEPT THE SPACE ENDING THE COMMAND: "MOV[BX]," IS ONE WORD TO THE PARSER
+    CHECK(!(AssemblyCache::key_for("MOV [BX], AX\n", "") == AssemblyCache::key_for("MOV[BX], AX\n", "")));
+    CHECK(!(AssemblyCache::key_for("LOCK ADD [BX], AX\n", "") == AssemblyCache::key_for("LOCK ADD[BX], AX\n", "")));
+    CHECK(AssemblyCache::key_for("MOV   [BX] , AX\n", "") == AssemblyCache::key_for("MOV [BX],AX\n", ""));
+
+    // A QUOTED FILE NAME IS KEPT AS WRITTEN
+    CHECK(!(AssemblyCache::key_for("INCLUDE \"a  b.asm\"\n", "") == AssemblyCache::key_for("INCLUDE \"a b.asm\"\n", "")));
+    CHECK(AssemblyCache::key_for("INCLUDE   \"a  b.asm\"\n", "") == AssemblyCache::key_for("INCLUDE \"a  b.asm\"\n", ""));
+
+    // THE DIRECTORY ONLY COUNTS FOR SOURCES THAT INCLUDE
+    CHECK(AssemblyCache::key_for("HALT\n", "x") == AssemblyCache::key_for("HALT\n", "y"));
+    CHECK(!(AssemblyCache::key_for("INCLUDE \"a.asm\"\n", "x") == AssemblyCache::key_for("INCLUDE \"a.asm\"\n", "y")));
+}
+
+static void test_names_with_spaces(const fs::path &dir)
+{
+    write_file(dir / "a  b.asm", "MOV AX, 2\n");
+    write_file(dir / "a b.asm", "MOV AX, 1\n");
+
+    AssemblyCache cache;
+    Parser parser;
+    auto two = cache.assemble(parser, "INCLUDE \"a  b.asm\"\n", dir.string());
+    auto one = cache.assemble(parser, "INCLUDE \"a b.asm\"\n", dir.string());
+    CHECK(two->error.empty() && one->error.empty());
+    CHECK_EQ(two->machine_code.at(2), 2);
+    CHECK_EQ(one->machine_code.at(2), 1);
+    CHECK_EQ(cache.misses(), 2);
+}
+
+// A SOURCE THE PARSER REJECTS NEVER GETS THE RESULT OF ONE IT ACCEPTS
+static void test_command_separator()
+{
+    AssemblyCache cache;
+    Parser parser;
+    CHECK(cache.assemble(parser, "MOV [BX], AX\nHALT\n")->error.empty());
+    const std::string error = cache.assemble(parser, "MOV[BX], AX\nHALT\n")->error;
+    CHECK(error.find("Unknown 1-operand command: MOV[BX],") != std::string::npos);
+    CHECK_EQ(cache.hits(), 0);
+}
+
+// THE SAME KEY FOR ANOTHER TEXT, AS A HASH COLLISION WOULD GIVE: THE DISK ENTRY OF ONE SOURCE IS
+// RENAMED TO THE KEY OF ANOTHER SOURCE, WHICH MUST STILL BE ASSEMBLED
+static void test_key_collision(const fs::path &dir)
+{
+    const fs::path disk = dir / "disk";
+    {
+        AssemblyCache cache(256, disk.string());
+        Parser parser;
+        cache.assemble(parser, "MOV AX, 1\nHALT\n");
+    }
+    const SourceKey key = AssemblyCache::key_for("MOV AX, 2\nHALT\n", "");
+    char name[40];
+    std::snprintf(name, sizeof(name), "%016llx%016llx.x86o", (unsigned long long)key.hi, (unsigned long long)key.lo);
+    for (const auto &file : fs::directory_iterator(disk))
+        fs::rename(file.path(), disk / name);
+
+    AssemblyCache cache(256, disk.string());
+    Parser parser;
+    CHECK_EQ(cache.assemble(parser, "MOV AX, 2\nHALT\n")->machine_code.at(2), 2);
+    CHECK_EQ(cache.hits(), 0);
+    CHECK_EQ(cache.misses(), 1);
+
+    // ITS OWN ENTRY, WRITTEN OVER THE RENAMED ONE, IS A HIT
+    AssemblyCache again(256, disk.string());
+    CHECK_EQ(again.assemble(parser, "MOV AX, 2\nHALT\n")->machine_code.at(2), 2);
+    CHECK_EQ(again.hits(), 1);
+}
+
+static void test_changed_include(const fs::path &dir)
+{
+    const fs::path lib = dir / "lib.asm";
+    write_file(lib, "MOV AX, 1\n");
+
+    AssemblyCache cache;
+    Parser parser;
+    const std::string source = "INCLUDE \"lib.asm\"\nHALT\n";
+    CHECK_EQ(cache.assemble(parser, source, dir.string())->machine_code.at(2), 1);
+    CHECK_EQ(cache.assemble(parser, source, dir.string())->machine_code.at(2), 1);
+    CHECK_EQ(cache.hits(), 1);
+
+    write_file(lib, "MOV AX, 3\n");
+    fs::last_write_time(lib, fs::last_write_time(lib) + std::chrono::seconds(5));
+    CHECK_EQ(cache.assemble(parser, source, dir.string())->machine_code.at(2), 3);
+    CHECK_EQ(cache.hits(), 1);
+    CHECK_EQ(cache.misses(), 2);
+}
+
+int main()
+{
+    const fs::path dir = fs::temp_directory_path() / "x86_test_asmcache";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    test_keys();
+    test_command_separator();
+    test_key_collision(dir);
+    test_names_with_spaces(dir);
+    test_changed_include(dir);
+    fs::remove_all(dir);
+    return check_report();
+}
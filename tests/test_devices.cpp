@@ -0,0 +1,72 @@
+#include "check.h"
+#include "cpu.h"
+#include "events.h"
+
+#include <vector>
+
+// ===============================================================
+// == WORD ACCESSES THAT ONLY PARTLY HIT A DEVICE PAGE
+// ===============================================================
+// A WORD WHOSE HIGH BYTE LANDS ON A DEVICE PAGE MUST GO THROUGH THE BUS BYTE BY BYTE: THE LOW
+// BYTE TO RAM, THE HIGH ONE TO THE DEVICE. THE HIGH BYTE LEAVES THE LOW ONE'S PAGE AT THE LAST
+// BYTE OF A PAGE, AND AT OFFSET 0xFFFF, WHERE IT WRAPS TO segment:0000.
+static void execute(CPU &cpu, const std::vector<uint8_t> &code)
+{
+    cpu.memory.load(Memory::physical(PROGRAM_SEGMENT, 0), code.data(), code.size());
+    cpu.regs.CS = PROGRAM_SEGMENT;
+    cpu.regs.IP = 0;
+    CHECK(cpu.step());
+}
+
+// THE MMIO EVENTS AT address AMONG THE ONES RECEIVED
+template <size_t N>
+static int mmio_events(const RingBufferSink<N> &sink, CpuEventKind kind, uint32_t address)
+{
+    int count = 0;
+    for (size_t i = 0; i < sink.size(); i++)
+        count += sink.at(i).kind == kind && sink.at(i).address == address;
+    return count;
+}
+
+static void test_word_across_page_end()
+{
+    // F000:EFFF IS THE LAST BYTE BEFORE THE CONSOLE PAGE, THE HIGH BYTE IS ITS DATA REGISTER
+    CPU cpu;
+    cpu.regs.DS = 0xF000;
+    cpu.regs.AX = 0x4142;
+    execute(cpu, {OP_MOV_MEM_IMM_FROM_REG, REG_AX, 0xFF, 0xEF});
+    CHECK_EQ(cpu.memory.read8(0xFEFFF), 0x42);
+    CHECK(cpu.console->take_output() == "A");
+}
+
+static void test_word_wrapping_the_offset()
+{
+    // FF01:FFFF IS PLAIN RAM AT 0x0F00F, ITS HIGH BYTE WRAPS TO FF01:0000 = 0xFF010 ON THE
+    // CONSOLE PAGE. NEITHER IS THE LAST BYTE OF A PAGE
+    const uint32_t low = Memory::physical(0xFF01, 0xFFFF);
+    const uint32_t high = Memory::physical(0xFF01, 0);
+    CHECK_EQ(low, 0x0F00F);
+    CHECK_EQ(high, 0xFF010);
+
+    CPU cpu;
+    RingBufferSink<16> sink;
+    cpu.set_event_sink(&sink);
+    cpu.regs.DS = 0xFF01;
+    cpu.regs.AX = 0x4142;
+    execute(cpu, {OP_MOV_MEM_IMM_FROM_REG, REG_AX, 0xFF, 0xFF});
+    CHECK_EQ(cpu.memory.read8(low), 0x42);
+    CHECK_EQ(cpu.memory.read8(high), 0); // NOT WRITTEN TO THE RAM UNDER THE DEVICE
+    CHECK_EQ(mmio_events(sink, EVENT_MMIO_WRITE, high), 1);
+
+    sink.clear();
+    execute(cpu, {OP_MOV_REG_FROM_MEM_IMM, REG_BX, 0xFF, 0xFF});
+    CHECK_EQ(cpu.regs.BL, 0x42);
+    CHECK_EQ(mmio_events(sink, EVENT_MMIO_READ, high), 1);
+}
+
+int main()
+{
+    test_word_across_page_end();
+    test_word_wrapping_the_offset();
+    return check_report();
+}
@@ -0,0 +1,67 @@
+#include "check.h"
+#include "parser.h"
+#include "util.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == INCLUDE: THE PROCESS-WIDE CACHE OF INCLUDED FILES
+// ===============================================================
+// EVERY Parser SHARES IT. A REWRITTEN FILE (NEW MTIME) MUST BE READ AGAIN, AND MORE FILES THAN
+// IT HOLDS MUST STILL ASSEMBLE: THE OLDEST ONES ARE DROPPED AND READ AGAIN WHEN NEEDED.
+namespace fs = std::filesystem;
+
+static std::vector<uint8_t> assemble(const fs::path &dir, const std::string &source)
+{
+    Parser parser;
+    parser.set_include_dir(dir.string());
+    std::vector<uint8_t> code = parser.parse_from_string(source);
+    CHECK(parser.get_last_error().empty());
+    return code;
+}
+
+static void test_rewritten_include(const fs::path &dir)
+{
+    const fs::path lib = dir / "lib.asm";
+    write_file(lib, "MOV AX, 0x1111 ; FIRST\n");
+    const std::vector<uint8_t> first = assemble(dir, "INCLUDE \"lib.asm\"\nHALT\n");
+    CHECK_EQ(first.size(), 5);
+    CHECK_EQ(first[2], 0x11);
+
+    // SAME PATH, NEW CONTENT AND A DIFFERENT MTIME
+    write_file(lib, "MOV AX, 0x2222\n");
+    fs::last_write_time(lib, fs::last_write_time(lib) + std::chrono::seconds(5));
+    const std::vector<uint8_t> second = assemble(dir, "INCLUDE \"lib.asm\"\nHALT\n");
+    CHECK_EQ(second.size(), 5);
+    CHECK_EQ(second[2], 0x22);
+}
+
+static void test_more_files_than_cached(const fs::path &dir)
+{
+    const int FILES = 200;
+    for (int i = 0; i < FILES; i++)
+        write_file(dir / ("f" + std::to_string(i) + ".asm"), "MOV AX, " + std::to_string(i) + "\n");
+
+    // TWICE, SO THE SECOND ROUND FINDS THE FIRST FILES EVICTED
+    for (int round = 0; round < 2; round++)
+        for (int i = 0; i < FILES; i++)
+        {
+            const std::vector<uint8_t> code = assemble(dir, "INCLUDE \"f" + std::to_string(i) + ".asm\"\n");
+            if (!CHECK_EQ(code.size(), 4) || !CHECK_EQ(code[2], i))
+                return;
+        }
+}
+
+int main()
+{
+    const fs::path dir = fs::temp_directory_path() / "x86_test_include";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    test_rewritten_include(dir);
+    test_more_files_than_cached(dir);
+    fs::remove_all(dir);
+    return check_report();
+}
@@ -0,0 +1,199 @@
+#include "check.h"
+#include "lockstep.h"
+#include "opcodes.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+// ===============================================================
+// == LOCKSTEP LANES AGAINST INDEPENDENT CPUs
+// ===============================================================
+// RANDOM PROGRAMS MOSTLY MADE OF THE INSTRUCTIONS THE VECTOR LOOPS RUN (16-BIT ALU, INC/DEC/
+// NOT/NEG, Jcc, LOOPs) WITH SOME THAT GO THROUGH CPU::step() (STACK, MEMORY, FLAG SETTERS).
+// SOME LANES SINGLE-STEP (TF) OR TAKE TIMER INTERRUPTS, SO LANES LEAVE AND REJOIN THE GROUP.
+// EVERY LANE MUST END EXACTLY LIKE A CPU THAT RAN THE SAME PROGRAM ON ITS OWN.
+static const int PROGRAMS = 400;
+
+static std::mt19937 random_source(43);
+
+static uint8_t dest16()
+{
+    static const uint8_t REGS[] = {REG_AX, REG_BX, REG_CX, REG_DX, REG_MNK, REG_SI, REG_DI, REG_BP};
+    return REGS[random_source() % sizeof(REGS)];
+}
+
+static uint8_t source16()
+{
+    static const uint8_t REGS[] = {REG_AX, REG_BX, REG_CX, REG_DX, REG_MNK, REG_SP, REG_SI, REG_DI, REG_BP};
+    return REGS[random_source() % sizeof(REGS)];
+}
+
+static std::vector<uint8_t> random_program(int count)
+{
+    static const uint8_t REG_REG[] = {OP_MOV_REG_REG, OP_ADD_REG_REG, OP_ADC_REG_REG, OP_SUB_REG_REG, OP_SBB_REG_REG,
+                                      OP_CMP_REG_REG, OP_AND_REG_REG, OP_OR_REG_REG, OP_XOR_REG_REG};
+    static const uint8_t REG_IMM[] = {OP_MOV_REG_IMM, OP_ADD_REG_IMM, OP_ADC_REG_IMM, OP_SUB_REG_IMM, OP_SBB_REG_IMM,
+                                      OP_CMP_REG_IMM, OP_AND_REG_IMM, OP_OR_REG_IMM, OP_XOR_REG_IMM};
+    static const uint8_t UNARY[] = {OP_INC_REG, OP_DEC_REG, OP_NOT_REG, OP_NEG_REG16};
+    static const uint8_t BRANCH[] = {OP_JMP, OP_JZ, OP_JNZ, OP_JC, OP_JNC, OP_JS, OP_JNS, OP_JO, OP_JNO, OP_JA,
+                                     OP_JBE, OP_JG, OP_JGE, OP_JL, OP_JLE, OP_JCXZ, OP_LOOP, OP_LOOPZ, OP_LOOPNZ};
+    auto pick = [](const uint8_t *list, size_t size) { return list[random_source() % size]; };
+
+    std::vector<std::vector<uint8_t>> program;
+    for (int i = 0; i < count; i++)
+    {
+        const unsigned kind = random_source() % 20;
+        const uint16_t imm = random_source() % 3 ? random_source() : (random_source() % 2 ? 0x7FFF : 0x8000);
+        const uint8_t lo = imm & 0xFF, hi = imm >> 8;
+        const uint8_t data = 0x80 + random_source() % 32; // WORDS AT 0x2080..0x209F
+        if (kind < 5)
+            program.push_back({pick(REG_REG, sizeof(REG_REG)), dest16(), source16()});
+        else if (kind < 9)
+            program.push_back({pick(REG_IMM, sizeof(REG_IMM)), dest16(), lo, hi});
+        else if (kind < 11)
+            program.push_back({pick(UNARY, sizeof(UNARY)), dest16()});
+        else if (kind < 14)
+            program.push_back({pick(BRANCH, sizeof(BRANCH)), 0, 0}); // TARGET BELOW
+        else if (kind == 14)
+            program.push_back({OP_NOP});
+        else if (kind == 15)
+        {
+            program.push_back({OP_PUSH_REG, source16()});
+            program.push_back({OP_POP_REG, dest16()});
+        }
+        else if (kind == 16)
+            program.push_back({OP_ADD_REG8_REG8, static_cast<uint8_t>(random_source() % 8), static_cast<uint8_t>(random_source() % 8)});
+        else if (kind == 17)
+            program.push_back({OP_MOV_MEM_IMM_FROM_REG, source16(), data, 0x20});
+        else if (kind == 18)
+            program.push_back({OP_MOV_REG_FROM_MEM_IMM, dest16(), data, 0x20});
+        else
+            program.push_back({static_cast<uint8_t>(OP_CLC + random_source() % 3)});
+    }
+    program.push_back({OP_HALT});
+
+    // FORWARD BRANCHES ONLY, SO EVERY PROGRAM ENDS
+    std::vector<uint16_t> at;
+    uint16_t size = 0;
+    for (const auto &ins : program)
+    {
+        at.push_back(size);
+        size += ins.size();
+    }
+    for (size_t i = 0; i < program.size(); i++)
+        if (OPCODE_TABLE[program[i][0]].layout == LAYOUT_ADDR16)
+        {
+            size_t target = std::min(i + 1 + random_source() % 6, program.size() - 1);
+            program[i][1] = at[target] & 0xFF;
+            program[i][2] = at[target] >> 8;
+        }
+
+    std::vector<uint8_t> code;
+    for (const auto &ins : program)
+        code.insert(code.end(), ins.begin(), ins.end());
+    return code;
+}
+
+struct LaneSetup
+{
+    uint16_t ax, bx, cx, dx, si, di, bp, flags;
+    bool trap;    // TF: INT 1 AFTER EVERY INSTRUCTION
+    bool timer;   // IF AND A PERIODIC TIMER: INT 8 EVERY FEW INSTRUCTIONS
+    uint16_t period;
+};
+
+static LaneSetup random_setup()
+{
+    LaneSetup s;
+    s.ax = random_source(), s.bx = random_source(), s.cx = random_source() % 4, s.dx = random_source();
+    s.si = random_source(), s.di = random_source(), s.bp = random_source();
+    s.flags = random_source() & ~(Flags::BIT_TF | Flags::BIT_IF);
+    s.trap = random_source() % 10 == 0;
+    s.timer = random_source() % 4 == 0;
+    s.period = 12 + random_source() % 40;
+    return s;
+}
+
+static void apply(CPU &cpu, const LaneSetup &s)
+{
+    cpu.regs.AX = s.ax, cpu.regs.BX = s.bx, cpu.regs.CX = s.cx, cpu.regs.DX = s.dx;
+    cpu.regs.SI = s.si, cpu.regs.DI = s.di, cpu.regs.BP = s.bp;
+    cpu.regs.SP = 0xFFF0;
+    cpu.flags.set_word(s.flags);
+    cpu.flags.TF = s.trap;
+
+    // INT 1 -> 0040:F000 IRET, INT 8 -> 0040:F100 ACKNOWLEDGE THE TIMER, INC DI, IRET
+    cpu.memory.write16(1 * 4, 0xF000);
+    cpu.memory.write16(1 * 4 + 2, PROGRAM_SEGMENT);
+    cpu.memory.write8(Memory::physical(PROGRAM_SEGMENT, 0xF000), OP_IRET);
+    const uint8_t handler[] = {OP_OUT_PORT_REG8, REG_AL, PORT_TIMER + TimerDevice::STATUS, OP_INC_REG, REG_DI, OP_IRET};
+    cpu.memory.load(Memory::physical(PROGRAM_SEGMENT, 0xF100), handler, sizeof(handler));
+    cpu.memory.write16(8 * 4, 0xF100);
+    cpu.memory.write16(8 * 4 + 2, PROGRAM_SEGMENT);
+    if (s.timer)
+    {
+        cpu.timer->write(TimerDevice::RELOAD_LO, s.period, 0);
+        cpu.timer->write(TimerDevice::CONTROL, TimerDevice::ENABLE | TimerDevice::PERIODIC, 0);
+        cpu.flags.IF = true;
+    }
+}
+
+static bool same_state(CPU &lane, CPU &ref)
+{
+    const Registers &x = lane.regs, &y = ref.regs;
+    if (x.AX != y.AX || x.BX != y.BX || x.CX != y.CX || x.DX != y.DX || x.MNK != y.MNK || x.SP != y.SP ||
+        x.BP != y.BP || x.SI != y.SI || x.DI != y.DI || x.IP != y.IP || x.CS != y.CS)
+        return false;
+    if (lane.flags.word() != ref.flags.word() || lane.instructions != ref.instructions)
+        return false;
+    if (lane.pic->pending(lane.instructions) != ref.pic->pending(ref.instructions))
+        return false;
+    for (uint32_t offset = 0; offset < Memory::SEGMENT_SIZE; offset++)
+        if (lane.memory.read8(PROGRAM_SEGMENT, offset) != ref.memory.read8(PROGRAM_SEGMENT, offset))
+            return false;
+    return true;
+}
+
+int main()
+{
+    uint64_t vector_total = 0;
+    for (int n = 0; n < PROGRAMS; n++)
+    {
+        const std::vector<uint8_t> code = random_program(10 + random_source() % 60);
+        const int lanes = 1 + random_source() % LockstepEngine::LANES;
+
+        LockstepEngine engine(lanes);
+        engine.load_program(code.data(), code.size());
+        std::vector<std::unique_ptr<CPU>> reference;
+        for (int l = 0; l < lanes; l++)
+        {
+            const LaneSetup setup = random_setup();
+            apply(engine.lane(l), setup);
+            reference.push_back(std::make_unique<CPU>());
+            reference.back()->load_program(code.data(), code.size());
+            apply(*reference.back(), setup);
+        }
+
+        // HALF THE PROGRAMS STOP PART WAY AND GO ON, WHICH MUST NOT CHANGE ANYTHING
+        int left = engine.run(n % 2 ? UINT64_MAX : 50 + random_source() % 50);
+        if (left)
+            left = engine.run(2000000);
+        CHECK_EQ(left, 0);
+
+        for (int l = 0; l < lanes; l++)
+        {
+            CPU &ref = *reference[l];
+            for (int steps = 0; steps < 2000000 && ref.step(); steps++)
+            {
+            }
+            if (!CHECK(same_state(engine.lane(l), ref)))
+                std::printf("    PROGRAM %d, LANE %d OF %d: IP %04X/%04X AX %04X/%04X\n", n, l, lanes,
+                            engine.lane(l).regs.IP, ref.regs.IP, engine.lane(l).regs.AX, ref.regs.AX);
+        }
+        vector_total += engine.vector_instructions();
+    }
+    CHECK(vector_total > 0); // THE VECTOR LOOPS DID RUN
+    return check_report();
+}
@@ -0,0 +1,78 @@
+#include "check.h"
+#include "cpu.h"
+#include "objfile.h"
+#include "parser.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == OBJECT FILES: WRITE, LOAD AT A BASE, RUN
+// ===============================================================
+// ObjectFile::load() MUST PUT THE PROGRAM WHERE CPU::load_program() WOULD (PROGRAM_SEGMENT,
+// NEVER OVER THE VECTOR TABLE), RELOCATE BRANCH TARGETS BY base AND LEAVE THE CPU READY TO RUN.
+static const char *const SOURCE = "JMP start\n"
+                                  "HALT\n"
+                                  "start:\n"
+                                  "MOV AX, 0x1234\n"
+                                  "HALT\n";
+
+static std::string write_object()
+{
+    Parser parser;
+    std::vector<uint8_t> code = parser.parse_from_string(SOURCE);
+    CHECK(parser.get_last_error().empty());
+    CHECK_EQ(parser.get_relocations().size(), 1);
+
+    const std::string path = (std::filesystem::temp_directory_path() / "x86_test_objfile.x86o").string();
+    ObjectFile object;
+    CHECK(object.write(path, ObjectFile::from_assembly(code, parser)));
+    return path;
+}
+
+static void test_load_at(const std::string &path, uint16_t base)
+{
+    CPU cpu;
+    ObjectFile object;
+    if (!CHECK(object.load(path, cpu, base)))
+    {
+        std::printf("    %s\n", object.get_last_error().c_str());
+        return;
+    }
+
+    CHECK_EQ(cpu.regs.CS, PROGRAM_SEGMENT);
+    CHECK_EQ(cpu.regs.DS, PROGRAM_SEGMENT);
+    CHECK_EQ(cpu.regs.SS, PROGRAM_SEGMENT);
+    CHECK_EQ(cpu.regs.IP, base);
+    for (uint32_t address = 0; address < Memory::physical(PROGRAM_SEGMENT, 0); address++)
+        if (!CHECK_EQ(cpu.memory.read8(address), 0)) // THE VECTOR TABLE IS UNTOUCHED
+            break;
+
+    // JMP start (3 BYTES) + HALT: start IS AT 4, RELOCATED BY base
+    CHECK_EQ(cpu.memory.read8(PROGRAM_SEGMENT, base), OP_JMP);
+    CHECK_EQ(cpu.memory.read16(PROGRAM_SEGMENT, base + 1), base + 4);
+
+    cpu.run();
+    CHECK_EQ(cpu.regs.AX, 0x1234);
+    CHECK_EQ(cpu.regs.IP, base + 8);
+}
+
+static void test_segment_outside_program_segment(const std::string &path)
+{
+    CPU cpu;
+    ObjectFile object;
+    CHECK(!object.load(path, cpu, 0xFFFC)); // 9 BYTES FROM FFFC DO NOT FIT
+    CHECK(!object.get_last_error().empty());
+}
+
+int main()
+{
+    const std::string path = write_object();
+    test_load_at(path, 0);
+    test_load_at(path, 0x100);
+    test_load_at(path, 0x1234);
+    test_segment_outside_program_segment(path);
+    std::filesystem::remove(path);
+    return check_report();
+}
@@ -0,0 +1,480 @@
+#include "check.h"
+#include "cpu.h"
+#include "disassembler.h"
+#include "opcodes.h"
+#include "parser.h"
+
+#include <cstring>
+#include <vector>
+
+// ===============================================================
+// == GOLDEN PER-OPCODE TESTS
+// ===============================================================
+// EVERY CASE WRITES ONE INSTRUCTION AT PROGRAM_SEGMENT:0000, SETS THE REGISTERS AND CF,
+// STEPS IT ONCE AND COMPARES THE RESULT AND THE STATUS FLAGS WITH THE EXPECTED ONES.
+static const uint16_t CF = Flags::BIT_CF;
+static const uint16_t ZF = Flags::BIT_ZF;
+static const uint16_t SF = Flags::BIT_SF;
+static const uint16_t OF = Flags::BIT_OF;
+static const uint16_t STATUS = CF | ZF | SF | OF;
+
+static bool execute(CPU &cpu, const std::vector<uint8_t> &code)
+{
+    cpu.memory.load(Memory::physical(PROGRAM_SEGMENT, 0), code.data(), code.size());
+    cpu.regs.CS = PROGRAM_SEGMENT;
+    cpu.regs.IP = 0;
+    bool executed = cpu.step();
+    CHECK_EQ(cpu.regs.IP, OPCODE_TABLE[code[0]].length);
+    return executed;
+}
+
+// THE DESTINATION IS ALWAYS AX/AL, A REGISTER SOURCE IS BX/BL
+static std::vector<uint8_t> encode(uint8_t opcode, uint16_t src)
+{
+    switch (OPCODE_TABLE[opcode].layout)
+    {
+    case LAYOUT_R16_R16:
+        return {opcode, REG_AX, REG_BX};
+    case LAYOUT_R8_R8:
+        return {opcode, REG_AL, REG_BL};
+    case LAYOUT_R16_I16:
+        return {opcode, REG_AX, static_cast<uint8_t>(src & 0xFF), static_cast<uint8_t>(src >> 8)};
+    case LAYOUT_R8_I8:
+        return {opcode, REG_AL, static_cast<uint8_t>(src)};
+    case LAYOUT_R16:
+        return {opcode, REG_AX};
+    case LAYOUT_R8:
+        return {opcode, REG_AL};
+    default:
+        return {opcode};
+    }
+}
+
+static bool is_8bit(uint8_t opcode)
+{
+    OperandLayout layout = OPCODE_TABLE[opcode].layout;
+    return layout == LAYOUT_R8_R8 || layout == LAYOUT_R8_I8 || layout == LAYOUT_R8 || layout == LAYOUT_R8_CL;
+}
+
+// ===============================================================
+// == ADD / ADC / SUB / SBB / CMP / NEG / INC / DEC
+// ===============================================================
+struct ArithCase
+{
+    uint8_t opcode;
+    uint16_t dest;
+    uint16_t src;
+    bool carry_in;
+    uint16_t result;
+    uint16_t status; // CF ZF SF OF AFTER THE INSTRUCTION
+};
+
+static const ArithCase ARITH_CASES[] = {
+    // update_flags_add, 16-BIT
+    {OP_ADD_REG_REG, 0x7FFF, 0x0001, false, 0x8000, SF | OF},
+    {OP_ADD_REG_REG, 0xFFFF, 0x0001, false, 0x0000, CF | ZF},
+    {OP_ADD_REG_REG, 0x8000, 0x8000, false, 0x0000, CF | ZF | OF},
+    {OP_ADD_REG_REG, 0xFFFF, 0xFFFF, false, 0xFFFE, CF | SF},
+    {OP_ADD_REG_REG, 0x7FFF, 0x7FFF, false, 0xFFFE, SF | OF},
+    {OP_ADD_REG_REG, 0x8000, 0xFFFF, false, 0x7FFF, CF | OF},
+    {OP_ADD_REG_REG, 0x0000, 0x0000, true, 0x0000, ZF},
+    {OP_ADD_REG_IMM, 0x7FFF, 0x0001, false, 0x8000, SF | OF},
+    {OP_ADD_REG_IMM, 0xFFFF, 0x0001, false, 0x0000, CF | ZF},
+    {OP_ADC_REG_REG, 0xFFFF, 0x0000, true, 0x0000, CF | ZF},
+    {OP_ADC_REG_REG, 0x7FFF, 0x0000, true, 0x8000, SF | OF},
+    {OP_ADC_REG_REG, 0xFFFF, 0xFFFF, true, 0xFFFF, CF | SF},
+    {OP_ADC_REG_IMM, 0xFFFE, 0x0001, true, 0x0000, CF | ZF},
+    {OP_ADC_REG_IMM, 0x1234, 0x0000, false, 0x1234, 0},
+
+    // update_flags_add, 8-BIT
+    {OP_ADD_REG8_REG8, 0x7F, 0x01, false, 0x80, SF | OF},
+    {OP_ADD_REG8_REG8, 0xFF, 0x01, false, 0x00, CF | ZF},
+    {OP_ADD_REG8_REG8, 0x80, 0x80, false, 0x00, CF | ZF | OF},
+    {OP_ADD_REG8_REG8, 0xFF, 0xFF, false, 0xFE, CF | SF},
+    {OP_ADD_REG8_REG8, 0x7F, 0x7F, false, 0xFE, SF | OF},
+    {OP_ADD_REG8_REG8, 0x80, 0xFF, false, 0x7F, CF | OF},
+    {OP_ADD_REG8_IMM, 0x7F, 0x01, false, 0x80, SF | OF},
+    {OP_ADD_REG8_IMM, 0xFF, 0x01, false, 0x00, CF | ZF},
+    {OP_ADC_REG8_REG8, 0xFF, 0x00, true, 0x00, CF | ZF},
+    {OP_ADC_REG8_REG8, 0x7F, 0x00, true, 0x80, SF | OF},
+    {OP_ADC_REG8_IMM, 0xFF, 0xFF, true, 0xFF, CF | SF},
+
+    // update_flags_sub, 16-BIT
+    {OP_SUB_REG_REG, 0x0000, 0x0001, false, 0xFFFF, CF | SF},
+    {OP_SUB_REG_REG, 0x8000, 0x0001, false, 0x7FFF, OF},
+    {OP_SUB_REG_REG, 0x7FFF, 0xFFFF, false, 0x8000, CF | SF | OF},
+    {OP_SUB_REG_REG, 0x0000, 0x8000, false, 0x8000, CF | SF | OF},
+    {OP_SUB_REG_REG, 0x1234, 0x1234, true, 0x0000, ZF},
+    {OP_SUB_REG_REG, 0x8000, 0x8000, false, 0x0000, ZF},
+    {OP_SUB_REG_IMM, 0x0000, 0x0001, false, 0xFFFF, CF | SF},
+    {OP_SUB_REG_IMM, 0x8000, 0x0001, false, 0x7FFF, OF},
+    {OP_SBB_REG_REG, 0x0000, 0x0000, true, 0xFFFF, CF | SF},
+    {OP_SBB_REG_REG, 0x8000, 0x0000, true, 0x7FFF, OF},
+    {OP_SBB_REG_IMM, 0x0005, 0x0004, true, 0x0000, ZF},
+    {OP_CMP_REG_REG, 0x0001, 0x0002, false, 0x0001, CF | SF},
+    {OP_CMP_REG_REG, 0x8000, 0x0001, false, 0x8000, OF},
+    {OP_CMP_REG_IMM, 0x4321, 0x4321, false, 0x4321, ZF},
+    {OP_NEG_REG16, 0x0000, 0, true, 0x0000, ZF},
+    {OP_NEG_REG16, 0x0001, 0, false, 0xFFFF, CF | SF},
+    {OP_NEG_REG16, 0x8000, 0, false, 0x8000, CF | SF | OF},
+
+    // update_flags_sub, 8-BIT
+    {OP_SUB_REG8_REG8, 0x00, 0x01, false, 0xFF, CF | SF},
+    {OP_SUB_REG8_REG8, 0x80, 0x01, false, 0x7F, OF},
+    {OP_SUB_REG8_REG8, 0x7F, 0xFF, false, 0x80, CF | SF | OF},
+    {OP_SUB_REG8_REG8, 0x00, 0x80, false, 0x80, CF | SF | OF},
+    {OP_SUB_REG8_IMM, 0x42, 0x42, true, 0x00, ZF},
+    {OP_SBB_REG8_REG8, 0x00, 0x00, true, 0xFF, CF | SF},
+    {OP_SBB_REG8_IMM, 0x80, 0x00, true, 0x7F, OF},
+    {OP_CMP_REG8_REG8, 0x01, 0x02, false, 0x01, CF | SF},
+    {OP_CMP_REG8_IMM, 0x80, 0x01, false, 0x80, OF},
+    {OP_NEG_REG8, 0x00, 0, true, 0x00, ZF},
+    {OP_NEG_REG8, 0x80, 0, false, 0x80, CF | SF | OF},
+
+    // update_flags_inc / update_flags_dec: CF IS LEFT AS IT WAS
+    {OP_INC_REG, 0x7FFF, 0, false, 0x8000, SF | OF},
+    {OP_INC_REG, 0x7FFF, 0, true, 0x8000, CF | SF | OF},
+    {OP_INC_REG, 0xFFFF, 0, false, 0x0000, ZF},
+    {OP_INC_REG, 0xFFFF, 0, true, 0x0000, CF | ZF},
+    {OP_INC_REG, 0x8000, 0, false, 0x8001, SF},
+    {OP_DEC_REG, 0x8000, 0, false, 0x7FFF, OF},
+    {OP_DEC_REG, 0x0000, 0, false, 0xFFFF, SF},
+    {OP_DEC_REG, 0x0001, 0, true, 0x0000, CF | ZF},
+    {OP_DEC_REG, 0x7FFF, 0, true, 0x7FFE, CF},
+    {OP_INC_REG8, 0x7F, 0, false, 0x80, SF | OF},
+    {OP_INC_REG8, 0xFF, 0, false, 0x00, ZF},
+    {OP_INC_REG8, 0xFF, 0, true, 0x00, CF | ZF},
+    {OP_DEC_REG8, 0x80, 0, false, 0x7F, OF},
+    {OP_DEC_REG8, 0x00, 0, true, 0xFF, CF | SF},
+    {OP_DEC_REG8, 0x01, 0, false, 0x00, ZF},
+};
+
+static void test_arithmetic(CPU &cpu)
+{
+    for (const ArithCase &c : ARITH_CASES)
+    {
+        cpu.start_program();
+        bool byte = is_8bit(c.opcode);
+        cpu.regs.AX = byte ? 0xA500 | c.dest : c.dest; // AH MUST SURVIVE AN 8-BIT OPERATION
+        cpu.regs.BX = byte ? 0x5A00 | c.src : c.src;
+        cpu.flags.assign(STATUS, c.carry_in ? CF : 0);
+
+        bool passed = CHECK(execute(cpu, encode(c.opcode, c.src)));
+        passed &= CHECK_EQ(byte ? cpu.regs.AL : cpu.regs.AX, c.result);
+        passed &= CHECK_EQ(cpu.flags.bits & STATUS, c.status);
+        if (byte)
+            passed &= CHECK_EQ(cpu.regs.AH, 0xA5);
+        if (!passed)
+            std::printf("    IN: %s dest=0x%X src=0x%X CF=%d\n", OPCODE_TABLE[c.opcode].mnemonic, c.dest, c.src, c.carry_in);
+    }
+}
+
+// ===============================================================
+// == SHIFTS AND ROTATES, COUNTS 0..32, IMMEDIATE AND CL FORMS
+// ===============================================================
+// THE EXPECTED VALUES COME FROM THE ONE-BIT-PER-ITERATION LOOPS THE CONSTANT TIME HANDLERS
+// REPLACED, SO EVERY COUNT IS CHECKED AGAINST AN INDEPENDENT MODEL
+enum ShiftKind
+{
+    KIND_SHL,
+    KIND_SHR,
+    KIND_SAR,
+    KIND_ROL,
+    KIND_ROR,
+    KIND_RCL,
+    KIND_RCR
+};
+
+struct ShiftOpcodes
+{
+    ShiftKind kind;
+    const char *name;
+    uint8_t imm16, cl16, imm8, cl8;
+};
+
+static const ShiftOpcodes SHIFT_OPCODES[] = {
+    {KIND_SHL, "SHL", OP_SHL_REG_IMM, OP_SHL_REG_CL, OP_SHL_REG8_IMM, OP_SHL_REG8_CL},
+    {KIND_SHR, "SHR", OP_SHR_REG_IMM, OP_SHR_REG_CL, OP_SHR_REG8_IMM, OP_SHR_REG8_CL},
+    {KIND_SAR, "SAR", OP_SAR_REG_IMM, OP_SAR_REG_CL, OP_SAR_REG8_IMM, OP_SAR_REG8_CL},
+    {KIND_ROL, "ROL", OP_ROL_REG_IMM, OP_ROL_REG_CL, OP_ROL_REG8_IMM, OP_ROL_REG8_CL},
+    {KIND_ROR, "ROR", OP_ROR_REG_IMM, OP_ROR_REG_CL, OP_ROR_REG8_IMM, OP_ROR_REG8_CL},
+    {KIND_RCL, "RCL", OP_RCL_REG_IMM, OP_RCL_REG_CL, OP_RCL_REG8_IMM, OP_RCL_REG8_CL},
+    {KIND_RCR, "RCR", OP_RCR_REG_IMM, OP_RCR_REG_CL, OP_RCR_REG8_IMM, OP_RCR_REG8_CL},
+};
+
+struct ShiftResult
+{
+    uint16_t value;
+    uint16_t status;
+};
+
+// flags_in IS THE STATUS BEFORE THE INSTRUCTION: ROTATES ONLY TOUCH CF AND OF
+static ShiftResult shift_model(ShiftKind kind, int bits, uint16_t value, unsigned count, uint16_t flags_in)
+{
+    const uint16_t mask = (1u << bits) - 1;
+    const uint16_t sign = 1u << (bits - 1);
+    uint16_t v = value & mask;
+    bool cf = flags_in & CF;
+    for (unsigned i = 0; i < count; i++)
+    {
+        bool out;
+        switch (kind)
+        {
+        case KIND_SHL:
+            v = (v << 1) & mask;
+            break;
+        case KIND_SHR:
+            v >>= 1;
+            break;
+        case KIND_SAR:
+            v = (v >> 1) | (v & sign);
+            break;
+        case KIND_ROL:
+            cf = v & sign;
+            v = ((v << 1) | cf) & mask;
+            break;
+        case KIND_ROR:
+            cf = v & 1;
+            v = (v >> 1) | (cf ? sign : 0);
+            break;
+        case KIND_RCL:
+            out = v & sign;
+            v = ((v << 1) | cf) & mask;
+            cf = out;
+            break;
+        case KIND_RCR:
+            out = v & 1;
+            v = (v >> 1) | (cf ? sign : 0);
+            cf = out;
+            break;
+        }
+    }
+
+    ShiftResult r{v, 0};
+    bool msb = v & sign;
+    bool next = v & (sign >> 1);
+    switch (kind)
+    {
+    case KIND_SHL:
+    case KIND_SHR:
+    case KIND_SAR:
+        // THE SHIFTS SET ZF/SF FROM THE RESULT AND CLEAR CF. OF ONLY MEANS SOMETHING AT COUNT 1
+        r.status = (v == 0 ? ZF : 0) | (msb ? SF : 0);
+        if (count == 1 && kind == KIND_SHL && msb)
+            r.status |= OF;
+        if (count == 1 && kind == KIND_SHR && (value & sign))
+            r.status |= OF;
+        break;
+    case KIND_ROL:
+    case KIND_RCL:
+        r.status = (flags_in & (ZF | SF | OF)) | (cf ? CF : 0);
+        if (count == 1)
+            r.status = (r.status & ~OF) | (msb != cf ? OF : 0);
+        break;
+    case KIND_ROR:
+    case KIND_RCR:
+        r.status = (flags_in & (ZF | SF | OF)) | (cf ? CF : 0);
+        if (count == 1)
+            r.status = (r.status & ~OF) | (msb != next ? OF : 0);
+        break;
+    }
+    return r;
+}
+
+static void test_shifts(CPU &cpu)
+{
+    static const uint16_t VALUES[] = {0x0000, 0x0001, 0x8000, 0x8001, 0x4000, 0x7FFF, 0xFFFF, 0xA5C3, 0x1234};
+    static const uint16_t FLAGS_IN[] = {0, CF, ZF | SF | OF, CF | ZF | SF | OF};
+
+    for (const ShiftOpcodes &op : SHIFT_OPCODES)
+        for (int form = 0; form < 4; form++)
+        {
+            const bool byte = form >= 2;
+            const bool via_cl = form & 1;
+            const uint8_t opcode = byte ? (via_cl ? op.cl8 : op.imm8) : (via_cl ? op.cl16 : op.imm16);
+            const int bits = byte ? 8 : 16;
+            const bool rotate = op.kind >= KIND_ROL;
+
+            for (unsigned count = 0; count <= 32; count++)
+                for (uint16_t value : VALUES)
+                    for (uint16_t flags_in : FLAGS_IN)
+                    {
+                        cpu.start_program();
+                        cpu.regs.AX = byte ? 0xA500 | (value & 0xFF) : value;
+                        cpu.regs.CX = via_cl ? count : 0xCC00;
+                        cpu.flags.assign(STATUS, flags_in);
+                        std::vector<uint8_t> code = {opcode, REG_AX};
+                        if (!via_cl)
+                            code.push_back(static_cast<uint8_t>(count));
+
+                        // THE 8-BIT ROTATE IMMEDIATES ONLY ENCODE COUNTS 0..31
+                        unsigned effective = (byte && rotate && !via_cl) ? count & 0x1F : count;
+                        ShiftResult expected = shift_model(op.kind, bits, value, effective, flags_in);
+
+                        bool passed = CHECK(execute(cpu, code));
+                        passed &= CHECK_EQ(byte ? cpu.regs.AL : cpu.regs.AX, expected.value);
+                        passed &= CHECK_EQ(cpu.flags.bits & STATUS, expected.status);
+                        if (byte)
+                            passed &= CHECK_EQ(cpu.regs.AH, 0xA5);
+                        if (!passed)
+                            std::printf("    IN: %s%s %s, %u value=0x%X flags=0x%X\n", op.name, byte ? "8" : "",
+                                        via_cl ? "CL" : "imm", count, value, flags_in);
+                    }
+        }
+}
+
+// A FEW ABSOLUTE VALUES, SO A BUG SHARED BY THE HANDLERS AND shift_model CANNOT HIDE
+static void test_shift_golden_values(CPU &cpu)
+{
+    struct Golden
+    {
+        uint8_t opcode;
+        uint16_t value;
+        uint8_t count;
+        bool carry_in;
+        uint16_t result;
+        uint16_t status;
+    };
+    static const Golden GOLDEN[] = {
+        {OP_SHL_REG_IMM, 0x4001, 1, false, 0x8002, SF | OF},
+        {OP_SHL_REG_IMM, 0xFFFF, 16, true, 0x0000, ZF},
+        {OP_SHR_REG_IMM, 0x8000, 1, false, 0x4000, OF},
+        {OP_SHR_REG_IMM, 0x8000, 15, false, 0x0001, 0},
+        {OP_SAR_REG_IMM, 0x8000, 15, false, 0xFFFF, SF},
+        {OP_SAR_REG_IMM, 0x8000, 32, false, 0xFFFF, SF},
+        {OP_SAR_REG8_IMM, 0x40, 7, false, 0x00, ZF},
+        {OP_ROL_REG_IMM, 0x8001, 1, false, 0x0003, CF | OF},
+        {OP_ROL_REG_IMM, 0x1234, 16, false, 0x1234, 0},
+        {OP_ROR_REG_IMM, 0x0001, 1, false, 0x8000, CF | OF},
+        {OP_ROR_REG8_IMM, 0x01, 4, false, 0x10, 0},
+        {OP_RCL_REG_IMM, 0x8001, 1, false, 0x0002, CF | OF},
+        {OP_RCL_REG_IMM, 0x0000, 1, true, 0x0001, 0},
+        {OP_RCL_REG_IMM, 0x1234, 17, true, 0x1234, CF},
+        {OP_RCR_REG_IMM, 0x0001, 1, false, 0x0000, CF},
+        {OP_RCR_REG_IMM, 0x0000, 1, true, 0x8000, OF},
+        {OP_RCL_REG8_IMM, 0x80, 9, false, 0x80, 0},
+        {OP_RCR_REG8_IMM, 0x01, 2, false, 0x80, 0},
+    };
+    for (const Golden &g : GOLDEN)
+    {
+        cpu.start_program();
+        bool byte = is_8bit(g.opcode);
+        cpu.regs.AX = g.value;
+        cpu.flags.assign(STATUS, g.carry_in ? CF : 0);
+        bool passed = CHECK(execute(cpu, {g.opcode, REG_AX, g.count}));
+        passed &= CHECK_EQ(byte ? cpu.regs.AL : cpu.regs.AX, g.result);
+        passed &= CHECK_EQ(cpu.flags.bits & STATUS, g.status);
+        if (!passed)
+            std::printf("    IN: %s 0x%X, %u CF=%d\n", OPCODE_TABLE[g.opcode].mnemonic, g.value, g.count, g.carry_in);
+    }
+}
+
+// ===============================================================
+// == [BX+SI] AND [reg+imm] ADDRESSING
+// ===============================================================
+static void test_register_pair_addressing(CPU &cpu)
+{
+    // MOV [BX+SI], AX THEN MOV CX, [BX+SI]
+    cpu.start_program();
+    cpu.regs.AX = 0xBEEF;
+    cpu.regs.BX = 0x1000;
+    cpu.regs.SI = 0x0234;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_REG_FROM_REG, REG_AX, REG_BX, REG_SI}));
+    CHECK_EQ(cpu.memory.read16(PROGRAM_SEGMENT, 0x1234), 0xBEEF);
+    CHECK(execute(cpu, {OP_MOV_REG_FROM_MEM_REG_REG, REG_CX, REG_BX, REG_SI}));
+    CHECK_EQ(cpu.regs.CX, 0xBEEF);
+
+    // THE SUM WRAPS AT 64 KiB INSIDE DS
+    cpu.regs.BX = 0xFFFF;
+    cpu.regs.SI = 0x0003;
+    cpu.regs.AX = 0x1357;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_REG_FROM_REG, REG_AX, REG_BX, REG_SI}));
+    CHECK_EQ(cpu.memory.read16(PROGRAM_SEGMENT, 0x0002), 0x1357);
+
+    // [BP+SI] AND [SI+BP] ADDRESS THE STACK SEGMENT
+    cpu.regs.SS = 0x2000;
+    cpu.regs.BP = 0x0010;
+    cpu.regs.SI = 0x0002;
+    cpu.regs.AX = 0xCAFE;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_REG_FROM_REG, REG_AX, REG_BP, REG_SI}));
+    CHECK_EQ(cpu.memory.read16(0x2000, 0x0012), 0xCAFE);
+    CHECK(execute(cpu, {OP_MOV_REG_FROM_MEM_REG_REG, REG_DX, REG_SI, REG_BP}));
+    CHECK_EQ(cpu.regs.DX, 0xCAFE);
+    CHECK(cpu.memory.read16(PROGRAM_SEGMENT, 0x0012) != 0xCAFE);
+}
+
+static void test_register_displacement_addressing(CPU &cpu)
+{
+    // MOV [BX+0x0010], AX / MOV DX, [BX+0x0010]
+    cpu.start_program();
+    cpu.regs.AX = 0x2468;
+    cpu.regs.BX = 0x3000;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_IMM_FROM_REG, REG_AX, REG_BX, 0x10, 0x00}));
+    CHECK_EQ(cpu.memory.read16(PROGRAM_SEGMENT, 0x3010), 0x2468);
+    CHECK(execute(cpu, {OP_MOV_REG_FROM_MEM_REG_IMM, REG_DX, REG_BX, 0x10, 0x00}));
+    CHECK_EQ(cpu.regs.DX, 0x2468);
+
+    // 8-BIT, HIGH BYTE OF THE WORD ABOVE
+    CHECK(execute(cpu, {OP_MOV_REG8_FROM_MEM_REG_IMM, REG_CH, REG_BX, 0x11, 0x00}));
+    CHECK_EQ(cpu.regs.CH, 0x24);
+    cpu.regs.DL = 0x99;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_IMM_FROM_REG8, REG_DL, REG_BX, 0x20, 0x00}));
+    CHECK_EQ(cpu.memory.read8(PROGRAM_SEGMENT, 0x3020), 0x99);
+
+    // A NEGATIVE DISPLACEMENT IS A 16-BIT WRAP
+    cpu.regs.SI = 0x0010;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_IMM_FROM_REG, REG_AX, REG_SI, 0xFE, 0xFF}));
+    CHECK_EQ(cpu.memory.read16(PROGRAM_SEGMENT, 0x000E), 0x2468);
+
+    // [BP+imm] ADDRESSES THE STACK SEGMENT
+    cpu.regs.SS = 0x3000;
+    cpu.regs.BP = 0x0100;
+    CHECK(execute(cpu, {OP_MOV_MEM_REG_IMM_FROM_REG, REG_AX, REG_BP, 0x04, 0x00}));
+    CHECK_EQ(cpu.memory.read16(0x3000, 0x0104), 0x2468);
+    CHECK_EQ(cpu.memory.read16(PROGRAM_SEGMENT, 0x0104), 0x0000);
+}
+
+// THE ASSEMBLER AND DISASSEMBLER AGREE WITH THE ENCODINGS ABOVE, AND A LABEL AFTER A
+// MEMORY OPERAND LANDS WHERE THE SECOND PASS PUT IT
+static void test_addressing_round_trip()
+{
+    Parser parser;
+    std::vector<uint8_t> code = parser.parse_from_string(
+        "MOV AX, [BX+SI]\n"
+        "MOV [BX+0x10], AX\n"
+        "MOV DL, [BP+4]\n"
+        "JMP done\n"
+        "done:\n"
+        "HALT\n");
+    CHECK_EQ(parser.get_last_error().size(), 0);
+    const std::vector<uint8_t> expected = {
+        OP_MOV_REG_FROM_MEM_REG_REG, REG_AX, REG_BX, REG_SI,
+        OP_MOV_MEM_REG_IMM_FROM_REG, REG_AX, REG_BX, 0x10, 0x00,
+        OP_MOV_REG8_FROM_MEM_REG_IMM, REG_DL, REG_BP, 0x04, 0x00,
+        OP_JMP, 0x11, 0x00,
+        OP_HALT};
+    CHECK(code == expected);
+
+    static const char *const TEXT[] = {"MOV AX, [BX+SI]", "MOV [BX+0x0010], AX", "MOV DL, [BP+0x0004]", "JMP 0x0011", "HALT"};
+    size_t at = 0;
+    for (const char *text : TEXT)
+    {
+        char line[64];
+        at += Disassembler::decode(code.data() + at, line, sizeof(line));
+        if (!CHECK(std::strcmp(line, text) == 0))
+            std::printf("    GOT \"%s\", EXPECTED \"%s\"\n", line, text);
+    }
+    CHECK_EQ(at, code.size());
+}
+
+int main()
+{
+    CPU cpu;
+    test_arithmetic(cpu);
+    test_shifts(cpu);
+    test_shift_golden_values(cpu);
+    test_register_pair_addressing(cpu);
+    test_register_displacement_addressing(cpu);
+    test_addressing_round_trip();
+    return check_report();
+}
@@ -0,0 +1,122 @@
+#include "check.h"
+#include "cpu.h"
+#include "parser.h"
+#include "random_asm.h"
+#include "util.h"
+
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == ZERO-COPY ASSEMBLY: parse_into() AND load_file() AGAINST THE VECTOR PATH
+// ===============================================================
+// EVERY RANDOM SOURCE IS ASSEMBLED FIVE WAYS: parse_from_string(), parse() OF A FILE,
+// parse_into() A BUFFER AND A CPU'S MEMORY, AND load_file() (mmap) INTO A CPU. ALL MUST AGREE ON
+// THE ERROR, AND WITHOUT ONE ON THE CODE, THE LABELS AND THE RELOCATIONS.
+namespace fs = std::filesystem;
+
+static const int SOURCES = 200;
+static const int LARGE_SOURCES = 4; // CODE WELL PAST A PAGE
+
+static std::mt19937 random_source(49);
+
+static bool same_in_memory(const CPU &cpu, const std::vector<uint8_t> &code)
+{
+    for (size_t i = 0; i < code.size(); i++)
+        if (cpu.memory.read8(PROGRAM_SEGMENT, i) != code[i])
+            return false;
+    return true;
+}
+
+static void test_paths_agree(const fs::path &dir)
+{
+    static uint8_t buffer[Memory::SEGMENT_SIZE];
+    const fs::path file = dir / "program.asm";
+    Parser parser;
+    parser.set_include_dir(dir.string());
+    int assembled = 0;
+    for (int n = 0; n < SOURCES + LARGE_SOURCES; n++)
+    {
+        const int lines = n < SOURCES ? random_source() % 400 : 4000 + random_source() % 4000;
+        const std::string source = random_asm(random_source, lines, random_source() % 10 ? 0 : 1 + random_source() % 4);
+
+        const std::vector<uint8_t> code = parser.parse_from_string(source);
+        const std::string error = parser.get_last_error();
+        const auto labels = parser.get_labels();
+        const auto relocations = parser.get_relocations();
+
+        const size_t into_buffer = parser.parse_into(source.data(), source.size(), buffer, sizeof(buffer));
+        CHECK(parser.get_last_error() == error);
+        CPU memory_cpu;
+        const size_t into_memory = parser.parse_into(source.data(), source.size(), memory_cpu.memory, PROGRAM_SEGMENT);
+        CHECK(parser.get_last_error() == error);
+
+        write_file(file, source);
+        CHECK(parser.parse(file.string()) == code);
+        CHECK(parser.get_last_error() == error);
+        CPU file_cpu;
+        const size_t loaded = parser.load_file(file.string(), file_cpu);
+        if (!CHECK(parser.get_last_error() == error))
+            std::printf("    SOURCE %d: '%s' / '%s'\n", n, parser.get_last_error().c_str(), error.c_str());
+        // load_file RESOLVES INCLUDE NEXT TO THE FILE; THE SAME DIRECTORY HERE
+        parser.set_include_dir(dir.string());
+
+        if (!error.empty())
+        {
+            CHECK_EQ(into_buffer, 0);
+            CHECK_EQ(into_memory, 0);
+            CHECK_EQ(loaded, 0);
+            continue;
+        }
+        assembled++;
+        CHECK_EQ(into_buffer, code.size());
+        CHECK_EQ(into_memory, code.size());
+        CHECK_EQ(loaded, code.size());
+        CHECK(std::memcmp(buffer, code.data(), code.size()) == 0);
+        CHECK(same_in_memory(memory_cpu, code));
+        CHECK(same_in_memory(file_cpu, code));
+        CHECK(parser.get_labels() == labels);
+        CHECK(parser.get_relocations() == relocations);
+        CHECK(file_cpu.regs.CS == PROGRAM_SEGMENT && file_cpu.regs.IP == 0);
+    }
+    CHECK(assembled > SOURCES / 2); // MOSTLY VALID SOURCES, NOT ALL ERRORS
+}
+
+static void test_errors(const fs::path &dir)
+{
+    Parser parser;
+    parser.set_include_dir(dir.string());
+
+    // CODE THAT DOES NOT FIT THE DESTINATION
+    uint8_t small[100];
+    const std::string source = random_asm(random_source, 2000);
+    CHECK_EQ(parser.parse_into(source.data(), source.size(), small, sizeof(small)), 0);
+    CHECK(!parser.get_last_error().empty());
+
+    std::string too_big;
+    for (int i = 0; i < 17000; i++)
+        too_big += "MOV AX, 0x1234\n"; // 4 BYTES EACH, MORE THAN A SEGMENT
+    CPU cpu;
+    CHECK_EQ(parser.parse_into(too_big.data(), too_big.size(), cpu.memory, PROGRAM_SEGMENT), 0);
+    CHECK(!parser.get_last_error().empty());
+
+    CHECK_EQ(parser.load_file((dir / "missing.asm").string(), cpu), 0);
+    CHECK(!parser.get_last_error().empty());
+    write_file(dir / "empty.asm", ""); // NO CODE, NOT AN ERROR
+    CHECK_EQ(parser.load_file((dir / "empty.asm").string(), cpu), 0);
+}
+
+int main()
+{
+    const fs::path dir = fs::temp_directory_path() / "x86_test_parse_into";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    write_file(dir / "lib.inc", "lib_start:\nMOV AX, 1\nRET\n");
+    test_paths_agree(dir);
+    test_errors(dir);
+    fs::remove_all(dir);
+    return check_report();
+}
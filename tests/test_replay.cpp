@@ -0,0 +1,192 @@
+#include "check.h"
+#include "cpu.h"
+#include "parser.h"
+#include "replay.h"
+#include "util.h"
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == RECORD / REPLAY: BIT-EXACT RUNS WITHOUT THE HOST
+// ===============================================================
+// A PROGRAM TAKES TIMER INTERRUPTS AND READS KEYS FROM A KEYBOARD INTERRUPT HANDLER (BOTH BY IN
+// AND THROUGH THE DEVICE PAGE) WHILE THE HOST PUSHES KEYS AT RANDOM POINTS. THE SAVED AND
+// RELOADED LOG MUST DRIVE A FRESH CPU TO THE SAME REGISTERS, MEMORY, EVENTS AND CONSOLE OUTPUT,
+// AND A DIFFERENT PROGRAM MUST BE CAUGHT AS A DIVERGENCE.
+namespace fs = std::filesystem;
+
+static const int SESSIONS = 40;
+
+static std::mt19937 random_source(47);
+
+// FNV-1a OVER EVERY EVENT THE CPU REPORTS
+struct HashSink : EventSink
+{
+    uint64_t hash = 1469598103934665603ull;
+    uint64_t events = 0;
+
+    void mix(uint64_t value)
+    {
+        hash = (hash ^ value) * 1099511628211ull;
+    }
+
+    void on_event(const CpuEvent &event) override
+    {
+        events++;
+        mix(event.kind), mix(event.code), mix(event.cs), mix(event.ip);
+        mix(event.value), mix(event.address), mix(event.instruction);
+    }
+};
+
+// tick: INT 8, COUNTS IN SI. kbd: INT 9, STORES EACH KEY AT DI AND SETS DX ON '\n'
+static std::string session_source(int reload, const std::string &extra = "")
+{
+    return "JMP main\n"
+           "tick:\nPUSH AX\nINC SI\nMOV AL, 1\nOUT 0x43, AL\nPOP AX\nIRET\n"
+           "kbd:\nPUSH AX\nPUSH BX\nPUSH DS\nMOV AX, 0xFF10\nMOV DS, AX\nMOV BX, 1\nMOV AL, [BX]\nPOP DS\n"
+           "IN AL, 0x20\nMOV BX, DI\nMOV [BX], AL\nINC DI\nMOV AH, 0\nADD BP, AX\n"
+           "CMP AL, 10\nJNZ kdone\nMOV DX, 1\nkdone:\nPOP BX\nPOP AX\nIRET\n"
+           "main:\nMOV DI, 0x2000\nMOV AL, " + std::to_string(reload) + "\nOUT 0x40, AL\n" + extra +
+           "MOV AL, 0\nOUT 0x41, AL\nMOV AL, 3\nOUT 0x42, AL\nMOV DX, 0\nMOV CX, 0\nSTI\n"
+           "loop:\nIN AL, 0x44\nMOV AH, 0\nADD CX, AX\nCMP DX, 1\nJNZ loop\nCLI\nHALT\n";
+}
+
+struct Program
+{
+    std::vector<uint8_t> code;
+    uint16_t tick, kbd;
+};
+
+static Program assemble(const std::string &source)
+{
+    Parser parser;
+    Program program;
+    program.code = parser.parse_from_string(source);
+    CHECK(parser.get_last_error().empty());
+    program.tick = parser.get_labels().at("tick");
+    program.kbd = parser.get_labels().at("kbd");
+    return program;
+}
+
+static void load(CPU &cpu, const Program &program)
+{
+    cpu.load_program(program.code.data(), program.code.size());
+    cpu.memory.write16(0, 8 * 4, program.tick);
+    cpu.memory.write16(0, 8 * 4 + 2, PROGRAM_SEGMENT);
+    cpu.memory.write16(0, 9 * 4, program.kbd);
+    cpu.memory.write16(0, 9 * 4 + 2, PROGRAM_SEGMENT);
+}
+
+static uint64_t state_hash(CPU &cpu, const HashSink &sink)
+{
+    HashSink h;
+    const Registers &r = cpu.regs;
+    for (uint64_t value : {r.AX, r.BX, r.CX, r.DX, r.SI, r.DI, r.BP, r.SP, r.IP})
+        h.mix(value);
+    h.mix(cpu.flags.word()), h.mix(cpu.instructions), h.mix(sink.hash), h.mix(sink.events);
+    for (uint32_t address = 0; address < Memory::SIZE; address++)
+        h.mix(cpu.memory.read8(address));
+    for (char c : cpu.console->take_output())
+        h.mix(c);
+    return h.hash;
+}
+
+static void test_session(int session, const fs::path &file)
+{
+    const int reload = 60 + random_source() % 190;
+    const Program program = assemble(session_source(reload));
+
+    // RECORD: KEYS ARRIVE BETWEEN RANDOM BATCHES OF INSTRUCTIONS, THEN THE NEWLINE
+    CPU recorded;
+    load(recorded, program);
+    HashSink recorded_events;
+    recorded.set_event_sink(&recorded_events);
+    InputLog log;
+    recorded.set_input_log(&log);
+    log.start_recording();
+    int keys = 0;
+    const int target = 1 + random_source() % 60;
+    bool alive = true;
+    while (alive)
+    {
+        const int batch = 1 + random_source() % 400;
+        for (int i = 0; i < batch && (alive = recorded.step()); i++)
+        {
+        }
+        if (!alive)
+            break;
+        if (keys < target && random_source() % 3 == 0)
+        {
+            std::string text;
+            for (int n = 1 + random_source() % 3; n > 0; n--, keys++)
+                text += static_cast<char>('a' + random_source() % 26);
+            recorded.keyboard->push_input(text);
+            recorded.recheck_interrupts();
+        }
+        else if (keys >= target && keys < 1000)
+        {
+            recorded.keyboard->push_input("\n");
+            recorded.recheck_interrupts();
+            keys = 1000;
+        }
+    }
+    log.stop();
+    CHECK(log.entries() > 0);
+    const uint64_t expected = state_hash(recorded, recorded_events);
+
+    // REPLAY FROM THE SAVED FILE INTO A FRESH CPU, NOTHING PUSHED
+    CHECK(log.save(file.string()));
+    InputLog loaded;
+    CHECK(loaded.load(file.string()));
+    CPU replayed;
+    load(replayed, program);
+    HashSink replayed_events;
+    replayed.set_event_sink(&replayed_events);
+    replayed.set_input_log(&loaded);
+    loaded.start_replay();
+    while (replayed.step())
+    {
+    }
+    CHECK_EQ(loaded.entries(), log.entries());
+    CHECK(loaded.finished());
+    if (!CHECK_EQ(state_hash(replayed, replayed_events), expected))
+        std::printf("    SESSION %d: %llu/%llu INSTRUCTIONS\n", session, (unsigned long long)recorded.instructions,
+                    (unsigned long long)replayed.instructions);
+
+    // ONE EXTRA DEVICE READ BEFORE THE LOOP: THE LOG NO LONGER FITS
+    const Program other = assemble(session_source(reload, "IN AL, 0x21\n"));
+    CPU different;
+    load(different, other);
+    InputLog again;
+    CHECK(again.load(file.string()));
+    different.set_input_log(&again);
+    again.start_replay();
+    for (uint64_t n = 0; n < 10 * recorded.instructions && different.step(); n++)
+    {
+    }
+    CHECK(again.diverged());
+}
+
+static void test_truncated(const fs::path &file)
+{
+    // HEADER, THEN A VARINT THAT SAYS MORE FOLLOWS AND NOTHING DOES
+    write_file(file, std::string("X86R\x01\x00\x85", 7));
+    InputLog log;
+    CHECK(!log.load(file.string()));
+    CHECK(!log.get_last_error().empty());
+}
+
+int main()
+{
+    const fs::path dir = fs::temp_directory_path() / "x86_test_replay";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    for (int session = 0; session < SESSIONS; session++)
+        test_session(session, dir / "session.x86r");
+    test_truncated(dir / "truncated.x86r");
+    fs::remove_all(dir);
+    return check_report();
+}
@@ -0,0 +1,74 @@
+#include "check.h"
+#include "scheduler.h"
+
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == SCHEDULER: PARKING ON INPUT, EXACT BUDGETS, close_input()
+// ===============================================================
+// MANY ECHO JOBS (PARKED WHILE THE KEYBOARD IS EMPTY) SHARE THE WORKERS WITH JOBS THAT NEVER
+// HALT AND MUST STOP AT EXACTLY THEIR BUDGET, WHATEVER THE SLICE.
+static const int ECHO_JOBS = 500;
+static const int SPIN_JOBS = 20;
+
+// lp: IN AL, KEYBOARD STATUS / CMP AL, 0 / JZ lp / IN AL, KEYBOARD / OUT CONSOLE, AL /
+//     CMP AL, '\n' / JNZ lp / HALT
+static const uint8_t ECHO[] = {OP_IN_REG8_PORT, REG_AL, PORT_KEYBOARD + 1, OP_CMP_REG8_IMM, REG_AL, 0,
+                               OP_JZ, 0x00, 0x00, OP_IN_REG8_PORT, REG_AL, PORT_KEYBOARD,
+                               OP_OUT_PORT_REG8, REG_AL, PORT_CONSOLE, OP_CMP_REG8_IMM, REG_AL, '\n',
+                               OP_JNZ, 0x00, 0x00, OP_HALT};
+
+// MOV CX, 0 / lp: INC AX / LOOP lp / JMP 0, NEVER HALTS
+static const uint8_t SPIN[] = {OP_MOV_REG_IMM, REG_CX, 0, 0, OP_INC_REG, REG_AX, OP_LOOP, 0x04, 0x00, OP_JMP, 0x00, 0x00};
+
+int main()
+{
+    Scheduler scheduler(4, 5000);
+    std::vector<Scheduler::JobId> echo, spin;
+    for (int i = 0; i < SPIN_JOBS; i++)
+        spin.push_back(scheduler.submit(SPIN, sizeof(SPIN), 20000 + 997 * i));
+    for (int i = 0; i < ECHO_JOBS; i++)
+        echo.push_back(scheduler.submit(ECHO, sizeof(ECHO)));
+
+    // NOTHING TO READ: EVERY ECHO JOB PARKS
+    scheduler.wait_idle();
+    for (Scheduler::JobId id : echo)
+        if (!CHECK_EQ(scheduler.status(id).state, Scheduler::JOB_WAITING_INPUT))
+            break;
+
+    // A LINE WITHOUT ITS NEWLINE: ECHOED, THEN PARKED AGAIN
+    for (int i = 0; i < ECHO_JOBS; i++)
+        scheduler.send_input(echo[i], "hi " + std::to_string(i));
+    scheduler.wait_idle();
+    for (Scheduler::JobId id : echo)
+        if (!CHECK_EQ(scheduler.status(id).state, Scheduler::JOB_WAITING_INPUT))
+            break;
+
+    for (int i = 0; i < ECHO_JOBS; i++)
+        scheduler.send_input(echo[i], "!\n");
+    for (int i = 0; i < ECHO_JOBS; i++)
+    {
+        CHECK_EQ(scheduler.wait(echo[i]), Scheduler::JOB_STOPPED);
+        Scheduler::JobStatus status = scheduler.status(echo[i]);
+        CHECK(status.has_stop_event && status.stop_event.kind == EVENT_HALT);
+        if (!CHECK(scheduler.take_output(echo[i]) == "hi " + std::to_string(i) + "!\n"))
+            break;
+        CHECK(scheduler.release(echo[i]));
+    }
+
+    // BUDGETS ARE EXACT, NOT ROUNDED TO A SLICE
+    for (int i = 0; i < SPIN_JOBS; i++)
+    {
+        CHECK_EQ(scheduler.wait(spin[i]), Scheduler::JOB_OUT_OF_BUDGET);
+        CHECK_EQ(scheduler.status(spin[i]).instructions, 20000 + 997 * i);
+    }
+
+    // AFTER close_input AN EMPTY KEYBOARD READS 0: THE ECHO LOOP SPINS TO ITS BUDGET
+    Scheduler::JobId closed = scheduler.submit(ECHO, sizeof(ECHO), 100000);
+    CHECK_EQ(scheduler.wait(closed), Scheduler::JOB_WAITING_INPUT);
+    scheduler.close_input(closed);
+    CHECK_EQ(scheduler.wait(closed), Scheduler::JOB_OUT_OF_BUDGET);
+    CHECK_EQ(scheduler.status(closed).instructions, 100000);
+    return check_report();
+}
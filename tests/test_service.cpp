@@ -0,0 +1,388 @@
+#include "check.h"
+#include "service.h"
+
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ===============================================================
+// == GRADING SERVICE AGAINST FRESH CPUs
+// ===============================================================
+// RANDOM BATCHES OF A FEW PROGRAMS (ECHO, ONE THAT READS MEMORY AN EARLIER JOB WROTE, ONE THAT
+// NEVER HALTS, ONE THAT FAULTS, ONE THAT DOES NOT ASSEMBLE, ONE THAT WRITES A BAD REGISTER CODE
+// INTO ITS OWN CODE) GO THROUGH THE SOCKET. EVERY RESULT
+// MUST BE WHAT A NEWLY BUILT CPU GIVES FOR THE SAME JOB: THE REUSED WORKER MACHINES AND THE
+// SHARED ASSEMBLY CACHE MUST NOT SHOW.
+namespace fs = std::filesystem;
+
+static const int BATCHES = 10;
+
+static std::mt19937 random_source(48);
+
+static const char *const SOURCES[] = {
+    "loop:\nIN AL, 0x20\nCMP AL, 0\nJZ done\nOUT 0x10, AL\nINC CX\nJMP loop\ndone:\nHALT\n",
+    "MOV BX, 0x3000\nMOV AX, [BX]\nMOV DX, AX\nMOV AX, 0x1234\nMOV [BX], AX\nHALT\n",
+    "l:\nINC AX\nJMP l\n", // NEVER HALTS
+    "MOV AX, 5\nMOV BL, 0\nDIV BL\nHALT\n",
+    "MOV AX, \nFOO\n",
+    // THE HALT AT 0x1E BECOMES 01 30, MOV reg, imm16 WITH A REGISTER CODE 0x30 THAT NAMES NONE
+    "MOV AX, 0x3001\nMOV [0x1E], AX\nJMP T\n"
+    "NOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\nNOP\n"
+    "T:\nHALT\n",
+};
+
+// WHAT A FRESH CPU DOES WITH job, LIKE GradingService::run_job
+struct StopSink : EventSink
+{
+    CpuEvent last = {};
+
+    void on_event(const CpuEvent &event) override
+    {
+        if (event.kind == EVENT_HALT || event.kind == EVENT_FAULT || event.kind == EVENT_UNKNOWN_OPCODE)
+            last = event;
+    }
+};
+
+static GradingService::Result fresh_run(const GradingService::Job &job)
+{
+    GradingService::Result result;
+    Parser parser;
+    const std::vector<uint8_t> code = parser.parse_from_string(job.source);
+    if (!parser.get_last_error().empty() || code.empty())
+        return result;
+
+    CPU cpu;
+    cpu.console->limit_output(GradingService::MAX_OUTPUT);
+    StopSink stop;
+    cpu.set_event_sink(&stop);
+    cpu.load_program(code.data(), code.size());
+    cpu.keyboard->push_input(job.input);
+    cpu.keyboard->close_input();
+    const uint64_t budget = job.budget ? std::min(job.budget, uint64_t(GradingService::MAX_BUDGET)) : GradingService::DEFAULT_BUDGET;
+    bool alive = true;
+    while (alive && cpu.instructions < budget)
+        alive = cpu.step();
+
+    if (alive)
+        result.status = GradingService::STATUS_BUDGET;
+    else if (stop.last.kind == EVENT_HALT)
+        result.status = GradingService::STATUS_HALT;
+    else
+        result.status = stop.last.kind == EVENT_FAULT ? GradingService::STATUS_FAULT : GradingService::STATUS_UNKNOWN_OPCODE;
+    result.instructions = cpu.instructions;
+    result.regs = cpu.regs;
+    result.flags = cpu.flags.word();
+    const bool truncated = cpu.console->output_dropped();
+    result.output = cpu.console->take_output();
+    if (truncated)
+        result.output += GradingService::TRUNCATED;
+    return result;
+}
+
+// ===============================================================
+// == CLIENT SIDE OF THE WIRE PROTOCOL
+// ===============================================================
+class Client
+{
+private:
+    int fd = -1;
+    std::string pending;
+
+    bool fill()
+    {
+        char chunk[65536];
+        ssize_t got = ::read(fd, chunk, sizeof(chunk));
+        if (got <= 0)
+            return false;
+        pending.append(chunk, got);
+        return true;
+    }
+
+public:
+    // RETRIES WHILE serve() IS STILL SETTING UP
+    explicit Client(const fs::path &socket_path)
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path.c_str());
+        for (int attempt = 0; attempt < 500 && fd < 0; attempt++)
+        {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+                usleep(10000);
+            }
+        }
+        CHECK(fd >= 0);
+        // A REPLY THAT NEVER COMES FAILS THE CHECK WAITING FOR IT INSTEAD OF HANGING THE TEST
+        timeval timeout = {10, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    ~Client()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool send(const std::string &data)
+    {
+        for (size_t sent = 0; sent < data.size();)
+        {
+            ssize_t n = ::write(fd, data.data() + sent, data.size() - sent);
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool line(std::string &out)
+    {
+        size_t end;
+        while ((end = pending.find('\n')) == std::string::npos)
+            if (!fill())
+                return false;
+        out = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        return true;
+    }
+
+    std::string bytes(size_t count)
+    {
+        while (pending.size() < count && fill())
+        {
+        }
+        std::string out = pending.substr(0, count);
+        pending.erase(0, count);
+        return out;
+    }
+
+    // THE SERVER CLOSED ITS END
+    bool closed()
+    {
+        return pending.empty() && !fill();
+    }
+};
+
+static std::string job_request(const GradingService::Job &job)
+{
+    return "JOB " + std::to_string(job.budget) + " " + std::to_string(job.source.size()) + " " +
+           std::to_string(job.input.size()) + "\n" + job.source + job.input;
+}
+
+// ONE "RESULT" LINE AND ITS PAYLOADS, IN THE TEXT FORM THE SERVER WRITES
+static std::string result_text(const GradingService::Result &result)
+{
+    const Registers &r = result.regs;
+    char header[256];
+    std::snprintf(header, sizeof(header), "RESULT %s %llu %04X %04X %04X %04X %04X %04X %04X %04X %04X %04X %zu",
+                  GradingService::status_name(result.status), (unsigned long long)result.instructions,
+                  r.AX, r.BX, r.CX, r.DX, r.SP, r.BP, r.SI, r.DI, r.IP, result.flags, result.output.size());
+    return header + std::string(" / ") + result.output;
+}
+
+static std::vector<std::string> run_over_socket(Client &client, const std::vector<GradingService::Job> &jobs)
+{
+    std::string request;
+    for (const GradingService::Job &job : jobs)
+        request += job_request(job);
+    CHECK(client.send(request + "RUN\n"));
+
+    std::vector<std::string> results;
+    std::string line;
+    for (size_t i = 0; i < jobs.size() && client.line(line); i++)
+    {
+        // THE LAST TWO FIELDS ARE THE PAYLOAD LENGTHS
+        const size_t error_at = line.rfind(' ');
+        const size_t output_at = line.rfind(' ', error_at - 1);
+        const size_t output_length = std::stoul(line.substr(output_at + 1));
+        const std::string output = client.bytes(output_length);
+        const std::string error = client.bytes(std::stoul(line.substr(error_at + 1)));
+        if (line.rfind("RESULT ASSEMBLY_ERROR", 0) == 0 || line.rfind("RESULT FAULT", 0) == 0)
+            CHECK(!error.empty());
+        results.push_back(line.substr(0, error_at) + " / " + output);
+    }
+    CHECK(client.line(line) && line == "DONE " + std::to_string(jobs.size()));
+    return results;
+}
+
+static std::vector<GradingService::Job> random_batch()
+{
+    std::vector<GradingService::Job> jobs(1 + random_source() % 300);
+    for (GradingService::Job &job : jobs)
+    {
+        const size_t program = random_source() % (sizeof(SOURCES) / sizeof(SOURCES[0]));
+        job.source = SOURCES[program];
+        for (int n = random_source() % 12; n > 0; n--)
+            job.input += static_cast<char>('a' + random_source() % 26);
+        // THE SPINNING PROGRAM ALWAYS GETS A SMALL BUDGET, THE DEFAULT ONE WOULD TAKE SECONDS
+        job.budget = program == 2 || random_source() % 4 == 0 ? 1 + random_source() % 5000 : 0;
+    }
+    return jobs;
+}
+
+static void test_against_fresh_cpus(GradingService &service, const fs::path &socket_path)
+{
+    Client client(socket_path);
+    for (int b = 0; b < BATCHES; b++)
+    {
+        const std::vector<GradingService::Job> jobs = random_batch();
+        const std::vector<std::string> over_socket = run_over_socket(client, jobs);
+        const std::vector<GradingService::Result> direct = service.run_batch(jobs);
+        if (!CHECK_EQ(over_socket.size(), jobs.size()))
+            return;
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            const std::string expected = result_text(fresh_run(jobs[i]));
+            CHECK(result_text(direct[i]) == expected);
+            if (!CHECK(over_socket[i] == expected))
+            {
+                std::printf("    BATCH %d JOB %zu:\n      %s\n      %s\n", b, i, over_socket[i].c_str(), expected.c_str());
+                return;
+            }
+        }
+    }
+    CHECK(service.cache().hits() > 0);
+    CHECK(client.send("QUIT\n"));
+    CHECK(client.closed());
+}
+
+// A BAD REGISTER CODE STOPS THE JOB, NOT THE DAEMON: THE NEXT JOB ON THE SAME CONNECTION RUNS
+static void test_invalid_register(const fs::path &socket_path)
+{
+    Client client(socket_path);
+    const std::vector<std::string> results = run_over_socket(client, {{SOURCES[5], "", 0}, {SOURCES[0], "x", 0}});
+    if (!CHECK_EQ(results.size(), 2))
+        return;
+    CHECK(results[0].rfind("RESULT UNKNOWN_OPCODE", 0) == 0);
+    CHECK(results[1].rfind("RESULT HALT", 0) == 0 && results[1].back() == 'x');
+}
+
+static void test_malformed(const fs::path &socket_path)
+{
+    Client client(socket_path);
+    std::string line;
+    CHECK(client.send("JOB 1 2\n"));
+    CHECK(client.line(line) && line.rfind("ERROR ", 0) == 0);
+    CHECK(client.closed());
+}
+
+// FOUR FULL-SIZE SOURCES FILL A BATCH: ONE MORE BYTE IS REFUSED BEFORE IT IS READ
+static void test_batch_bytes(const fs::path &socket_path)
+{
+    static_assert(GradingService::MAX_BATCH_BYTES == 4 * GradingService::MAX_PAYLOAD, "ADJUST THE TEST");
+    Client client(socket_path);
+    GradingService::Job job;
+    job.source.assign(GradingService::MAX_PAYLOAD, '\n');
+    for (int i = 0; i < 4; i++)
+        CHECK(client.send(job_request(job)));
+    std::string line;
+    CHECK(client.send("JOB 0 0 1\n"));
+    CHECK(client.line(line) && line.rfind("ERROR ", 0) == 0);
+    CHECK(client.closed());
+}
+
+static void test_budget_limit(const fs::path &socket_path)
+{
+    Client client(socket_path);
+    std::string line;
+    CHECK(client.send(job_request({SOURCES[0], "", GradingService::MAX_BUDGET + 1})));
+    CHECK(client.line(line) && line.rfind("ERROR ", 0) == 0);
+    CHECK(client.closed());
+}
+
+// A JOB THAT PRINTS FOREVER KEEPS MAX_OUTPUT BYTES AND THE MARKER. A REPLY OF MANY OF THEM SENDS
+// MAX_REPLY_BYTES OF OUTPUT: THE ONE THAT DOES NOT FIT IS CUT, THOSE AFTER IT ARE ONLY THE MARKER
+static void test_output_limits(GradingService &service, const fs::path &socket_path)
+{
+    static_assert(GradingService::MAX_OUTPUT < GradingService::MAX_REPLY_BYTES, "ADJUST THE TEST");
+    const GradingService::Job printer = {"MOV AL, 0x41\nl:\nOUT 0x10, AL\nJMP l\n", "", 2 * GradingService::MAX_OUTPUT + 100};
+    const std::string kept = std::string(GradingService::MAX_OUTPUT, 'A') + GradingService::TRUNCATED;
+    const std::vector<GradingService::Result> direct = service.run_batch({printer});
+    CHECK(direct.at(0).status == GradingService::STATUS_BUDGET);
+    CHECK(direct.at(0).output == kept);
+
+    const size_t whole = GradingService::MAX_REPLY_BYTES / kept.size();
+    Client client(socket_path);
+    const std::vector<std::string> results = run_over_socket(client, std::vector<GradingService::Job>(whole + 2, printer));
+    if (!CHECK_EQ(results.size(), whole + 2))
+        return;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const std::string output = results[i].substr(results[i].find(" / ") + 3);
+        if (i < whole)
+            CHECK(output == kept);
+        else if (i == whole)
+            CHECK(output == kept.substr(0, GradingService::MAX_REPLY_BYTES - whole * kept.size()) + GradingService::TRUNCATED);
+        else
+            CHECK(output == GradingService::TRUNCATED);
+    }
+}
+
+static void test_connection_limit(const fs::path &socket_path)
+{
+    std::vector<std::unique_ptr<Client>> open;
+    for (size_t i = 0; i < GradingService::MAX_CONNECTIONS; i++)
+        open.push_back(std::make_unique<Client>(socket_path));
+    // EACH OF THEM IS SERVED
+    for (auto &client : open)
+        CHECK_EQ(run_over_socket(*client, {{SOURCES[0], "x", 0}}).at(0).back(), 'x');
+
+    Client refused(socket_path);
+    std::string line;
+    CHECK(refused.line(line) && line.rfind("ERROR ", 0) == 0);
+    CHECK(refused.closed());
+
+    // ONCE ONE CLOSES THERE IS ROOM AGAIN, AFTER ITS THREAD HAS LEFT
+    open.pop_back();
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        Client again(socket_path);
+        CHECK(again.send(job_request({SOURCES[0], "y", 0}) + "RUN\n"));
+        if (again.line(line) && line.rfind("RESULT HALT", 0) == 0)
+            return;
+        usleep(10000);
+    }
+    CHECK(!"NO ROOM AFTER A CONNECTION CLOSED");
+}
+
+int main()
+{
+    std::signal(SIGPIPE, SIG_IGN);
+    const fs::path dir = fs::temp_directory_path() / "x86_test_service";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const fs::path socket_path = dir / "socket";
+
+    GradingService service(4);
+    std::thread server([&] { CHECK(service.serve(socket_path.string())); });
+    test_against_fresh_cpus(service, socket_path);
+    test_invalid_register(socket_path);
+    test_malformed(socket_path);
+    test_batch_bytes(socket_path);
+    test_budget_limit(socket_path);
+    test_output_limits(service, socket_path);
+    test_connection_limit(socket_path);
+
+    // AN IDLE OPEN CONNECTION DOES NOT HOLD UP stop()
+    {
+        Client idle(socket_path);
+        service.stop();
+        server.join();
+    }
+    CHECK(!fs::exists(socket_path));
+    fs::remove_all(dir);
+    return check_report();
+}
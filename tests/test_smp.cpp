@@ -0,0 +1,134 @@
+#include "check.h"
+#include "parser.h"
+#include "smp.h"
+
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == SMP: LOCKED COUNTERS, XCHG SPINLOCKS, REPRODUCIBLE INTERLEAVING
+// ===============================================================
+// EVERY CORE RUNS THE SAME PROGRAM ROUNDS TIMES. UNDER run_parallel() ONLY LOCK-DISCIPLINED
+// PROGRAMS ARE SUPPORTED (smp.h), SO BOTH PROGRAMS TESTED THERE ARE: THE COUNTER IS ONLY EVER
+// UPDATED BY LOCK ADD, OR ONLY INSIDE A SPINLOCK TAKEN AND RELEASED WITH XCHG.
+static const int ROUNDS = 500;
+static const uint16_t LOCK_WORD = 0x3000;
+static const uint16_t COUNTER = 0x3002;
+
+static std::string rounds(int n)
+{
+    return "MOV CX, " + std::to_string(n) + "\n";
+}
+
+// LOCK ADD [COUNTER], 1 EVERY ROUND
+static std::string locked_counter()
+{
+    return rounds(ROUNDS) +
+           "MOV BX, " + std::to_string(COUNTER) + "\n"
+           "MOV DX, 1\n"
+           "again:\n"
+           "LOCK ADD [BX], DX\n"
+           "LOOP again\n"
+           "HALT\n";
+}
+
+// A PLAIN READ-MODIFY-WRITE OF THE COUNTER INSIDE AN XCHG SPINLOCK
+static std::string spinlock_counter()
+{
+    return rounds(ROUNDS) +
+           "MOV BX, " + std::to_string(LOCK_WORD) + "\n"
+           "MOV SI, " + std::to_string(COUNTER) + "\n"
+           "acquire:\n"
+           "MOV AX, 1\n"
+           "XCHG AX, [BX]\n"
+           "CMP AX, 0\n"
+           "JNZ acquire\n"
+           "MOV DX, [SI]\n"
+           "INC DX\n"
+           "MOV [SI], DX\n"
+           "MOV AX, 0\n"
+           "XCHG AX, [BX]\n"
+           "LOOP acquire\n"
+           "HALT\n";
+}
+
+// THE SAME UPDATE WITHOUT ANY LOCK: LOSES INCREMENTS, ONLY FOR run_interleaved()
+static std::string racy_counter()
+{
+    return rounds(ROUNDS) +
+           "MOV SI, " + std::to_string(COUNTER) + "\n"
+           "again:\n"
+           "MOV DX, [SI]\n"
+           "INC DX\n"
+           "MOV [SI], DX\n"
+           "LOOP again\n"
+           "HALT\n";
+}
+
+static void load(SmpMachine &machine, const std::string &source)
+{
+    Parser parser;
+    std::vector<uint8_t> code = parser.parse_from_string(source);
+    CHECK(parser.get_last_error().empty());
+    machine.load_program(code.data(), code.size());
+}
+
+static uint16_t counter(SmpMachine &machine)
+{
+    return machine.memory().read16(PROGRAM_SEGMENT, COUNTER);
+}
+
+static void test_parallel(const std::string &source, const char *name)
+{
+    for (int cores : {2, 3, 4, 8, 16})
+    {
+        SmpMachine machine(cores);
+        load(machine, source);
+        CHECK_EQ(machine.run_parallel(), 0);
+        if (!CHECK_EQ(counter(machine), cores * ROUNDS))
+            std::printf("    %s ON %d CORES\n", name, cores);
+        for (int i = 0; i < cores; i++)
+            CHECK_EQ(machine.core(i).regs.CX, 0);
+    }
+}
+
+// EVERYTHING A RUN LEAVES BEHIND THAT THE INTERLEAVING DECIDES
+static std::vector<uint64_t> outcome(const std::string &source, int cores, uint64_t seed)
+{
+    SmpMachine machine(cores);
+    load(machine, source);
+    CHECK_EQ(machine.run_interleaved(UINT64_MAX, seed), 0);
+    std::vector<uint64_t> result = {counter(machine)};
+    for (int i = 0; i < cores; i++)
+    {
+        const CPU &core = machine.core(i);
+        result.insert(result.end(), {core.instructions, core.regs.AX, core.regs.DX, core.regs.IP});
+    }
+    return result;
+}
+
+static void test_interleaved()
+{
+    for (uint64_t seed : {0, 1, 12345})
+    {
+        // THE SPINLOCK'S RETRIES AND THE RACE'S LOST UPDATES DEPEND ON THE ORDER, BUT A SEED
+        // ALWAYS GIVES THE SAME ONE
+        const std::vector<uint64_t> spin = outcome(spinlock_counter(), 4, seed);
+        CHECK(spin == outcome(spinlock_counter(), 4, seed));
+        CHECK_EQ(spin[0], 4 * ROUNDS);
+
+        const std::vector<uint64_t> racy = outcome(racy_counter(), 4, seed);
+        CHECK(racy == outcome(racy_counter(), 4, seed));
+        CHECK(racy[0] <= 4 * ROUNDS);
+        if (seed != 0)
+            CHECK(racy[0] < 4 * ROUNDS); // A RANDOM ORDER DOES LOSE UPDATES
+    }
+}
+
+int main()
+{
+    test_parallel(locked_counter(), "LOCK ADD");
+    test_parallel(spinlock_counter(), "XCHG SPINLOCK");
+    test_interleaved();
+    return check_report();
+}
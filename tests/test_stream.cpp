@@ -0,0 +1,129 @@
+#include "check.h"
+#include "cpu.h"
+#include "objfile.h"
+#include "parser.h"
+#include "random_asm.h"
+#include "util.h"
+
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// ===============================================================
+// == STREAMING ASSEMBLY: stream_into() AGAINST THE WHOLE-TEXT PATH
+// ===============================================================
+// ONE PASS WITH BRANCH TARGETS PATCHED IN AT THE END OF THE INPUT MUST GIVE WHAT TWO PASSES OVER
+// THE WHOLE TEXT GIVE: THE SAME ERROR (UNDEFINED LABELS AND MACROS LEFT OPEN ARE ONLY KNOWN AT
+// THE END), AND WITHOUT ONE THE SAME CODE, LABELS, RELOCATIONS, INCLUDES AND SOURCE MAP.
+namespace fs = std::filesystem;
+
+static const int SOURCES = 300;
+static const int LARGE_SOURCES = 4;
+
+static std::mt19937 random_source(50);
+
+static bool same_source_map(const SourceMap &a, const SourceMap &b)
+{
+    if (a.end() != b.end() || a.entries().size() != b.entries().size())
+        return false;
+    for (size_t i = 0; i < a.entries().size(); i++)
+        if (a.entries()[i].address != b.entries()[i].address || a.entries()[i].line != b.entries()[i].line)
+            return false;
+    return true;
+}
+
+static void test_stream_matches_batch(const fs::path &dir)
+{
+    static uint8_t batch[Memory::SEGMENT_SIZE], streamed[Memory::SEGMENT_SIZE];
+    Parser parser;
+    parser.set_include_dir(dir.string());
+    int assembled = 0;
+    for (int n = 0; n < SOURCES + LARGE_SOURCES; n++)
+    {
+        const int lines = n < SOURCES ? random_source() % 300 : 4000 + random_source() % 4000;
+        const std::string source = random_asm(random_source, lines, random_source() % 8 ? 0 : 1 + random_source() % 4);
+
+        const size_t batch_size = parser.parse_into(source.data(), source.size(), batch, sizeof(batch));
+        const std::string error = parser.get_last_error();
+        const auto labels = parser.get_labels();
+        const auto relocations = parser.get_relocations();
+        const size_t includes = parser.get_includes().size();
+        const SourceMap source_map = parser.get_source_map();
+
+        std::istringstream in(source);
+        const size_t stream_size = parser.stream_into(in, streamed, sizeof(streamed));
+        if (!CHECK(parser.get_last_error() == error) || !CHECK_EQ(stream_size, batch_size))
+        {
+            std::printf("    SOURCE %d:\n      '%s'\n      '%s'\n", n, error.c_str(), parser.get_last_error().c_str());
+            continue;
+        }
+        if (!error.empty())
+            continue;
+        assembled++;
+        CHECK(std::memcmp(batch, streamed, batch_size) == 0);
+        CHECK(parser.get_labels() == labels);
+        CHECK(parser.get_relocations() == relocations);
+        CHECK_EQ(parser.get_includes().size(), includes);
+        CHECK(same_source_map(parser.get_source_map(), source_map));
+        CHECK_EQ(parser.get_source_map().end(), batch_size);
+    }
+    CHECK(assembled > SOURCES / 2);
+}
+
+// THE SAME OBJECT FILE FROM A STREAM AS FROM A WHOLE-TEXT ASSEMBLY
+static void test_object_file(const fs::path &dir)
+{
+    Parser parser;
+    parser.set_include_dir(dir.string());
+    const std::string source = random_asm(random_source, 3000);
+    const std::vector<uint8_t> code = parser.parse_from_string(source);
+    CHECK(parser.get_last_error().empty());
+    ObjectFile whole, streamed;
+    CHECK(whole.write((dir / "whole.x86o").string(), ObjectFile::from_assembly(code, parser)));
+    std::istringstream in(source);
+    CHECK(streamed.assemble_stream(in, parser, (dir / "streamed.x86o").string()));
+    CHECK(read_file(dir / "whole.x86o") == read_file(dir / "streamed.x86o"));
+}
+
+// A SOURCE WITHOUT END, ALL CODE: THE ASSEMBLY STOPS WHEN THE SEGMENT IS FULL
+class EndlessCode : public std::streambuf
+{
+private:
+    std::string chunk;
+
+    int_type underflow() override
+    {
+        chunk.clear();
+        for (int i = 0; i < 4096; i++)
+            chunk += "MOV AX, 0x1234\n";
+        setg(&chunk[0], &chunk[0], &chunk[0] + chunk.size());
+        return traits_type::to_int_type(chunk[0]);
+    }
+};
+
+static void test_endless()
+{
+    EndlessCode source;
+    std::istream in(&source);
+    Parser parser;
+    CPU cpu;
+    CHECK_EQ(parser.stream_into(in, cpu.memory, PROGRAM_SEGMENT), 0);
+    CHECK(!parser.get_last_error().empty());
+}
+
+int main()
+{
+    const fs::path dir = fs::temp_directory_path() / "x86_test_stream";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    write_file(dir / "lib.inc", "lib_start:\nMOV AX, 1\nRET\n");
+    test_stream_matches_batch(dir);
+    test_object_file(dir);
+    test_endless();
+    fs::remove_all(dir);
+    return check_report();
+}
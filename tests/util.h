@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// ===============================================================
+// == FILES FOR THE TEST PROGRAMS
+// ===============================================================
+// WHOLE FILES IN AND OUT AS BYTES, NO LINE END TRANSLATION. text MAY HOLD ZERO BYTES.
+inline void write_file(const std::filesystem::path &path, const std::string &text)
+{
+    std::ofstream(path, std::ios::binary) << text;
+}
+
+// "" WHEN path CANNOT BE READ
+inline std::string read_file(const std::filesystem::path &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
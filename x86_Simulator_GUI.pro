@@ -8,7 +8,19 @@ SOURCES += \
     main.cpp \
     mainwindow.cpp \
     /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/cpu.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/memory.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/devices.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/events.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/lockstep.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/scheduler.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/smp.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/replay.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/service.cpp \
     /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/parser.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/objfile.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/asmcache.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/sourcemap.cpp \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/disassembler.cpp \
     stardialog.cpp \
     userdialog.cpp
 
@@ -16,7 +28,22 @@ HEADERS += \
     codeeditor.h \
     mainwindow.h \
     /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/cpu.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/memory.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/devices.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/events.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/alu.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/lockstep.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/scheduler.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/smp.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/replay.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/service.h \
     /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/parser.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/objfile.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/mappedfile.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/asmcache.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/sourcemap.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/opcodes.h \
+    /home/roo0t/Desktop/_Assembler_SIM/x86-Simulator/src/disassembler.h \
     stardialog.h \
     userdialog.h
 